@@ -454,6 +454,80 @@ function bytesToHuman(bytes, si = false) {
   return bytes.toFixed(1) + ' ' + units[u];
 }
 
+// CONCATENATED MODULE: ./src/command_data.js
+
+/**
+ * When generated from shournal, only a compact summary of each command
+ * (id, dates, command text, number of read/written files...) is parsed on
+ * startup. The remaining command data (read and written files) is stored in
+ * compressed chunks of CMD_DATA_CHUNK_SIZE commands, which are only
+ * decompressed and parsed, when the data of one of their commands is
+ * actually needed.
+ */
+
+/**
+ * @param {string} base64 zlib compressed data
+ * @return {string} the uncompressed data
+ */
+async function _inflateBase64(base64){
+  if (typeof DecompressionStream === 'undefined') {
+    throw new Error('Your browser does not support DecompressionStream, ' +
+      'which is required to display the files of a command.');
+  }
+  const binary = atob(base64);
+  const bytes = new Uint8Array(binary.length);
+  for (let i = 0; i < binary.length; i++) {
+    bytes[i] = binary.charCodeAt(i);
+  }
+  const stream = new Blob([bytes]).stream()
+    .pipeThrough(new DecompressionStream('deflate'));
+  return await new Response(stream).text();
+}
+
+// chunk index -> promise of its loading
+const _chunkLoads = new Map();
+
+async function _loadChunk(commands, chunkIdx){
+  const chunkTag = document.getElementById('commandDataChunk' + chunkIdx);
+  const cmdDatas = JSON.parse(await _inflateBase64(chunkTag.textContent));
+  const firstIdx = chunkIdx * CMD_DATA_CHUNK_SIZE;
+  cmdDatas.forEach((cmdData, i) => {
+    Object.assign(commands[firstIdx + i], cmdData);
+  });
+  chunkTag.remove();
+}
+
+/**
+ * Make sure the file events of commands[idx] are loaded (along with those
+ * of all other commands in the same chunk).
+ * @param {[Command]} commands
+ * @param {int} idx
+ * @return {Promise}
+ */
+function loadCommandData(commands, idx){
+  if (typeof commands[idx].fileWriteEvents !== 'undefined') {
+    // already loaded or sample data during development
+    return Promise.resolve();
+  }
+  const chunkIdx = Math.floor(idx / CMD_DATA_CHUNK_SIZE);
+  let load = _chunkLoads.get(chunkIdx);
+  if (load === undefined) {
+    load = _loadChunk(commands, chunkIdx);
+    _chunkLoads.set(chunkIdx, load);
+  }
+  return load;
+}
+
+/**
+ * @param {int} id the id of the read file
+ * @return {string} the base64 encoded content of the read file or null,
+ * if it is not contained in the report (e.g. no text file).
+ */
+function readFileContent(id){
+  const tag = document.getElementById('readFileContent' + id);
+  return (tag === null) ? null : tag.textContent;
+}
+
 // CONCATENATED MODULE: ./src/command_list.js
 
 
@@ -461,9 +535,10 @@ function bytesToHuman(bytes, si = false) {
 
 
 
+
 class command_list_CommandList {
   constructor(commands) {
-
+    this._commands = commands;
     this._CMDLISTPADDING = 18;
     this._CMDLISTBG = '#777';
 
@@ -537,12 +612,32 @@ class command_list_CommandList {
       ${this._CMDLISTBG} ${this._CMDLISTPADDING - 1}px, ${this._CMDLISTBG} 100%)`;
   }
 
-  _handleClickOnCmd(cmd, idx){
+  async _handleClickOnCmd(cmd, idx){
     let contentDiv = d3.select(`#cmdcontent${cmd.id}`);
     if (! contentDiv.empty()) {
       contentDiv.remove();
       return;
     }
+    // the read and written files are loaded on demand
+    let loadError = null;
+    try {
+      await loadCommandData(this._commands, idx);
+    } catch (error) {
+      console.log(error);
+      loadError = error;
+    }
+    if (! d3.select(`#cmdcontent${cmd.id}`).empty()) {
+      // clicked again while loading
+      return;
+    }
+    if (loadError !== null) {
+      d3.select('body').append('div')
+        .attr('id', `cmdcontent${cmd.id}`)
+        .attr('class', 'collapsibleCmdContent')
+        .style('color', 'red')
+        .text(loadError.message);
+      return;
+    }
 
     contentDiv = d3.select('body').append('div')
       .attr('id', `cmdcontent${cmd.id}`)
@@ -610,8 +705,9 @@ class command_list_CommandList {
                         `size: ${bytesToHuman(readFile.size)}<br>` + 
                         `hash: ${readFile.hash}<br>`;
 
-          const readFileContent = atob(readFileContentMap.get(readFile.id));
-          textDialog.show(title, readFileContent);
+          const content = readFileContent(readFile.id);
+          textDialog.show(title, (content === null) ?
+            '(content not included in report)' : atob(content));
         }
       });
     
@@ -1102,7 +1198,7 @@ class session_timeline_SessionTimeline {
     this.annotationMinWidth = this.annotationCharWidth * 5;
     // distance to the belonging command rect
     this.annotationDistance = this.annotationCharHeight / 3.0;
-    this.commandRects = [];
+    this._sessions = [];
 
     
     // minimum width of a cmd-rect. Let it be at least 1, otherwise very short commands
@@ -1160,53 +1256,14 @@ class session_timeline_SessionTimeline {
         // .tickFormat(d3.timeFormat('%b %d'))
       );
 
-    const _drawSession = (session, idx, lineIdx) => {
-      // draw rectangles
-      const className = 'sessionTimeSeries' + 
-        session.getSessionGroup() + idx;
-      this.commandRects.push(this.svg.selectAll('.' + className)
-        .data(session.getCmdsWithMeta())
-        .enter()
-        .append('rect')
-        .attr('class', className)
-        .attr('x', (cmdWithMeta) => { 
-          return this._calcRectXPosition(cmdWithMeta.cmd, this.xScale); 
-        })
-        .attr('y', (cmdWithMeta) => { 
-          // rects are drawn from top to bottom, so add the height:
-          return this._yScale(cmdWithMeta.getY() + cmdWithMeta.getHeight()); 
-        })
-        .attr('width', (cmdWithMeta) => { 
-          return this._calcRectWidth(cmdWithMeta.cmd, this.xScale); 
-        })
-        .attr('height', (cmdWithMeta) => { 
-          return cmdWithMeta.getHeight(); 
-        })
-        .attr('fill', (cmdWithMeta) => { 
-          // TODO: rather determine the session color in this class
-          // on a per line-basis, so the same color appears as seldom
-          // as possible in a given line (?).
-          // But what about the colors in the cmd-list?...
-          return cmdWithMeta.cmd.sessionColor; 
-        } )
-        .style('cursor', 'pointer')
-        .attr('title', (cmdWithMeta) => { return cmdWithMeta.cmd.command; })
-        .on("click", (cmdWithMeta) => { 
-          commandList.scrollToCmd(cmdWithMeta.cmd); 
-        })
-        );
-      $('.' + className).tooltip({
-        delay: { show: 50, hide: 0 },
-      });
-
-    }; 
-
-    groupedSessions.forEach((sessionLine, lineIdx) => {
+    groupedSessions.forEach((sessionLine) => {
       sessionLine.forEach((session, sessionIdx) => {
-        _drawSession(session, sessionIdx, lineIdx);
+        session.setClassName('sessionTimeSeries' +
+          session.getSessionGroup() + '_' + sessionIdx);
+        this._sessions.push(session);
       });
-    });   
-
+    });
+    this._renderSessions(this.xScale);
 
     this._preRenderAnnotations(groupedSessions);
     this._annotationRender.setOnNoteClick((cmdWithMeta) => {
@@ -1407,6 +1464,90 @@ class session_timeline_SessionTimeline {
   }
 
 
+  /**
+   * Draw the commands of all sessions for the given xScale. To keep the number
+   * of svg-elements bounded, only visible commands are drawn and commands
+   * which would overlap (e.g. when zoomed out) are drawn as a single,
+   * aggregated rect (level of detail).
+   * @param {*} xScale
+   */
+  _renderSessions(xScale){
+    this._sessions.forEach((session) => {
+      const rects = this.svg.selectAll('.' + session.getClassName())
+        .data(this._generateLodItems(session, xScale), (item) => { return item.key; });
+
+      rects.exit()
+        .each(function() { $(this).tooltip('dispose'); })
+        .remove();
+
+      const entered = rects.enter()
+        .append('rect')
+        .attr('class', session.getClassName())
+        .attr('y', (item) => {
+          // rects are drawn from top to bottom, so add the height:
+          return this._yScale(item.cmdWithMeta.getY() + item.cmdWithMeta.getHeight());
+        })
+        .attr('height', (item) => { return item.cmdWithMeta.getHeight(); })
+        .attr('fill', (item) => {
+          // TODO: rather determine the session color in this class
+          // on a per line-basis, so the same color appears as seldom
+          // as possible in a given line (?).
+          // But what about the colors in the cmd-list?...
+          return item.cmdWithMeta.cmd.sessionColor;
+        })
+        .style('cursor', 'pointer')
+        .attr('title', (item) => { return item.title; })
+        .on("click", (item) => {
+          commandList.scrollToCmd(item.cmdWithMeta.cmd);
+        });
+      $(entered.nodes()).tooltip({
+        delay: { show: 50, hide: 0 },
+      });
+
+      entered.merge(rects)
+        // note: x may be less than zero which is ok, because
+        // otherwise wide rects may disappear too soon.
+        .attr('x', (item) => { return item.x; })
+        .attr('width', (item) => { return item.width; });
+    });
+  }
+
+  /**
+   * @return {[Object]} the rects to draw for the given session: commands
+   * outside of the visible range are skipped, commands of the same group
+   * which overlap in pixel space are merged into one item.
+   * @param {session_timeline_Session} session
+   * @param {*} xScale
+   */
+  _generateLodItems(session, xScale){
+    const items = [];
+    // y-position of parallel commands -> the item to extend
+    const lastItems = new Map();
+    session.getCmdsWithMeta().forEach((cmdWithMeta) => {
+      const x = this._calcRectXPosition(cmdWithMeta.cmd, xScale);
+      const width = this._calcRectWidth(cmdWithMeta.cmd, xScale);
+      if (x > this.svgWidth || x + width < 0) {
+        return;
+      }
+      const lastItem = lastItems.get(cmdWithMeta.getY());
+      if (lastItem !== undefined && x < lastItem.x + lastItem.width) {
+        lastItem.width = Math.max(lastItem.width, x + width - lastItem.x);
+        lastItem.count++;
+        return;
+      }
+      const item = { cmdWithMeta: cmdWithMeta, x: x, width: width, count: 1 };
+      items.push(item);
+      lastItems.set(cmdWithMeta.getY(), item);
+    });
+    items.forEach((item) => {
+      const cmd = item.cmdWithMeta.cmd;
+      item.key = cmd.id + '_' + item.count;
+      item.title = (item.count === 1) ? cmd.command :
+        `${item.count} commands, the first one: ${cmd.command}`;
+    });
+    return items;
+  }
+
   _calcRectXPosition(cmd, xScale) {
     let startX = xScale(cmd.startTime);
     const w = xScale(cmd.endTime) - startX;
@@ -1438,18 +1579,7 @@ class session_timeline_SessionTimeline {
       // .ticks(d3.timeWeek, 2)
       // .tickFormat(d3.timeFormat('%b %d'))
     );
-    // maybe_todo: execute in parallel...
-    this.commandRects.forEach((rectGroup) => {
-      rectGroup.attr('x', (cmdWithMeta) => {
-        const pos = this._calcRectXPosition(cmdWithMeta.cmd, xScaleNew);
-        // note: pos may be less than zero which is ok, because
-        // otherwise wide rects may disappear too soon.
-        return pos;
-        })
-        .attr('width', (cmdWithMeta) => {
-          return this._calcRectWidth(cmdWithMeta.cmd, xScaleNew);
-        });
-    });
+    this._renderSessions(xScaleNew);
 
     this._annotationRender.update(xScaleNew);
   }
@@ -1518,6 +1648,7 @@ class session_timeline_Session {
     this._sessionGroup = null;
     this._maxCountOfParallelCmds = null;
     this._height = null;
+    this._className = null;
   }
 
   /**
@@ -1584,7 +1715,13 @@ class session_timeline_Session {
     return this._y;
   }
 
+  setClassName(val){
+    this._className = val;
+  }
 
+  getClassName(){
+    return this._className;
+  }
 }
 
 // CONCATENATED MODULE: ./src/d3js_util.js
@@ -2103,21 +2240,9 @@ class _SessionMostCmdsEntry {
 
 
 
-
 async function generateMiscStats() {
   const body = d3.select('body');
 
-  if (typeof commands[0].fileWriteEvents === 'undefined') {
-    // when generating from shournal, command-data (like fileWriteEvents)
-    // is loaded later for performance reasons
-    await timedForEach(commands, (cmd, idx) => {
-      const cmdDataTag = d3.select('#commandDataJSON' + idx);
-      const cmdData = JSON.parse(cmdDataTag.html());
-      Object.assign(cmd, cmdData);
-      cmdDataTag.remove();
-    });
-  }
-
   if (mostFileMods.length === 0 && sessionsMostCmds.length === 0 && 
       cwdCmdCounts.length === 0 && dirIoCounts.length === 0) {
     // No stats to display...
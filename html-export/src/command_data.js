@@ -0,0 +1,72 @@
+
+/**
+ * When generated from shournal, only a compact summary of each command
+ * (id, dates, command text, number of read/written files...) is parsed on
+ * startup. The remaining command data (read and written files) is stored in
+ * compressed chunks of CMD_DATA_CHUNK_SIZE commands, which are only
+ * decompressed and parsed, when the data of one of their commands is
+ * actually needed.
+ */
+
+/**
+ * @param {string} base64 zlib compressed data
+ * @return {string} the uncompressed data
+ */
+async function _inflateBase64(base64){
+  if (typeof DecompressionStream === 'undefined') {
+    throw new Error('Your browser does not support DecompressionStream, ' +
+      'which is required to display the files of a command.');
+  }
+  const binary = atob(base64);
+  const bytes = new Uint8Array(binary.length);
+  for (let i = 0; i < binary.length; i++) {
+    bytes[i] = binary.charCodeAt(i);
+  }
+  const stream = new Blob([bytes]).stream()
+    .pipeThrough(new DecompressionStream('deflate'));
+  return await new Response(stream).text();
+}
+
+// chunk index -> promise of its loading
+const _chunkLoads = new Map();
+
+async function _loadChunk(commands, chunkIdx){
+  const chunkTag = document.getElementById('commandDataChunk' + chunkIdx);
+  const cmdDatas = JSON.parse(await _inflateBase64(chunkTag.textContent));
+  const firstIdx = chunkIdx * CMD_DATA_CHUNK_SIZE;
+  cmdDatas.forEach((cmdData, i) => {
+    Object.assign(commands[firstIdx + i], cmdData);
+  });
+  chunkTag.remove();
+}
+
+/**
+ * Make sure the file events of commands[idx] are loaded (along with those
+ * of all other commands in the same chunk).
+ * @param {[Command]} commands
+ * @param {int} idx
+ * @return {Promise}
+ */
+export function loadCommandData(commands, idx){
+  if (typeof commands[idx].fileWriteEvents !== 'undefined') {
+    // already loaded or sample data during development
+    return Promise.resolve();
+  }
+  const chunkIdx = Math.floor(idx / CMD_DATA_CHUNK_SIZE);
+  let load = _chunkLoads.get(chunkIdx);
+  if (load === undefined) {
+    load = _loadChunk(commands, chunkIdx);
+    _chunkLoads.set(chunkIdx, load);
+  }
+  return load;
+}
+
+/**
+ * @param {int} id the id of the read file
+ * @return {string} the base64 encoded content of the read file or null,
+ * if it is not contained in the report (e.g. no text file).
+ */
+export function readFileContent(id){
+  const tag = document.getElementById('readFileContent' + id);
+  return (tag === null) ? null : tag.textContent;
+}
@@ -2,11 +2,12 @@ import * as html_util from './html_util';
 import * as util from './util';
 import * as globals from './globals';
 import * as conversions from './conversions';
+import * as command_data from './command_data';
 
 
 export default class CommandList {
   constructor(commands) {
-
+    this._commands = commands;
     this._CMDLISTPADDING = 18;
     this._CMDLISTBG = '#777';
 
@@ -80,12 +81,32 @@ export default class CommandList {
       ${this._CMDLISTBG} ${this._CMDLISTPADDING - 1}px, ${this._CMDLISTBG} 100%)`;
   }
 
-  _handleClickOnCmd(cmd, idx){
+  async _handleClickOnCmd(cmd, idx){
     let contentDiv = d3.select(`#cmdcontent${cmd.id}`);
     if (! contentDiv.empty()) {
       contentDiv.remove();
       return;
     }
+    // the read and written files are loaded on demand
+    let loadError = null;
+    try {
+      await command_data.loadCommandData(this._commands, idx);
+    } catch (error) {
+      console.log(error);
+      loadError = error;
+    }
+    if (! d3.select(`#cmdcontent${cmd.id}`).empty()) {
+      // clicked again while loading
+      return;
+    }
+    if (loadError !== null) {
+      d3.select('body').append('div')
+        .attr('id', `cmdcontent${cmd.id}`)
+        .attr('class', 'collapsibleCmdContent')
+        .style('color', 'red')
+        .text(loadError.message);
+      return;
+    }
 
     contentDiv = d3.select('body').append('div')
       .attr('id', `cmdcontent${cmd.id}`)
@@ -153,8 +174,9 @@ export default class CommandList {
                         `size: ${conversions.bytesToHuman(readFile.size)}<br>` + 
                         `hash: ${readFile.hash}<br>`;
 
-          const readFileContent = atob(readFileContentMap.get(readFile.id));
-          globals.textDialog.show(title, readFileContent);
+          const content = command_data.readFileContent(readFile.id);
+          globals.textDialog.show(title, (content === null) ?
+            '(content not included in report)' : atob(content));
         }
       });
     
@@ -96,9 +96,10 @@ export default class CommandTimeline {
       .attr('y', (cmd) => { return this.svgHeight - this.cmdGroupOffsets[cmd.vertOffsetGroup]; })
       .attr('width', (cmd) => { return this._calcRectWidth(cmd, this.xScale); })
       .attr('height', (cmd) => {
-        if(cmd.fileWriteEvents.length === 0) return _CmdRectHeights.NO_MOD;
-        if(cmd.fileWriteEvents.length < 5) return _CmdRectHeights.FEW_MOD;
-        if(cmd.fileWriteEvents.length < 15) return _CmdRectHeights.MANY_MOD;
+        // only the count of file events is loaded up front
+        if(cmd.fileWriteEvents_length === 0) return _CmdRectHeights.NO_MOD;
+        if(cmd.fileWriteEvents_length < 5) return _CmdRectHeights.FEW_MOD;
+        if(cmd.fileWriteEvents_length < 15) return _CmdRectHeights.MANY_MOD;
         return _CmdRectHeights.VERY_MANY_MOD;
       })
       .attr('fill', (cmd, i) => {
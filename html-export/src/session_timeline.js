@@ -34,7 +34,7 @@ export default class SessionTimeline {
     this.annotationMinWidth = this.annotationCharWidth * 5;
     // distance to the belonging command rect
     this.annotationDistance = this.annotationCharHeight / 3.0;
-    this.commandRects = [];
+    this._sessions = [];
 
     
     // minimum width of a cmd-rect. Let it be at least 1, otherwise very short commands
@@ -92,53 +92,14 @@ export default class SessionTimeline {
         // .tickFormat(d3.timeFormat('%b %d'))
       );
 
-    const _drawSession = (session, idx, lineIdx) => {
-      // draw rectangles
-      const className = 'sessionTimeSeries' + 
-        session.getSessionGroup() + idx;
-      this.commandRects.push(this.svg.selectAll('.' + className)
-        .data(session.getCmdsWithMeta())
-        .enter()
-        .append('rect')
-        .attr('class', className)
-        .attr('x', (cmdWithMeta) => { 
-          return this._calcRectXPosition(cmdWithMeta.cmd, this.xScale); 
-        })
-        .attr('y', (cmdWithMeta) => { 
-          // rects are drawn from top to bottom, so add the height:
-          return this._yScale(cmdWithMeta.getY() + cmdWithMeta.getHeight()); 
-        })
-        .attr('width', (cmdWithMeta) => { 
-          return this._calcRectWidth(cmdWithMeta.cmd, this.xScale); 
-        })
-        .attr('height', (cmdWithMeta) => { 
-          return cmdWithMeta.getHeight(); 
-        })
-        .attr('fill', (cmdWithMeta) => { 
-          // TODO: rather determine the session color in this class
-          // on a per line-basis, so the same color appears as seldom
-          // as possible in a given line (?).
-          // But what about the colors in the cmd-list?...
-          return cmdWithMeta.cmd.sessionColor; 
-        } )
-        .style('cursor', 'pointer')
-        .attr('title', (cmdWithMeta) => { return cmdWithMeta.cmd.command; })
-        .on("click", (cmdWithMeta) => { 
-          globals.commandList.scrollToCmd(cmdWithMeta.cmd); 
-        })
-        );
-      $('.' + className).tooltip({
-        delay: { show: 50, hide: 0 },
-      });
-
-    }; 
-
-    groupedSessions.forEach((sessionLine, lineIdx) => {
+    groupedSessions.forEach((sessionLine) => {
       sessionLine.forEach((session, sessionIdx) => {
-        _drawSession(session, sessionIdx, lineIdx);
+        session.setClassName('sessionTimeSeries' +
+          session.getSessionGroup() + '_' + sessionIdx);
+        this._sessions.push(session);
       });
-    });   
-
+    });
+    this._renderSessions(this.xScale);
 
     this._preRenderAnnotations(groupedSessions);
     this._annotationRender.setOnNoteClick((cmdWithMeta) => {
@@ -339,6 +300,90 @@ export default class SessionTimeline {
   }
 
 
+  /**
+   * Draw the commands of all sessions for the given xScale. To keep the number
+   * of svg-elements bounded, only visible commands are drawn and commands
+   * which would overlap (e.g. when zoomed out) are drawn as a single,
+   * aggregated rect (level of detail).
+   * @param {*} xScale
+   */
+  _renderSessions(xScale){
+    this._sessions.forEach((session) => {
+      const rects = this.svg.selectAll('.' + session.getClassName())
+        .data(this._generateLodItems(session, xScale), (item) => { return item.key; });
+
+      rects.exit()
+        .each(function() { $(this).tooltip('dispose'); })
+        .remove();
+
+      const entered = rects.enter()
+        .append('rect')
+        .attr('class', session.getClassName())
+        .attr('y', (item) => {
+          // rects are drawn from top to bottom, so add the height:
+          return this._yScale(item.cmdWithMeta.getY() + item.cmdWithMeta.getHeight());
+        })
+        .attr('height', (item) => { return item.cmdWithMeta.getHeight(); })
+        .attr('fill', (item) => {
+          // TODO: rather determine the session color in this class
+          // on a per line-basis, so the same color appears as seldom
+          // as possible in a given line (?).
+          // But what about the colors in the cmd-list?...
+          return item.cmdWithMeta.cmd.sessionColor;
+        })
+        .style('cursor', 'pointer')
+        .attr('title', (item) => { return item.title; })
+        .on("click", (item) => {
+          globals.commandList.scrollToCmd(item.cmdWithMeta.cmd);
+        });
+      $(entered.nodes()).tooltip({
+        delay: { show: 50, hide: 0 },
+      });
+
+      entered.merge(rects)
+        // note: x may be less than zero which is ok, because
+        // otherwise wide rects may disappear too soon.
+        .attr('x', (item) => { return item.x; })
+        .attr('width', (item) => { return item.width; });
+    });
+  }
+
+  /**
+   * @return {[Object]} the rects to draw for the given session: commands
+   * outside of the visible range are skipped, commands of the same group
+   * which overlap in pixel space are merged into one item.
+   * @param {_Session} session
+   * @param {*} xScale
+   */
+  _generateLodItems(session, xScale){
+    const items = [];
+    // y-position of parallel commands -> the item to extend
+    const lastItems = new Map();
+    session.getCmdsWithMeta().forEach((cmdWithMeta) => {
+      const x = this._calcRectXPosition(cmdWithMeta.cmd, xScale);
+      const width = this._calcRectWidth(cmdWithMeta.cmd, xScale);
+      if (x > this.svgWidth || x + width < 0) {
+        return;
+      }
+      const lastItem = lastItems.get(cmdWithMeta.getY());
+      if (lastItem !== undefined && x < lastItem.x + lastItem.width) {
+        lastItem.width = Math.max(lastItem.width, x + width - lastItem.x);
+        lastItem.count++;
+        return;
+      }
+      const item = { cmdWithMeta: cmdWithMeta, x: x, width: width, count: 1 };
+      items.push(item);
+      lastItems.set(cmdWithMeta.getY(), item);
+    });
+    items.forEach((item) => {
+      const cmd = item.cmdWithMeta.cmd;
+      item.key = cmd.id + '_' + item.count;
+      item.title = (item.count === 1) ? cmd.command :
+        `${item.count} commands, the first one: ${cmd.command}`;
+    });
+    return items;
+  }
+
   _calcRectXPosition(cmd, xScale) {
     let startX = xScale(cmd.startTime);
     const w = xScale(cmd.endTime) - startX;
@@ -370,18 +415,7 @@ export default class SessionTimeline {
       // .ticks(d3.timeWeek, 2)
       // .tickFormat(d3.timeFormat('%b %d'))
     );
-    // maybe_todo: execute in parallel...
-    this.commandRects.forEach((rectGroup) => {
-      rectGroup.attr('x', (cmdWithMeta) => {
-        const pos = this._calcRectXPosition(cmdWithMeta.cmd, xScaleNew);
-        // note: pos may be less than zero which is ok, because
-        // otherwise wide rects may disappear too soon.
-        return pos;
-        })
-        .attr('width', (cmdWithMeta) => {
-          return this._calcRectWidth(cmdWithMeta.cmd, xScaleNew);
-        });
-    });
+    this._renderSessions(xScaleNew);
 
     this._annotationRender.update(xScaleNew);
   }
@@ -450,6 +484,7 @@ class _Session {
     this._sessionGroup = null;
     this._maxCountOfParallelCmds = null;
     this._height = null;
+    this._className = null;
   }
 
   /**
@@ -516,5 +551,11 @@ class _Session {
     return this._y;
   }
 
+  setClassName(val){
+    this._className = val;
+  }
 
+  getClassName(){
+    return this._className;
+  }
 }
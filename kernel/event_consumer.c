@@ -1,14 +1,19 @@
 
+#include <linux/atomic.h>
 #include <linux/compiler.h>
+#include <linux/cred.h>
 #include <linux/dcache.h>
 #include <linux/file.h>
 #include <linux/fdtable.h>
+#include <linux/hash.h>
 #include <linux/kthread.h>
 #include <linux/slab.h>
 #include <linux/stat.h>
 #include <linux/sched.h>
 #include <linux/fadvise.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include <linux/mmu_context.h>
 #include <linux/splice.h>
 #include <asm/uaccess.h>
@@ -91,24 +96,29 @@ static bool __write_to_target_file_safe(struct event_target* event_target,
 }
 
 /// xxhash the passed file
-static void __do_hash_file(struct partial_xxhash* part_hash,
+static void __do_hash_file(struct event_target* t,
                                struct file* file,
                                loff_t file_size,
                                const struct qstr* filename,
                                struct shournalk_close_event* user_event){
+    struct partial_xxhash* part_hash = &t->partial_hash;
     struct partial_xxhash_result hash_result;
     long ret;
+    u64 start_ns;
     kutil_WARN_DBG(file_size == 0, "file_size == 0");
     kutil_WARN_DBG(part_hash->chunksize == 0, "part_hash->chunksize == 0");
 
     part_hash->seekstep =
             file_size / part_hash->max_count_of_reads;
-    if(unlikely(ret = partial_xxh_digest_file(file,
-                                      part_hash,
-                                      &hash_result))){
+    start_ns = ktime_get_ns();
+    ret = partial_xxh_digest_file(file, part_hash, &hash_result);
+    t->hash_ns += ktime_get_ns() - start_ns;
+    t->hash_count++;
+    if(unlikely(ret)){
         pr_devel("failed to partial_hash file with %ld - %s\n", ret, filename->name);
         goto invalidate_hash;
     }
+    t->hash_bytes += hash_result.count_of_bytes;
 
     if(unlikely(hash_result.count_of_bytes == 0)){
         // zero bytes read - file became empty in between?
@@ -127,18 +137,15 @@ invalidate_hash:
 }
 
 
-/// rewrite user_event after having corrected the file content
-/// size with the actual number of bytes written (should
+/// Overwrite count bytes at pos, to correct the file content
+/// size of an event with the actual number of bytes written (should
 /// happen rarely)
 static bool
-__correct_file_event_at_pos(struct event_target* t, loff_t pos,
-                            struct shournalk_close_event* user_event){
+__correct_target_file_at_pos(struct event_target* t, loff_t pos,
+                             const void* buf, size_t count){
     ssize_t ret;
     struct file* dest = t->file->__file;
-    if( (ret = kutil_kernel_write(dest, user_event,
-                       sizeof(struct shournalk_close_event),
-                       &pos
-                       )) !=  sizeof(struct shournalk_close_event)){
+    if( (ret = kutil_kernel_write(dest, buf, count, &pos)) != (ssize_t)count){
         WRITE_ONCE(t->ERROR, true);
         pr_debug("Failed to correct file content size for target %s, returned %ld\n",
                  t->file_init_path, ret);
@@ -151,16 +158,16 @@ __correct_file_event_at_pos(struct event_target* t, loff_t pos,
 
 /// write size bytes from src to
 /// our target file
+/// @param written_size: the number of bytes actually written. The
+/// content starts at the file position minus written_size.
 static bool
 __write_file_content(struct event_target* t,
                      struct file* src,
                      loff_t size,
-                     struct shournalk_close_event* user_event){
-    ssize_t ret;
+                     loff_t* written_size){
     struct file* dest = t->file->__file;
     loff_t src_pos = 0;
     loff_t old_dst_pos;
-    loff_t written_size;
 
     if(unlikely(! event_consumer_flush_target_file_safe(t))){
         return false;
@@ -168,21 +175,92 @@ __write_file_content(struct event_target* t,
 
     file_start_write(dest);
     old_dst_pos = dest->f_pos;
-    ret = do_splice_direct(src, &src_pos, dest, &dest->f_pos, size, 0);
-    written_size = dest->f_pos - old_dst_pos;
+    do_splice_direct(src, &src_pos, dest, &dest->f_pos, size, 0);
+    *written_size = dest->f_pos - old_dst_pos;
     file_end_write(dest);
 
-    if(unlikely(written_size != size)){
-        // before having written the file content, the
-        // close event was written, which we overwrite now.
-        // seek back and correct the written bytes
-        loff_t correct_pos = old_dst_pos - sizeof(struct shournalk_close_event);
-        user_event->bytes = written_size;
+    if(unlikely(*written_size != size)){
         pr_debug("Only %lld of %lld bytes written - attempting "
-                 "to correct this...\n", written_size, size);
-        return __correct_file_event_at_pos(t, correct_pos, user_event);
+                 "to correct this...\n", *written_size, size);
+    }
+    return true;
+}
+
+static bool __ev2_slot_matches(const struct ev2_dir_slot* slot,
+                               const struct consumer_cache_entry* directory){
+    return slot->name != NULL &&
+           slot->len == directory->dirname_len &&
+           memcmp(slot->name, directory->dirname, slot->len) == 0;
+}
+
+/// If the allocation fails, the slot stays empty, so the directory is
+/// simply written again next time.
+static void __ev2_slot_set(struct ev2_dir_slot* slot,
+                           const struct consumer_cache_entry* directory){
+    kfree(slot->name);
+    slot->name = kmemdup(directory->dirname, directory->dirname_len, SHOURNALK_GFP);
+    slot->len = directory->dirname_len;
+}
+
+/// Write the event in format version 2 (see shournalk_user.h)
+static bool __write_event_v2(struct event_target* t,
+                             struct shournalk_close_event* user_event,
+                             struct file* content_file,
+                             const struct qstr* filename,
+                             struct consumer_cache_entry* directory){
+    struct event_consumer* c = &t->event_consumer;
+    unsigned char buf[SHOURNALK_EV2_HEAD_MAX];
+    const unsigned slot = hash_ptr(directory->dir.dentry,
+                                   ilog2(SHOURNALK_EV2_DIR_SLOTS));
+    const bool new_dir = ! __ev2_slot_matches(&c->ev2_dir_slots[slot], directory);
+    uint64_t tag = (uint64_t)user_event->flags | ((uint64_t)slot << SHOURNALK_EV2_SLOT_SHIFT);
+    unsigned len;
+    loff_t written_size;
+
+    if(! user_event->hash_is_null) tag |= SHOURNALK_EV2_HAS_HASH;
+    if(user_event->bytes) tag |= SHOURNALK_EV2_HAS_CONTENT;
+    if(new_dir) tag |= SHOURNALK_EV2_NEW_DIR;
+
+    len = shournalk_ev2_put_varint(buf, tag);
+    len += shournalk_ev2_put_varint(buf + len, shournalk_ev2_zigzag(
+                                        (int64_t)(user_event->mtime - c->ev2_last_mtime)));
+    len += shournalk_ev2_put_varint(buf + len, user_event->size);
+    len += shournalk_ev2_put_varint(buf + len, user_event->mode);
+    if(! user_event->hash_is_null){
+        shournalk_ev2_put_u64(buf + len, user_event->hash);
+        len += 8;
+    }
+    c->ev2_last_mtime = user_event->mtime;
+    if(unlikely(! __write_to_target_file_safe(t, buf, len))){
+        return false;
+    }
+    if(new_dir){
+        // the root directory is the empty string
+        if(directory->dirname_len > 1){
+            __write_to_target_file_safe(t, directory->dirname, directory->dirname_len);
+        }
+        __write_to_target_file_safe(t, "", 1);
+        __ev2_slot_set(&c->ev2_dir_slots[slot], directory);
+    }
+    __write_to_target_file_safe(t, filename->name, filename->len + 1);
 
+    if(likely(! user_event->bytes)){
+        return true;
+    }
+    shournalk_ev2_put_u64(buf, user_event->bytes);
+    if(unlikely(! __write_to_target_file_safe(t, buf, 8)) ||
+       unlikely(! __write_file_content(t, content_file, user_event->bytes,
+                                       &written_size))){
+        return false;
     }
+    if(unlikely(written_size != (loff_t)user_event->bytes)){
+        shournalk_ev2_put_u64(buf, written_size);
+        if(! __correct_target_file_at_pos(
+                    t, t->file->__file->f_pos - written_size - 8, buf, 8)){
+            return false;
+        }
+    }
+    t->stored_files_count++;
     return true;
 }
 
@@ -200,7 +278,7 @@ static bool __do_log_file_event(struct event_target* t,
 
     if(current->mm && unlikely(current->mm->owner != t->caller_tsk)){
         WRITE_ONCE(t->ERROR, true);
-        // See comment in event_consumer_thread_setup
+        // See comment in consumer_worker_enter_target
         // for the rationale.
         pr_debug("mm->owner does not belong to pid %d "
                  "any more - most likely the caller died. "
@@ -236,19 +314,43 @@ static bool __do_log_file_event(struct event_target* t,
     }
     user_event.bytes = (store_whole_file) ? user_event.size : 0;
     if(! user_event.hash_is_null){
-        __do_hash_file(&t->partial_hash, file, user_event.size, filename, &user_event);
+        __do_hash_file(t, file, user_event.size, filename, &user_event);
+    }
+
+    if(t->events_v2){
+        bool ret = __write_event_v2(t, &user_event, file, filename, directory);
+        if(! IS_ERR_OR_NULL(file)){
+            fput(file);
+        }
+        return ret;
     }
 
     if(unlikely(! __write_to_target_file_safe(
                     t, &user_event,
                     sizeof (struct shournalk_close_event)))
             ){
+        if(! IS_ERR_OR_NULL(file)){
+            fput(file);
+        }
         return false;
     }
 
     if(unlikely(store_whole_file)){
-        if(__write_file_content(t, file, user_event.bytes, &user_event)){
-            t->stored_files_count++;
+        loff_t written_size;
+        if(__write_file_content(t, file, user_event.bytes, &written_size)){
+            bool ok = true;
+            if(unlikely(written_size != (loff_t)user_event.bytes)){
+                // before having written the file content, the
+                // close event was written, which we overwrite now.
+                user_event.bytes = written_size;
+                ok = __correct_target_file_at_pos(
+                            t, t->file->__file->f_pos - written_size -
+                               (loff_t)sizeof(struct shournalk_close_event),
+                            &user_event, sizeof(struct shournalk_close_event));
+            }
+            if(ok){
+                t->stored_files_count++;
+            }
         }
     }
     if(! IS_ERR_OR_NULL(file)){
@@ -268,7 +370,8 @@ static bool __do_log_file_event(struct event_target* t,
 
 
 static void
-__handle_read_event(struct event_target* t,
+__handle_read_event(struct consumer_worker* worker,
+                    struct event_target* t,
                     struct close_event* close_ev,
                     bool may_write){
     const struct shounalk_settings* sets = &t->settings;
@@ -308,7 +411,7 @@ __handle_read_event(struct event_target* t,
     }
 
     d_ent = consumer_cache_find(
-                    t->event_consumer.r_cache,
+                    worker->r_cache,
                     path->mnt, READ_ONCE(path->dentry->d_parent),
                 &cache_entry_existed);
     if(IS_ERR(d_ent)){
@@ -379,7 +482,8 @@ out_release:
 }
 
 static void
-__handle_write_event(struct event_target* t,
+__handle_write_event(struct consumer_worker* worker,
+                    struct event_target* t,
                     struct close_event* close_ev,
                     bool may_write){
     const struct shounalk_settings* sets = &t->settings;
@@ -404,7 +508,7 @@ __handle_write_event(struct event_target* t,
     }
 
     d_ent = consumer_cache_find(
-                    t->event_consumer.w_cache,
+                    worker->w_cache,
                     path->mnt, READ_ONCE(path->dentry->d_parent),
                 &cache_entry_existed);
     if(IS_ERR(d_ent)){
@@ -450,6 +554,8 @@ out_release:
 ////////////////////////////////////////////////////////////////////////////
 
 long event_consumer_init(struct event_consumer* consumer){
+    static atomic64_t target_id_counter = ATOMIC64_INIT(0);
+
     memset(consumer, 0, sizeof (struct event_consumer));
 
     // To avoid alignment of struct close_event to buffer size,
@@ -459,77 +565,71 @@ long event_consumer_init(struct event_consumer* consumer){
                                       SHOURNALK_GFP | __GFP_RETRY_MAYFAIL);
     if(! consumer->circ_buf.buf)
         return -ENOMEM;
-    consumer->w_cache = kvzalloc(sizeof (struct consumer_cache),
-                                 SHOURNALK_GFP | __GFP_RETRY_MAYFAIL);
-    if(! consumer->w_cache)
-        goto err1;
-
-    consumer->r_cache = kvzalloc(sizeof (struct consumer_cache),
-                                 SHOURNALK_GFP | __GFP_RETRY_MAYFAIL);
-    if(! consumer->r_cache)
-        goto err2;
 
     consumer->circ_buf_size = CONSUMER_CIRC_BUFSIZE;
     spin_lock_init(&consumer->queue_lock);
-    sema_init(&consumer->start_sema, 0);
-
-    consumer_cache_init(consumer->w_cache);
-    consumer_cache_init(consumer->r_cache);
-
+    INIT_LIST_HEAD(&consumer->run_node);
+    consumer->target_id = atomic64_inc_return(&target_id_counter);
 
     return 0;
-
-err2:
-    kvfree(consumer->w_cache);
-err1:
-    kvfree(consumer->circ_buf.buf);
-    return -ENOMEM;
 }
 
 void event_consumer_cleanup(struct event_consumer* c){
-    if(! IS_ERR_OR_NULL(c->consume_task)){
-        put_task_struct(c->consume_task);
-    }
-
-    kvfree(c->r_cache);
-    kvfree(c->w_cache);
+    event_consumer_reset_ev2(c);
     kvfree(c->circ_buf.buf);
 }
 
-
-long event_consumer_thread_create(struct event_target* event_target,
-                        const char* thread_name){
-    struct event_consumer* consumer = &event_target->event_consumer;
-    consumer->consume_task = kthread_create(event_queue_consume_thread,
-                                            event_target,
-                                            "%s", thread_name);
-
-    if(IS_ERR(consumer->consume_task)){
-        pr_warn("Failed to create consume thread %s - %ld\n", thread_name,
-                PTR_ERR(consumer->consume_task));
-        return PTR_ERR(consumer->consume_task);
+/// Empty the directory slots of the events format v2, e.g.
+/// after a new target file was set.
+void event_consumer_reset_ev2(struct event_consumer* c){
+    int i;
+    for(i=0; i < SHOURNALK_EV2_DIR_SLOTS; i++){
+        kfree(c->ev2_dir_slots[i].name);
+        c->ev2_dir_slots[i].name = NULL;
     }
-    get_task_struct(consumer->consume_task);
+    c->ev2_last_mtime = 0;
+}
+
 
-    wake_up_process(consumer->consume_task);
+long consumer_worker_init(struct consumer_worker* worker){
+    memset(worker, 0, sizeof (struct consumer_worker));
 
-    // see documentation of kthread_stop (linux 4.19):
-    // if kthread is stopped very early,
-    // the threadfn might *never* be called. Here this might happen
-    // during the observation of short-lived processes.
-    // We must however make sure, it runs at least once, as
-    // events might be pending. So wait, until our thread calls "up".
-    down(&consumer->start_sema);
+    worker->w_cache = kvzalloc(sizeof (struct consumer_cache), GFP_KERNEL);
+    if(! worker->w_cache)
+        return -ENOMEM;
 
+    worker->r_cache = kvzalloc(sizeof (struct consumer_cache), GFP_KERNEL);
+    if(! worker->r_cache){
+        kvfree(worker->w_cache);
+        return -ENOMEM;
+    }
+    consumer_cache_init(worker->w_cache);
+    consumer_cache_init(worker->r_cache);
     return 0;
 }
 
-void event_consumer_thread_setup(struct event_target* event_target){
-    struct event_consumer* consumer = &event_target->event_consumer;
+void consumer_worker_cleanup(struct consumer_worker* worker){
+    kvfree(worker->r_cache);
+    kvfree(worker->w_cache);
+}
+
+/// Called by the worker before consuming a batch of events of the
+/// given target.
+void consumer_worker_enter_target(struct consumer_worker* worker,
+                                  struct event_target* event_target){
+    kutil_WARN_ONCE_IFN_DBG(current != worker->task,
+                            "current != worker->task");
+
+    // The cached directory flags depend on the target's settings
+    if(worker->cache_target_id != event_target->event_consumer.target_id){
+        consumer_cache_init(worker->w_cache);
+        consumer_cache_init(worker->r_cache);
+        worker->cache_target_id = event_target->event_consumer.target_id;
+    }
 
     if(event_target->mm) {
 #ifdef USE_MM_SET_FS_OFF
-        consumer->consume_tsk_oldfs = get_fs();
+        worker->oldfs = get_fs();
         set_fs(USER_DS);
 #endif
         kutil_use_mm(event_target->mm);
@@ -567,36 +667,25 @@ void event_consumer_thread_setup(struct event_target* event_target){
     //             alloc_buffer_head
     //                 kmem_cache_alloc
 
-
-    // set_user_nice(current, 1); // 2? 10? MAX_NICE?
-    // Only affects reads. See also: https://unix.stackexchange.com/a/480863/288001
-    set_task_ioprio(current, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 6));
-
     // process events with user credentials
-    consumer->consume_task_orig_cred = override_creds(event_target->cred);
+    worker->orig_cred = override_creds(event_target->cred);
 }
 
-void event_consumer_thread_cleanup(struct event_target* event_target){
-    struct event_consumer* consumer = &event_target->event_consumer;
-
-    kutil_WARN_ONCE_IFN_DBG(current != consumer->consume_task,
-                            "current != consumer->consume_task");
-    revert_creds(consumer->consume_task_orig_cred);
+/// Undo consumer_worker_enter_target. Must be called before the worker
+/// puts its references of the target.
+void consumer_worker_leave_target(struct consumer_worker* worker,
+                                  struct event_target* event_target){
+    kutil_WARN_ONCE_IFN_DBG(current != worker->task,
+                            "current != worker->task");
+    revert_creds(worker->orig_cred);
     if(event_target->mm){
         kutil_unuse_mm(event_target->mm);
 #ifdef USE_MM_SET_FS_OFF
-        set_fs(consumer->consume_tsk_oldfs);
+        set_fs(worker->oldfs);
 #endif
     }
 }
 
-void event_consumer_thread_stop(struct event_consumer* consumer){
-    int ret;
-    if( (ret = kthread_stop(consumer->consume_task))){
-        kutil_WARN_ONCE_IFN_DBG(1, "event-consume-thread returned %d\n", ret);
-    }
-}
-
 bool event_consumer_flush_target_file_safe(struct event_target *t)
 {
     ssize_t ret;
@@ -611,7 +700,9 @@ bool event_consumer_flush_target_file_safe(struct event_target *t)
 }
 
 
-void close_event_consume(struct event_target* event_target, struct close_event* close_ev){
+void close_event_consume(struct consumer_worker* worker,
+                         struct event_target* event_target,
+                         struct close_event* close_ev){
     bool may_read;
     bool may_write;
 
@@ -637,9 +728,9 @@ void close_event_consume(struct event_target* event_target, struct close_event*
     // as write-event.
     // maybe_todo: differentiate?
     if(close_ev->f_mode & FMODE_WRITE){
-        __handle_write_event(event_target, close_ev, may_write);
+        __handle_write_event(worker, event_target, close_ev, may_write);
     } else {
-        __handle_read_event(event_target, close_ev, may_write);
+        __handle_read_event(worker, event_target, close_ev, may_write);
     }
 
 out:
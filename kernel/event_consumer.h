@@ -11,51 +11,77 @@
 #include <linux/timer.h>
 #include <linux/compiler.h>
 #include <linux/circ_buf.h>
+#include <linux/list.h>
 
 #include "kutil.h"
+#include "shournalk_user.h"
 
 struct event_target;
 struct consumer_cache;
 
+/// A directory of the events format v2 (see shournalk_user.h).
+/// The name is compared instead of the path, since the (unreferenced)
+/// dentry might have been freed and reused for another directory.
+struct ev2_dir_slot {
+    char* name; /* NULL: empty slot */
+    int len;
+};
+
 struct close_event {
     struct path path;
     fmode_t f_mode;
+    u64 enqueue_ns; /* ktime_get_ns() */
 };
 
+/// Per event_target part of the consumer: the ringbuffer, filled
+/// by the producers and drained by one worker of the consumer pool
+/// at a time (see event_queue.c).
 struct event_consumer {
     struct circ_buf circ_buf;
     struct spinlock queue_lock;
     int circ_buf_size;
-    bool woken_up;
-    struct task_struct* consume_task;
+    int max_used_bytes; /* high-water mark of the ringbuffer. Protected by queue_lock */
+    bool queued; /* on the pool's run-list or being consumed. Protected by queue_lock */
+    struct list_head run_node; /* protected by the pool's run_lock */
+    u64 target_id; /* unique, in contrast to the event_target's address */
 
-    const struct cred* consume_task_orig_cred;
-    struct consumer_cache* w_cache;
     struct path w_last_written_path; /* last logged full path */
-    struct consumer_cache* r_cache;
     struct path r_last_written_path;
-    struct semaphore start_sema;
+    /* events format v2: the directories of the slots and the mtime
+     * of the last record (see shournalk_user.h) */
+    struct ev2_dir_slot ev2_dir_slots[SHOURNALK_EV2_DIR_SLOTS];
+    u64 ev2_last_mtime;
+};
+
+/// State of one kthread of the consumer pool, which is reused for
+/// all event targets it consumes. While consuming a target, the worker
+/// runs with the target's mm and credentials.
+struct consumer_worker {
+    struct task_struct* task;
+    struct consumer_cache* w_cache;
+    struct consumer_cache* r_cache;
+    u64 cache_target_id; /* the caches are only valid for this target */
+    const struct cred* orig_cred;
 #ifdef USE_MM_SET_FS_OFF
-       mm_segment_t consume_tsk_oldfs;
+       mm_segment_t oldfs;
 #endif
-
 };
 
 
 long event_consumer_init(struct event_consumer*);
 void event_consumer_cleanup(struct event_consumer*);
+void event_consumer_reset_ev2(struct event_consumer*);
 
-long event_consumer_thread_create(struct event_target* event_target,
-                        const char* thread_name);
-void event_consumer_thread_setup(struct event_target* event_target);
-void event_consumer_thread_cleanup(struct event_target* event_target);
-
-void event_consumer_thread_stop(struct event_consumer* consumer);
+long consumer_worker_init(struct consumer_worker*);
+void consumer_worker_cleanup(struct consumer_worker*);
+void consumer_worker_enter_target(struct consumer_worker*, struct event_target*);
+void consumer_worker_leave_target(struct consumer_worker*, struct event_target*);
 
 bool event_consumer_flush_target_file_safe(struct event_target*);
 
 
-void close_event_consume(struct event_target*, struct close_event*);
+void close_event_consume(struct consumer_worker*, struct event_target*,
+                         struct close_event*);
 void close_event_cleanup(struct close_event* event);
 
 
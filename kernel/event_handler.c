@@ -7,6 +7,7 @@
 #include <linux/delay.h>
 #include <linux/thread_info.h>
 #include <linux/interrupt.h>
+#include <linux/sched/signal.h>
 
 
 #include "event_handler.h"
@@ -28,6 +29,21 @@ static struct kmem_cache * __task_entry_cache;
 static DEFINE_SPINLOCK(task_table_lock);
 static struct workqueue_struct* del_taskentries_wq = NULL;
 
+#ifdef CONFIG_CGROUPS
+/// Tasks within a marked cgroup are not inserted into the task_table,
+/// instead their cgroup is looked up on each event.
+struct cgroup_entry {
+     ino_t cgrp_ino;
+     struct event_target* event_target;
+     struct hlist_node node;
+     struct rcu_work destroy_rwork;
+};
+static DEFINE_HASHTABLE(cgroup_table, 6);
+static DEFINE_SPINLOCK(cgroup_table_lock);
+// Spare the cgroup lookup while no cgroup is marked
+static atomic_t cgroup_table_count = ATOMIC_INIT(0);
+#endif
+
 static struct task_entry* __task_entry_alloc(void){
     return kmem_cache_alloc(__task_entry_cache,
                             GFP_NOWAIT | __GFP_ACCOUNT | __GFP_NOWARN);
@@ -85,6 +101,101 @@ __find_get_event_target_safe(struct task_struct* task){
     return event_target;
 }
 
+#ifdef CONFIG_CGROUPS
+static inline struct cgroup_entry*
+__find_cgroup_entry(ino_t cgrp_ino){
+    struct cgroup_entry* el;
+    hash_for_each_possible_rcu(cgroup_table, el, node, cgrp_ino) {
+        if(el->cgrp_ino == cgrp_ino){
+            return el;
+        }
+    }
+    return NULL;
+}
+
+/// Like __task_check_same_owner, but compare with the owner of
+/// the event target. Must be called under rcu_read_lock.
+static inline bool
+__task_check_target_owner(struct task_struct *task,
+                          const struct event_target* event_target){
+    const struct cred *cred_task = __task_cred(task);
+    return uid_eq(event_target->cred->euid, cred_task->euid) ||
+           uid_eq(event_target->cred->euid, cred_task->uid);
+}
+
+/// find and get a reference of the event target, the cgroup
+/// of the given task is marked with. As for marked pids, only tasks
+/// of the owner of the event target are observed.
+static inline __attribute__((__warn_unused_result__))
+struct event_target*
+__find_get_cgroup_target_safe(struct task_struct* task){
+    struct cgroup_entry* el;
+    struct event_target* event_target = NULL;
+
+    if(likely(atomic_read(&cgroup_table_count) == 0)){
+        return NULL;
+    }
+    rcu_read_lock();
+    if((el = __find_cgroup_entry(kutil_task_dfl_cgroup_ino(task))) != NULL &&
+       __task_check_target_owner(task, el->event_target)){
+        event_target = event_target_get(el->event_target);
+    }
+    rcu_read_unlock();
+    return event_target;
+}
+
+static void __cgroup_entry_destroy_work(struct work_struct *work){
+    struct cgroup_entry* el = container_of(to_rcu_work(work),
+                    struct cgroup_entry, destroy_rwork);
+    event_target_put(el->event_target);
+    kfree(el);
+}
+
+/// The process of the caller of an event target exits, possibly without
+/// having unmarked its cgroups (e.g. it crashed or was killed). Unlike
+/// marked tasks, marked cgroups do not exit, so stop observing them
+/// here, which releases the event target along with its pipe and file.
+/// Called for each exiting task, so this must not sleep.
+static void
+__remove_cgroups_of_exiting_caller(struct task_struct* task){
+    struct cgroup_entry* el;
+    struct hlist_node *temp_node;
+    int bucket;
+
+    if(likely(atomic_read(&cgroup_table_count) == 0)){
+        return;
+    }
+    // Only the last exiting thread of a process counts, see
+    // kernel/exit.c::do_exit, which decrements signal->live
+    // before calling cgroup_exit.
+    if(atomic_read(&task->signal->live) != 0){
+        return;
+    }
+    spin_lock(&cgroup_table_lock);
+    hash_for_each_safe(cgroup_table, bucket, temp_node, el, node) {
+        if(el->event_target->caller_tsk->tgid != task->tgid){
+            continue;
+        }
+        pr_debug("cgroup %lu: caller %d exited without unmarking it\n",
+                 (unsigned long)el->cgrp_ino, task->tgid);
+        hash_del_rcu(&el->node);
+        atomic_dec(&cgroup_table_count);
+        // free later, readers may still get a reference of the target
+        INIT_RCU_WORK(&el->destroy_rwork, __cgroup_entry_destroy_work);
+        queue_rcu_work(del_taskentries_wq, &el->destroy_rwork);
+    }
+    spin_unlock(&cgroup_table_lock);
+}
+#else
+static inline struct event_target*
+__find_get_cgroup_target_safe(struct task_struct* task){
+    return NULL;
+}
+
+static inline void
+__remove_cgroups_of_exiting_caller(struct task_struct* task){}
+#endif
+
 /// Called when we stop observing the task set in the event_target's
 /// exit_tsk, either because it exited or it was unmarked for observation.
 static inline void
@@ -293,6 +404,17 @@ void event_handler_destructor(void)
         __task_entry_destroy(el);
     }
     kmem_cache_destroy(__task_entry_cache);
+
+#ifdef CONFIG_CGROUPS
+    {
+        struct cgroup_entry* cg_el;
+        hash_for_each_safe(cgroup_table, bucket, temp_node, cg_el, node) {
+            hash_del(&cg_el->node);
+            event_target_put(cg_el->event_target);
+            kfree(cg_el);
+        }
+    }
+#endif
 }
 
 struct event_target*
@@ -361,6 +483,85 @@ long event_handler_remove_pid(pid_t pid){
 }
 
 
+#ifdef CONFIG_CGROUPS
+
+/// Register param event_target as target for file events of all tasks
+/// within the cgroup (v2) identified by the inode number of its directory.
+/// Unlike marked pids, tasks are not tracked on fork and exit, the
+/// observation lasts until the cgroup is unmarked or the process of the
+/// caller of the event_target exits. If the cgroup is already marked,
+/// the event_target is replaced.
+long event_handler_add_cgroup(struct event_target* event_target, ino_t cgrp_ino){
+    struct cgroup_entry* el;
+    struct cgroup_entry* old_el;
+    struct mem_cgroup * oldcg;
+
+    oldcg = kutil_set_active_memcg(event_target->memcg);
+    el = kmalloc(sizeof (struct cgroup_entry), SHOURNALK_GFP | __GFP_ACCOUNT);
+    kutil_set_active_memcg(oldcg);
+    if(! el){
+        return -ENOMEM;
+    }
+    el->cgrp_ino = cgrp_ino;
+    el->event_target = event_target_get(event_target);
+
+    rcu_read_lock();
+    spin_lock(&cgroup_table_lock);
+    if((old_el = __find_cgroup_entry(cgrp_ino)) != NULL){
+        hlist_replace_rcu(&old_el->node, &el->node);
+    } else {
+        hash_add_rcu(cgroup_table, &el->node, cgrp_ino);
+        atomic_inc(&cgroup_table_count);
+    }
+    spin_unlock(&cgroup_table_lock);
+    rcu_read_unlock();
+
+    if(old_el){
+        pr_debug("cgroup %lu: event_target caller changed from %d to %d\n",
+                 (unsigned long)cgrp_ino, old_el->event_target->caller_tsk->pid,
+                 event_target->caller_tsk->pid);
+        synchronize_rcu();
+        event_target_put(old_el->event_target);
+        kfree(old_el);
+    }
+    return 0;
+}
+
+long event_handler_remove_cgroup(ino_t cgrp_ino){
+    struct cgroup_entry* el;
+
+    rcu_read_lock();
+    spin_lock(&cgroup_table_lock);
+    if((el = __find_cgroup_entry(cgrp_ino)) != NULL){
+        hash_del_rcu(&el->node);
+        atomic_dec(&cgroup_table_count);
+    }
+    spin_unlock(&cgroup_table_lock);
+    rcu_read_unlock();
+
+    if(! el){
+        return -ESRCH;
+    }
+    // Wait for readers, which may still get a reference of the target
+    synchronize_rcu();
+    event_target_put(el->event_target);
+    kfree(el);
+    return 0;
+}
+
+#else
+
+long event_handler_add_cgroup(struct event_target* event_target, ino_t cgrp_ino){
+    return -EOPNOTSUPP;
+}
+
+long event_handler_remove_cgroup(ino_t cgrp_ino){
+    return -EOPNOTSUPP;
+}
+
+#endif // CONFIG_CGROUPS
+
+
 /// If the current task shall be observed,
 /// enqueue the file event for later processing.
 /// Endless recursion is avoided by
@@ -396,7 +597,8 @@ void event_handler_fput(unsigned long ip __attribute__ ((unused)),
     kutil_WARN_DBG(atomic_read(&file_inode(file)->i_count) < 1,
                    "file_inode(file)->i_count < 1");
 
-    if((event_target = __find_get_event_target_safe(current)) == NULL ){
+    if((event_target = __find_get_event_target_safe(current)) == NULL &&
+       (event_target = __find_get_cgroup_target_safe(current)) == NULL){
         return;
     }
     if( unlikely(! __fput_is_interesting(file, event_target)))
@@ -423,6 +625,7 @@ void event_handler_process_exit(struct task_struct *task)
         return;
     }
     __remove_task_from_table_safe(task, true);
+    __remove_cgroups_of_exiting_caller(task);
 }
 
 
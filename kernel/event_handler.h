@@ -15,6 +15,8 @@ struct event_target*
 get_event_target_from_pid(pid_t pid);
 long event_handler_add_pid(struct event_target*, pid_t, bool collect_exitcode);
 long event_handler_remove_pid(pid_t pid);
+long event_handler_add_cgroup(struct event_target*, ino_t cgrp_ino);
+long event_handler_remove_cgroup(ino_t cgrp_ino);
 
 noinline notrace
 void event_handler_fput(unsigned long, unsigned long,
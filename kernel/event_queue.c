@@ -6,6 +6,7 @@
 #include <linux/file.h>
 #include <linux/cred.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/timer.h>
 #include <linux/random.h>
 #include <linux/delay.h>
@@ -15,6 +16,10 @@
 #include <linux/mmu_context.h>
 #include <linux/memcontrol.h>
 #include <linux/mm_types.h>
+#include <linux/list.h>
+#include <linux/wait.h>
+#include <linux/cpumask.h>
+#include <linux/rcupdate.h>
 
 
 #include "event_queue.h"
@@ -25,106 +30,216 @@
 #define __CONSUMER_JIFFY_OFFSET 200
 
 
-/// "Consumes" the ringbuffer (writes tail)
-/// @return the number of consumed bytes (*not* events).
+/// Instead of one kthread per event_target, a pool of kthreads (one
+/// per cpu) consumes the ringbuffers of all event_targets. A target
+/// is put on the run-list, when its first event is enqueued, and
+/// consumed by exactly one worker at a time, until its ringbuffer is empty.
+struct consumer_pool {
+    struct spinlock run_lock;
+    struct list_head run_list; /* event_consumer.run_node of scheduled targets */
+    wait_queue_head_t waitq;
+    struct consumer_worker* workers;
+    int n_workers;
+};
+
+static struct consumer_pool __pool;
+
+
+/// "Consumes" the ringbuffer (writes tail), until it is empty or
+/// the deadline is reached.
+/// @return the number of consumed events.
 static int
-__consume_close_events(struct event_target* event_target){
-    int bytes;
-    int bytes_total;
+__consume_close_events(struct consumer_worker* worker,
+                       struct event_target* event_target,
+                       unsigned long deadline_jiffy){
+    int event_count = 0;
     int head, tail;
     struct circ_buf* circ_buf = &event_target->event_consumer.circ_buf;
     const int cir_buf_size = event_target->event_consumer.circ_buf_size;
     struct close_event* e;
-    unsigned long next_sched_jiffy;
 
     head = smp_load_acquire(&circ_buf->head);
     tail = READ_ONCE(circ_buf->tail);
-    bytes_total = CIRC_CNT(head, tail, cir_buf_size);
 
-    next_sched_jiffy =  jiffies + msecs_to_jiffies(__CONSUMER_JIFFY_OFFSET);
-    for(bytes=0; bytes < bytes_total; ){
+    while(head != tail){
         e = (struct close_event*)&circ_buf->buf[tail];
+        event_target_account_queue_latency(event_target,
+                                           ktime_get_ns() - e->enqueue_ns);
+        close_event_consume(worker, event_target, e);
         tail = (tail + sizeof (struct close_event)) & (cir_buf_size - 1);
-        bytes += sizeof(struct close_event);
+        event_count++;
 
-        close_event_consume(event_target, e);
-        if(time_is_before_jiffies(next_sched_jiffy)){
+        if(time_is_before_jiffies(deadline_jiffy)){
+            break;
+        }
+        if(head == tail){
+            // make room for the producers and check for new events
             smp_store_release(&circ_buf->tail, tail);
-            kutil_kthread_be_nice();
-            next_sched_jiffy =  jiffies + msecs_to_jiffies(__CONSUMER_JIFFY_OFFSET);
+            head = smp_load_acquire(&circ_buf->head);
         }
     }
-    // maybe_todo: move into loop to avoid event-overflow?
     smp_store_release(&circ_buf->tail, tail);
 
-    if( bytes_total > 0){
-        // bulk refcount-decrement..
-        int event_count = bytes_total/sizeof(struct close_event);
-        event_target->consumed_event_count += event_count;
-        if(kuref_sub_and_test(event_count, &event_target->_f_count)){
-            __event_target_put(event_target);
-        }
-    }
-    return bytes_total;
+    event_target->consumed_event_count += event_count;
+    return event_count;
 }
 
 
-/// For each event_target one thread is created, which
-/// consumes the events of the target's ringbuffer.
-int event_queue_consume_thread(void* data){
-    struct event_target* event_target = (struct event_target*)data;
+/// Consume the events of a target taken from the run-list. The
+/// run-list reference is passed on, if the target is scheduled again,
+/// otherwise put along with the references of the consumed events.
+static void
+__consume_target(struct consumer_worker* worker, struct event_target* event_target){
     struct event_consumer* consumer = &event_target->event_consumer;
+    struct circ_buf* circ_buf = &consumer->circ_buf;
     struct kbuffered_file* target_file = event_target->file;
-    uint64_t schedcount = 0;
-    int sleep_counter = 0;
-
-    up(&consumer->start_sema);
-
-    event_consumer_thread_setup(event_target);
-
-    // lost wake-up problem.
-    set_current_state(TASK_INTERRUPTIBLE);
-
-    // Calling wake_up_process is costly, so we want the producer
-    // to do so rarely. Therefore:
-    // First loop until nothing can be consumed.
-    // Then sleep and check again for new events, before scheduling
-    // without timeout.
-    while(!kthread_should_stop()){
-        int consumed_bytes = __consume_close_events(event_target);
-        if(consumed_bytes){
-            sleep_counter = 0;
-        } else {
-            // maybe a good time to flush?
-            if(target_file->__pos > target_file->__bufsize/4){
-                event_consumer_flush_target_file_safe(event_target);
-                // this might have taken a while, so..
-                kutil_kthread_be_nice();
-                continue;
-            }
-
-            if(sleep_counter > 2){
-                smp_store_mb(event_target->event_consumer.woken_up, false);
-                // By checking again for events we allow a
-                // harmless race in the consumer.
-                __consume_close_events(event_target);
-                schedcount++;
-                schedule();
-            } else {
-                schedule_timeout(1);
-                sleep_counter++;
-            }
-            set_current_state(TASK_INTERRUPTIBLE);
-        }
+    unsigned long deadline_jiffy = jiffies + msecs_to_jiffies(__CONSUMER_JIFFY_OFFSET);
+    int put_count;
+    bool reschedule;
+
+    consumer_worker_enter_target(worker, event_target);
+    // Only one worker consumes a target at a time, so this is
+    // uncontended, unless user space swaps the target file.
+    mutex_lock(&event_target->file_lock);
+    put_count = __consume_close_events(worker, event_target, deadline_jiffy);
+    // maybe a good time to flush?
+    if(target_file->__pos > target_file->__bufsize/4){
+        event_consumer_flush_target_file_safe(event_target);
+    }
+    mutex_unlock(&event_target->file_lock);
+    consumer_worker_leave_target(worker, event_target);
+
+    // Either the deadline was reached or new events were enqueued
+    // in between. In the latter case the producer did not schedule
+    // the target, because it is still marked as queued.
+    spin_lock(&consumer->queue_lock);
+    reschedule = CIRC_CNT(READ_ONCE(circ_buf->head), READ_ONCE(circ_buf->tail),
+                          consumer->circ_buf_size) > 0;
+    if(! reschedule){
+        consumer->queued = false;
+    }
+    spin_unlock(&consumer->queue_lock);
+
+    if(reschedule){
+        __event_queue_schedule_target(event_target);
+    } else {
+        put_count++;
+    }
 
+    // bulk refcount-decrement..
+    if(put_count > 0 && kuref_sub_and_test(put_count, &event_target->_f_count)){
+        __event_target_put(event_target);
     }
+}
+
+static struct event_target* __pop_target(void){
+    struct event_consumer* consumer;
+
+    spin_lock(&__pool.run_lock);
+    consumer = list_first_entry_or_null(&__pool.run_list,
+                                        struct event_consumer, run_node);
+    if(consumer){
+        list_del_init(&consumer->run_node);
+    }
+    spin_unlock(&__pool.run_lock);
+
+    return (consumer) ? container_of(consumer, struct event_target, event_consumer)
+                      : NULL;
+}
 
-    // consume final remaining events. Note in case *this* kthread
-    // puts the final event_target-ref, we never get here.
-    __consume_close_events(event_target);
-    event_consumer_thread_cleanup(event_target);
-    kutil_kthread_exit(NULL, 0);
+static int __consume_thread(void* data){
+    struct consumer_worker* worker = (struct consumer_worker*)data;
+    struct event_target* event_target;
+
+    // set_user_nice(current, 1); // 2? 10? MAX_NICE?
+    // Only affects reads. See also: https://unix.stackexchange.com/a/480863/288001
+    set_task_ioprio(current, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 6));
+
+    while(true){
+        event_target = __pop_target();
+        if(event_target){
+            __consume_target(worker, event_target);
+            kutil_kthread_be_nice();
+            continue;
+        }
+        // Targets are only scheduled while the tracepoints are
+        // registered, which is no longer the case, when we are
+        // stopped. So draining the run-list one last time suffices.
+        if(kthread_should_stop()){
+            break;
+        }
+        // exclusive, so a scheduled target wakes a single worker.
+        wait_event_interruptible_exclusive(__pool.waitq,
+                                           ! list_empty_careful(&__pool.run_list) ||
+                                           kthread_should_stop());
+    }
     return 0;
 }
 
 
+void __event_queue_schedule_target(struct event_target* event_target){
+    spin_lock(&__pool.run_lock);
+    list_add_tail(&event_target->event_consumer.run_node, &__pool.run_list);
+    spin_unlock(&__pool.run_lock);
+
+    wake_up(&__pool.waitq);
+}
+
+
+long event_queue_constructor(void){
+    int i;
+    long ret;
+    const int n_cpus = num_online_cpus();
+
+    spin_lock_init(&__pool.run_lock);
+    INIT_LIST_HEAD(&__pool.run_list);
+    init_waitqueue_head(&__pool.waitq);
+    __pool.n_workers = 0;
+    __pool.workers = kcalloc(n_cpus, sizeof (struct consumer_worker), GFP_KERNEL);
+    if(! __pool.workers)
+        return -ENOMEM;
+
+    for(i=0; i < n_cpus; i++){
+        struct consumer_worker* worker = &__pool.workers[i];
+        if((ret = consumer_worker_init(worker)))
+            goto error_out;
+
+        worker->task = kthread_create(__consume_thread, worker,
+                                      "shournalk_consumer/%d", i);
+        if(IS_ERR(worker->task)){
+            ret = PTR_ERR(worker->task);
+            pr_warn("Failed to create consume thread %d - %ld\n", i, ret);
+            consumer_worker_cleanup(worker);
+            goto error_out;
+        }
+        get_task_struct(worker->task);
+        wake_up_process(worker->task);
+        __pool.n_workers++;
+    }
+    return 0;
+
+error_out:
+    event_queue_destructor();
+    return ret;
+}
+
+/// Stop the workers. Must be called after the tracepoints are
+/// unregistered, so no new events arrive. Pending events are
+/// consumed before.
+void event_queue_destructor(void){
+    int i;
+    // wait for producers still running in a tracepoint-handler
+    synchronize_rcu();
+    for(i=0; i < __pool.n_workers; i++){
+        struct consumer_worker* worker = &__pool.workers[i];
+        // -EINTR, if stopped before the thread ever ran, which does no harm.
+        kthread_stop(worker->task);
+        put_task_struct(worker->task);
+        consumer_worker_cleanup(worker);
+    }
+    kutil_WARN_ONCE_IFN_DBG(! list_empty(&__pool.run_list),
+                            "run-list not empty after stopping the consumers");
+    kfree(__pool.workers);
+    __pool.workers = NULL;
+    __pool.n_workers = 0;
+}
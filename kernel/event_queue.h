@@ -1,26 +1,33 @@
-/* File events are stored into a ringbuffer
- * and consumed in a per-event_target-thread.
+/* File events are stored into a per-event_target ringbuffer
+ * and consumed by a module-wide pool of kthreads.
  */
 
 #pragma once
 
 #include "shournalk_global.h"
 
+#include <linux/ktime.h>
 #include <linux/mount.h>
 
 #include "event_target.h"
 #include "event_consumer.h"
 
 
-int event_queue_consume_thread(void *data);
+long event_queue_constructor(void);
+void event_queue_destructor(void);
 
-/// Threadsafe enqueue the close event and wake up
-/// the consumer. This function consumes one event_target-reference (passes
-/// it to the consumer or puts it in case of overflow)!
+void __event_queue_schedule_target(struct event_target* event_target);
+
+/// Threadsafe enqueue the close event and schedule the event_target
+/// for consumption by the pool. This function consumes one
+/// event_target-reference (passes it to the consumer or puts it
+/// in case of overflow)!
 static inline void event_queue_add(struct event_target* event_target, struct file* file){
     int head;
     int tail;
     int remaining_bytes;
+    int used_bytes;
+    bool schedule;
     struct close_event* close_ev;
     struct event_consumer* consumer = &event_target->event_consumer;
     struct circ_buf* circ_buf = &consumer->circ_buf;
@@ -52,27 +59,31 @@ static inline void event_queue_add(struct event_target* event_target, struct fil
     close_ev = (struct close_event*)&circ_buf->buf[head];
     close_ev->f_mode = file->f_mode;
     close_ev->path = file->f_path;
+    close_ev->enqueue_ns = ktime_get_ns();
 
     // write new head *after* having written content:
     head = (head + sizeof (struct close_event)) & (consumer->circ_buf_size - 1);
     smp_store_release(&circ_buf->head, head);
 
+    used_bytes = CIRC_CNT(head, tail, consumer->circ_buf_size);
+    if(used_bytes > consumer->max_used_bytes)
+        consumer->max_used_bytes = used_bytes;
+
+    // Scheduling the target is costly, so only do so, if it is
+    // not scheduled already. The consumer clears the queued-flag under
+    // queue_lock only after having drained the ringbuffer, so an event
+    // is never left unconsumed. As the event we just enqueued holds a
+    // reference and no one consumes it while not queued, it is safe
+    // to get another one for the run-list.
+    schedule = ! consumer->queued;
+    if(schedule){
+        consumer->queued = true;
+        kuref_inc(&event_target->_f_count);
+    }
     spin_unlock(&consumer->queue_lock);
 
-    // We could simply call wake_up_process all the time, but this
-    // slows down things significantly when many events occur.
-    // Therefore try to only wake the consumer up, if
-    // necessary.
-    // The consumer sets woken_up to false and
-    // afterwards checks for remaining events. Due to this race
-    // it may (rarely) happen that we wake the consumer up
-    // with nothing to do, *but* it can *never* happen
-    // that we produce something which is never consumed.
-    if(READ_ONCE(consumer->woken_up))
-        return;
-
-    smp_store_mb(consumer->woken_up, true);
-    wake_up_process(consumer->consume_task);
+    if(schedule)
+        __event_queue_schedule_target(event_target);
 
     return;
 
@@ -16,6 +16,7 @@
 #include "event_target.h"
 #include "kutil.h"
 #include "shournal_kio.h"
+#include "shournalk_debugfs.h"
 #include "shournalk_user.h"
 #include "xxhash_shournalk.h"
 
@@ -198,7 +199,13 @@ __event_target_create(struct file* target_file, struct file* pipe_w,
     t->partial_hash.max_count_of_reads = mark_struct->settings.hash_max_count_reads;
 
     mutex_init(&t->lock);
+    mutex_init(&t->file_lock);
     t->settings = mark_struct->settings;
+    t->events_v2 = mark_struct->flags & SHOURNALK_MARK_EVENTS_V2;
+    if(t->events_v2){
+        // buffered, so this does not fail yet
+        shournal_kio_write(t->file, SHOURNALK_EV2_MAGIC, SHOURNALK_EV2_MAGIC_LEN);
+    }
     kpathtree_init(&t->w_includes);
     kpathtree_init(&t->w_excludes);
     kpathtree_init(&t->r_includes);
@@ -299,11 +306,7 @@ event_target_create(const struct shournalk_mark_struct * mark_struct)
         error = PTR_ERR(event_target);
         goto err_put_unlock;
     }
-
-    // maybe_todo: add caller-pid to threadname?
-    if((error = event_consumer_thread_create(event_target, "shournalk_consumer"))){
-        goto err_put_unlock;
-    }
+    shournalk_debugfs_add_target(event_target);
 
     return event_target;
 
@@ -347,13 +350,56 @@ bool event_target_is_commited(const struct event_target* t){
 }
 
 
+/// Write all pending events to the current target file and continue
+/// writing to the one opened as target_fd. The reference of the old file is
+/// dropped, so once we return, user space may consume it completely.
+/// Directory paths are not shared across files, so the first path of
+/// each event type (or directory slot, for format version 2) written to
+/// the new file is a full one.
+long event_target_swap_file(struct event_target* t, int target_fd){
+    struct file* new_file;
+    struct file* old_file;
+    ssize_t ret;
+
+    new_file = __get_check_target_file(target_fd);
+    if(IS_ERR(new_file)){
+        return PTR_ERR(new_file);
+    }
+    mutex_lock(&t->file_lock);
+    if(unlikely(READ_ONCE(t->ERROR))){
+        ret = -EIO;
+        goto err_unlock;
+    }
+    if((ret = shournal_kio_flush(t->file)) < 0){
+        pr_debug("failed to flush target file before swap: %ld\n", (long)ret);
+        goto err_unlock;
+    }
+    old_file = t->file->__file;
+    t->file->__file = new_file;
+    memset(&t->event_consumer.w_last_written_path, 0, sizeof (struct path));
+    memset(&t->event_consumer.r_last_written_path, 0, sizeof (struct path));
+    if(t->events_v2){
+        event_consumer_reset_ev2(&t->event_consumer);
+        shournal_kio_write(t->file, SHOURNALK_EV2_MAGIC, SHOURNALK_EV2_MAGIC_LEN);
+    }
+    mutex_unlock(&t->file_lock);
+
+    fput(old_file);
+    return 0;
+
+err_unlock:
+    mutex_unlock(&t->file_lock);
+    fput(new_file);
+    return ret;
+}
+
+
 /// Final put
 void __event_target_put(struct event_target* event_target){
     long user_ret;
     int pending_bytes;
     struct event_consumer* consumer = &event_target->event_consumer;
     struct circ_buf* circ_buf = &consumer->circ_buf;
-    bool we_are_consume_thread;
 
     might_sleep();
 
@@ -363,14 +409,11 @@ void __event_target_put(struct event_target* event_target){
         dump_stack();
     }
 #endif
-    we_are_consume_thread = current == consumer->consume_task;
-    if(we_are_consume_thread){
-        event_consumer_thread_cleanup(event_target);
-    } else {
-        // stopping the consumer thread also flushes the event buffer
-        // one last time
-        event_consumer_thread_stop(consumer);
-    }
+    // Each enqueued event and the run-list of the consumer pool
+    // hold a reference, so no events are pending and no consumer
+    // works on this target any more.
+    kutil_WARN_ONCE_IFN_DBG(consumer->queued, "event target still queued");
+    shournalk_debugfs_remove_target(event_target);
 
     pr_devel("Event processing done. Caller pid: %d - init target file path %s\n",
              event_target->caller_tsk->pid, event_target->file_init_path);
@@ -404,11 +447,6 @@ void __event_target_put(struct event_target* event_target){
     } else {
         __event_target_free(event_target);
     }
-
-    if(we_are_consume_thread){
-        // we just released the final reference - that's it.
-        kutil_kthread_exit(NULL, 0);
-    }
 }
 
 
@@ -5,7 +5,11 @@
 #include "xxhash_common.h"
 
 #include <linux/atomic.h>
+#include <linux/bitops.h>
 #include <linux/limits.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/time64.h>
 
 #include "kpathtree.h"
 #include "kfileextensions.h"
@@ -18,6 +22,10 @@
 
 #define TARGET_FILE_BUFSIZE  (1 << 15)
 
+// enqueue->consume latency histogram: bucket 0 counts latencies
+// below 1us, bucket i those below 2^i us, the last one all others.
+#define EVENT_TARGET_LAT_BUCKETS 24
+
 struct cred;
 struct file;
 struct kbuffered_file;
@@ -33,6 +41,7 @@ struct event_target {
     bool w_enable; /* record write events */
     bool r_enable; /* record read events */
     bool ERROR; /* lazy-release references in case of an error */
+    bool events_v2; /* write events in format version 2 */
     uint64_t lost_event_count;
     struct task_struct* exit_tsk; /* task for which to collect the exit code */
     int exit_code; /* see exit_tsk */
@@ -63,11 +72,19 @@ struct event_target {
     struct partial_xxhash partial_hash;
 
     struct mutex lock; /* protects adding paths before committed */
+    struct mutex file_lock; /* serializes writing to file with swapping it */
 
     atomic_t _written_to_user_pipe; /* we write to user pipe only once */
     uint64_t _dircache_hits;
     uint64_t _pathwrite_hits;
 
+    /* statistics, see shournalk_debugfs.c */
+    uint64_t hash_count;  /* # of partially hashed files */
+    uint64_t hash_bytes;  /* read for hashing */
+    uint64_t hash_ns;     /* time spent hashing */
+    uint64_t queue_lat_hist[EVENT_TARGET_LAT_BUCKETS];
+    struct list_head stats_node;
+
     struct file_extensions script_ext;
     struct kpathtree w_includes;
     struct kpathtree w_excludes;
@@ -85,6 +102,7 @@ struct event_target {
 struct event_target* event_target_create(const struct shournalk_mark_struct*);
 long event_target_commit(struct event_target*);
 bool event_target_is_commited(const struct event_target*);
+long event_target_swap_file(struct event_target*, int target_fd);
 
 
 static inline __attribute__((__warn_unused_result__))
@@ -112,3 +130,12 @@ event_target_put(struct event_target* event_target){
 
 void event_target_write_result_to_user_ONCE(struct event_target*, long error_nb);
 
+/// Called by the consumer only
+static inline void
+event_target_account_queue_latency(struct event_target* t, u64 latency_ns){
+    int bucket = fls64(div_u64(latency_ns, NSEC_PER_USEC));
+    if(bucket >= EVENT_TARGET_LAT_BUCKETS)
+        bucket = EVENT_TARGET_LAT_BUCKETS - 1;
+    t->queue_lat_hist[bucket]++;
+}
+
@@ -238,6 +238,23 @@ kutil_inode_permission(struct path* path, int mask){
 #endif
 }
 
+// Identify the cgroup (v2) of a task by the inode number of its
+// directory within cgroupfs. Must be called under rcu_read_lock.
+// From 4.13 to 5.4 the inode number is part of union kernfs_node_id.
+// See commit 67c0496e87d193b8356d2af49ab95e8a1b954b3c: the kernfs
+// inode number became the lower bits of the 64 bit kernfs node id.
+#ifdef CONFIG_CGROUPS
+static inline ino_t kutil_task_dfl_cgroup_ino(struct task_struct* task){
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 13, 0))
+    return task_dfl_cgroup(task)->kn->ino;
+#elif (LINUX_VERSION_CODE < KERNEL_VERSION(5, 5, 0))
+    return task_dfl_cgroup(task)->kn->id.ino;
+#else
+    return (ino_t)cgroup_id(task_dfl_cgroup(task));
+#endif
+}
+#endif
+
 // see commit 077c212f0344a
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(6, 7, 0))
 static inline time64_t kutil_get_mtime_sec(const struct inode *inode){
@@ -256,6 +273,7 @@ static inline time64_t kutil_get_mtime_sec(const struct inode *inode){
 #define kuref_t             atomic_t
 #define kuref_sub_and_test  atomic_sub_and_test
 #define kuref_set           atomic_set
+#define kuref_inc           atomic_inc
 #define kuref_inc_not_zero  atomic_inc_not_zero
 #define kuref_dec_and_test  atomic_dec_and_test
 
@@ -264,6 +282,7 @@ static inline time64_t kutil_get_mtime_sec(const struct inode *inode){
 #define kuref_t             refcount_t
 #define kuref_sub_and_test  refcount_sub_and_test
 #define kuref_set           refcount_set
+#define kuref_inc           refcount_inc
 #define kuref_inc_not_zero  refcount_inc_not_zero
 #define kuref_dec_and_test  refcount_dec_and_test
 
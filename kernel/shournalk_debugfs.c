@@ -0,0 +1,138 @@
+/* Live statistics of all event targets, readable by root at
+ * <debugfs>/shournalk/targets, e.g. to find commands whose ringbuffer
+ * is about to overflow. The counters are read without synchronization,
+ * so they may be slightly inconsistent.
+ */
+
+#include <linux/circ_buf.h>
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+
+#include "shournalk_debugfs.h"
+#include "event_target.h"
+#include "shournal_kio.h"
+#include "kutil.h"
+
+
+static LIST_HEAD(__targets);
+static DEFINE_SPINLOCK(__targets_lock);
+static struct dentry* __debugfs_dir;
+
+
+static void __show_target(struct seq_file* m, struct event_target* t){
+    const struct event_consumer* c = &t->event_consumer;
+    const struct shounalk_settings* sets = &t->settings;
+    int i;
+
+    seq_printf(m, "target: %s\n", t->file_init_path);
+    seq_printf(m, "  caller_pid: %d\n", t->caller_tsk->pid);
+    seq_printf(m, "  committed: %d\n", event_target_is_commited(t));
+    seq_printf(m, "  error: %d\n", READ_ONCE(t->ERROR));
+    seq_printf(m, "  ring_used_bytes: %d\n",
+               CIRC_CNT(READ_ONCE(c->circ_buf.head), READ_ONCE(c->circ_buf.tail),
+                        c->circ_buf_size));
+    seq_printf(m, "  ring_max_used_bytes: %d\n", READ_ONCE(c->max_used_bytes));
+    seq_printf(m, "  ring_size: %d\n", c->circ_buf_size);
+    seq_printf(m, "  lost_events: %llu\n", READ_ONCE(t->lost_event_count));
+    seq_printf(m, "  consumed_events: %llu\n", READ_ONCE(t->consumed_event_count));
+    seq_printf(m, "  w_events: %llu/%llu\n", READ_ONCE(t->w_event_count),
+               sets->w_max_event_count);
+    seq_printf(m, "  w_dropped: %llu\n", READ_ONCE(t->w_dropped_count));
+    seq_printf(m, "  w_deleted: %llu\n", READ_ONCE(t->w_deleted_count));
+    seq_printf(m, "  w_examined: %llu\n", READ_ONCE(t->w_examined_count));
+    seq_printf(m, "  r_events: %llu/%llu\n", READ_ONCE(t->r_event_count),
+               sets->r_max_event_count);
+    seq_printf(m, "  r_dropped: %llu\n", READ_ONCE(t->r_dropped_count));
+    seq_printf(m, "  r_deleted: %llu\n", READ_ONCE(t->r_deleted_count));
+    seq_printf(m, "  r_examined: %llu\n", READ_ONCE(t->r_examined_count));
+    seq_printf(m, "  stored_files: %u/%u\n", READ_ONCE(t->stored_files_count),
+               (unsigned)sets->r_store_max_count_of_files);
+    seq_printf(m, "  dircache_hits: %llu\n", READ_ONCE(t->_dircache_hits));
+    seq_printf(m, "  pathwrite_hits: %llu\n", READ_ONCE(t->_pathwrite_hits));
+    seq_printf(m, "  hashed_files: %llu\n", READ_ONCE(t->hash_count));
+    seq_printf(m, "  hash_bytes: %llu\n", READ_ONCE(t->hash_bytes));
+    seq_printf(m, "  hash_ns: %llu\n", READ_ONCE(t->hash_ns));
+
+    seq_puts(m, "  queue_latency_us:");
+    for(i=0; i < EVENT_TARGET_LAT_BUCKETS - 1; i++){
+        seq_printf(m, " <%llu:%llu", 1ULL << i, READ_ONCE(t->queue_lat_hist[i]));
+    }
+    seq_printf(m, " >=%llu:%llu\n", 1ULL << i, READ_ONCE(t->queue_lat_hist[i]));
+}
+
+static int __targets_show(struct seq_file *m, void *v __attribute__ ((unused))){
+    struct event_target* t;
+
+    // Targets are removed on their final put, before they are freed,
+    // so holding the lock suffices.
+    spin_lock(&__targets_lock);
+    list_for_each_entry(t, &__targets, stats_node){
+        __show_target(m, t);
+    }
+    spin_unlock(&__targets_lock);
+    return 0;
+}
+
+static int __targets_open(struct inode *inode, struct file *file){
+    return single_open(file, __targets_show, inode->i_private);
+}
+
+static const struct file_operations __targets_fops = {
+    .owner = THIS_MODULE,
+    .open = __targets_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+
+/// Statistics are optional, so failing to create the debugfs
+/// entries (e.g. no CONFIG_DEBUG_FS) is not an error.
+int shournalk_debugfs_constructor(void){
+    __debugfs_dir = debugfs_create_dir("shournalk", NULL);
+    if(IS_ERR_OR_NULL(__debugfs_dir)){
+        pr_debug("failed to create debugfs directory\n");
+        __debugfs_dir = NULL;
+        return 0;
+    }
+    debugfs_create_file("targets", 0400, __debugfs_dir, NULL, &__targets_fops);
+    return 0;
+}
+
+void shournalk_debugfs_destructor(void){
+    debugfs_remove_recursive(__debugfs_dir);
+    __debugfs_dir = NULL;
+}
+
+void shournalk_debugfs_add_target(struct event_target* t){
+    spin_lock(&__targets_lock);
+    list_add_tail(&t->stats_node, &__targets);
+    spin_unlock(&__targets_lock);
+}
+
+void shournalk_debugfs_remove_target(struct event_target* t){
+    spin_lock(&__targets_lock);
+    list_del(&t->stats_node);
+    spin_unlock(&__targets_lock);
+}
+
+/// The list of statistics contains all targets, so it also serves to
+/// find the target currently writing to target_file.
+/// @return the target with an additional reference or NULL.
+struct event_target* shournalk_debugfs_find_get_target(const struct file* target_file){
+    struct event_target* t;
+    struct event_target* found = NULL;
+
+    spin_lock(&__targets_lock);
+    list_for_each_entry(t, &__targets, stats_node){
+        if(READ_ONCE(t->file->__file) == target_file){
+            found = event_target_get(t);
+            break;
+        }
+    }
+    spin_unlock(&__targets_lock);
+    return found;
+}
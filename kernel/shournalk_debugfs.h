@@ -0,0 +1,14 @@
+
+#pragma once
+#include "shournalk_global.h"
+
+struct event_target;
+struct file;
+
+int shournalk_debugfs_constructor(void);
+
+void shournalk_debugfs_destructor(void);
+
+void shournalk_debugfs_add_target(struct event_target*);
+void shournalk_debugfs_remove_target(struct event_target*);
+struct event_target* shournalk_debugfs_find_get_target(const struct file*);
@@ -15,6 +15,7 @@ MODULE_VERSION(SHOURNAL_VERSION);
 #include "event_handler.h"
 #include "event_handler.h"
 #include "shournalk_sysfs.h"
+#include "shournalk_debugfs.h"
 #include "tracepoint_helper.h"
 #include "event_queue.h"
 #include "kutil.h"
@@ -34,13 +35,19 @@ static int __init shournalk_init(void)
         return ret;
     }
     if((ret = event_handler_constructor()) != 0)      goto error1;
-    if ((ret = tracepoint_helper_constructor()) != 0) goto error2;
-    if((ret = shournalk_sysfs_constructor()) != 0)    goto error3;
+    if((ret = (int)event_queue_constructor()) != 0)   goto error2;
+    if((ret = shournalk_debugfs_constructor()) != 0)  goto error3;
+    if ((ret = tracepoint_helper_constructor()) != 0) goto error4;
+    if((ret = shournalk_sysfs_constructor()) != 0)    goto error5;
 
     return 0;
 
-error3:
+error5:
     tracepoint_helper_destructor();
+error4:
+    shournalk_debugfs_destructor();
+error3:
+    event_queue_destructor();
 error2:
     event_handler_destructor();
 error1:
@@ -53,6 +60,9 @@ static void __exit shournalk_exit(void)
     // Be very careful about the order here.
     shournalk_sysfs_destructor();    
     tracepoint_helper_destructor();
+    shournalk_debugfs_destructor();
+    // consume pending events, before the event targets are released
+    event_queue_destructor();
     event_handler_destructor();
     shournalk_global_destructor();
 }
@@ -1,18 +1,22 @@
 
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/cred.h>
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/fdtable.h>
+#include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/delay.h>
+#include <linux/magic.h>
 
 #include "shournalk_sysfs.h"
 #include "shournalk_user.h"
 #include "event_handler.h"
 #include "event_target.h"
 #include "kutil.h"
+#include "shournalk_debugfs.h"
 
 // Use «default attribute groups». Kernel v5.1-rc3,
 // aa30f47cf666111f6bbfd15f290a27e8a7b9d854 added default attribute groups
@@ -79,13 +83,23 @@ static ssize_t __show_version(struct shournal_obj *o __attribute__ ((unused)),
     return sprintf(buf, SHOURNAL_VERSION);
 }
 
+static ssize_t __show_mark_prog_version(struct shournal_obj *o __attribute__ ((unused)),
+                                        struct shournal_attr* attr __attribute__ ((unused)),
+                                        char *buf)
+{
+    return sprintf(buf, "%d", SHOURNALK_MARK_PROG_VERSION);
+}
+
 static struct shournal_attr attr_mark = __ATTR(mark, 0664, NULL, __mark);
 static struct shournal_attr attr_version = __ATTR(version, 0444, __show_version, NULL);
+static struct shournal_attr attr_mark_prog_version =
+        __ATTR(mark_program_version, 0444, __show_mark_prog_version, NULL);
 
 
 static struct attribute *shournal_default_attrs[] = {
     &attr_mark.attr,
     &attr_version.attr,
+    &attr_mark_prog_version.attr,
     NULL,
 };
 #ifdef SHOURNALK_USE_ATTR_GROUPS
@@ -187,39 +201,60 @@ static long verify_hash_settings(struct shournalk_mark_struct * mark_struct){
     return 0;
 }
 
-static long __handle_pid_add(struct shournalk_mark_struct* mark_struct){
-    pid_t pid = (pid_t)mark_struct->pid;
+static long __load_mark_program(struct event_target* t, const void* __user src);
+
+/// Verify the settings and create the event target. In case of a mark
+/// program, it is loaded and the target committed.
+static struct event_target*
+__create_event_target(struct shournalk_mark_struct* mark_struct){
     struct event_target* event_target;
     // somewhat arbitrary limits
     const int STORE_MAX_SIZE = 1024*1024 * 2;
     const int STORE_MAX_FILECOUNT = 100;
     long ret;
-    bool collect_exitcode = mark_struct->flags & SHOURNALK_MARK_COLLECT_EXITCODE;
 
     if((ret = verify_hash_settings(mark_struct))){
-        return ret;
+        return ERR_PTR(ret);
     }
     if(mark_struct->settings.r_store_max_size > STORE_MAX_SIZE){
         pr_debug("r_store_max_size > %d\n", STORE_MAX_SIZE);
-        return -EINVAL;
+        return ERR_PTR(-EINVAL);
     }
     if(mark_struct->settings.r_store_max_count_of_files > STORE_MAX_FILECOUNT){
         pr_debug("r_store_max_count_of_files > %d\n", STORE_MAX_FILECOUNT);
-        return -EINVAL;
+        return ERR_PTR(-EINVAL);
     }
 
     if(mark_struct->settings.w_max_event_count == 0 ||
             mark_struct->settings.r_max_event_count == 0){
         pr_debug("max_event_count(s) must not be zero\n");
-        return -EINVAL;
+        return ERR_PTR(-EINVAL);
     }
 
     event_target = event_target_create(mark_struct);
+    if(IS_ERR(event_target)){
+        return event_target;
+    }
+    if((mark_struct->action == SHOURNALK_MARK_PID_PROGRAM ||
+        mark_struct->action == SHOURNALK_MARK_CGROUP) &&
+            (ret = __load_mark_program(event_target, mark_struct->data))){
+        event_target_put(event_target);
+        return ERR_PTR(ret);
+    }
+    return event_target;
+}
+
+static long __handle_pid_add(struct shournalk_mark_struct* mark_struct){
+    pid_t pid = (pid_t)mark_struct->pid;
+    struct event_target* event_target;
+    long ret;
+    bool collect_exitcode = mark_struct->flags & SHOURNALK_MARK_COLLECT_EXITCODE;
+
+    event_target = __create_event_target(mark_struct);
     if(IS_ERR(event_target)){
         return PTR_ERR(event_target);
     }
     ret = event_handler_add_pid(event_target, pid, collect_exitcode);
-
     event_target_put(event_target);
     return ret;
 }
@@ -230,6 +265,87 @@ static long __handle_pid_remove(const struct shournalk_mark_struct * mark_struct
     return event_handler_remove_pid(pid);
 }
 
+/// Resolve the cgroup directory opened as fd to its inode number. Like
+/// for managing a (delegated) cgroup, write access to the directory
+/// is required.
+static long __cgroup_ino_from_fd(int fd, ino_t* cgrp_ino){
+    struct file* file;
+    struct inode* inode;
+    long ret = 0;
+
+    file = fget(fd);
+    if(! file){
+        return -EBADF;
+    }
+    inode = file_inode(file);
+    if(inode->i_sb->s_magic != CGROUP2_SUPER_MAGIC || ! S_ISDIR(inode->i_mode)){
+        pr_debug("fd %d is not a cgroup2 directory\n", fd);
+        ret = -ENOTDIR;
+        goto out;
+    }
+    if((ret = kutil_inode_permission(&file->f_path, MAY_WRITE))){
+        goto out;
+    }
+    *cgrp_ino = inode->i_ino;
+
+out:
+    fput(file);
+    return ret;
+}
+
+static long __handle_cgroup_add(struct shournalk_mark_struct* mark_struct){
+    struct event_target* event_target;
+    ino_t cgrp_ino;
+    long ret;
+
+    if((ret = __cgroup_ino_from_fd((int)mark_struct->pid, &cgrp_ino))){
+        return ret;
+    }
+    event_target = __create_event_target(mark_struct);
+    if(IS_ERR(event_target)){
+        return PTR_ERR(event_target);
+    }
+    ret = event_handler_add_cgroup(event_target, cgrp_ino);
+    event_target_put(event_target);
+    return ret;
+}
+
+static long __handle_cgroup_remove(const struct shournalk_mark_struct * mark_struct){
+    ino_t cgrp_ino;
+    long ret;
+
+    if((ret = __cgroup_ino_from_fd((int)mark_struct->pid, &cgrp_ino))){
+        return ret;
+    }
+    return event_handler_remove_cgroup(cgrp_ino);
+}
+
+static long __handle_swap_target(const struct shournalk_mark_struct * mark_struct){
+    struct event_target* event_target;
+    struct file* target_file;
+    long ret;
+
+    target_file = fget(mark_struct->target_fd);
+    if(! target_file){
+        return -EBADF;
+    }
+    event_target = shournalk_debugfs_find_get_target(target_file);
+    fput(target_file);
+    if(! event_target){
+        pr_debug("no event target writes to fd %d\n", mark_struct->target_fd);
+        return -ESRCH;
+    }
+    if(! uid_eq(event_target->cred->euid, current_euid())){
+        ret = -EPERM;
+        goto out_put;
+    }
+    ret = event_target_swap_file(event_target, (int)mark_struct->pid);
+
+out_put:
+    event_target_put(event_target);
+    return ret;
+}
+
 /// @return length of passed string or neg. error
 static ssize_t __copy_path_from_user(char* buf, const char* __user src){
    long str_len = strncpy_from_user(buf, src, PATH_MAX);
@@ -301,13 +417,146 @@ out:
     return ret;
 }
 
+/// Add a path of a mark program (already copied from user space)
+static long __add_prog_path(struct kpathtree* pathtree, const char* path, size_t len){
+    if(unlikely(len == 0 || len >= PATH_MAX || path[0] != '/')){
+        pr_debug("invalid path in mark program\n");
+        return -EINVAL;
+    }
+    return kpathtree_add(pathtree, path, (int)len);
+}
+
+/// Add all null-terminated strings of a mark program section.
+/// The last string must be terminated.
+static long __add_prog_section(struct event_target* t, int action,
+                               const char* strs, size_t strs_len){
+    const char* end = strs + strs_len;
+    size_t len;
+    long ret;
+
+    for(; strs < end; strs += len + 1){
+        len = strlen(strs);
+        switch (action) {
+        case SHOURNALK_MARK_W_INCL:
+            ret = __add_prog_path(&t->w_includes, strs, len); break;
+        case SHOURNALK_MARK_W_EXCL:
+            ret = __add_prog_path(&t->w_excludes, strs, len); break;
+        case SHOURNALK_MARK_R_INCL:
+            ret = __add_prog_path(&t->r_includes, strs, len); break;
+        case SHOURNALK_MARK_R_EXCL:
+            ret = __add_prog_path(&t->r_excludes, strs, len); break;
+        case SHOURNALK_MARK_SCRIPT_INCL:
+            ret = __add_prog_path(&t->script_includes, strs, len); break;
+        case SHOURNALK_MARK_SCRIPT_EXCL:
+            ret = __add_prog_path(&t->script_excludes, strs, len); break;
+        case SHOURNALK_MARK_ALL_EXCL:
+            if((ret = __add_prog_path(&t->w_excludes, strs, len)) ||
+               (ret = __add_prog_path(&t->r_excludes, strs, len)))
+                break;
+            ret = __add_prog_path(&t->script_excludes, strs, len); break;
+        case SHOURNALK_MARK_SCRIPT_EXTS:
+            // shortest possible extension including trailing / is e.g. o/
+            ret = (len < 2) ? -EINVAL
+                            : file_extensions_add_multiple(&t->script_ext, strs, len);
+            break;
+        default:
+            pr_debug("invalid action %d in mark program\n", action);
+            ret = -EINVAL;
+        }
+        if(ret)
+            return ret;
+    }
+    return 0;
+}
+
+/// Copy the mark program from user space, add all of its paths and
+/// extensions to the not yet committed event target and commit it.
+static long __load_mark_program(struct event_target* t, const void* __user src){
+    struct shournalk_mark_prog_header header;
+    struct shournalk_mark_prog_section section;
+    char* prog;
+    uint32_t prog_size;
+    size_t pos;
+    uint32_t i;
+    long ret;
+
+    if(copy_from_user(&header, src, sizeof (header))){
+        return -EFAULT;
+    }
+    if(header.version != SHOURNALK_MARK_PROG_VERSION){
+        pr_debug("unsupported mark program version %u\n", header.version);
+        return -EPROTO;
+    }
+    if(header.size < sizeof (header) || header.size > SHOURNALK_MARK_PROG_MAX_SIZE){
+        pr_debug("invalid mark program size %u\n", header.size);
+        return -EINVAL;
+    }
+    prog_size = header.size;
+    prog = kvmalloc(prog_size, SHOURNALK_GFP);
+    if(! prog)
+        return -ENOMEM;
+
+    // Only use the copied program and the validated size from here on,
+    // user space might have changed the header meanwhile.
+    if(copy_from_user(prog, src, prog_size)){
+        ret = -EFAULT;
+        goto out_free;
+    }
+    memcpy(&header, prog, sizeof (header));
+    if(header.size != prog_size || header.version != SHOURNALK_MARK_PROG_VERSION){
+        pr_debug("mark program header changed while copying\n");
+        ret = -EINVAL;
+        goto out_free;
+    }
+
+    mutex_lock(&t->lock);
+    pos = sizeof (header);
+    for(i=0; i < header.n_sections; i++){
+        if(prog_size - pos < sizeof (section)){
+            ret = -EINVAL;
+            goto out_unlock;
+        }
+        memcpy(&section, prog + pos, sizeof (section));
+        pos += sizeof (section);
+        if(section.len == 0 || section.len > prog_size - pos ||
+                prog[pos + section.len - 1] != '\0'){
+            pr_debug("invalid section %u in mark program\n", i);
+            ret = -EINVAL;
+            goto out_unlock;
+        }
+        if((ret = __add_prog_section(t, section.action, prog + pos, section.len))){
+            goto out_unlock;
+        }
+        pos += section.len;
+    }
+    if(pos != prog_size){
+        pr_debug("trailing bytes in mark program\n");
+        ret = -EINVAL;
+        goto out_unlock;
+    }
+    ret = event_target_commit(t);
+
+out_unlock:
+    mutex_unlock(&t->lock);
+out_free:
+    kvfree(prog);
+    return ret;
+}
+
 
 static long __handle_mark_add(struct shournalk_mark_struct mark_struct){
     long ret = -EINVAL;
     struct event_target* t;
-    if(mark_struct.action == SHOURNALK_MARK_PID){
+    if(mark_struct.action == SHOURNALK_MARK_PID ||
+            mark_struct.action == SHOURNALK_MARK_PID_PROGRAM){
         return __handle_pid_add(&mark_struct);
     }
+    if(mark_struct.action == SHOURNALK_MARK_CGROUP){
+        return __handle_cgroup_add(&mark_struct);
+    }
+    if(mark_struct.action == SHOURNALK_SWAP_TARGET){
+        return __handle_swap_target(&mark_struct);
+    }
 
     // for all other add-actions an existing event target is required
     t = get_event_target_from_pid((pid_t)mark_struct.pid);
@@ -356,6 +605,8 @@ static long __handle_mark_remove(struct shournalk_mark_struct mark_struct){
     switch (mark_struct.action) {
     case SHOURNALK_MARK_PID:
         ret = __handle_pid_remove(&mark_struct); break;
+    case SHOURNALK_MARK_CGROUP:
+        ret = __handle_cgroup_remove(&mark_struct); break;
     default:
         ret = -EINVAL;
     }
@@ -36,6 +36,12 @@ extern "C" {
    SHOURNALK_INVALID_EXIT_CODE */
 #define SHOURNALK_MARK_COLLECT_EXITCODE 0x00000008
 
+/* If this flag is set when creating an event target (MARK_PID,
+   PID_PROGRAM, CGROUP), the close events are written in format
+   version 2 (see below). Older kernel modules ignore it and write
+   version 1, so readers must check the magic. */
+#define SHOURNALK_MARK_EVENTS_V2        0x00000010
+
 
 /* actions */
 #define SHOURNALK_MARK_PID          100
@@ -50,6 +56,51 @@ extern "C" {
 #define SHOURNALK_MARK_W_INCL       130
 #define SHOURNALK_MARK_W_EXCL       131
 
+/* Like MARK_PID, but data points to a mark program (see below), whose
+ * paths and extensions are added before the target is committed. */
+#define SHOURNALK_MARK_PID_PROGRAM  140
+
+/* Only valid as section of a mark program: exclude paths for W, R and SCRIPT */
+#define SHOURNALK_MARK_ALL_EXCL     150
+
+/* Observe all processes within a cgroup (v2), instead of a process tree.
+ * Here pid is the file descriptor of the opened cgroup directory, which
+ * the caller must be allowed to write to. On ADD, data points to a mark
+ * program like with PID_PROGRAM. The observation ends, when the cgroup
+ * is removed (REMOVE) with a descriptor of the same directory or the
+ * process which created the event target exits. */
+#define SHOURNALK_MARK_CGROUP       160
+
+/* Write all pending events of the target, which currently writes to
+ * target_fd, and continue writing to the regular file whose descriptor is
+ * passed as pid. Afterwards the old file is complete, so user space may
+ * consume it, e.g. to checkpoint long observations. Directory paths are
+ * not shared across files. Only valid with flags ADD. */
+#define SHOURNALK_SWAP_TARGET       170
+
+
+/* A mark program holds all paths and extensions of an event target in
+ * a single buffer, so a target is created, filled and committed with
+ * one write. It starts with struct shournalk_mark_prog_header, followed
+ * by n_sections sections. Each section consists of a (possibly unaligned)
+ * struct shournalk_mark_prog_section followed by len bytes of
+ * null-terminated strings: absolute paths for the include- and exclude-actions
+ * or slash-terminated extensions (e.g. sh/py/) for SCRIPT_EXTS.
+ * The supported version is readable from sysfs (mark_program_version). */
+#define SHOURNALK_MARK_PROG_VERSION     1
+#define SHOURNALK_MARK_PROG_MAX_SIZE    (1 << 22)
+
+struct shournalk_mark_prog_header {
+    uint32_t version; /* SHOURNALK_MARK_PROG_VERSION */
+    uint32_t size;    /* of the whole program including this header */
+    uint32_t n_sections;
+};
+
+struct shournalk_mark_prog_section {
+    int32_t action; /* one of SHOURNALK_MARK_*_INCL, *_EXCL, SCRIPT_EXTS */
+    uint32_t len;   /* size of the following strings */
+};
+
 
 struct shounalk_settings {
     bool w_exclude_hidden;
@@ -75,7 +126,7 @@ struct shournalk_mark_struct {
     int pipe_fd; /* stats are written here after event processing finished */
     int target_fd; /* close events are written to this binary file */
     int flags; /* ADD, REMOVE, COMMIT */
-    int action; /* PID, SCRIPT_INCL/EXCL */
+    int action; /* PID, PID_PROGRAM, SCRIPT_INCL/EXCL */
     uint64_t pid;
 
     struct shounalk_settings settings;
@@ -101,6 +152,71 @@ struct shournalk_close_event {
 };
 
 
+/* Version 2 of the event file format. It starts with the 8 bytes
+ * SHOURNALK_EV2_MAGIC (a version 1 file starts with the flags of
+ * its first event, which are 0, 1 or 2). Each record consists of
+ * - varint tag: the event flags (O_RDONLY, O_WRONLY, O_RDWR) in the lower
+ *   two bits, ORed with SHOURNALK_EV2_HAS_* and the directory slot
+ *   shifted by SHOURNALK_EV2_SLOT_SHIFT
+ * - varint zigzag-encoded difference of mtime to the previous record
+ * - varint size, varint mode
+ * - if HAS_HASH: 8 bytes hash (little endian)
+ * - if NEW_DIR: the null-terminated directory path (without trailing
+ *   slash), which the directory slot refers to from now on. Otherwise the
+ *   slot refers to the directory of a previous record.
+ * - the null-terminated filename
+ * - if HAS_CONTENT: 8 bytes content size (little endian), followed
+ *   by that many bytes of the file content.
+ * Varints are unsigned LEB128. The writer chooses the slots, the
+ * reader only needs to remember the last directory of each one. */
+#define SHOURNALK_EV2_MAGIC         "SHRNEV2\n"
+#define SHOURNALK_EV2_MAGIC_LEN     8
+#define SHOURNALK_EV2_FLAGS_MASK    0x03
+#define SHOURNALK_EV2_HAS_HASH      0x04
+#define SHOURNALK_EV2_HAS_CONTENT   0x08
+#define SHOURNALK_EV2_NEW_DIR       0x10
+#define SHOURNALK_EV2_SLOT_SHIFT    5
+#define SHOURNALK_EV2_DIR_SLOTS     64
+#define SHOURNALK_EV2_VARINT_MAX    10
+/* tag, mtime, size, mode and hash */
+#define SHOURNALK_EV2_HEAD_MAX      (4*SHOURNALK_EV2_VARINT_MAX + 8)
+
+/// @return the number of bytes written to buf
+static inline unsigned shournalk_ev2_put_varint(unsigned char* buf, uint64_t val){
+    unsigned len = 0;
+    while(val >= 0x80){
+        buf[len++] = (unsigned char)(val | 0x80);
+        val >>= 7;
+    }
+    buf[len++] = (unsigned char)val;
+    return len;
+}
+
+static inline void shournalk_ev2_put_u64(unsigned char* buf, uint64_t val){
+    unsigned i;
+    for(i=0; i < 8; i++){
+        buf[i] = (unsigned char)(val >> (8*i));
+    }
+}
+
+static inline uint64_t shournalk_ev2_get_u64(const unsigned char* buf){
+    uint64_t val = 0;
+    unsigned i;
+    for(i=0; i < 8; i++){
+        val |= (uint64_t)buf[i] << (8*i);
+    }
+    return val;
+}
+
+static inline uint64_t shournalk_ev2_zigzag(int64_t val){
+    return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+static inline int64_t shournalk_ev2_unzigzag(uint64_t val){
+    return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+
 /// When the observation finishes, this struct is written to
 /// a pipe (created in user space) belonging to the notification
 /// group
@@ -1,5 +1,7 @@
 
 #include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
 
 #include "cefd.h"
 #include "os.h"
@@ -7,9 +9,10 @@
 #include "osutil.h"
 
 
-CEfd::CEfd()
+/// @param flags additional eventfd-flags, e.g. EFD_NONBLOCK
+CEfd::CEfd(int flags)
 {
-    m_fd = eventfd(0, EFD_CLOEXEC);
+    m_fd = eventfd(0, EFD_CLOEXEC | flags);
     if (m_fd == -1){
         throw os::ExcOs("eventfd failed");
     }
@@ -35,6 +38,33 @@ uint64_t CEfd::recvMsg()
     return n;
 }
 
+/// Read without blocking (the eventfd must have been created
+/// with EFD_NONBLOCK).
+/// @return false, if no message is available
+bool CEfd::tryRecvMsg(uint64_t *n)
+{
+    if(::read(m_fd, n, sizeof(*n)) == sizeof(*n)){
+        return true;
+    }
+    if(errno == EAGAIN){
+        return false;
+    }
+    throw os::ExcOs("cefd: read failed");
+}
+
+int CEfd::fd() const
+{
+    return m_fd;
+}
+
+/// Take ownership of the passed eventfd, e.g. one which was
+/// inherited from another process.
+void CEfd::adoptFd(int fd)
+{
+    teardown();
+    m_fd = fd;
+}
+
 void CEfd::teardown()
 {
     if(m_fd != -1){
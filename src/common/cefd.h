@@ -10,12 +10,15 @@ public:
     static const uint64_t MSG_OK {7};
     static const uint64_t MSG_FAIL {8};
 
-    CEfd();
+    explicit CEfd(int flags=0);
     ~CEfd();
 
     void sendMsg(uint64_t n);
     uint64_t recvMsg();
+    bool tryRecvMsg(uint64_t* n);
 
+    int fd() const;
+    void adoptFd(int fd);
     void teardown();
 
 
@@ -9,15 +9,18 @@
 
 
 CXXHash::CXXHash() :
-    m_pXXState(XXH64_createState())
+    m_pXXState(XXH64_createState()),
+    m_pXX3State(XXH3_createState())
 {
     assert(m_pXXState != nullptr);
+    assert(m_pXX3State != nullptr);
     m_buf.resize(sysconf(_SC_PAGESIZE));
 }
 
 CXXHash::~CXXHash()
 {
     XXH64_freeState(m_pXXState);
+    XXH3_freeState(m_pXX3State);
 }
 
 void CXXHash::resizeBuf(size_t n)
@@ -44,16 +47,21 @@ void CXXHash::update(const void *buffer, size_t len)
     }
 }
 
-struct partial_xxhash_result CXXHash::digestWholeFile(int fd, int chunksize)
+struct partial_xxhash_result CXXHash::digestWholeFile(int fd, int chunksize,
+                                                      partial_xxhash_algorithm algorithm)
 {
-    return this->digestFile(fd, chunksize, 0, std::numeric_limits<int>::max());
+    return this->digestFile(fd, chunksize, 0, std::numeric_limits<int>::max(),
+                            algorithm);
 }
 
 partial_xxhash_result CXXHash::digestFile(int fd, int chunksize,
-                                off64_t seekstep, int maxCountOfReads)
+                                off64_t seekstep, int maxCountOfReads,
+                                partial_xxhash_algorithm algorithm)
 {
     struct partial_xxhash part_hash;
     part_hash.xxh_state = m_pXXState;
+    part_hash.xxh3_state = m_pXX3State;
+    part_hash.algorithm = algorithm;
     part_hash.chunksize = chunksize;
     part_hash.seekstep = seekstep;
     part_hash.max_count_of_reads = maxCountOfReads;
@@ -35,9 +35,11 @@ public:
 
     void resizeBuf(size_t n);
 
-    struct partial_xxhash_result digestWholeFile(int fd, int chunksize);
+    struct partial_xxhash_result digestWholeFile(int fd, int chunksize,
+                            partial_xxhash_algorithm algorithm=PARTIAL_XXHASH_XXH64);
     struct partial_xxhash_result digestFile(int fd, int chunksize, off64_t seekstep,
-                            int maxCountOfReads=std::numeric_limits<int>::max());
+                            int maxCountOfReads=std::numeric_limits<int>::max(),
+                            partial_xxhash_algorithm algorithm=PARTIAL_XXHASH_XXH64);
 
 public:
     CXXHash(const CXXHash&) = delete;
@@ -48,6 +50,7 @@ private:
     void update(const void* buffer, size_t len);
 
     XXH64_state_t * const m_pXXState;
+    XXH3_state_t * const m_pXX3State;
     StrLight m_buf;
 };
 
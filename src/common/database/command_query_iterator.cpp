@@ -5,6 +5,8 @@
 #include "db_connection.h"
 #include "db_conversions.h"
 #include "db_controller.h"
+#include "logger.h"
+#include "db_archive.h"
 
 
 ///  @param reverseIter: if true, instead of calling next(), previous() will be called
@@ -16,13 +18,33 @@ CommandQueryIterator::CommandQueryIterator(std::shared_ptr<QSqlQueryThrow>& quer
 {
 }
 
+/// Iterate over already known commands, e.g. from the QueryResultCache.
+CommandQueryIterator::CommandQueryIterator(CommandInfos cachedCmds) :
+    m_reverseIter(false),
+    m_cachedCmds(std::move(cachedCmds))
+{}
+
 // set cursor to next or previous, if reverseIter was set on constructor
 bool CommandQueryIterator::next()
 {
     m_cmd.clear();
+    if(m_cmdQuery == nullptr){
+        if(m_cachedIdx + 1 >= m_cachedCmds.size()){
+            return false;
+        }
+        m_cmd = std::move(m_cachedCmds[++m_cachedIdx]);
+        return true;
+    }
     const bool nextRet = (m_reverseIter) ? m_cmdQuery->previous() : m_cmdQuery->next();
     if(nextRet){
         fillCommand();
+        if(m_recorder){
+            recordCommand();
+        }
+    } else if(m_recorder){
+        m_recorder(m_recordedCmds);
+        m_recorder = nullptr;
+        m_recordedCmds.clear();
     }
     return nextRet;
 }
@@ -34,9 +56,29 @@ CommandInfo &CommandQueryIterator::value()
 
 int CommandQueryIterator::computeSize()
 {
+    if(m_cmdQuery == nullptr){
+        return m_cachedCmds.size();
+    }
     return m_cmdQuery->computeSize();
 }
 
+/// Once the last command was iterated, pass all commands to recorder.
+/// Recording is abandoned, if the commands have more than maxFileInfos
+/// read and written files in total.
+void CommandQueryIterator::setResultRecorder(const ResultRecorder &recorder,
+                                             int maxFileInfos)
+{
+    m_recorder = recorder;
+    m_maxRecordedFileInfos = maxFileInfos;
+}
+
+/// Keep the archive attached as long as this iterator lives
+void CommandQueryIterator::setArchiveScope(
+        const std::shared_ptr<db_archive::ArchiveScope> &scope)
+{
+    m_archiveScope = scope;
+}
+
 
 
 void CommandQueryIterator::fillCommand()
@@ -56,8 +98,10 @@ void CommandQueryIterator::fillCommand()
     if(! hashChunksize.isNull()){
         qVariantTo_throw(hashChunksize, &m_cmd.hashMeta.chunkSize) ;
         qVariantTo_throw(m_cmdQuery->value(i++), &m_cmd.hashMeta.maxCountOfReads);
+        m_cmd.hashMeta.algorithm = HashMeta::Algorithm(
+                    qVariantTo_throw<int>(m_cmdQuery->value(i++)));
     } else {
-        i++;
+        i += 2;
     }
     m_cmd.username = m_cmdQuery->value(i++).toString();
     m_cmd.hostname = m_cmdQuery->value(i++).toString();
@@ -89,5 +133,14 @@ void CommandQueryIterator::fillWrittenFiles()
     }
 }
 
-
-
+void CommandQueryIterator::recordCommand()
+{
+    m_recordedFileInfoCount += m_cmd.fileWriteInfos.size() + m_cmd.fileReadInfos.size();
+    if(m_recordedFileInfoCount > m_maxRecordedFileInfos){
+        logDebug << "query result too large to be recorded";
+        m_recorder = nullptr;
+        m_recordedCmds.clear();
+        return;
+    }
+    m_recordedCmds.push_back(m_cmd);
+}
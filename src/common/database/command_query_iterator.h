@@ -1,15 +1,24 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 
 #include "qsqlquerythrow.h"
 #include "commandinfo.h"
 #include "db_connection.h"
 
+namespace db_archive {
+class ArchiveScope;
+}
+
 class CommandQueryIterator
 {
 public:
+    typedef QVector<CommandInfo> CommandInfos;
+    typedef std::function<void(const CommandInfos&)> ResultRecorder;
+
     CommandQueryIterator(std::shared_ptr<QSqlQueryThrow> &query, bool reverseIter);
+    explicit CommandQueryIterator(CommandInfos cachedCmds);
 
     bool next();
 
@@ -17,6 +26,9 @@ public:
 
     int computeSize();
 
+    void setResultRecorder(const ResultRecorder& recorder, int maxFileInfos);
+    void setArchiveScope(const std::shared_ptr<db_archive::ArchiveScope>& scope);
+
 public:
     CommandQueryIterator(const CommandQueryIterator &) = delete ;
     void operator=(const CommandQueryIterator &) = delete ;
@@ -25,10 +37,22 @@ private:
 
     void fillCommand();
     void fillWrittenFiles();
+    void recordCommand();
 
+    // declared first, so the queries are destroyed before it
+    std::shared_ptr<db_archive::ArchiveScope> m_archiveScope;
     std::shared_ptr<QSqlQueryThrow> m_cmdQuery;
     QueryPtr m_tmpQuery;
     CommandInfo m_cmd;
     bool m_reverseIter;
+
+    // iterate over these instead of m_cmdQuery, if the latter is null
+    CommandInfos m_cachedCmds;
+    int m_cachedIdx{-1};
+
+    ResultRecorder m_recorder;
+    CommandInfos m_recordedCmds;
+    int m_recordedFileInfoCount{0};
+    int m_maxRecordedFileInfos{0};
 };
 
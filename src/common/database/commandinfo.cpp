@@ -4,11 +4,13 @@
 #include <QJsonArray>
 
 #include "commandinfo.h"
+#include "file_status_cache.h"
 
 #include "os.h"
 #include "settings.h"
 #include "db_globals.h"
 #include "conversions.h"
+#include "json_stream_writer.h"
 
 /// Settings must be loaded beforehand!
 /// Fill commandInfo with those information independent from the current
@@ -41,6 +43,14 @@ CommandInfo::CommandInfo()
       returnVal(INVALID_RETURN_VAL)
 {}
 
+QString CommandInfo::fileStatus(const FileInfo &info, const CmdJsonWriteCfg &writeCfg) const
+{
+    if(writeCfg.fileStatusCache != nullptr){
+        return writeCfg.fileStatusCache->status(info, hashMeta);
+    }
+    return info.currentStatus(*this);
+}
+
 void CommandInfo::write(QJsonObject &json, bool withMilliseconds,
                         const CmdJsonWriteCfg &writeCfg) const
 {
@@ -51,12 +61,15 @@ void CommandInfo::write(QJsonObject &json, bool withMilliseconds,
     if(writeCfg.hostname) json["hostname"] = hostname;
 
     if(writeCfg.hashMeta) {
+        QJsonValue hashAlgorithm;
         QJsonValue hashChunkSize;
         QJsonValue hashMaxCountOfReads;
         if(! hashMeta.isNull()){
+            hashAlgorithm = hashMeta.algorithmName();
             hashChunkSize = hashMeta.chunkSize;
             hashMaxCountOfReads = hashMeta.maxCountOfReads;
         }
+        json["hashAlgorithm"] = hashAlgorithm;
         json["hashChunkSize"] = hashChunkSize;
         json["hashMaxCountOfReads"] = hashMaxCountOfReads;
     }
@@ -88,7 +101,7 @@ void CommandInfo::write(QJsonObject &json, bool withMilliseconds,
 
             QJsonObject fReadObj;
             info.write(fReadObj);
-            fReadObj["status"] = (writeCfg.fileStatus) ? info.currentStatus(*this) : "NA";
+            fReadObj["status"] = (writeCfg.fileStatus) ? fileStatus(info, writeCfg) : "NA";
             fReadArr.append(fReadObj);
             ++idx;
             if(idx >= writeCfg.maxCountRFiles){
@@ -104,7 +117,7 @@ void CommandInfo::write(QJsonObject &json, bool withMilliseconds,
         for(const auto& info : fileWriteInfos){
             QJsonObject fWObject;
             info.write(fWObject);
-            fWObject["status"] = (writeCfg.fileStatus) ? info.currentStatus(*this) : "NA";
+            fWObject["status"] = (writeCfg.fileStatus) ? fileStatus(info, writeCfg) : "NA";
             fWriteArr.append(fWObject);
             ++idx;
             if(idx >= writeCfg.maxCountWFiles){
@@ -116,6 +129,88 @@ void CommandInfo::write(QJsonObject &json, bool withMilliseconds,
 
 }
 
+/// Streaming variant of write(QJsonObject&...) which produces the same
+/// output as QJsonDocument would, without building a QJsonObject.
+/// Keys are written in ascending order, as QJsonObject sorts them.
+void CommandInfo::write(JsonStreamWriter &w, bool withMilliseconds,
+                        const CmdJsonWriteCfg &writeCfg) const
+{
+    auto writeTime = [&w, withMilliseconds](const QDateTime& t){
+        if(withMilliseconds){
+            w.writeString(t.toString(Conversions::dateIsoFormatWithMilliseconds()));
+        } else {
+            w.writeVariant(t);
+        }
+    };
+    auto writeStatus = [this, &w, &writeCfg](const FileInfo& info){
+        w.key("status");
+        w.writeString((writeCfg.fileStatus) ? fileStatus(info, writeCfg) : "NA");
+    };
+
+    w.beginObject();
+    if(writeCfg.text) { w.key("command"); w.writeString(text); }
+    if(writeCfg.startEndTime) { w.key("endTime"); writeTime(endTime); }
+
+    if(writeCfg.fileReadInfos){
+        w.key("fileReadEvents");
+        w.beginArray();
+        int idx = 0;
+        for(const auto& info : fileReadInfos){
+            w.beginObject();
+            info.write(w);
+            writeStatus(info);
+            w.endObject();
+            w.flushIfNeeded();
+            ++idx;
+            if(idx >= writeCfg.maxCountRFiles){
+                break;
+            }
+        }
+        w.endArray();
+    }
+    if(writeCfg.fileWriteInfos){
+        w.key("fileWriteEvents");
+        w.beginArray();
+        int idx = 0;
+        for(const auto& info : fileWriteInfos){
+            w.beginObject();
+            info.write(w);
+            writeStatus(info);
+            w.endObject();
+            w.flushIfNeeded();
+            ++idx;
+            if(idx >= writeCfg.maxCountWFiles){
+                break;
+            }
+        }
+        w.endArray();
+    }
+
+    if(writeCfg.hashMeta) {
+        w.key("hashAlgorithm");
+        if(hashMeta.isNull()) w.writeNull(); else w.writeString(hashMeta.algorithmName());
+        w.key("hashChunkSize");
+        if(hashMeta.isNull()) w.writeNull(); else w.writeInt(hashMeta.chunkSize);
+        w.key("hashMaxCountOfReads");
+        if(hashMeta.isNull()) w.writeNull(); else w.writeInt(hashMeta.maxCountOfReads);
+    }
+    if(writeCfg.hostname) { w.key("hostname"); w.writeString(hostname); }
+    if(writeCfg.idInDb) { w.key("id"); w.writeInt(idInDb); }
+    if(writeCfg.returnVal) { w.key("returnValue"); w.writeInt(returnVal); }
+    if(writeCfg.sessionInfo){
+        w.key("sessionUuid");
+        if(sessionInfo.uuid.isNull()){
+            w.writeNull();
+        } else {
+            w.writeString(QString::fromLatin1(sessionInfo.uuid.toBase64()));
+        }
+    }
+    if(writeCfg.startEndTime) { w.key("startTime"); writeTime(startTime); }
+    if(writeCfg.username) { w.key("username"); w.writeString(username); }
+    if(writeCfg.workingDirectory) { w.key("workingDir"); w.writeString(workingDirectory); }
+    w.endObject();
+}
+
 bool CommandInfo::operator==(const CommandInfo &rhs) const
 {
     if(idInDb != db::INVALID_INT_ID && rhs.idInDb != db::INVALID_INT_ID){
@@ -9,6 +9,9 @@
 #include "fileinfos.h"
 
 
+class FileStatusCache;
+class JsonStreamWriter;
+
 typedef QVector<FileWriteInfo> FileWriteInfos;
 typedef QVector<FileReadInfo> FileReadInfos;
 
@@ -48,6 +51,8 @@ struct CmdJsonWriteCfg {
     int maxCountRFiles{std::numeric_limits<int>::max()};
 
     bool fileStatus{false};
+    // if set, used to determine the file status
+    FileStatusCache* fileStatusCache{nullptr};
 };
 
 struct CommandInfo
@@ -76,10 +81,14 @@ struct CommandInfo
 
     void write(QJsonObject &json, bool withMilliseconds=false,
                const CmdJsonWriteCfg& writeCfg=CmdJsonWriteCfg(true)) const;
+    void write(JsonStreamWriter &w, bool withMilliseconds=false,
+               const CmdJsonWriteCfg& writeCfg=CmdJsonWriteCfg(true)) const;
 
     bool operator==(const CommandInfo& rhs) const;
 
     void clear();
 
+private:
+    QString fileStatus(const FileInfo& info, const CmdJsonWriteCfg& writeCfg) const;
 };
 
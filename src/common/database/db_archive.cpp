@@ -0,0 +1,339 @@
+
+#include <QFile>
+#include <QUrl>
+#include <cassert>
+
+#include "db_archive.h"
+#include "db_connection.h"
+#include "cflock.h"
+#include "cleanupresource.h"
+#include "logger.h"
+#include "qfilethrow.h"
+#include "settings.h"
+
+namespace {
+
+const char* CMD_COLS = "id,sessionId,envId,hashmetaId,txt,returnVal,"
+                       "startTime,endTime,workingDirectory";
+const char* WRITTEN_FILE_COLS = "id,name,pathId,cmdId,mtime,size,hash";
+const char* READ_FILE_CMD_COLS = "id,cmdId,readFileId";
+
+std::weak_ptr<db_archive::ArchiveScope> g_archiveScope;
+
+/// @param month: yyyy-MM
+QString tableSuffix(const QString& month){
+    return QString(month).replace('-', '_');
+}
+
+/// start times are stored as yyyy-MM-ddThh:mm:ss.zzz, so the month
+/// is a prefix which sorts before all times of the month.
+QString nextMonth(const QString& month){
+    return QDate::fromString(month, "yyyy-MM").addMonths(1).toString("yyyy-MM");
+}
+
+void createMonthTables(const QueryPtr& query, const QString& month){
+    const QString s = tableSuffix(month);
+    query->exec("create table if not exists archive_rw.cmd_" + s + " ("
+                "`id` INTEGER,"
+                "`sessionId` BLOB,"
+                "`envId` INTEGER NOT NULL,"
+                "`hashmetaId` INTEGER,"
+                "`txt` TEXT NOT NULL,"
+                "`returnVal` INTEGER NOT NULL,"
+                "`startTime` timestamp NOT NULL,"
+                "`endTime` timestamp NOT NULL,"
+                "`workingDirectory` TEXT NOT NULL,"
+                "PRIMARY KEY(`id`))");
+    query->exec("create index if not exists archive_rw.idx_cmd_" + s + "_startTime "
+                "on cmd_" + s + " (`startTime`)");
+
+    query->exec("create table if not exists archive_rw.writtenFile_" + s + " ("
+                "`id` INTEGER,"
+                "`name` TEXT NOT NULL,"
+                "`pathId` INTEGER NOT NULL,"
+                "`cmdId` INTEGER NOT NULL,"
+                "`mtime` timestamp NOT NULL,"
+                "`size` INTEGER NOT NULL,"
+                "`hash` BLOB,"
+                "PRIMARY KEY(`id`))");
+    const QVector<QPair<QString, QString>> writtenFileIndexes {
+        {"cmdId", "`cmdId`"}, {"name", "`name`"}, {"pathId", "`pathId`"},
+        {"mtime", "`mtime`"}, {"size_hash", "`size`,`hash`"},
+    };
+    for(const auto& idx : writtenFileIndexes){
+        query->exec("create index if not exists archive_rw.idx_writtenFile_" + s +
+                    "_" + idx.first + " on writtenFile_" + s + " (" + idx.second + ")");
+    }
+
+    query->exec("create table if not exists archive_rw.readFileCmd_" + s + " ("
+                "`id` INTEGER,"
+                "`cmdId` INTEGER NOT NULL,"
+                "`readFileId` INTEGER,"
+                "PRIMARY KEY(`id`))");
+    query->exec("create index if not exists archive_rw.idx_readFileCmd_" + s + "_cmdId "
+                "on readFileCmd_" + s + " (`cmdId`)");
+    query->exec("create index if not exists archive_rw.idx_readFileCmd_" + s + "_readFileId "
+                "on readFileCmd_" + s + " (`readFileId`)");
+}
+
+/// Move the commands of the given month along with their file events
+/// to the attached archive, within a single transaction.
+void archiveMonth(const QString& month){
+    logDebug << "archiving commands of" << month;
+    auto query = db_connection::mkQuery();
+    const QString s = tableSuffix(month);
+    const QString cmdsOfMonth = "select id from main.cmd "
+                                "where startTime >= ? and startTime < ?";
+    const QVariantList monthRange{month, nextMonth(month)};
+
+    query->transaction();
+    createMonthTables(query, month);
+
+    query->prepare(QString("insert into archive_rw.cmd_%1 (%2) select %2 from main.cmd "
+                           "where startTime >= ? and startTime < ?").arg(s, CMD_COLS));
+    query->addBindValues(monthRange);
+    query->exec();
+
+    query->prepare(QString("insert into archive_rw.writtenFile_%1 (%2) select %2 "
+                           "from main.writtenFile where cmdId in (%3)")
+                   .arg(s, WRITTEN_FILE_COLS, cmdsOfMonth));
+    query->addBindValues(monthRange);
+    query->exec();
+
+    query->prepare(QString("insert into archive_rw.readFileCmd_%1 (%2) select %2 "
+                           "from main.readFileCmd where cmdId in (%3)")
+                   .arg(s, READ_FILE_CMD_COLS, cmdsOfMonth));
+    query->addBindValues(monthRange);
+    query->exec();
+
+    // Keep the rows still referenced by the archive
+    struct ArchiveRef {
+        const char* table;
+        const char* column;
+        const char* archivedTable;
+    };
+    const ArchiveRef refs[] {
+        {"env", "envId", "cmd"},
+        {"hashmeta", "hashmetaId", "cmd"},
+        {"session", "sessionId", "cmd"},
+        {"readFile", "readFileId", "readFileCmd"},
+        {"pathtable", "pathId", "writtenFile"},
+    };
+    for(const auto& ref : refs){
+        query->exec(QString("insert or ignore into main.archiveRef (tableName, refId) "
+                            "select distinct '%1',%2 from archive_rw.%3_%4 "
+                            "where %2 is not null")
+                    .arg(ref.table, ref.column, ref.archivedTable, s));
+    }
+
+    // New rows must never get the id of an archived one
+    for(const char* table : {"cmd", "writtenFile", "readFileCmd"}){
+        query->exec(QString("insert or replace into main.archivedMaxId (tableName, maxId) "
+                            "select '%1', max(coalesce(max(id), 0), "
+                            "coalesce((select maxId from main.archivedMaxId "
+                            "where tableName='%1'), 0)) "
+                            "from archive_rw.%1_%2").arg(table, s));
+    }
+
+    query->prepare("insert or ignore into main.archivedMonth (month) values (?)");
+    query->addBindValue(month);
+    query->exec();
+
+    // cascades to writtenFile and readFileCmd
+    query->prepare("delete from main.cmd where startTime >= ? and startTime < ?");
+    query->addBindValues(monthRange);
+    query->exec();
+    query->commit();
+}
+
+} // namespace
+
+
+QString db_archive::archivePath()
+{
+    return db_connection::getDatabaseDir() + "/archive.db";
+}
+
+/// Archive commands older than configured in the settings, if any.
+/// Cheap, if there is nothing to do. Errors are only logged.
+void db_archive::archiveIfDue()
+{
+    const int months = Settings::instance().databaseSettings().archiveAfterMonths;
+    if(months <= 0){
+        return;
+    }
+    const QDate today = QDate::currentDate();
+    try {
+        archiveMonthsBefore(QDate(today.year(), today.month(), 1).addMonths(-months));
+    } catch (const std::exception& ex) {
+        logWarning << qtr("Failed to archive old commands: %1").arg(ex.what());
+    }
+}
+
+/// Move all commands which started before the month of firstKeptMonth
+/// to the archive, one month per transaction. Afterwards compact the
+/// archive and make it read-only.
+/// @return the number of archived months.
+int db_archive::archiveMonthsBefore(const QDate &firstKeptMonth)
+{
+    assert(g_archiveScope.expired());
+    const QString cutoff = firstKeptMonth.toString("yyyy-MM");
+    auto query = db_connection::mkQuery();
+    query->exec("select min(startTime) from main.cmd");
+    if(! query->next() || query->value(0).isNull() ||
+            query->value(0).toString() >= cutoff){
+        return 0;
+    }
+
+    // Concurrent archivers would otherwise race for the archive's permissions
+    QFileThrow lockfile(db_connection::getDatabaseDir() + "/.shournal-archivelock");
+    lockfile.open(QFile::OpenModeFlag::ReadWrite);
+    CFlock lock(lockfile.handle());
+    lock.lockExclusive();
+
+    query->prepare("select distinct substr(startTime,1,7) from main.cmd "
+                   "where startTime < ? order by 1");
+    query->addBindValue(cutoff);
+    query->exec();
+    QStringList months;
+    while(query->next()){
+        months.push_back(query->value(0).toString());
+    }
+    if(months.isEmpty()){
+        // another process was faster
+        return 0;
+    }
+    logInfo << qtr("Archiving the commands of %1 month(s)").arg(months.size());
+
+    const QString path = archivePath();
+    QFile archiveFile(path);
+    if(archiveFile.exists()){
+        archiveFile.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    }
+    query->prepare("attach database ? as archive_rw");
+    query->addBindValue(path);
+    query->exec();
+    auto detach = finally([&query] {
+        query->exec("detach database archive_rw");
+    });
+
+    for(const auto& month : months){
+        archiveMonth(month);
+    }
+    query->exec("vacuum archive_rw");
+    archiveFile.setPermissions(QFileDevice::ReadOwner);
+    return months.size();
+}
+
+/// @return the archived months (yyyy-MM), which may contain commands started
+/// within the given range. Invalid datetimes do not restrict the range.
+QStringList db_archive::queryArchivedMonths(const QDateTime &minStartTime,
+                                            const QDateTime &maxStartTime)
+{
+    auto query = db_connection::mkQuery();
+    QString sql = "select month from main.archivedMonth where 1 ";
+    if(minStartTime.isValid()){
+        sql += "and month >= ? ";
+    }
+    if(maxStartTime.isValid()){
+        sql += "and month <= ? ";
+    }
+    query->prepare(sql + "order by month");
+    if(minStartTime.isValid()){
+        query->addBindValue(minStartTime.toString("yyyy-MM"));
+    }
+    if(maxStartTime.isValid()){
+        query->addBindValue(maxStartTime.toString("yyyy-MM"));
+    }
+    query->exec();
+    QStringList months;
+    while(query->next()){
+        months.push_back(query->value(0).toString());
+    }
+    return months;
+}
+
+
+/// @return a scope covering at least the given months, or null,
+/// if months is empty.
+std::shared_ptr<db_archive::ArchiveScope>
+db_archive::ArchiveScope::acquire(const QStringList &months)
+{
+    if(months.isEmpty()){
+        return std::shared_ptr<ArchiveScope>();
+    }
+    auto scope = g_archiveScope.lock();
+    if(scope){
+        QStringList missing;
+        for(const auto& m : months){
+            if(! scope->m_months.contains(m)){
+                missing.push_back(m);
+            }
+        }
+        if(! missing.isEmpty()){
+            const QStringList allMonths = scope->m_months + missing;
+            scope->dropViews();
+            scope->createViews(allMonths);
+        }
+        return scope;
+    }
+    scope = std::shared_ptr<ArchiveScope>(new ArchiveScope);
+    auto query = db_connection::mkQuery();
+    query->prepare("attach database ? as archive");
+    query->addBindValue("file:" + QString::fromLatin1(
+                            QUrl::toPercentEncoding(archivePath(), "/")) + "?mode=ro");
+    query->exec();
+    try {
+        scope->createViews(months);
+    } catch (...) {
+        query->exec("detach database archive");
+        throw;
+    }
+    g_archiveScope = scope;
+    return scope;
+}
+
+/// @overload for all archived months
+std::shared_ptr<db_archive::ArchiveScope> db_archive::ArchiveScope::acquireAll()
+{
+    return acquire(queryArchivedMonths());
+}
+
+db_archive::ArchiveScope::~ArchiveScope()
+{
+    try {
+        dropViews();
+        db_connection::mkQuery()->exec("detach database archive");
+    } catch (const std::exception& ex) {
+        logWarning << ex.what();
+    }
+}
+
+void db_archive::ArchiveScope::createViews(const QStringList &months)
+{
+    auto query = db_connection::mkQuery();
+    const QVector<QPair<QString, const char*>> tables {
+        {"cmd", CMD_COLS},
+        {"writtenFile", WRITTEN_FILE_COLS},
+        {"readFileCmd", READ_FILE_CMD_COLS},
+    };
+    for(const auto& t : tables){
+        QString sql = QString("create temp view %1 as select %2 from main.%1 ")
+                      .arg(t.first, t.second);
+        for(const auto& m : months){
+            sql += QString("union all select %2 from archive.%1_%3 ")
+                   .arg(t.first, t.second, tableSuffix(m));
+        }
+        query->exec(sql);
+    }
+    m_months = months;
+}
+
+void db_archive::ArchiveScope::dropViews()
+{
+    auto query = db_connection::mkQuery();
+    for(const char* table : {"cmd", "writtenFile", "readFileCmd"}){
+        query->exec(QString("drop view if exists temp.%1").arg(table));
+    }
+    m_months.clear();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QDate>
+#include <QDateTime>
+#include <QStringList>
+#include <memory>
+
+#include "util.h"
+
+/// Commands which started long ago may be moved from the database
+/// to the archive database next to it, where each month lives in its own
+/// tables (cmd_YYYY_MM, writtenFile_YYYY_MM, readFileCmd_YYYY_MM). The
+/// tables referenced by commands and file events (env, hashmeta, session,
+/// readFile, pathtable) stay in the database, the rows still required by
+/// the archive are recorded in archiveRef.
+/// After archiving, the archive is compacted and only opened read-only,
+/// so archived commands can not be deleted or modified.
+namespace db_archive {
+
+QString archivePath();
+
+void archiveIfDue();
+int archiveMonthsBefore(const QDate& firstKeptMonth);
+
+QStringList queryArchivedMonths(const QDateTime& minStartTime=QDateTime(),
+                                const QDateTime& maxStartTime=QDateTime());
+
+/// While alive, the archive is attached read-only and the temporary
+/// views cmd, writtenFile and readFileCmd (which take precedence over
+/// the tables of the same name) unite the database with the
+/// archived months, so existing queries find archived commands as well.
+/// Only one set of views can exist per connection, so a scope is shared
+/// by all concurrent users and extended on demand. Must not be alive,
+/// while writing to the database.
+class ArchiveScope {
+public:
+    static std::shared_ptr<ArchiveScope> acquire(const QStringList& months);
+    static std::shared_ptr<ArchiveScope> acquireAll();
+
+    ~ArchiveScope();
+
+private:
+    ArchiveScope() = default;
+    Q_DISABLE_COPY(ArchiveScope)
+    DISABLE_MOVE(ArchiveScope)
+
+    void createViews(const QStringList& months);
+    void dropViews();
+
+    QStringList m_months;
+};
+
+}
@@ -49,7 +49,8 @@ static void newSqliteDbIfNeeded(){
                                    "Is the driver installed?"));
         }
         // give enough time, e.g. for cases where the db is stored on a nfs-drive.
-        g_db->setConnectOptions("QSQLITE_BUSY_TIMEOUT=15000");
+        // URIs allow for attaching the archive read-only (see db_archive).
+        g_db->setConnectOptions("QSQLITE_BUSY_TIMEOUT=15000;QSQLITE_OPEN_URI");
     });
 }
 
@@ -92,6 +93,26 @@ static void updateDbScheme(QSqlQueryThrow& query, const QVersionNumber& latestSc
         sqlite_database_scheme_updates::v2_5(query);
     }
 
+    if(dbVersion < QVersionNumber{3, 3}){
+        logDebug << "updating db to 3.3...";
+        sqlite_database_scheme_updates::v3_3(query);
+    }
+
+    if(dbVersion < QVersionNumber{3, 4}){
+        logDebug << "updating db to 3.4...";
+        sqlite_database_scheme_updates::v3_4(query);
+    }
+
+    if(dbVersion < QVersionNumber{3, 5}){
+        logDebug << "updating db to 3.5...";
+        sqlite_database_scheme_updates::v3_5(query);
+    }
+
+    if(dbVersion < QVersionNumber{3, 6}){
+        logDebug << "updating db to 3.6...";
+        sqlite_database_scheme_updates::v3_6(query);
+    }
+
     query.prepare("replace into version (id, ver) values (1, ?)");
     query.addBindValue(latestSchemeVer.toString());
     query.exec();
@@ -154,7 +175,7 @@ static void openAndPrepareSqliteDb()
     // Until shournal v3.2 the database version was always set to the application version.
     // This required a synchronized update of all machines sharing the same database.
     // Therefore, only update the database version if a scheme update is necessary.
-    auto latestSchemeVer = QVersionNumber{3, 2};
+    auto latestSchemeVer = QVersionNumber{3, 6};
     QSqlQueryThrow query(*g_db);
     if(! versionTableExists(query)){
         logDebug << "version table did not exist yet..";
@@ -6,7 +6,9 @@
 #include <QSql>
 #include <QSqlDriver>
 #include <QDateTime>
+#include <QHash>
 #include <cassert>
+#include <algorithm>
 
 #include "db_controller.h"
 #include "db_connection.h"
@@ -23,29 +25,70 @@
 #include "interrupt_handler.h"
 #include "os.h"
 #include "qoutstream.h"
+#include "query_result_cache.h"
+#include "db_archive.h"
 
 using namespace db_conversions;
 using db_controller::InsertIfNotExist;
 
+/// Larger results are not stored in the query result cache
+const int MAX_CACHED_FILE_INFOS = 200000;
 
-static void
-insertFileWriteEvent(const QueryPtr& query, const CommandInfo &cmd,
-                FileEvent* e )
-{
-    auto pathFnamePair =  splitAbsPath(QString(e->path()));
+/// @return an expression for the id of a new row in table, which
+/// is unique within the database and the archive (see db_archive). Without
+/// archive it equals the id sqlite chooses.
+static QString nextIdExpr(const char* table){
+    return QString("(select max(coalesce((select max(id) from main.%1), 0), "
+                   "coalesce((select maxId from archivedMaxId where tableName='%1'), 0)) "
+                   "+ 1)").arg(table);
+}
+
+/// @return a condition true for rows of table, which are not
+/// referenced by archived commands or file events.
+static QString notArchiveReferenced(const char* table){
+    return QString("not exists (select 1 from archiveRef where "
+                   "archiveRef.tableName='%1' and archiveRef.refId=%1.id)").arg(table);
+}
+
+
+/// The pathtable-ids of the directories of file events by
+/// FileEvent::dirId. Only valid within the transaction they were
+/// obtained in: afterwards unreferenced paths may be deleted.
+typedef QHash<uint, QVariant> PathIdCache;
+
+static QVariant
+pathIdOf(const QueryPtr& query, const FileEvent* e, PathIdCache& pathIds){
+    auto it = pathIds.constFind(e->dirId());
+    if(it != pathIds.constEnd()){
+        return it.value();
+    }
+    const QString dir = QString::fromUtf8(e->dir());
     query->prepare(query->insertIgnorePreamble() + " into pathtable (path)"
                    "values (?)");
-    query->addBindValue(pathFnamePair.first);
+    query->addBindValue(dir);
+    query->exec();
+    query->prepare("select `id` from pathtable where path=?");
+    query->addBindValue(dir);
     query->exec();
+    query->next(true);
+    const QVariant pathId = query->value(0);
+    pathIds.insert(e->dirId(), pathId);
+    return pathId;
+}
+
+static void
+insertFileWriteEvent(const QueryPtr& query, const CommandInfo &cmd,
+                FileEvent* e, PathIdCache& pathIds )
+{
+    const QVariant pathId = pathIdOf(query, e, pathIds);
     query->prepare(query->insertIgnorePreamble() +
-                   " into writtenFile (cmdId,pathId,name,mtime,size,hash) "
-                   "values (?,"
-                   "(select `id` from pathtable where path=?),"
+                   " into writtenFile (id,cmdId,pathId,name,mtime,size,hash) "
+                   "values (" + nextIdExpr("writtenFile") + ",?,?,"
                    "?,?,?,?)");
 
     query->addBindValue(cmd.idInDb);
-    query->addBindValue(pathFnamePair.first);
-    query->addBindValue(pathFnamePair.second);
+    query->addBindValue(pathId);
+    query->addBindValue(QString::fromUtf8(e->filename()));
     query->addBindValue(fromMtime(e->mtime()));
     query->addBindValue(static_cast<qint64>(e->size()));
     query->addBindValue(fromHashValue(e->hash()));
@@ -79,22 +122,16 @@ copyToStoredFiles(const FileEvent* e,
 static void
 insertFileReadEvent(const QueryPtr& query, const CommandInfo &cmd,
                     const QVariant& envId, const QVariant& hashMetaId,
-                    FileEvent* e )
+                    FileEvent* e, PathIdCache& pathIds )
 {
     StoredFiles storedFiles;
     const QByteArray storedFilesDir = storedFiles.getReadFilesDir().toUtf8();
 
-    const auto pathFnamePair = splitAbsPath(QString(e->path()));
-    query->prepare(query->insertIgnorePreamble() + " into pathtable (path)"
-                   "values (?)");
-    query->addBindValue(pathFnamePair.first);
-    query->exec();
-
+    const QVariant pathId = pathIdOf(query, e, pathIds);
     InsertIfNotExist insIfnExist(*query, "readFile");
     insIfnExist.addSimple("envId", envId);
-    insIfnExist.addSimple("name", pathFnamePair.second);
-    insIfnExist.addEntry("pathId", {pathFnamePair.first},
-                         "(select id from pathtable where path=?)");
+    insIfnExist.addSimple("name", QString::fromUtf8(e->filename()));
+    insIfnExist.addSimple("pathId", pathId);
 
     insIfnExist.addSimple("mtime",fromMtime(e->mtime()));
     insIfnExist.addSimple("size", qint64(e->size()));
@@ -110,7 +147,8 @@ insertFileReadEvent(const QueryPtr& query, const CommandInfo &cmd,
         copyToStoredFiles(e, storedFilesDir, readFileId.toByteArray());
     }
     query->prepare(query->insertIgnorePreamble() +
-                   " into readFileCmd (cmdId, readFileId) values (?,?)");
+                   " into readFileCmd (id, cmdId, readFileId) values (" +
+                   nextIdExpr("readFileCmd") + ",?,?)");
     query->addBindValue(cmd.idInDb);
     query->addBindValue(readFileId);
     query->exec();
@@ -127,16 +165,19 @@ static void
 deleteChildlessParents(const QueryPtr& query){
     logDebug << "delete from hashmeta...";
     query->exec("delete from hashmeta where not exists "
-               "(select 1 from cmd where cmd.hashmetaId=hashmeta.id)");
+               "(select 1 from cmd where cmd.hashmetaId=hashmeta.id) and " +
+                notArchiveReferenced("hashmeta"));
     logDebug << "delete from session...";
     query->exec("delete from session where not exists "
-               "(select 1 from cmd where cmd.sessionId=session.id)");
+               "(select 1 from cmd where cmd.sessionId=session.id) and " +
+                notArchiveReferenced("session"));
 
     // delete stored read files (script files) in filesystem AND database
     query->setForwardOnly(true);
     query->prepare("select readFile.id from readFile where "
         "readFile.isStoredToDisk=? and "
-        "not exists (select 1 from readFileCmd where readFileCmd.readFileId=readFile.id) ");
+        "not exists (select 1 from readFileCmd where readFileCmd.readFileId=readFile.id) "
+        "and " + notArchiveReferenced("readFile"));
     query->bindValue(0, true);
     query->exec();
     StoredFiles storedFiles;
@@ -150,17 +191,19 @@ deleteChildlessParents(const QueryPtr& query){
     }
     logDebug << "delete from readFile...";
     query->exec("delete from readFile where not exists "
-               "(select 1 from readFileCmd where readFileCmd.readFileId=readFile.id)");
+               "(select 1 from readFileCmd where readFileCmd.readFileId=readFile.id) and " +
+                notArchiveReferenced("readFile"));
 
     // Do it last -> foreign key in readFile
     logDebug << "delete from env...";
     query->exec("delete from env where not exists (select 1 from cmd where "
-               "cmd.envId=env.id)");
+               "cmd.envId=env.id) and " + notArchiveReferenced("env"));
 
     query->exec("delete from pathtable where not exists "
                 "(select 1 from writtenFile where writtenFile.pathId=pathtable.id) "
                 "and not exists "
-                "(select 1 from readFile where readFile.pathId=pathtable.id)");
+                "(select 1 from readFile where readFile.pathId=pathtable.id) and " +
+                notArchiveReferenced("pathtable"));
 }
 
 
@@ -193,6 +236,152 @@ queryFileReadInfos(const SqlQuery& sqlQ, const QueryPtr& query_=nullptr, const Q
 }
 
 
+/// @return the select-statement for commands up to and including
+/// the where-keyword. Written and read files are only joined, if
+/// the query refers to them.
+static QString
+cmdQueryPreamble(const SqlQuery &sqlQ){
+    return
+            "select cmd.id,cmd.txt,"
+            "cmd.returnVal,cmd.startTime,cmd.endTime,cmd.workingDirectory,"
+            "session.id,session.comment,"
+            "hashmeta.chunkSize,hashmeta.maxCountOfReads,hashmeta.algorithm,"
+            "env.username,env.hostname "
+            "from cmd "             +
+            QString((sqlQ.containsTablename("writtenFile") ||
+                     sqlQ.containsTablename("writtenFile_path")) ? // an alias
+                        "join writtenFile on cmd.id=writtenFile.cmdId "
+                        "join pathtable as writtenFile_path "
+                        "on writtenFile.pathId=writtenFile_path.id " : "") +
+            QString((sqlQ.containsTablename("readFile") ||
+                     sqlQ.containsTablename("readFile_path")) ?
+                        "join readFileCmd on cmd.id=readFileCmd.cmdId "
+                        "join readFile on readFileCmd.readFileId=readFile.id "
+                        "join pathtable as readFile_path "
+                        "on readFile.pathId=readFile_path.id " :
+                        "") +
+            "join env on cmd.envId=env.id "
+            "left join hashmeta on hashmeta.id=cmd.hashmetaId " // left joins last, if possible!
+            "left join `session` on cmd.sessionId=session.id "
+            "where ";
+}
+
+static QString
+cmdQueryOrderBy(const SqlQuery &sqlQ){
+    // do not change this -> order matters in html-plot...
+    return "order by cmd.startTime " + sqlQ.ascendingStr() +
+            sqlQ.mkLimitString();
+}
+
+/// Commands are archived by month, once they are older than all commands
+/// in the database, so the newest commands are found in the database
+/// first and then in the archived months from newest to oldest.
+/// @return the newest of archivedMonths which are required to find the
+/// newest newestLimit commands of fullQuery. While fewer results are
+/// found, the searched months are doubled (1, 2, 4, ...), so e.g.
+/// --history does not slow down with a growing archive and a query
+/// matching fewer commands only counts O(log(months)) times.
+static QStringList
+requiredNewestMonths(const QString& fullQuery, const QVariantList& values,
+                     int newestLimit, const QStringList& archivedMonths){
+    auto query = db_connection::mkQuery();
+    const QString countQuery = "select count(*) from (" + fullQuery + ")";
+    QStringList months;
+    // keep the views of the months counted so far
+    std::shared_ptr<db_archive::ArchiveScope> archiveScope;
+    while(true){
+        query->prepare(countQuery);
+        query->addBindValues(values);
+        query->exec();
+        query->next(true);
+        if(qVariantTo_throw<qint64>(query->value(0)) >= newestLimit){
+            return months;
+        }
+        const int monthCount = std::min(std::max(1, months.size() * 2),
+                                        archivedMonths.size());
+        if(monthCount == archivedMonths.size()){
+            return archivedMonths;
+        }
+        months = archivedMonths.mid(archivedMonths.size() - monthCount);
+        archiveScope = db_archive::ArchiveScope::acquire(months);
+    }
+}
+
+/// @param archivedMonths: the months of the archive the query may find
+/// commands in.
+/// @param newestLimit: if not SqlQuery::NO_LIMIT, the query selects the
+/// newest newestLimit commands, so only the required archivedMonths are
+/// searched (see requiredNewestMonths).
+static std::unique_ptr<CommandQueryIterator>
+execCmdQuery(const QString& fullQuery, const QVariantList& values,
+             bool reverseResultIter, const QStringList& archivedMonths,
+             int newestLimit){
+    const QStringList months = (newestLimit == SqlQuery::NO_LIMIT || archivedMonths.isEmpty())
+            ? archivedMonths
+            : requiredNewestMonths(fullQuery, values, newestLimit, archivedMonths);
+    auto archiveScope = db_archive::ArchiveScope::acquire(months);
+    auto pQuery = db_connection::mkQuery();
+    std::unique_ptr<CommandQueryIterator> cmdIter(
+                new CommandQueryIterator(pQuery, reverseResultIter));
+    cmdIter->setArchiveScope(archiveScope);
+
+    // we need the size (at other places) but QSQLITE does not support QSqlQuery::size.
+    // To use a workaround, forward mode must not be enabled.
+    // See also https://stackoverflow.com/a/26500811/7015849
+    // if( ! reverseResultIter){
+    //     pQuery->setForwardOnly(true);
+    // }
+    pQuery->prepare(fullQuery);
+    pQuery->addBindValues(values);
+    logDebug << "executing" << fullQuery;
+    pQuery->exec();
+
+    if(reverseResultIter){
+        // place cursor right after the last record, so a call to "previous" points to last.
+        pQuery->last();
+        pQuery->next();
+    }
+    return cmdIter;
+}
+
+/// Serve the query from resultCache, if it is up to date, else
+/// record the result once it was iterated completely.
+/// Cached results still hold the archive scope of the archived months
+/// they contain, so later queries of the caller (e.g. CmdStats::eval)
+/// find those commands as well.
+static std::unique_ptr<CommandQueryIterator>
+execCachedCmdQuery(const QString& fullQuery, const QVariantList& values,
+                   bool reverseResultIter, const QStringList& archivedMonths,
+                   int newestLimit, QueryResultCache& resultCache){
+    // Query the generation before the commands, so concurrent modifications
+    // never end up in a result cached with an older generation.
+    const qint64 generation = db_controller::queryGeneration();
+    const QString key = QueryResultCache::mkKey(fullQuery, values, reverseResultIter);
+    QueryResultCache::CommandInfos cmds;
+    if(resultCache.load(key, generation, &cmds)){
+        logDebug << "query result taken from cache";
+        QStringList cmdMonths;
+        for(const auto& cmd : cmds){
+            const QString month = cmd.startTime.toString("yyyy-MM");
+            if(archivedMonths.contains(month) && ! cmdMonths.contains(month)){
+                cmdMonths.push_back(month);
+            }
+        }
+        std::unique_ptr<CommandQueryIterator> cmdIter(
+                    new CommandQueryIterator(std::move(cmds)));
+        cmdIter->setArchiveScope(db_archive::ArchiveScope::acquire(cmdMonths));
+        return cmdIter;
+    }
+    auto cmdIter = execCmdQuery(fullQuery, values, reverseResultIter, archivedMonths,
+                                newestLimit);
+    QueryResultCache* pCache = &resultCache;
+    cmdIter->setResultRecorder([pCache, key, generation](
+                               const QueryResultCache::CommandInfos& result){
+        pCache->store(key, generation, result);
+    }, MAX_CACHED_FILE_INFOS);
+    return cmdIter;
+}
+
 /////////////////////// public ////////////////////////////////
 
 
@@ -218,9 +407,11 @@ qint64 db_controller::addCommand(const CommandInfo &cmd)
 
     if(! cmd.hashMeta.isNull()) {
         query->prepare(query->insertIgnorePreamble() +
-                      " into hashmeta (chunkSize, maxCountOfReads) values (?,?)");
+                      " into hashmeta (chunkSize, maxCountOfReads, algorithm) "
+                      "values (?,?,?)");
         query->addBindValue(cmd.hashMeta.chunkSize);
         query->addBindValue(cmd.hashMeta.maxCountOfReads);
+        query->addBindValue(int(cmd.hashMeta.algorithm));
         query->exec();
     }
 
@@ -231,23 +422,24 @@ qint64 db_controller::addCommand(const CommandInfo &cmd)
         query->exec();
     }
 
-    query->prepare("insert into cmd (txt,envId,hashmetaId,returnVal,"
+    query->prepare("insert into cmd (id,txt,envId,hashmetaId,returnVal,"
                   "startTime,endTime,workingDirectory,sessionId) "
-                  "values (?,?,"
-                  "(select id from hashmeta where chunkSize=? and maxCountOfReads=?),"
+                  "values (" + nextIdExpr("cmd") + ",?,?,"
+                  "(select id from hashmeta where chunkSize=? and maxCountOfReads=? "
+                  "and algorithm=?),"
                   "?,?,?,?,?)"
                   );
     query->addBindValue(cmd.text);
     query->addBindValue(envId);
     query->addBindValue(cmd.hashMeta.chunkSize);
     query->addBindValue(cmd.hashMeta.maxCountOfReads);
+    query->addBindValue(int(cmd.hashMeta.algorithm));
     query->addBindValue(cmd.returnVal);
     query->addBindValue(cmd.startTime);
     query->addBindValue(cmd.endTime);
     query->addBindValue(cmd.workingDirectory);
     query->addBindValue(cmd.sessionInfo.uuid);
     query->exec();
-
     return qVariantTo_throw<qint64>(query->lastInsertId());
 }
 
@@ -259,6 +451,7 @@ void db_controller::updateCommand(const CommandInfo &cmd)
 {
     assert(cmd.idInDb != db::INVALID_INT_ID);
     auto query = db_connection::mkQuery();
+    query->transaction();
 
     query->prepare("update cmd set txt=?,returnVal=?,startTime=?,endTime=? "
                    "where `id`=?");
@@ -269,16 +462,17 @@ void db_controller::updateCommand(const CommandInfo &cmd)
     query->addBindValue(cmd.idInDb);
 
     query->exec();
-
 }
 
 
 /// Add file events belonging to param cmd which must belong to a valid
-/// database entry (idInDb must valid)
+/// database entry (idInDb must valid). Only a growing file of fileEvents
+/// may be read from a position other than its beginning, so file events
+/// of a running command can be added in several calls.
 void db_controller::addFileEvents(const CommandInfo &cmd, FileEvents &fileEvents)
 {
     assert(cmd.idInDb != db::INVALID_INT_ID);
-    assert(ftell(fileEvents.file()) == 0);
+    assert(fileEvents.growingFile() || ftell(fileEvents.file()) == 0);
 
     auto query = db_connection::mkQuery();
     query->transaction();
@@ -292,17 +486,19 @@ void db_controller::addFileEvents(const CommandInfo &cmd, FileEvents &fileEvents
 
     FileEvent* e;
     uint counter = 0;
+    PathIdCache pathIds;
     InterruptProtect ip(SIGTERM);
     while ((e = fileEvents.read()) != nullptr) {
         if(FileEvents::isReadEvent(e->flags())){
-            insertFileReadEvent(query, cmd, envId, hashMetaId, e);
+            insertFileReadEvent(query, cmd, envId, hashMetaId, e, pathIds);
         }
         if(FileEvents::isWriteEvent(e->flags())){
-            insertFileWriteEvent(query, cmd, e);
+            insertFileWriteEvent(query, cmd, e, pathIds);
         }
         // Be 'nice' to others and sleep a bit every now and then
         if(++counter % 500 == 0 &&
            ! ip.signalOccurred()){ // if we shall terminate don't sleep.
+            pathIds.clear();
             query->commit();
             usleep(10 * 1000);
             query->transaction();
@@ -334,58 +530,109 @@ int db_controller::deleteCommand(const SqlQuery &sqlQuery)
 
 /// @param reverseResultIter: if true, the returned Iterator will traverse the resultset in
 /// reverse order on continous 'next'-calls.
+/// @param resultCache: if not null, serve the result from it, if the database did
+/// not change in between and sqlQ is cacheable. Must outlive the returned iterator.
 std::unique_ptr<CommandQueryIterator>
-db_controller::queryForCmd(const SqlQuery &sqlQ, bool reverseResultIter){
-    auto pQuery = db_connection::mkQuery();
-    std::unique_ptr<CommandQueryIterator> cmdIter(
-                new CommandQueryIterator(pQuery, reverseResultIter));
-
-    const QString queryStr =
-            "select cmd.id,cmd.txt,"
-            "cmd.returnVal,cmd.startTime,cmd.endTime,cmd.workingDirectory,"
-            "session.id,session.comment,"
-            "hashmeta.chunkSize,hashmeta.maxCountOfReads,"
-            "env.username,env.hostname "
-            "from cmd "             +
-            QString((sqlQ.containsTablename("writtenFile") ||
-                     sqlQ.containsTablename("writtenFile_path")) ? // an alias
-                        "join writtenFile on cmd.id=writtenFile.cmdId "
-                        "join pathtable as writtenFile_path "
-                        "on writtenFile.pathId=writtenFile_path.id " : "") +
-            QString((sqlQ.containsTablename("readFile") ||
-                     sqlQ.containsTablename("readFile_path")) ?
-                        "join readFileCmd on cmd.id=readFileCmd.cmdId "
-                        "join readFile on readFileCmd.readFileId=readFile.id "
-                        "join pathtable as readFile_path "
-                        "on readFile.pathId=readFile_path.id " :
-                        "") +
-            "join env on cmd.envId=env.id "
-            "left join hashmeta on hashmeta.id=cmd.hashmetaId " // left joins last, if possible!
-            "left join `session` on cmd.sessionId=session.id "
-            "where ";
+db_controller::queryForCmd(const SqlQuery &sqlQ, bool reverseResultIter,
+                           QueryResultCache* resultCache){
+    const QString fullQuery = cmdQueryPreamble(sqlQ) + sqlQ.query() +
+                              " group by cmd.id " + cmdQueryOrderBy(sqlQ);
+    // Commands never end before they start, so an upper bound of the end
+    // time bounds the start time as well.
+    const auto& cols = QueryColumns::instance();
+    QDateTime maxStartTime = sqlQ.maxDateTime(cols.cmd_starttime);
+    const QDateTime maxEndTime = sqlQ.maxDateTime(cols.cmd_endtime);
+    if(! maxStartTime.isValid() || (maxEndTime.isValid() && maxEndTime < maxStartTime)){
+        maxStartTime = maxEndTime;
+    }
+    const QStringList archivedMonths = db_archive::queryArchivedMonths(
+                sqlQ.minDateTime(cols.cmd_starttime), maxStartTime);
+    const int newestLimit = (sqlQ.ascending()) ? int(SqlQuery::NO_LIMIT) : sqlQ.limit();
+    if(resultCache != nullptr && sqlQ.cacheable()){
+        return execCachedCmdQuery(fullQuery, sqlQ.values(), reverseResultIter,
+                                  archivedMonths, newestLimit, *resultCache);
+    }
+    return execCmdQuery(fullQuery, sqlQ.values(), reverseResultIter, archivedMonths,
+                        newestLimit);
+}
 
-    // do not change this -> order matters in html-plot...
-    const QString orderBy = "order by cmd.startTime " + sqlQ.ascendingStr() +
-                            sqlQ.mkLimitString();
 
-    // we need the size (at other places) but QSQLITE does not support QSqlQuery::size.
-    // To use a workaround, forward mode must not be enabled.
-    // See also https://stackoverflow.com/a/26500811/7015849
-    // if( ! reverseResultIter){
-    //     pQuery->setForwardOnly(true);
-    // }
-    const QString fullQuery = queryStr + sqlQ.query() + " group by cmd.id " + orderBy;
-    pQuery->prepare(fullQuery);
-    pQuery->addBindValues(sqlQ.values());
-    logDebug << "executing" << fullQuery;
-    pQuery->exec();
+/// Find the commands which (transitively) produced the written file(s) matched by
+/// wFileQuery: starting from the command(s) which wrote the file, recursively
+/// add those commands which wrote a file (same size and hash) that was
+/// read by an already found command, before that command started.
+/// @param wFileQuery: a query for written files as built by file_query_helper.
+/// @param maxDepth: the max. number of producer->consumer hops to follow
+/// @param minStartTime: if valid, only follow producers which started not before
+/// the given time.
+/// @param filterQuery: if not empty, further filter the found commands.
+std::unique_ptr<CommandQueryIterator>
+db_controller::queryLineage(const SqlQuery &wFileQuery, int maxDepth,
+                            const QDateTime &minStartTime,
+                            const SqlQuery &filterQuery,
+                            bool reverseResultIter,
+                            QueryResultCache* resultCache)
+{
+    // Note that this query relies on the indexes created in scheme update v3_3.
+    // Files without hash (empty ones or hashing disabled) are only
+    // considered equal, if path, name and mtime match as well.
+    QString lineageCte =
+            "with recursive lineage(cmdId, depth) as ("
+            "select writtenFile.cmdId, 0 from writtenFile "
+            "join pathtable as writtenFile_path "
+            "on writtenFile.pathId=writtenFile_path.id "
+            "join cmd on cmd.id=writtenFile.cmdId "
+            "where " + wFileQuery.query() + " "
+            "union "
+            "select producer.id, lineage.depth+1 from lineage "
+            "join cmd as consumer on consumer.id=lineage.cmdId "
+            "join readFileCmd on readFileCmd.cmdId=lineage.cmdId "
+            "join readFile on readFile.id=readFileCmd.readFileId "
+            "join writtenFile as producedFile on producedFile.size=readFile.size "
+            "and producedFile.hash=readFile.hash "
+            "join cmd as producer on producer.id=producedFile.cmdId "
+            "where lineage.depth < ? "
+            "and producer.id != consumer.id "
+            "and producer.startTime <= consumer.startTime "
+            "and producer.hashmetaId is readFile.hashmetaId "
+            "and (length(readFile.hash) > 0 or "
+            "(producedFile.pathId=readFile.pathId and "
+            "producedFile.name=readFile.name and "
+            "producedFile.mtime=readFile.mtime)) ";
+    QVariantList values = wFileQuery.values();
+    values.push_back(maxDepth);
+    if(minStartTime.isValid()){
+        lineageCte += "and producer.startTime >= ? ";
+        values.push_back(minStartTime);
+    }
+    lineageCte += ") ";
 
-    if(reverseResultIter){
-        // place cursor right after the last record, so a call to "previous" points to last.
-        pQuery->last();
-        pQuery->next();
+    QString fullQuery = lineageCte + cmdQueryPreamble(filterQuery) +
+                        "cmd.id in (select cmdId from lineage) ";
+    if(! filterQuery.isEmpty()){
+        fullQuery += "and (" + filterQuery.query() + ") ";
+        values += filterQuery.values();
     }
-    return cmdIter;
+    fullQuery += "group by cmd.id " + cmdQueryOrderBy(filterQuery);
+    // The starting commands are not bounded in time, so consider
+    // all archived months.
+    const QStringList archivedMonths = db_archive::queryArchivedMonths();
+    if(resultCache != nullptr && wFileQuery.cacheable() && filterQuery.cacheable()){
+        return execCachedCmdQuery(fullQuery, values, reverseResultIter,
+                                  archivedMonths, SqlQuery::NO_LIMIT, *resultCache);
+    }
+    return execCmdQuery(fullQuery, values, reverseResultIter, archivedMonths,
+                        SqlQuery::NO_LIMIT);
+}
+
+/// @return the generation of the database, which is incremented
+/// on each modification of commands or their file events.
+qint64 db_controller::queryGeneration()
+{
+    auto query = db_connection::mkQuery();
+    query->exec("select generation from dbGeneration where id=1");
+    query->next(true);
+    return qVariantTo_throw<qint64>(query->value(0));
 }
 
 /// if no entry can be found, the id of the returned file info is invalid.
@@ -418,7 +665,7 @@ FileReadInfos db_controller::queryReadInfos_byCmdId(qint64 cmdId, const QueryPtr
 /// restrictingFilesize!=-1
 db_controller::HashMetas
 db_controller::queryHashmetas(qint64 restrictingFilesize, bool isReadFile){
-    const QString FIELDS = " chunkSize,maxCountOfReads,hashmeta.id ";
+    const QString FIELDS = " chunkSize,maxCountOfReads,hashmeta.id,algorithm ";
 
     QString sql;
     if(restrictingFilesize == -1){
@@ -428,13 +675,17 @@ db_controller::queryHashmetas(qint64 restrictingFilesize, bool isReadFile){
               "select "+FIELDS+" from `readFile` "
               "left join hashmeta on readFile.hashmetaId=hashmeta.id "
               "where readFile.size=? "
-              "group by chunkSize,maxCountOfReads "
+              "group by chunkSize,maxCountOfReads,algorithm "
             :
               "select "+FIELDS+" from cmd "
               "join `writtenFile` on cmd.id=writtenFile.cmdId "
               "left join hashmeta on cmd.hashmetaId=hashmeta.id "
               "where writtenFile.size=? "
-              "group by chunkSize,maxCountOfReads ";
+              "group by chunkSize,maxCountOfReads,algorithm ";
+    }
+    std::shared_ptr<db_archive::ArchiveScope> archiveScope;
+    if(restrictingFilesize != -1 && ! isReadFile){
+        archiveScope = db_archive::ArchiveScope::acquireAll();
     }
     auto query = db_connection::mkQuery();
     query->prepare(sql);
@@ -453,22 +704,25 @@ db_controller::queryHashmetas(qint64 restrictingFilesize, bool isReadFile){
             qVariantTo_throw(query->value(0), &h.chunkSize);
             qVariantTo_throw(query->value(1), &h.maxCountOfReads);
             qVariantTo_throw(query->value(2), &h.idInDb);
+            h.algorithm = HashMeta::Algorithm(qVariantTo_throw<int>(query->value(3)));
             hashMetas.push_back(h);
         }
     }
     return hashMetas;
 }
 
-/// Find the database id of a given hasmeta entry (by chunkSize and maxCountOfReads)
+/// Find the database id of a given hasmeta entry (by chunkSize, maxCountOfReads
+/// and algorithm)
 qint64
 db_controller::queryHashmetaId(const HashMeta &hashMeta )
 {
     qint64 idIndDb = db::INVALID_INT_ID;
     auto query = db_connection::mkQuery();
     query->prepare("select `id` from hashmeta where "
-                   "chunkSize=? and maxCountOfReads=?");
+                   "chunkSize=? and maxCountOfReads=? and algorithm=?");
     query->addBindValue(hashMeta.chunkSize);
     query->addBindValue(hashMeta.maxCountOfReads);
+    query->addBindValue(int(hashMeta.algorithm));
     query->exec();
     if(query->next()){
         qVariantTo_throw(query->value(0), &idIndDb);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QByteArray>
+#include <QDateTime>
 #include <QVector>
 #include <memory>
 
@@ -11,6 +12,8 @@
 #include "qsqlquerythrow.h"
 #include "command_query_iterator.h"
 
+class QueryResultCache;
+
 
 namespace db_controller {
 
@@ -23,7 +26,15 @@ void addFileEvents(const CommandInfo &cmd, FileEvents& fileEvents);
 
 int deleteCommand(const SqlQuery &query);
 
-std::unique_ptr<CommandQueryIterator> queryForCmd(const SqlQuery& sqlQ, bool reverseResultIter=false);
+std::unique_ptr<CommandQueryIterator> queryForCmd(const SqlQuery& sqlQ, bool reverseResultIter=false,
+                                                  QueryResultCache* resultCache=nullptr);
+std::unique_ptr<CommandQueryIterator> queryLineage(const SqlQuery& wFileQuery, int maxDepth,
+                                                   const QDateTime& minStartTime=QDateTime(),
+                                                   const SqlQuery& filterQuery=SqlQuery(),
+                                                   bool reverseResultIter=false,
+                                                   QueryResultCache* resultCache=nullptr);
+
+qint64 queryGeneration();
 
 FileReadInfo queryReadInfo_byId(qint64 id, const QueryPtr& query_=nullptr);
 FileReadInfos queryReadInfos_byCmdId(qint64 cmdId, const QueryPtr& query_=nullptr);
@@ -1,8 +1,14 @@
 
 #include <QDateTime>
 #include <QDebug>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "cleanupresource.h"
+#include "db_archive.h"
+#include "db_connection.h"
 #include "db_controller.h"
 #include "db_conversions.h"
 #include "db_globals.h"
@@ -99,9 +105,10 @@ addToHashQuery(SqlQuery& query,
 /// Generate all necessary HashMeta-HashValue-pairs for the given fd,
 /// ignoring a possibly existing knownPair.
 static vector<HashMetaValuePair>
-generateHashMetaValuePairs(QFileThrow& file, qint64 filesize,
+generateHashMetaValuePairs(QFileThrow& file, const struct stat& st,
                            const FileQueryColumns* c=nullptr,
                            const HashMetaValuePair* knownPair=nullptr){
+    const qint64 filesize = st.st_size;
     if(filesize == 0){
         return {};
     }
@@ -118,7 +125,7 @@ generateHashMetaValuePairs(QFileThrow& file, qint64 filesize,
                 // already got this one.
                 continue;
             }
-            hashVal = hashCtrl.genPartlyHash(file.handle(), filesize, hashMeta);
+            hashVal = hashCtrl.genPartlyHash(file.handle(), st, hashMeta);
             if(hashVal.isNull()){
                 throw QExcIo(qtr("file %1 - failed to hash, although it "
                                   "was not empty.").arg(file.fileName()));
@@ -129,6 +136,104 @@ generateHashMetaValuePairs(QFileThrow& file, qint64 filesize,
     return pairs;
 }
 
+namespace {
+
+struct BatchFile {
+    QString path;
+    qint64 size {-1}; // -1 on error
+    QVariant mtime;
+    std::vector<HashMetaValuePair> hashes;
+    QString error;
+};
+
+typedef std::unordered_map<qint64, std::vector<HashMeta> > HashMetasBySize;
+
+/// Call func(file, hashCtrl) for all files, distributed among several threads.
+template <class F>
+void parallelForEachFile(std::vector<BatchFile>& files, F func){
+    std::atomic<size_t> nextIdx {0};
+    auto worker = [&files, &nextIdx, &func] {
+        HashControl hashCtrl;
+        size_t i;
+        while((i = nextIdx++) < files.size()){
+            try {
+                func(files[i], hashCtrl);
+            } catch (const std::exception& ex) {
+                files[i].size = -1;
+                files[i].error = ex.what();
+            }
+        }
+    };
+    const size_t threadCount = std::min<size_t>(
+                std::max(1u, std::thread::hardware_concurrency()),
+                files.size() / 64 + 1);
+    std::vector<std::thread> threads;
+    for(size_t i=1; i < threadCount; i++){
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(auto& t : threads){
+        t.join();
+    }
+}
+
+void statBatchFile(BatchFile& f, HashControl&){
+    const auto st = os::stat(f.path.toUtf8().constData());
+    if(! S_ISREG(st.st_mode)){
+        throw QExcIo(qtr("not a regular file"));
+    }
+    f.size = st.st_size;
+    f.mtime = fromMtime(st.st_mtime);
+}
+
+/// Hash the file with all hashmetas, which were used for written files of
+/// the same size.
+void hashBatchFile(BatchFile& f, HashControl& hashCtrl,
+                   const HashMetasBySize& hashMetasBySize){
+    auto it = hashMetasBySize.find(f.size);
+    if(f.size <= 0 || it == hashMetasBySize.end()){
+        return;
+    }
+    int fd = os::open(f.path.toUtf8().constData(), os::OPEN_RDONLY);
+    auto closeFd = finally([&fd] { close(fd); });
+    const auto st = os::fstat(fd);
+    for(const auto& hashMeta : it->second){
+        HashValue hashVal;
+        if(! hashMeta.isNull()){
+            hashVal = hashCtrl.genPartlyHash(fd, st, hashMeta);
+            if(hashVal.isNull()){
+                throw QExcIo(qtr("failed to hash, although it was not empty."));
+            }
+        }
+        f.hashes.push_back({hashMeta, hashVal});
+    }
+}
+
+HashMetasBySize queryHashMetasOfBatchSizes(const QueryPtr& query){
+    query->exec("select b.size,hashmeta.id,hashmeta.chunkSize,hashmeta.maxCountOfReads,"
+                "hashmeta.algorithm "
+                "from (select distinct size from temp.wfileBatch where size>0) as b "
+                "join writtenFile on writtenFile.size=b.size "
+                "join cmd on cmd.id=writtenFile.cmdId "
+                "left join hashmeta on hashmeta.id=cmd.hashmetaId "
+                "group by b.size,hashmeta.id");
+    HashMetasBySize hashMetasBySize;
+    while(query->next()){
+        HashMeta h;
+        if(! query->value(1).isNull()){
+            qVariantTo_throw(query->value(1), &h.idInDb);
+            qVariantTo_throw(query->value(2), &h.chunkSize);
+            qVariantTo_throw(query->value(3), &h.maxCountOfReads);
+            h.algorithm = HashMeta::Algorithm(qVariantTo_throw<int>(query->value(4)));
+        }
+        hashMetasBySize[qVariantTo_throw<qint64>(query->value(0))].push_back(h);
+    }
+    return hashMetasBySize;
+}
+
+} // namespace
+
+
 static bool
 entriesExists(const SqlQuery& query){
     return db_controller::queryForCmd(query)->next();
@@ -140,8 +245,8 @@ entriesExists(const SqlQuery& query){
 /// so optimistically generate a hash using current settings (if
 /// enabled)
 static HashMetaValuePair
-goodLuckHashAttempt(QFileThrow& file, const qint64 size){
-    if(size == 0){
+goodLuckHashAttempt(QFileThrow& file, const struct stat& st){
+    if(st.st_size == 0){
         return {};
     }
     const auto &sets = Settings::instance();
@@ -157,7 +262,7 @@ goodLuckHashAttempt(QFileThrow& file, const qint64 size){
         return {};
     }
 
-    hashVal = hashCtrl.genPartlyHash(file.handle(), size, hashMeta);
+    hashVal = hashCtrl.genPartlyHash(file.handle(), st, hashMeta);
     if(hashVal.isNull()){
         // no need to print a warning here - is caught in
         // generateHashMetaValuePairs
@@ -208,7 +313,7 @@ file_query_helper::buildFileQuerySmart(const QString &filename, bool readFile)
     }
 
     vector<HashMetaValuePair> hashMetaValuePairs;
-    auto firstHashRes = goodLuckHashAttempt(file, size);
+    auto firstHashRes = goodLuckHashAttempt(file, st_);
     if(! firstHashRes.meta.isNull()){
         SqlQuery query;
         addToHashQuery(query, firstHashRes, c);
@@ -220,7 +325,7 @@ file_query_helper::buildFileQuerySmart(const QString &filename, bool readFile)
     }
     // Our goodluck first attempt failed (bad size, hash or mtime) - now query based
     // on all other hashMetaValuePairs
-    hashMetaValuePairs = generateHashMetaValuePairs(file, size, &c, &firstHashRes);
+    hashMetaValuePairs = generateHashMetaValuePairs(file, st_, &c, &firstHashRes);
     if(firstHashRes.meta.isNull() && hashMetaValuePairs.empty()){
         logDebug << filename << "no file with matching size exists";
         return mkInertSqlQuery();
@@ -276,7 +381,7 @@ SqlQuery file_query_helper::buildFileQuery(const QString &filename,
             }
         } else {
             auto hashMetaValuePairs = generateHashMetaValuePairs(
-                        file, use_size,
+                        file, st_,
                         (use_size)? &c : nullptr);
             SqlQuery hashQuery;
             addToHashQuery(hashQuery, hashMetaValuePairs, c);
@@ -286,3 +391,128 @@ SqlQuery file_query_helper::buildFileQuery(const QString &filename,
     if(use_size) query.addWithAnd(c.col_size, qint64(size));
     return query;
 }
+
+
+/// Like buildFileQuerySmart for written files, but for many files at once:
+/// the files are stat'ed and hashed in parallel (only using those hashmetas
+/// which are relevant for the respective file size) and matched against
+/// the database within temporary tables. As in buildFileQuerySmart, per file
+/// matches with the same mtime are preferred.
+/// The returned query refers to a temporary table and is therefore only valid
+/// until the database connection is closed.
+/// @param foundCount: if not null, set to the number of files for which at least
+/// one command was found.
+SqlQuery file_query_helper::buildWFilesBatchQuery(const QStringList &filenames,
+                                                  int* foundCount)
+{
+    std::vector<BatchFile> files(size_t(filenames.size()));
+    for(int i=0; i < filenames.size(); i++){
+        files[size_t(i)].path = filenames[i];
+    }
+    parallelForEachFile(files, statBatchFile);
+
+    // written files of archived commands shall be found as well
+    auto archiveScope = db_archive::ArchiveScope::acquireAll();
+    auto query = db_connection::mkQuery();
+    query->exec("drop table if exists temp.wfileBatch");
+    query->exec("drop table if exists temp.wfileBatchHash");
+    query->exec("drop table if exists temp.wfileBatchMatch");
+    query->exec("create temp table wfileBatch "
+                "(idx INTEGER PRIMARY KEY, size INTEGER, mtime timestamp)");
+    query->exec("create temp table wfileBatchHash "
+                "(idx INTEGER, hashmetaId INTEGER, hash BLOB)");
+    query->exec("create temp table wfileBatchMatch (cmdId INTEGER PRIMARY KEY)");
+
+    query->transaction();
+    query->prepare("insert into temp.wfileBatch (idx,size,mtime) values (?,?,?)");
+    for(size_t i=0; i < files.size(); i++){
+        if(files[i].size == -1){
+            continue;
+        }
+        query->bindValue(0, qint64(i));
+        query->bindValue(1, files[i].size);
+        query->bindValue(2, files[i].mtime);
+        query->exec();
+    }
+    query->commit();
+
+    const auto hashMetasBySize = queryHashMetasOfBatchSizes(query);
+    parallelForEachFile(files, [&hashMetasBySize](BatchFile& f, HashControl& hashCtrl){
+        if(f.size != -1){
+            hashBatchFile(f, hashCtrl, hashMetasBySize);
+        }
+    });
+
+    query->transaction();
+    query->prepare("insert into temp.wfileBatchHash (idx,hashmetaId,hash) values (?,?,?)");
+    for(size_t i=0; i < files.size(); i++){
+        const auto& f = files[i];
+        if(f.size == -1){
+            logWarning << qtr("Skipping file %1: %2").arg(f.path, f.error);
+            continue;
+        }
+        for(const auto& p : f.hashes){
+            query->bindValue(0, qint64(i));
+            query->bindValue(1, (p.meta.isNull()) ? QVariant() : QVariant(p.meta.idInDb));
+            query->bindValue(2, fromHashValue(p.value));
+            query->exec();
+        }
+    }
+    query->commit();
+
+    // Written files of commands without hashmeta (hashing disabled) have no
+    // hash, so match them by size only. Empty files are not hashed, so
+    // match them by mtime (see buildFileQuerySmart).
+    query->exec("select h.idx,writtenFile.cmdId,writtenFile.mtime=b.mtime "
+                "from temp.wfileBatchHash as h "
+                "join temp.wfileBatch as b on b.idx=h.idx "
+                "join writtenFile on writtenFile.size=b.size and writtenFile.hash=h.hash "
+                "join cmd on cmd.id=writtenFile.cmdId "
+                "where h.hashmetaId is not null and cmd.hashmetaId=h.hashmetaId "
+                "union all "
+                "select h.idx,writtenFile.cmdId,writtenFile.mtime=b.mtime "
+                "from temp.wfileBatchHash as h "
+                "join temp.wfileBatch as b on b.idx=h.idx "
+                "join writtenFile on writtenFile.size=b.size "
+                "join cmd on cmd.id=writtenFile.cmdId "
+                "where h.hashmetaId is null and cmd.hashmetaId is null "
+                "union all "
+                "select b.idx,writtenFile.cmdId,1 from temp.wfileBatch as b "
+                "join writtenFile on writtenFile.size=0 and writtenFile.mtime=b.mtime "
+                "where b.size=0");
+    struct FileMatches {
+        std::vector<qint64> sameMtime;
+        std::vector<qint64> other;
+    };
+    std::unordered_map<qint64, FileMatches> matchesByIdx;
+    while(query->next()){
+        auto& m = matchesByIdx[qVariantTo_throw<qint64>(query->value(0))];
+        const auto cmdId = qVariantTo_throw<qint64>(query->value(1));
+        if(query->value(2).toBool()){
+            m.sameMtime.push_back(cmdId);
+        } else {
+            m.other.push_back(cmdId);
+        }
+    }
+
+    query->transaction();
+    query->prepare(query->insertIgnorePreamble() +
+                   " into temp.wfileBatchMatch (cmdId) values (?)");
+    for(const auto& idxMatches : matchesByIdx){
+        const auto& m = idxMatches.second;
+        for(qint64 cmdId : (m.sameMtime.empty()) ? m.other : m.sameMtime){
+            query->bindValue(0, cmdId);
+            query->exec();
+        }
+    }
+    query->commit();
+
+    if(foundCount != nullptr){
+        *foundCount = int(matchesByIdx.size());
+    }
+    SqlQuery sqlQuery;
+    sqlQuery.setQuery(" cmd.id in (select cmdId from temp.wfileBatchMatch) ");
+    // the query is the same for all file lists
+    sqlQuery.setCacheable(false);
+    return sqlQuery;
+}
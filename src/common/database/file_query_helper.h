@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QFile>
+#include <QStringList>
 
 #include "sqlquery.h"
 #include "nullable_value.h"
@@ -10,6 +11,7 @@ namespace file_query_helper {
     SqlQuery buildFileQuerySmart(const QString& filename, bool readFile);
     SqlQuery buildFileQuery(const QString& filename, bool readFile,
                               bool use_mtime, bool use_hash, bool use_size);
+    SqlQuery buildWFilesBatchQuery(const QStringList& filenames, int* foundCount=nullptr);
 }
 
 
@@ -0,0 +1,199 @@
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_status_cache.h"
+#include "cleanupresource.h"
+#include "commandinfo.h"
+#include "logger.h"
+#include "os.h"
+
+/// @param threadCount: number of worker threads. If 0, choose it based on
+/// the number of cpus. Note that the files may reside on a network file system,
+/// so use a few more threads than cpus.
+FileStatusCache::FileStatusCache(unsigned threadCount) :
+    m_threadCount((threadCount != 0) ? threadCount :
+                                       std::max(4u, std::thread::hardware_concurrency()))
+{}
+
+FileStatusCache::~FileStatusCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_stopThreads = true;
+    }
+    m_queueCond.notify_all();
+    for(auto& t : m_threads){
+        t.join();
+    }
+}
+
+/// Schedule the evaluation of the current status of file f.
+void FileStatusCache::prefetch(const FileInfo &f, const HashMeta &hashMeta)
+{
+    stateFuture(f, hashMeta);
+}
+
+/// Schedule the evaluation of the current status of the (first) written and read
+/// files of cmd.
+void FileStatusCache::prefetch(const CommandInfo &cmd, int maxCountWFiles, int maxCountRFiles)
+{
+    int count = 0;
+    for(const auto& f : cmd.fileWriteInfos){
+        if(count++ >= maxCountWFiles) break;
+        prefetch(f, cmd.hashMeta);
+    }
+    count = 0;
+    for(const auto& f : cmd.fileReadInfos){
+        if(count++ >= maxCountRFiles) break;
+        prefetch(f, cmd.hashMeta);
+    }
+}
+
+/// @return the current status of file f compared to the database: U (up to date),
+/// M (modified), N (not exist) or ERROR (in case of an error).
+/// Blocks, until the evaluation is finished.
+QString FileStatusCache::status(const FileInfo &f, const HashMeta &hashMeta)
+{
+    const CurrentState& st = stateFuture(f, hashMeta).get();
+    const auto filename = pathJoinFilename(f.path, f.name);
+    if(! st.error.isEmpty()){
+        logWarning << qtr("Failed to determine status of file %1 - %2")
+                      .arg(filename, st.error);
+        return "ERROR";
+    }
+    if(! st.exists){
+        return "N";
+    }
+    if(f.size != st.size || f.mtime != st.mtime){
+        return "M";
+    }
+    try {
+        return (f.hash != hashOf(filename, st, hashMeta)) ? "M" : "U";
+    } catch (const std::exception& ex) {
+        logWarning << qtr("Failed to determine status of file %1 - %2")
+                      .arg(filename).arg(QString(ex.what()));
+        return "ERROR";
+    }
+}
+
+/// Runs within a worker thread. Only hash the file, if size and mtime match the
+/// recorded ones, otherwise it is modified anyway.
+FileStatusCache::CurrentState
+FileStatusCache::evalState(const QString &path, const HashMeta &hashMeta,
+                           qint64 recordedSize, const QDateTime &recordedMtime)
+{
+    thread_local HashControl hashCtrl;
+    CurrentState st;
+    try {
+        const int fd = ::open(path.toUtf8().constData(), O_RDONLY | O_CLOEXEC);
+        if(fd == -1){
+            if(errno != ENOENT && errno != ENOTDIR){
+                st.error = QString(strerror(errno));
+            }
+            return st;
+        }
+        auto closeFd = finally([&fd] { close(fd); });
+        const auto stat_ = os::fstat(fd);
+        st.exists = true;
+        st.dev = stat_.st_dev;
+        st.ino = stat_.st_ino;
+        st.mtimeSec = stat_.st_mtime;
+        st.size = stat_.st_size;
+        st.mtime = QDateTime::fromTime_t(static_cast<uint>(stat_.st_mtime));
+        if(st.size == recordedSize && st.mtime == recordedMtime){
+            if(! hashMeta.isNull()){
+                st.hash = hashCtrl.genPartlyHash(fd, stat_, hashMeta);
+            }
+            st.hashed = true;
+        }
+    } catch (const std::exception& ex) {
+        st.error = QString(ex.what());
+    }
+    return st;
+}
+
+QString FileStatusCache::mkKey(const QString &path, const HashMeta &hashMeta)
+{
+    return QString::number(hashMeta.chunkSize) + ',' +
+            QString::number(hashMeta.maxCountOfReads) + ',' +
+            QString::number(int(hashMeta.algorithm)) + ',' + path;
+}
+
+const FileStatusCache::StateFuture&
+FileStatusCache::stateFuture(const FileInfo &f, const HashMeta &hashMeta)
+{
+    const QString path = pathJoinFilename(f.path, f.name);
+    auto it = m_states.find(mkKey(path, hashMeta));
+    if(it != m_states.end()){
+        return it->second;
+    }
+    startThreadsIfNeeded();
+    const qint64 size = f.size;
+    const QDateTime mtime = f.mtime;
+    auto task = std::make_shared<std::packaged_task<CurrentState()> >(
+                [path, hashMeta, size, mtime] {
+        return evalState(path, hashMeta, size, mtime);
+    });
+    it = m_states.emplace(mkKey(path, hashMeta), task->get_future().share()).first;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queue.emplace_back([task] { (*task)(); });
+    }
+    m_queueCond.notify_one();
+    return it->second;
+}
+
+/// The evaluation was scheduled by another file info for the same path
+/// with different size or mtime, so hashing was skipped there.
+HashValue FileStatusCache::hashOf(const QString& path, const CurrentState &st,
+                                  const HashMeta &hashMeta)
+{
+    if(st.hashed){
+        return st.hash;
+    }
+    if(hashMeta.isNull()){
+        return {};
+    }
+    const HashKey key(st.dev, st.ino, st.size, qint64(st.mtimeSec),
+                      hashMeta.chunkSize, hashMeta.maxCountOfReads,
+                      int(hashMeta.algorithm));
+    auto it = m_lateHashes.find(key);
+    if(it != m_lateHashes.end()){
+        return it->second;
+    }
+    const int fd = os::open(path.toUtf8().constData(), os::OPEN_RDONLY);
+    auto closeFd = finally([&fd] { close(fd); });
+    const auto hash = m_hashCtrl.genPartlyHash(fd, os::fstat(fd), hashMeta);
+    m_lateHashes.emplace(key, hash);
+    return hash;
+}
+
+void FileStatusCache::startThreadsIfNeeded()
+{
+    if(! m_threads.empty()){
+        return;
+    }
+    for(unsigned i=0; i < m_threadCount; i++){
+        m_threads.emplace_back(&FileStatusCache::workerLoop, this);
+    }
+}
+
+void FileStatusCache::workerLoop()
+{
+    while(true){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueCond.wait(lock, [this] { return m_stopThreads || ! m_queue.empty(); });
+            if(m_stopThreads){
+                return;
+            }
+            task = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <QDateTime>
+#include <QString>
+
+#include "fileinfos.h"
+#include "hashcontrol.h"
+#include "hashmeta.h"
+#include "util.h"
+
+struct CommandInfo;
+
+/// Determine the current status of files (see FileInfo::currentStatus) for
+/// many commands at once: files are registered via prefetch() and opened,
+/// stat'ed and hashed by a pool of worker threads, while status() waits for
+/// the respective result. The same path is only evaluated once per hashmeta,
+/// so files touched by many commands are not re-hashed over and over.
+class FileStatusCache
+{
+public:
+    explicit FileStatusCache(unsigned threadCount=0);
+    ~FileStatusCache();
+
+    void prefetch(const FileInfo& f, const HashMeta& hashMeta);
+    void prefetch(const CommandInfo& cmd, int maxCountWFiles, int maxCountRFiles);
+
+    QString status(const FileInfo& f, const HashMeta& hashMeta);
+
+public:
+    Q_DISABLE_COPY(FileStatusCache)
+    DISABLE_MOVE(FileStatusCache)
+
+private:
+    struct CurrentState {
+        bool exists {false};
+        QString error;
+        dev_t dev {};
+        ino_t ino {};
+        qint64 size {};
+        QDateTime mtime;
+        time_t mtimeSec {};
+        bool hashed {false};
+        HashValue hash;
+    };
+    typedef std::shared_future<CurrentState> StateFuture;
+    // dev, ino, size, mtime, chunkSize, maxCountOfReads, algorithm
+    typedef std::tuple<dev_t, ino_t, qint64, qint64, int, int, int> HashKey;
+
+    static CurrentState evalState(const QString& path, const HashMeta& hashMeta,
+                                  qint64 recordedSize, const QDateTime& recordedMtime);
+    static QString mkKey(const QString& path, const HashMeta& hashMeta);
+
+    const StateFuture& stateFuture(const FileInfo& f, const HashMeta& hashMeta);
+    HashValue hashOf(const QString& path, const CurrentState& st,
+                     const HashMeta& hashMeta);
+    void startThreadsIfNeeded();
+    void workerLoop();
+
+    unsigned m_threadCount;
+    std::unordered_map<QString, StateFuture> m_states;
+    std::map<HashKey, HashValue> m_lateHashes;
+    HashControl m_hashCtrl;
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()> > m_queue;
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueCond;
+    bool m_stopThreads {false};
+};
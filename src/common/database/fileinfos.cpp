@@ -3,6 +3,7 @@
 #include "db_conversions.h"
 #include "commandinfo.h"
 #include "hashcontrol.h"
+#include "json_stream_writer.h"
 #include "logger.h"
 #include "qfilethrow.h"
 #include "util.h"
@@ -22,7 +23,7 @@ QString FileInfo::currentStatus(const CommandInfo &cmd) const
         const auto st_ = os::fstat(f.handle());
         if(size != st_.st_size ||
            QDateTime::fromTime_t(static_cast<uint>(st_.st_mtime))!= mtime ||
-           hash!= hashCtrl.genPartlyHash(f.handle(), st_.st_size, cmd.hashMeta, false)){
+           hash!= hashCtrl.genPartlyHash(f.handle(), st_, cmd.hashMeta)){
             return "M";
         }
         return "U";
@@ -43,6 +44,15 @@ void FileWriteInfo::write(QJsonObject &json) const
     json["hash"] = QJsonValue::fromVariant(QVariant::fromValue(hash));
 }
 
+void FileWriteInfo::write(JsonStreamWriter &w) const
+{
+    w.key("hash"); w.writeVariant(QVariant::fromValue(hash));
+    w.key("id"); w.writeInt(idInDb);
+    w.key("mtime"); w.writeVariant(mtime);
+    w.key("path"); w.writeString(pathJoinFilename(path, name));
+    w.key("size"); w.writeInt(size);
+}
+
 bool
 FileWriteInfo::operator==(const FileInfo &rhs) const
 {
@@ -71,6 +81,16 @@ void FileReadInfo::write(QJsonObject &json) const
     json["isStoredToDisk"] = isStoredToDisk;
 }
 
+void FileReadInfo::write(JsonStreamWriter &w) const
+{
+    w.key("hash"); w.writeVariant(QVariant::fromValue(hash));
+    w.key("id"); w.writeInt(idInDb);
+    w.key("isStoredToDisk"); w.writeBool(isStoredToDisk);
+    w.key("mtime"); w.writeVariant(mtime);
+    w.key("path"); w.writeString(pathJoinFilename(path, name));
+    w.key("size"); w.writeInt(size);
+}
+
 bool
 FileReadInfo::operator==(const FileReadInfo &rhs) const
 {
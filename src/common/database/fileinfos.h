@@ -8,6 +8,7 @@
 #include "db_globals.h"
 
 struct CommandInfo;
+class JsonStreamWriter;
 
 struct FileInfo {
     virtual ~FileInfo() = 0;
@@ -22,6 +23,9 @@ struct FileInfo {
 
     virtual QString currentStatus(const CommandInfo &cmd) const;
     virtual void write(QJsonObject &json) const = 0;
+    /// Write the same keys as write(QJsonObject&) in ascending order
+    /// into the currently open object (which is not closed).
+    virtual void write(JsonStreamWriter &w) const = 0;
     virtual bool operator==(const FileInfo& rhs) const = 0 ;
 };
 
@@ -29,6 +33,7 @@ struct FileWriteInfo : public FileInfo
 {
 
     virtual void write(QJsonObject &json) const;
+    virtual void write(JsonStreamWriter &w) const;
     virtual bool operator==(const FileInfo& rhs) const;
 
 };
@@ -40,6 +45,7 @@ struct FileReadInfo : public FileInfo
     bool isStoredToDisk {false};
 
     virtual void write(QJsonObject &json) const;
+    virtual void write(JsonStreamWriter &w) const;
 
     virtual bool operator==(const FileReadInfo& rhs) const;
     virtual bool operator==(const FileInfo& rhs) const;
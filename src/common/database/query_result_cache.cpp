@@ -0,0 +1,198 @@
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "query_result_cache.h"
+#include "logger.h"
+
+namespace {
+
+const quint32 QUERY_CACHE_MAGIC = 0x53485143; // SHQC
+const quint32 QUERY_CACHE_VERSION = 2;
+
+void writeFileInfo(QDataStream& ds, const FileInfo& f){
+    ds << f.idInDb << f.mtime << f.size << f.path << f.name
+       << f.hash.isNull() << quint64((f.hash.isNull()) ? 0 : f.hash.value());
+}
+
+void readFileInfo(QDataStream& ds, FileInfo& f){
+    bool hashIsNull;
+    quint64 hash;
+    ds >> f.idInDb >> f.mtime >> f.size >> f.path >> f.name >> hashIsNull >> hash;
+    if(! hashIsNull){
+        f.hash = HashValue(hash);
+    }
+}
+
+void writeCmd(QDataStream& ds, const CommandInfo& cmd){
+    ds << cmd.idInDb << cmd.text << cmd.returnVal << cmd.username << cmd.hostname
+       << cmd.hashMeta.chunkSize << cmd.hashMeta.maxCountOfReads
+       << qint32(cmd.hashMeta.algorithm)
+       << cmd.sessionInfo.uuid << cmd.sessionInfo.comment
+       << cmd.startTime << cmd.endTime << cmd.workingDirectory;
+    ds << cmd.fileWriteInfos.size();
+    for(const auto& f : cmd.fileWriteInfos){
+        writeFileInfo(ds, f);
+    }
+    ds << cmd.fileReadInfos.size();
+    for(const auto& f : cmd.fileReadInfos){
+        writeFileInfo(ds, f);
+        ds << quint32(f.mode) << f.isStoredToDisk;
+    }
+}
+
+void readCmd(QDataStream& ds, CommandInfo& cmd){
+    qint32 algorithm = HashMeta::XXH64;
+    ds >> cmd.idInDb >> cmd.text >> cmd.returnVal >> cmd.username >> cmd.hostname
+       >> cmd.hashMeta.chunkSize >> cmd.hashMeta.maxCountOfReads
+       >> algorithm
+       >> cmd.sessionInfo.uuid >> cmd.sessionInfo.comment
+       >> cmd.startTime >> cmd.endTime >> cmd.workingDirectory;
+    cmd.hashMeta.algorithm = HashMeta::Algorithm(algorithm);
+    int count;
+    ds >> count;
+    for(int i=0; i < count && ds.status() == QDataStream::Ok; i++){
+        FileWriteInfo f;
+        readFileInfo(ds, f);
+        cmd.fileWriteInfos.push_back(f);
+    }
+    ds >> count;
+    for(int i=0; i < count && ds.status() == QDataStream::Ok; i++){
+        FileReadInfo f;
+        readFileInfo(ds, f);
+        quint32 mode;
+        ds >> mode >> f.isStoredToDisk;
+        f.mode = mode_t(mode);
+        cmd.fileReadInfos.push_back(f);
+    }
+}
+
+} // namespace
+
+
+QString QueryResultCache::defaultDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/queryresults";
+}
+
+/// @return a key unique to the given query, its bind values and the
+/// iteration direction.
+QString QueryResultCache::mkKey(const QString &query, const QVariantList &values,
+                                bool reverseIter)
+{
+    QString key = query;
+    key += (reverseIter) ? "\nreverse" : "\nforward";
+    for(const auto& val : values){
+        key += '\n';
+        key += val.typeName();
+        key += ':';
+        if(val.isNull()){
+            key += "null";
+        } else if(val.type() == QVariant::DateTime){
+            key += val.toDateTime().toString(Qt::ISODateWithMs);
+        } else if(val.type() == QVariant::ByteArray){
+            key += val.toByteArray().toHex();
+        } else {
+            key += val.toString();
+        }
+    }
+    return key;
+}
+
+QueryResultCache::QueryResultCache(const QString &dir, int maxEntries) :
+    m_dir(dir),
+    m_maxEntries(maxEntries)
+{}
+
+/// @return true, if a result for key of the given db generation was found.
+bool QueryResultCache::load(const QString &key, qint64 generation, CommandInfos *cmds)
+{
+    QFile f(filePath(key));
+    if(! f.open(QFile::ReadOnly)){
+        return false;
+    }
+    QDataStream ds(&f);
+    ds.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    quint32 version;
+    qint64 storedGeneration;
+    QString storedKey;
+    ds >> magic >> version;
+    if(magic != QUERY_CACHE_MAGIC || version != QUERY_CACHE_VERSION){
+        return false;
+    }
+    ds >> storedGeneration >> storedKey;
+    if(storedGeneration != generation || storedKey != key){
+        logDebug << "cached query result is outdated";
+        return false;
+    }
+    int count;
+    ds >> count;
+    cmds->clear();
+    for(int i=0; i < count && ds.status() == QDataStream::Ok; i++){
+        CommandInfo cmd;
+        readCmd(ds, cmd);
+        cmds->push_back(cmd);
+    }
+    if(ds.status() != QDataStream::Ok){
+        logWarning << qtr("Cached query result at %1 is corrupt").arg(f.fileName());
+        cmds->clear();
+        return false;
+    }
+    // mark as recently used
+    f.close();
+    f.open(QFile::ReadWrite);
+    f.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    return true;
+}
+
+/// Store the result, failures are only logged.
+void QueryResultCache::store(const QString &key, qint64 generation, const CommandInfos &cmds)
+{
+    if(! QDir().mkpath(m_dir)){
+        logWarning << qtr("Failed to create the query result cache directory %1")
+                      .arg(m_dir);
+        return;
+    }
+    // the results reveal the command history
+    QFile(m_dir).setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner |
+                                QFileDevice::ExeOwner);
+    QSaveFile f(filePath(key));
+    if(! f.open(QFile::WriteOnly)){
+        logWarning << qtr("Failed to cache the query result at %1: %2")
+                      .arg(f.fileName(), f.errorString());
+        return;
+    }
+    QDataStream ds(&f);
+    ds.setVersion(QDataStream::Qt_5_0);
+    ds << QUERY_CACHE_MAGIC << QUERY_CACHE_VERSION << generation << key << cmds.size();
+    for(const auto& cmd : cmds){
+        writeCmd(ds, cmd);
+    }
+    if(ds.status() != QDataStream::Ok || ! f.commit()){
+        logWarning << qtr("Failed to cache the query result at %1: %2")
+                      .arg(f.fileName(), f.errorString());
+        return;
+    }
+    prune();
+}
+
+QString QueryResultCache::filePath(const QString &key) const
+{
+    return m_dir + '/' + QCryptographicHash::hash(key.toUtf8(),
+                                                  QCryptographicHash::Sha1).toHex();
+}
+
+/// Remove the least recently used results
+void QueryResultCache::prune()
+{
+    const auto entries = QDir(m_dir).entryInfoList(QDir::Files, QDir::Time);
+    for(int i=m_maxEntries; i < entries.size(); i++){
+        QFile::remove(entries[i].absoluteFilePath());
+    }
+}
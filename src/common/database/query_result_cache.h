@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+
+#include "commandinfo.h"
+#include "util.h"
+
+
+/// Keep the results of command queries (see db_controller::queryForCmd) in
+/// files within the user's cache directory, one per query. A result is
+/// stored along with the generation of the database at query time, which
+/// is incremented on each modification of commands or their file events, so
+/// a stale result is never returned.
+/// The least recently used results are removed, once more than maxEntries
+/// are stored.
+class QueryResultCache
+{
+public:
+    typedef QVector<CommandInfo> CommandInfos;
+
+    static QString defaultDir();
+    static QString mkKey(const QString& query, const QVariantList& values,
+                         bool reverseIter);
+
+    QueryResultCache(const QString& dir, int maxEntries);
+
+    bool load(const QString& key, qint64 generation, CommandInfos* cmds);
+    void store(const QString& key, qint64 generation, const CommandInfos& cmds);
+
+private:
+    Q_DISABLE_COPY(QueryResultCache)
+    DISABLE_MOVE(QueryResultCache)
+
+    QString filePath(const QString& key) const;
+    void prune();
+
+    QString m_dir;
+    int m_maxEntries;
+};
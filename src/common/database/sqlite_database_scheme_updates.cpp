@@ -216,3 +216,79 @@ void sqlite_database_scheme_updates::v2_5(QSqlQueryThrow &query)
     query.exec("create unique index if not exists "
                " idx_unq_writtenFile on writtenFile (`name`,pathId,cmdId,mtime,size,hash)");
 }
+
+
+void sqlite_database_scheme_updates::v3_3(QSqlQueryThrow &query)
+{
+    // Support the recursive lineage-query, which matches read files
+    // against written files of (earlier) commands by size and hash.
+    query.exec("create index if not exists `idx_writtenFile_size_hash` "
+               "ON `writtenFile` (`size`,`hash`)");
+    query.exec("create index if not exists `idx_readFile_size_hash` "
+               "ON `readFile` (`size`,`hash`)");
+    query.exec("create index if not exists `idx_cmd_startTime` ON `cmd` (`startTime`)");
+}
+
+void sqlite_database_scheme_updates::v3_4(QSqlQueryThrow &query)
+{
+    // A counter incremented on each modification of commands or their
+    // file events, so cached query results can be invalidated.
+    query.exec("create table if not exists `dbGeneration` ("
+               "`id` INTEGER PRIMARY KEY CHECK (`id` = 1),"
+               "`generation` INTEGER NOT NULL)");
+    query.exec("insert or ignore into `dbGeneration` (id, generation) values (1, 0)");
+
+    // Increment it in triggers rather than in db_controller, so all writers,
+    // including older shournal versions, invalidate the cached results.
+    for(const char* table : {"cmd", "writtenFile", "readFile", "readFileCmd"}){
+        for(const char* op : {"insert", "update", "delete"}){
+            query.exec(QString("create trigger if not exists `trg_%1_%2_generation` "
+                               "after %2 on `%1` begin "
+                               "update `dbGeneration` set generation=generation+1 where id=1; "
+                               "end").arg(table, op));
+        }
+    }
+}
+
+void sqlite_database_scheme_updates::v3_5(QSqlQueryThrow &query)
+{
+    // Bookkeeping of the archive database (see db_archive):
+    // the archived months, the rows of env, hashmeta, session, readFile
+    // and pathtable referenced by archived commands and the max. archived
+    // id of cmd, writtenFile and readFileCmd, which new rows must exceed.
+    query.exec("create table if not exists `archivedMonth` ("
+               "`month` TEXT PRIMARY KEY)");
+    query.exec("create table if not exists `archiveRef` ("
+               "`tableName` TEXT NOT NULL,"
+               "`refId` NOT NULL,"
+               "PRIMARY KEY(`tableName`, `refId`)) WITHOUT ROWID");
+    query.exec("create table if not exists `archivedMaxId` ("
+               "`tableName` TEXT PRIMARY KEY,"
+               "`maxId` INTEGER NOT NULL)");
+}
+
+void sqlite_database_scheme_updates::v3_6(QSqlQueryThrow &query)
+{
+    // Store the hash function of a hashmeta. Existing ones were hashed with
+    // XXH64 (0), see HashMeta::Algorithm. The unique constraint cannot be
+    // altered, so recreate the table, keeping the ids referenced by cmd
+    // and readFile.
+    query.exec (
+    R"SOMERANDOMTEXT(
+    CREATE TABLE `hashmeta_TMP` (
+        `id` INTEGER,
+        `chunkSize` INTEGER NOT NULL,
+        `maxCountOfReads` INTEGER NOT NULL,
+        `algorithm` INTEGER NOT NULL DEFAULT 0, /* new */
+        PRIMARY KEY(`id`),
+        CONSTRAINT unq UNIQUE (`chunkSize`,`maxCountOfReads`,`algorithm`)
+    ))SOMERANDOMTEXT"
+    );
+
+    query.exec("insert into hashmeta_TMP (id,chunkSize,maxCountOfReads) "
+               "select id,chunkSize,maxCountOfReads from hashmeta");
+
+    query.exec("drop table if exists hashmeta");
+
+    query.exec("alter table `hashmeta_TMP` rename to `hashmeta`");
+}
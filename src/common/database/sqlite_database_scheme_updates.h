@@ -8,6 +8,10 @@ namespace sqlite_database_scheme_updates {
     void v2_2(QSqlQueryThrow& query); // 2.1 -> 2.2
     void v2_4(QSqlQueryThrow& query); // 2.3 -> 2.4
     void v2_5(QSqlQueryThrow& query); // 2.4 -> 2.5
+    void v3_3(QSqlQueryThrow& query); // 3.2 -> 3.3
+    void v3_4(QSqlQueryThrow& query); // 3.3 -> 3.4
+    void v3_5(QSqlQueryThrow& query); // 3.4 -> 3.5
+    void v3_6(QSqlQueryThrow& query); // 3.5 -> 3.6
 
 }
 
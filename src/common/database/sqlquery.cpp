@@ -28,6 +28,10 @@ void SqlQuery::clear()
     m_tablenames.clear();
     m_ascending = true;
     m_limit = NO_LIMIT;
+    m_minDateTimes.clear();
+    m_maxDateTimes.clear();
+    m_containsOuterOr = false;
+    m_cacheable = true;
 }
 
 bool SqlQuery::isEmpty() const
@@ -92,6 +96,7 @@ void SqlQuery::addWithConnector(const QString& columnName, const QVariantList& v
 
     auto actualOps = expandOperatorsIfNeeded(operators, values.size());
 
+    const bool wasEmpty = m_query.isEmpty();
     writeConnectorPrefix(outerAnd);
 
     auto valueIt = values.begin();
@@ -105,6 +110,10 @@ void SqlQuery::addWithConnector(const QString& columnName, const QVariantList& v
     } else {
         innerJunction = " or ";
     }
+    // Only if all comparisons must hold, each of them bounds the column
+    const bool valuesAreBounds = innerJunction == " and " || values.size() == 1;
+    QHash<QString, QDateTime> mins;
+    QHash<QString, QDateTime> maxs;
     while(valueIt != values.end()){
         if(valueIt != values.begin()){
             m_query += innerJunction;
@@ -134,6 +143,23 @@ void SqlQuery::addWithConnector(const QString& columnName, const QVariantList& v
 
             m_query += columnName + operatorIt->asSql() + "? ";
             m_values.push_back(var);
+
+            if(valuesAreBounds && var.type() == QVariant::DateTime){
+                const QDateTime dt = var.toDateTime();
+                const auto op = operatorIt->asEnum();
+                if(op == E_CompareOperator::GT || op == E_CompareOperator::GE ||
+                        op == E_CompareOperator::EQ){
+                    if(! mins.contains(columnName) || mins[columnName] < dt){
+                        mins[columnName] = dt;
+                    }
+                }
+                if(op == E_CompareOperator::LT || op == E_CompareOperator::LE ||
+                        op == E_CompareOperator::EQ){
+                    if(! maxs.contains(columnName) || maxs[columnName] > dt){
+                        maxs[columnName] = dt;
+                    }
+                }
+            }
         }
 
         ++valueIt;
@@ -142,6 +168,7 @@ void SqlQuery::addWithConnector(const QString& columnName, const QVariantList& v
 
     writeConnectorSuffix();
     addToTableCols(columnName);
+    updateDateTimeBounds(mins, maxs, outerAnd, wasEmpty);
 }
 
 
@@ -151,14 +178,17 @@ void SqlQuery::addWithConnector(const SqlQuery& other, bool outerAnd){
         return;
     }
 
+    const bool wasEmpty = m_query.isEmpty();
     writeConnectorPrefix(outerAnd);
 
     m_query += other.query();
     m_values.append(other.values());
     m_columnSet.insert(other.m_columnSet.begin(), other.m_columnSet.end());
     m_tablenames.insert(other.m_tablenames.begin(), other.m_tablenames.end());
+    m_cacheable = m_cacheable && other.m_cacheable;
 
     writeConnectorSuffix();
+    updateDateTimeBounds(other.m_minDateTimes, other.m_maxDateTimes, outerAnd, wasEmpty);
 }
 
 
@@ -224,6 +254,36 @@ void SqlQuery::writeConnectorSuffix()
      m_query += " ) ";
 }
 
+/// Tighten the known bounds by those of a just added part, if it was
+/// connected with AND. Connecting with OR loosens all bounds, so forget them.
+/// As AND takes precedence over OR, parts added later do not bound the
+/// whole query either.
+void SqlQuery::updateDateTimeBounds(const QHash<QString, QDateTime> &mins,
+                                    const QHash<QString, QDateTime> &maxs,
+                                    bool outerAnd, bool wasEmpty)
+{
+    if(! outerAnd && ! wasEmpty){
+        m_containsOuterOr = true;
+    }
+    if(m_containsOuterOr){
+        m_minDateTimes.clear();
+        m_maxDateTimes.clear();
+        return;
+    }
+    for(auto it=mins.begin(); it != mins.end(); ++it){
+        auto existing = m_minDateTimes.find(it.key());
+        if(existing == m_minDateTimes.end() || existing.value() < it.value()){
+            m_minDateTimes[it.key()] = it.value();
+        }
+    }
+    for(auto it=maxs.begin(); it != maxs.end(); ++it){
+        auto existing = m_maxDateTimes.find(it.key());
+        if(existing == m_maxDateTimes.end() || existing.value() > it.value()){
+            m_maxDateTimes[it.key()] = it.value();
+        }
+    }
+}
+
 /// setting the query is only allowed, it no values were set (yet)
 void SqlQuery::setQuery(const QString &query)
 {
@@ -244,6 +304,20 @@ bool SqlQuery::containsTablename(const QString &table) const
     return m_tablenames.find(table) != m_tablenames.end();
 }
 
+/// @return the lower bound of the datetime-column col, which all
+/// results satisfy, as added via addWithAnd/addWithOr, or an invalid
+/// datetime, if there is none.
+QDateTime SqlQuery::minDateTime(const QString &col) const
+{
+    return m_minDateTimes.value(col);
+}
+
+/// @see minDateTime
+QDateTime SqlQuery::maxDateTime(const QString &col) const
+{
+    return m_maxDateTimes.value(col);
+}
+
 
 int SqlQuery::limit() const
 {
@@ -256,6 +330,19 @@ void SqlQuery::setLimit(int limit)
     m_limit = limit;
 }
 
+bool SqlQuery::cacheable() const
+{
+    return m_cacheable;
+}
+
+/// Set to false, if the result does not only depend on the query
+/// and its values, e.g. because temporary tables are read, so it must
+/// not be taken from the QueryResultCache.
+void SqlQuery::setCacheable(bool cacheable)
+{
+    m_cacheable = cacheable;
+}
+
 /// @return 'limit x '-string or space character, if NO_LIMIT is imposed
 QString SqlQuery::mkLimitString() const
 {
@@ -3,6 +3,8 @@
 #include <type_traits>
 #include <QVector>
 #include <QVariant>
+#include <QDateTime>
+#include <QHash>
 #include <unordered_set>
 
 #include "compareoperator.h"
@@ -51,9 +53,15 @@ public:
 
     void setQuery(const QString &query);
 
+    bool cacheable() const;
+    void setCacheable(bool cacheable);
+
     bool containsColumn(const QString& col) const;
     bool containsTablename(const QString& table) const;
 
+    QDateTime minDateTime(const QString& col) const;
+    QDateTime maxDateTime(const QString& col) const;
+
 private:
 
     void addWithConnector(const QString& columnName, const QVariantList& values,
@@ -67,6 +75,9 @@ private:
     void addToTableCols(const QString& tableCol);
     void writeConnectorPrefix(bool outerAnd);
     void writeConnectorSuffix();
+    void updateDateTimeBounds(const QHash<QString, QDateTime>& mins,
+                              const QHash<QString, QDateTime>& maxs,
+                              bool outerAnd, bool wasEmpty);
 
     QString m_query;
     QVariantList m_values;
@@ -74,6 +85,11 @@ private:
     std::unordered_set<QString> m_tablenames;
     bool m_ascending {true};
     int m_limit {NO_LIMIT};
+    // bounds of datetime-columns all results must satisfy
+    QHash<QString, QDateTime> m_minDateTimes;
+    QHash<QString, QDateTime> m_maxDateTimes;
+    bool m_containsOuterOr {false};
+    bool m_cacheable {true};
 
 };
 
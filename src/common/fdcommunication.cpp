@@ -149,7 +149,9 @@ void SocketCommunication::sendMessages(const SocketCommunication::Messages &mess
         memcpy(fdptr, fds.data(), fds.size() * sizeof(int));
     }
     try {
-        os::sendmsg(m_sockFd, &messageHeader);
+        // The other end may be gone (e.g. a persistent backend was killed),
+        // so don't raise SIGPIPE in that case but report the error.
+        os::sendmsg(m_sockFd, &messageHeader, MSG_NOSIGNAL);
     } catch (const os::ExcOs& ex) {
         QString msg = (messages.isEmpty()) ? "EMPTY message" : messages[0].bytes;
         throw ExcFdComm(qtr("Failed to send «%1» - %2").arg(msg).arg(ex.what()));
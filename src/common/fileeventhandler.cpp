@@ -14,12 +14,78 @@
 #include "logger.h"
 #include "osutil.h"
 #include "os.h"
-#include "qfddummydevice.h"
 #include "qoutstream.h"
 #include "settings.h"
 #include "stdiocpp.h"
 #include "strlight_util.h"
 
+namespace  {
+
+const size_t MAX_DIRCACHE_SIZE = 4096;
+
+/// A path is hidden, if any of its components starts with a dot.
+/// memmem is vectorized in glibc, which pays off for the typically long
+/// paths.
+bool pathIsHidden(const char* path, size_t len){
+    return memmem(path, len, "/.", 2) != nullptr;
+}
+
+/// @return offFlag, if all files within dir are rejected by the include-,
+/// exclude- and hidden-settings of cfg, onFlag if all non-hidden files
+/// are accepted and 0 if it depends on the respective file (e.g. because
+/// include or exclude paths exist *below* dir).
+template <class Cfg>
+uint8_t dirVerdict(const Cfg& cfg, const StrLight& dir, bool dirHidden,
+                   uint8_t offFlag, uint8_t onFlag){
+    if(cfg.excludePaths->isSubPath(dir, true)){
+        return offFlag;
+    }
+    const bool hiddenRejected = cfg.excludeHidden && dirHidden &&
+            ! cfg.includePathsHidden->isSubPath(dir, true);
+    if(cfg.includePaths->isSubPath(dir, true)){
+        if(cfg.excludePaths->isParentPath(dir)){
+            return 0;
+        }
+        if(! hiddenRejected){
+            return onFlag;
+        }
+        return (cfg.includePathsHidden->isParentPath(dir)) ? 0 : offFlag;
+    }
+    return (cfg.includePaths->isParentPath(dir)) ? 0 : offFlag;
+}
+
+enum class PathVerdict { ACCEPT, NOT_INCLUDED, EXCLUDED, HIDDEN };
+
+/// Check fpath against the include-, exclude- and hidden-settings of cfg,
+/// the cached directory verdict allowing for a shortcut.
+template <class Cfg>
+PathVerdict checkPathSettings(const Cfg& cfg, const StrLight& fpath,
+                              bool dirOn){
+    if(dirOn){
+        // The filename is the only thing left to check
+        const char* fname = static_cast<const char*>(
+                    memrchr(fpath.constData(), '/', fpath.size()));
+        if(! cfg.excludeHidden || fname == nullptr || fname[1] != '.' ||
+                cfg.includePathsHidden->isSubPath(fpath, true)){
+            return PathVerdict::ACCEPT;
+        }
+        return PathVerdict::HIDDEN;
+    }
+    if(! cfg.includePaths->isSubPath(fpath, true)){
+        return PathVerdict::NOT_INCLUDED;
+    }
+    if(cfg.excludePaths->isSubPath(fpath, true)){
+        return PathVerdict::EXCLUDED;
+    }
+    if(cfg.excludeHidden && pathIsHidden(fpath.constData(), fpath.size()) &&
+            ! cfg.includePathsHidden->isSubPath(fpath, true)){
+        return PathVerdict::HIDDEN;
+    }
+    return PathVerdict::ACCEPT;
+}
+
+} // namespace
+
 static QString buildFilecacheDir(){
     return
        pathJoinFilename(QDir::tempPath(),
@@ -38,10 +104,7 @@ FileEventHandler::FileEventHandler() :
     r_scriptCfg(Settings::instance().readEventScriptSettings()),
     r_hashCfg(Settings::instance().hashSettings())
 {
-    FILE* f = stdiocpp::fopen(
-                pathJoinFilename(m_filecacheDir.path().toUtf8(),
-                                 QByteArray("file-events")), "w+");
-    m_fileEvents.setFile(f);
+    m_fileEvents = mkFileEvents();
 
     this->fillAllowedGroups();
     if(r_hashCfg.hashEnable){
@@ -52,7 +115,7 @@ FileEventHandler::FileEventHandler() :
 }
 
 FileEventHandler::~FileEventHandler(){
-    fclose(m_fileEvents.file());
+    fclose(m_fileEvents->file());
     try {
         os::close(m_ourProcFdDirDescriptor);
     } catch (const os::ExcOs& e) {
@@ -60,6 +123,35 @@ FileEventHandler::~FileEventHandler(){
     }
 }
 
+/// Open a new file to write file-events to. If configured, it resides in
+/// memory until it becomes too large, beyond that in our cache dir.
+/// Otherwise it is created within our cache dir right away, except for
+/// the first one, the files are deleted right away (see takeFileEvents()).
+std::unique_ptr<FileEvents> FileEventHandler::mkFileEvents()
+{
+    std::unique_ptr<FileEvents> events(new FileEvents);
+    const off_t maxMemSize = off_t(
+                Settings::instance().databaseSettings().eventLogMaxMemMiB) * 1024 * 1024;
+    if(maxMemSize > 0){
+        events->setFile(stdiocpp::memfile("shournal-file-events"));
+        events->setMaxMemSize(maxMemSize, m_filecacheDir.path().toUtf8());
+        return events;
+    }
+
+    QByteArray fname("file-events");
+    if(m_eventFileCount > 0){
+        fname += '-' + QByteArray::number(m_eventFileCount);
+    }
+    const auto fpath = pathJoinFilename(m_filecacheDir.path().toUtf8(), fname);
+    FILE* f = stdiocpp::fopen(fpath, "w+");
+    if(m_eventFileCount > 0){
+        os::remove(fpath);
+    }
+    ++m_eventFileCount;
+    events->setFile(f);
+    return events;
+}
+
 void FileEventHandler::fillAllowedGroups()
 {
     auto groups = os::getgroups();
@@ -102,12 +194,13 @@ bool FileEventHandler::userHasReadPermission(const struct stat &st)
 /// if both unset, accept all,
 /// else only take the set one into account.
 bool FileEventHandler::readFileTypeMatches(const Settings::ScriptFileSettings &scriptCfg,
-                                           int fd, const StrLight& fpath)
+                                           int fd, const os::stat_t& st,
+                                           const StrLight& fpath)
 {
     if(! scriptCfg.includeExtensions.empty() && ! scriptCfg.includeMimetypes.empty()){
         // both not empty, consider both (OR'd)
         return fileExtensionMatches(scriptCfg.includeExtensions, fpath) ||
-               mimeTypeMatches(fd, scriptCfg.includeMimetypes);
+               mimeTypeMatches(fd, st, scriptCfg.includeMimetypes);
     }
     if(scriptCfg.includeExtensions.empty() && scriptCfg.includeMimetypes.empty()){
         return true;
@@ -117,7 +210,7 @@ bool FileEventHandler::readFileTypeMatches(const Settings::ScriptFileSettings &s
         return fileExtensionMatches(scriptCfg.includeExtensions, fpath);
     }
     assert(! scriptCfg.includeMimetypes.empty());
-    return mimeTypeMatches(fd, scriptCfg.includeMimetypes);
+    return mimeTypeMatches(fd, st, scriptCfg.includeMimetypes);
 }
 
 void FileEventHandler::readLinkOfFd(int fd, StrLight &output)
@@ -146,12 +239,10 @@ bool FileEventHandler::fileExtensionMatches(const Settings::StrLightSet &validEx
     return validExtensions.find(m_extensionBuf) != validExtensions.end();
 }
 
-bool FileEventHandler::mimeTypeMatches(int fd, const Settings::MimeSet &validMimetypes)
+bool FileEventHandler::mimeTypeMatches(int fd, const os::stat_t& st,
+                                       const Settings::MimeSet &validMimetypes)
 {
-    QFdDummyDevice f(fd);
-    const auto mimetype = m_mimedb.mimeTypeForData(&f).name();
-    os::lseek(fd, 0, SEEK_SET);
-    return validMimetypes.find(mimetype) != validMimetypes.end();
+    return m_mimeSniffer.mimeTypeMatches(fd, st, validMimetypes);
 }
 
 
@@ -163,12 +254,22 @@ QString FileEventHandler::getTmpDirPath() const
 
 void FileEventHandler::clearEvents()
 {
-    m_fileEvents.clear();
+    m_fileEvents->clear();
 }
 
 FileEvents &FileEventHandler::fileEvents()
 {
-    return m_fileEvents;
+    return *m_fileEvents;
+}
+
+/// Hand over all events collected so far to the caller, who
+/// becomes responsible for closing the FILE of the returned events.
+/// Subsequent events are collected in a new file.
+std::unique_ptr<FileEvents> FileEventHandler::takeFileEvents()
+{
+    auto newEvents = mkFileEvents();
+    std::swap(m_fileEvents, newEvents);
+    return newEvents;
 }
 
 /// @param enableReadActions: if false, do not read from fd, regardless of settings
@@ -191,37 +292,40 @@ void FileEventHandler::handleCloseWrite(int fd)
         return;
     }
 
-    if(! r_wCfg.includePaths->isSubPath(m_pathbuf, true) ){
+    const uint8_t dirFlags = dirFlagsOfPath(m_pathbuf);
+    if(dirFlags & DIRCACHE_W_OFF){
+        logDebug << "closedwrite-event ignored (directory not included, "
+                    "excluded or hidden):" << m_pathbuf;
+        return;
+    }
+    switch (checkPathSettings(r_wCfg, m_pathbuf, dirFlags & DIRCACHE_W_ON)) {
+    case PathVerdict::ACCEPT: break;
+    case PathVerdict::NOT_INCLUDED:
         logDebug << "closedwrite-event ignored (no subpath of include_dirs): "
                  << m_pathbuf;
         return;
-    }
-    if(r_wCfg.excludePaths->isSubPath(m_pathbuf, true) ){
+    case PathVerdict::EXCLUDED:
         logDebug << "closedwrite-event ignored (subpath of exclude_dirs): "
                  << m_pathbuf;
         return;
-    }
-
-    if(r_wCfg.excludeHidden && pathIsHidden(m_pathbuf) &&
-            ! r_wCfg.includePathsHidden->isSubPath(m_pathbuf, true)){
+    case PathVerdict::HIDDEN:
         logDebug << "closedwrite-event ignored (hidden file):"
                  << m_pathbuf;
         return;
     }
 
-    if(m_fileEvents.wEventCount() >= r_wCfg.maxEventCount){
+    if(m_fileEvents->wEventCount() >= r_wCfg.maxEventCount){
         logDebug << "closedwrite-event dropped:"
                  << m_pathbuf;
-        m_fileEvents.incrementDropCount(O_WRONLY);
+        m_fileEvents->incrementDropCount(O_WRONLY);
         return;
     }
 
     HashValue hash;
     if(r_hashCfg.hashEnable){
-        hash =  m_hashControl.genPartlyHash(fd, st.st_size,
-                                                       r_hashCfg.hashMeta);
+        hash =  m_hashControl.genPartlyHash(fd, st, r_hashCfg.hashMeta);
     }
-    m_fileEvents.write(O_WRONLY, m_pathbuf, st, hash);
+    m_fileEvents->write(O_WRONLY, m_pathbuf, st, hash);
 
     logDebug << "closedwrite-event recorded: "
              << m_pathbuf;
@@ -233,7 +337,8 @@ void FileEventHandler::handleCloseWrite(int fd)
 }
 
 bool FileEventHandler::generalReadSettingsSayLogIt(const bool userHasWritePerm,
-                                                   const StrLight& filepath)
+                                                   const StrLight& filepath,
+                                                   uint8_t dirFlags)
 {
     if(! r_rCfg.enable){
         return false;
@@ -244,19 +349,22 @@ bool FileEventHandler::generalReadSettingsSayLogIt(const bool userHasWritePerm,
         return false;
     }
 
-    if( ! r_rCfg.includePaths->isSubPath(filepath, true)){
+    if(dirFlags & DIRCACHE_R_OFF){
+        logDebug << "general read event ignored: directory not included, "
+                    "excluded or hidden:" << filepath;
+        return false;
+    }
+    switch (checkPathSettings(r_rCfg, filepath, dirFlags & DIRCACHE_R_ON)) {
+    case PathVerdict::ACCEPT: break;
+    case PathVerdict::NOT_INCLUDED:
         logDebug << "general read event ignored: not a subpath of any included path:"
                  << filepath;
         return false;
-    }
-    if( r_rCfg.excludePaths->isSubPath(filepath, true)){
+    case PathVerdict::EXCLUDED:
         logDebug << "general read event ignored: is a subpath of an excluded path:"
                  << filepath;
         return false;
-    }
-
-    if(r_rCfg.excludeHidden && pathIsHidden(filepath) &&
-            ! r_rCfg.includePathsHidden->isSubPath(filepath, true)){
+    case PathVerdict::HIDDEN:
         logDebug << "general read event ignored: hidden file:"
                  << filepath;
         return false;
@@ -269,14 +377,15 @@ bool
 FileEventHandler::scriptReadSettingsSayLogIt(bool userHasWritePerm,
                                                   const StrLight &fpath,
                                                   const os::stat_t &st,
-                                                  int fd)
+                                                  int fd,
+                                                  uint8_t dirFlags)
 {
     if(! r_scriptCfg.enable){
         return false;
     }
     // repeat check here: fanotify-read-events are only unregistered, if
     // general read events are disabled...
-    if(m_fileEvents.rStoredFilesCount() >= r_scriptCfg.maxCountOfFiles){
+    if(m_fileEvents->rStoredFilesCount() >= r_scriptCfg.maxCountOfFiles){
         logDebug << "possible script-event ignored: already collected enough files:"
                  << fpath;
         return false;
@@ -294,25 +403,28 @@ FileEventHandler::scriptReadSettingsSayLogIt(bool userHasWritePerm,
         return false;
     }
 
-    if( ! r_scriptCfg.includePaths->isSubPath(fpath, true)){
+    if(dirFlags & DIRCACHE_SCRIPT_OFF){
+        logDebug << "possible script-event ignored: directory of file"
+                 << fpath << "is not included, excluded or hidden";
+        return false;
+    }
+    switch (checkPathSettings(r_scriptCfg, fpath, dirFlags & DIRCACHE_SCRIPT_ON)) {
+    case PathVerdict::ACCEPT: break;
+    case PathVerdict::NOT_INCLUDED:
         logDebug << "possible script-event ignored: file"
                  << fpath << "is not a subpath of any included path";
         return false;
-    }
-    if( r_scriptCfg.excludePaths->isSubPath(fpath, true)){
+    case PathVerdict::EXCLUDED:
         logDebug << "possible script-event ignored: file"
                  << fpath << "is a subpath of an excluded path";
         return false;
-    }
-
-    if(r_scriptCfg.excludeHidden && pathIsHidden(fpath) &&
-            ! r_scriptCfg.includePathsHidden->isSubPath(fpath, true)){
+    case PathVerdict::HIDDEN:
         logDebug << "possible script-event ignored: hidden file:"
                  << fpath;
         return false;
     }
 
-    if(! readFileTypeMatches(r_scriptCfg, fd, fpath)){
+    if(! readFileTypeMatches(r_scriptCfg, fd, st, fpath)){
         logDebug << "script-event ignored: neither file-extension nor mime-type "
                     "matches for " << fpath;
         return false;
@@ -320,9 +432,48 @@ FileEventHandler::scriptReadSettingsSayLogIt(bool userHasWritePerm,
     return true;
 }
 
-bool FileEventHandler::pathIsHidden(const StrLight &fullPath)
+/// @return the DirCacheFlags of the parent directory of fullPath. The
+/// verdicts only depend on the (constant) settings, so they are computed
+/// once per directory. Typically many events in a row occur within the
+/// same directory, so the last one is checked first.
+uint8_t FileEventHandler::dirFlagsOfPath(const StrLight &fullPath)
 {
-    return fullPath.find("/.") != StrLight::npos;
+    const char* lastSlash = static_cast<const char*>(
+                memrchr(fullPath.constData(), '/', fullPath.size()));
+    if(lastSlash == nullptr || lastSlash == fullPath.constData()){
+        // not absolute or directly below /. Check each file on its own.
+        return 0;
+    }
+    const size_t dirLen = size_t(lastSlash - fullPath.constData());
+    if(m_lastDir != nullptr && m_lastDir->size() == dirLen &&
+            memcmp(m_lastDir->constData(), fullPath.constData(), dirLen) == 0){
+        return m_lastDirFlags;
+    }
+
+    m_dirKeyBuf.setRawData(fullPath.constData(), dirLen);
+    auto it = m_dirCache.find(m_dirKeyBuf);
+    if(it == m_dirCache.end()){
+        if(m_dirCache.size() >= MAX_DIRCACHE_SIZE){
+            m_dirCache.clear();
+        }
+        const bool dirHidden = pathIsHidden(fullPath.constData(), dirLen);
+        uint8_t flags = 0;
+        flags |= dirVerdict(r_wCfg, m_dirKeyBuf, dirHidden,
+                            DIRCACHE_W_OFF, DIRCACHE_W_ON);
+        if(r_rCfg.enable){
+            flags |= dirVerdict(r_rCfg, m_dirKeyBuf, dirHidden,
+                                DIRCACHE_R_OFF, DIRCACHE_R_ON);
+        }
+        if(r_scriptCfg.enable){
+            flags |= dirVerdict(r_scriptCfg, m_dirKeyBuf, dirHidden,
+                                DIRCACHE_SCRIPT_OFF, DIRCACHE_SCRIPT_ON);
+        }
+        it = m_dirCache.emplace(StrLight(fullPath.constData(), dirLen), flags).first;
+    }
+    // node-based, so the key's address stays valid until the next clear()
+    m_lastDir = &it->first;
+    m_lastDirFlags = it->second;
+    return m_lastDirFlags;
 }
 
 
@@ -345,25 +496,25 @@ void FileEventHandler::handleCloseRead(int fd)
         return;
     }
     const bool userHasWritePerm = userHasWritePermission(st);
+    const uint8_t dirFlags = dirFlagsOfPath(m_pathbuf);
     const bool logGeneralReadEvent = generalReadSettingsSayLogIt(userHasWritePerm,
-                                                                 m_pathbuf);
+                                                                 m_pathbuf, dirFlags);
     bool logScriptEvent = scriptReadSettingsSayLogIt(userHasWritePerm, m_pathbuf,
-                                                     st, fd);
+                                                     st, fd, dirFlags);
     if(! logGeneralReadEvent && ! logScriptEvent){
         return;
     }
-    if(m_fileEvents.rEventCount() >= r_rCfg.maxEventCount){
+    if(m_fileEvents->rEventCount() >= r_rCfg.maxEventCount){
         logDebug << "closedread-event dropped:"
                  << m_pathbuf;
-        m_fileEvents.incrementDropCount(O_RDONLY);
+        m_fileEvents->incrementDropCount(O_RDONLY);
         return;
     }
 
     HashValue hash;
     if(r_hashCfg.hashEnable){
         assert(os::ltell(fd) == 0);
-        hash =  m_hashControl.genPartlyHash(fd, st.st_size,
-                                                       r_hashCfg.hashMeta);
+        hash =  m_hashControl.genPartlyHash(fd, st, r_hashCfg.hashMeta);
     }
     int storeFd;
     if(logScriptEvent){
@@ -373,7 +524,7 @@ void FileEventHandler::handleCloseRead(int fd)
         storeFd = -1;
     }
 
-    m_fileEvents.write(O_RDONLY, m_pathbuf, st, hash, storeFd);
+    m_fileEvents->write(O_RDONLY, m_pathbuf, st, hash, storeFd);
 
     logDebug << "closedread-event recorded (collect script:" << logScriptEvent << ")"
              << m_pathbuf;
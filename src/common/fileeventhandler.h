@@ -2,13 +2,15 @@
 
 #include <sys/stat.h>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <QHash>
 #include <QPair>
-#include <QMimeDatabase>
 #include <QTemporaryDir>
+#include <memory>
 
 #include "hashcontrol.h"
+#include "mime_sniffer.h"
 #include "nullable_value.h"
 #include "fileevents.h"
 #include "settings.h"
@@ -31,6 +33,7 @@ public:
     void handleCloseRead(int fd);
 
     FileEvents& fileEvents();
+    std::unique_ptr<FileEvents> takeFileEvents();
 
     void clearEvents();
 
@@ -42,35 +45,57 @@ public:
 
 
 private:
+    // Per directory verdicts of the include-, exclude- and hidden-settings
+    // (similar to the kernel module's dircache). *_OFF: all files within the
+    // directory are rejected, *_ON: all non-hidden files are accepted.
+    // If neither is set, each file is checked on its own.
+    enum DirCacheFlags : uint8_t {
+        DIRCACHE_W_OFF      = 1 << 0,
+        DIRCACHE_R_OFF      = 1 << 1,
+        DIRCACHE_SCRIPT_OFF = 1 << 2,
+        DIRCACHE_W_ON       = 1 << 3,
+        DIRCACHE_R_ON       = 1 << 4,
+        DIRCACHE_SCRIPT_ON  = 1 << 5,
+    };
+
+    std::unique_ptr<FileEvents> mkFileEvents();
     void fillAllowedGroups();
 
     bool userHasWritePermission(const struct stat& st);
     bool userHasReadPermission(const struct stat& st);
     bool readFileTypeMatches(const Settings::ScriptFileSettings& scriptCfg, int fd,
-                             const StrLight &fpath);
+                             const os::stat_t& st, const StrLight &fpath);
     void readLinkOfFd(int fd, StrLight &output);
 
     bool fileExtensionMatches(const Settings::StrLightSet &validExtensions,
                               const StrLight &fullPath);
-    bool mimeTypeMatches(int fd, const Settings::MimeSet& validMimetypes);
+    bool mimeTypeMatches(int fd, const os::stat_t& st,
+                         const Settings::MimeSet& validMimetypes);
     bool generalReadSettingsSayLogIt(bool userHasWritePerm,
-                                     const StrLight &filepath);
+                                     const StrLight &filepath,
+                                     uint8_t dirFlags);
     bool scriptReadSettingsSayLogIt(bool userHasWritePerm,
                                     const StrLight &fpath,
                                     const os::stat_t& st,
-                                    int fd);
-    bool pathIsHidden(const StrLight &fullPath);
+                                    int fd,
+                                    uint8_t dirFlags);
+    uint8_t dirFlagsOfPath(const StrLight &fullPath);
 
     QTemporaryDir m_filecacheDir;
-    FileEvents m_fileEvents;
+    std::unique_ptr<FileEvents> m_fileEvents;
+    uint m_eventFileCount {0};
     HashControl m_hashControl;
     std::unordered_set<gid_t> m_groups;
     uid_t m_uid; // cached real uid
     int m_ourProcFdDirDescriptor; // holds open fd on /proc/self/fd
-    QMimeDatabase m_mimedb;
+    MimeSniffer m_mimeSniffer;
     StrLight m_pathbuf;
     StrLight m_fdStringBuf;
     StrLight m_extensionBuf;
+    std::unordered_map<StrLight, uint8_t> m_dirCache;
+    StrLight m_dirKeyBuf; // raw buffer for lookups
+    const StrLight* m_lastDir {nullptr}; // key of the last hit in m_dirCache
+    uint8_t m_lastDirFlags {0};
 
     const Settings::WriteFileSettings& r_wCfg;
     const Settings::ReadFileSettings& r_rCfg;
@@ -1,7 +1,11 @@
 #include "fileevents.h"
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <QHash>
 
 #include "stdiocpp.h"
 #include "strlight.h"
@@ -52,7 +56,35 @@ off_t FileEvent::fileContentStart() const
 
 const char *FileEvent::path() const
 {
-    return m_path.data();
+    if(m_pathIsStale){
+        m_path = m_dir;
+        if(m_dir != "/"){
+            m_path += '/';
+        }
+        m_path += m_filename;
+        m_pathIsStale = false;
+    }
+    return m_path.constData();
+}
+
+/// Events of the same FileEvents with equal dirId have an
+/// equal dir(), so callers may cache whatever they derive from the latter.
+uint FileEvent::dirId() const
+{
+    return m_dirId;
+}
+
+/// @return the directory of path() ("/" for the root directory). Like
+/// filename(), this refers to the event file or buffers of FileEvents and
+/// is only valid until the next read().
+const QByteArray &FileEvent::dir() const
+{
+    return m_dir;
+}
+
+const QByteArray &FileEvent::filename() const
+{
+    return m_filename;
 }
 
 FILE *FileEvent::file() const
@@ -63,6 +95,23 @@ FILE *FileEvent::file() const
 void FileEvent::setPath(const char *path)
 {
     m_path = path;
+    m_pathIsStale = false;
+}
+
+/// Let dir() and filename() refer to the given data without copying it,
+/// path() is only built on demand.
+void FileEvent::setDirAndFilename(const QByteArray &dir, uint dirId,
+                                  const char *filename, int filenameLen)
+{
+    static const char rootDir[] = "/";
+    if(dir.isEmpty()){
+        m_dir.setRawData(rootDir, 1);
+    } else {
+        m_dir.setRawData(dir.constData(), uint(dir.size()));
+    }
+    m_dirId = dirId;
+    m_filename.setRawData(filename, uint(filenameLen));
+    m_pathIsStale = true;
 }
 
 
@@ -87,6 +136,42 @@ static int freadCstring(FILE* file, char* buf){
     return pathIdx;
 }
 
+/// Read an unsigned LEB128 varint from file.
+/// @return false on EOF
+static bool freadVarint(FILE* file, uint64_t* val){
+    *val = 0;
+    for(unsigned shift=0; shift < 7*SHOURNALK_EV2_VARINT_MAX; shift += 7){
+        int c = stdiocpp::fgetc_unlocked(file);
+        if(c == EOF){
+            return false;
+        }
+        *val |= uint64_t(c & 0x7f) << shift;
+        if((c & 0x80) == 0){
+            return true;
+        }
+    }
+    throw QExcIo(QString("Invalid varint in file %1")
+                 .arg(osutil::findPathOfFd<QByteArray>(fileno(file)).constData()));
+}
+
+static uint64_t freadVarintOrThrow(FILE* file){
+    uint64_t val;
+    if(! freadVarint(file, &val)){
+        throw QExcIo(QString("EOF reached within event in file %1")
+                     .arg(osutil::findPathOfFd<QByteArray>(fileno(file)).constData()));
+    }
+    return val;
+}
+
+static uint64_t freadU64OrThrow(FILE* file){
+    unsigned char buf[8];
+    if(stdiocpp::fread_unlocked(buf, sizeof(buf), 1, file) != 1){
+        throw QExcIo(QString("EOF reached within event in file %1")
+                     .arg(osutil::findPathOfFd<QByteArray>(fileno(file)).constData()));
+    }
+    return shournalk_ev2_get_u64(buf);
+}
+
 bool FileEvents::isReadEvent(int flags)
 {
     switch (flags) {
@@ -112,6 +197,11 @@ FileEvents::FileEvents() :
 
 }
 
+FileEvents::~FileEvents()
+{
+    unmapFile();
+}
+
 /// Write the file-event to the logfile. If storefd != -1 and
 /// the file has a st_size greater than zero, the whole file is copied
 /// as well.
@@ -119,38 +209,18 @@ void FileEvents::write(int flags, const StrLight &path,
                        const struct stat &st, HashValue hash, int storefd)
 {
     bool isREvent =  isReadEvent(flags);
+    const bool storeContent = storefd != -1 && st.st_size > 0;
+    if(unlikely(m_map != nullptr)){
+        // we will not see the new events in the mapping
+        unmapFile();
+    }
 
-    m_eventTmp.flags = flags;
-    m_eventTmp.mtime = st.st_mtime;
-    m_eventTmp.size = st.st_size;
-    m_eventTmp.mode = st.st_mode;
-
-    m_eventTmp.hash = (hash.isNull()) ? 0  : hash.value();
-    m_eventTmp.hash_is_null = hash.isNull();
-
-    m_eventTmp.bytes = (storefd == -1) ? 0 : st.st_size;
-    auto oldOffset = stdiocpp::ftell(m_file);
-    stdiocpp::fwrite_unlocked(&m_eventTmp , sizeof(m_eventTmp), 1, m_file );
-
-    if(m_eventTmp.bytes > 0){
-        assert(os::ltell(storefd) == 0);
-        int targetfd = fileno_unlocked(m_file);
-        // kernel-copy has no idea of our buffer - flush it
-        stdiocpp::fflush(m_file);
-        auto sent = os::sendfile(targetfd, storefd, m_eventTmp.bytes);
-        stdiocpp::fseek(m_file, os::ltell(targetfd), SEEK_SET);
-
-        if(sent != off_t(m_eventTmp.bytes)){
-            // should happpen very rarely - seek back and correct file size
-            logInfo << qtr("Could only collect %1 of %2 bytes for file %3")
-                       .arg(sent).arg(m_eventTmp.bytes)
-                       .arg(osutil::findPathOfFd<QByteArray>(storefd).constData());
-
-            m_eventTmp.bytes = sent;
-            stdiocpp::fseek(m_file, oldOffset, SEEK_SET);
-            stdiocpp::fwrite_unlocked(&m_eventTmp , sizeof(m_eventTmp), 1, m_file );
-            stdiocpp::fseek(m_file, 0, SEEK_END);
-        }
+    if(m_writeVersion == 2){
+        writeV2(flags, path, st, hash, storeContent, storefd);
+    } else {
+        writeV1(flags, path, st, hash, storeContent, storefd);
+    }
+    if(storeContent){
         if(isREvent){
             m_rStoredFilesCount++;
         }
@@ -159,13 +229,14 @@ void FileEvents::write(int flags, const StrLight &path,
         }
     }
 
-     writeFilenameToFile(path, isREvent);
-
      if(isREvent){
          m_rEventCount++;
      } else {
          m_wEventCount++;
      }
+     if(m_maxMemSize > 0 && stdiocpp::ftell(m_file) > m_maxMemSize){
+         spillToDisk();
+     }
 }
 
 void FileEvents::incrementDropCount(int eventType)
@@ -180,44 +251,46 @@ void FileEvents::incrementDropCount(int eventType)
 
 void FileEvents::clear()
 {
+    unmapFile();
     stdiocpp::ftruncate_unlocked(m_file);
+    // The directory of the next path must be written in full
+    m_wbuf_lastReadDir.resize(0);
+    m_wbuf_lastWrittenDir.resize(0);
+    for(auto& dir : m_wbuf_dirSlots){
+        dir.clear();
+    }
+    m_wbuf_lastMtime = 0;
     m_rStoredFilesCount = 0;
     m_wStoredFilesCount = 0;
     m_rEventCount = 0;
     m_wEventCount = 0;
+    m_rDroppedCount = 0;
+    m_wDroppedCount = 0;
 }
 
 
 
+/// @return the next event or nullptr at the end of the file. The returned
+/// event is only valid until the next call.
+/// Unless the file is growing, it is mapped into memory and read without
+/// copying, so the file position is only updated once all events were read.
 FileEvent *FileEvents::read()
 {
-    if(stdiocpp::fread_unlocked(&m_fileEvent.m_close_event,
-                                sizeof(shournalk_close_event), 1, m_file) != 1){
-        return nullptr;
+    if(m_readVersion == 0){
+        if(! detectReadVersion()){
+            return nullptr;
+        }
+        if(! m_growingFile){
+            mapFile();
+        }
     }
-    if(m_fileEvent.fileContentSize() > 0){
-        // remember offset where file content begins, the caller may use this
-        m_fileEvent.m_fileContentStart = stdiocpp::ftell(m_file);
-        stdiocpp::fseek(m_file, m_fileEvent.fileContentSize(), SEEK_CUR);
+    if(m_map != nullptr){
+        return (m_readVersion == 2) ? readMappedV2() : readMappedV1();
     }
-    auto filename_len = freadCstring(m_file, m_pathTmp);
-
-    // If last and current directory-path is equal, the producer
-    // may have omitted it after the first time,
-    // for read- and write-events respectively. In this case,
-    // the path does not start with a '/'
-    auto& lastDir = (isWriteEvent(m_fileEvent.m_close_event.flags))
-            ? m_rbuf_lastWrittenDir : m_rbuf_lastReadDir;
-    if(m_pathTmp[0] == '/'){
-        m_fileEvent.m_path = QByteArray(m_pathTmp, filename_len);
-        lastDir = splitAbsPath<QByteArray>(m_fileEvent.m_path).first;
-    } else {
-        // use dir-path from last time and append current filename
-        m_fileEvent.m_path = pathJoinFilename(
-                                lastDir,
-                                QByteArray::fromRawData(m_pathTmp, filename_len));
+    if(m_growingFile && ! nextEventComplete()){
+        return nullptr;
     }
-    return &m_fileEvent;
+    return (m_readVersion == 2) ? readV2() : readV1();
 }
 
 FILE *FileEvents::file() const
@@ -227,8 +300,65 @@ FILE *FileEvents::file() const
 
 void FileEvents::setFile(FILE *file)
 {
+    unmapFile();
     m_fileEvent.m_file = file;
     m_file = file;
+    m_readEnd = 0;
+    m_readVersion = 0;
+    // these may refer to the mapping of the previous file
+    m_rbuf_lastReadDir.clear();
+    m_rbuf_lastWrittenDir.clear();
+    m_rbuf_lastReadDirId = 0;
+    m_rbuf_lastWrittenDirId = 0;
+    for(auto& dir : m_rbuf_dirSlots){
+        dir.clear();
+    }
+    memset(m_rbuf_dirSlotIds, 0, sizeof(m_rbuf_dirSlotIds));
+    m_rbuf_lastMtime = 0;
+}
+
+bool FileEvents::growingFile() const
+{
+    return m_growingFile;
+}
+
+/// Set to true, if another process may still append events to the file while
+/// we read it. read() then returns nullptr at an incomplete trailing event and
+/// leaves the file position at its start, so reading may be continued later on.
+void FileEvents::setGrowingFile(bool growingFile)
+{
+    m_growingFile = growingFile;
+}
+
+int FileEvents::writeVersion() const
+{
+    return m_writeVersion;
+}
+
+/// The version of the format written by write(): 1 or 2 (default).
+void FileEvents::setWriteVersion(int writeVersion)
+{
+    if(writeVersion != 1 && writeVersion != 2){
+        throw QExcProgramming("bad event format version: " +
+                              QString::number(writeVersion));
+    }
+    m_writeVersion = writeVersion;
+}
+
+off_t FileEvents::maxMemSize() const
+{
+    return m_maxMemSize;
+}
+
+/// Only for files residing in memory (see stdiocpp::memfile):
+/// once the file grows larger than maxMemSize bytes (0: never), write()
+/// moves it to an unnamed file within spillDir (default: the temp dir)
+/// and continues there, so the events of short commands never touch the disk.
+/// Afterwards file() returns the new file, the old one is closed.
+void FileEvents::setMaxMemSize(off_t maxMemSize, const QByteArray &spillDir)
+{
+    m_maxMemSize = maxMemSize;
+    m_spillDir = spillDir;
 }
 
 uint FileEvents::wEventCount() const
@@ -264,6 +394,511 @@ uint FileEvents::wStoredFilesCount() const
 }
 
 
+/// @return true, if the event at the current file position was written
+/// completely. The file position is not changed.
+bool FileEvents::nextEventComplete()
+{
+    const long start = stdiocpp::ftell(m_file);
+    auto completeBefore = [this, start](off_t end){
+        return (m_readVersion == 2) ? eventCompleteBeforeV2(start, end)
+                                    : eventCompleteBefore(start, end);
+    };
+    if(completeBefore(m_readEnd)){
+        return true;
+    }
+    // Obtain the file size *before* reading the event again: the producer
+    // corrects the content size of an event, before appending anything else.
+    m_readEnd = os::fstat(fileno_unlocked(m_file)).st_size;
+    // Drop buffered data, it may contain such an outdated event.
+    stdiocpp::fflush(m_file);
+    return completeBefore(m_readEnd);
+}
+
+bool FileEvents::eventCompleteBefore(long start, off_t end)
+{
+    shournalk_close_event ev;
+    if(start + off_t(sizeof(ev)) > end){
+        return false;
+    }
+    bool complete = false;
+    if(stdiocpp::fread_unlocked(&ev, sizeof(ev), 1, m_file) == 1){
+        off_t pos = start + off_t(sizeof(ev)) + off_t(ev.bytes);
+        if(pos < end){
+            stdiocpp::fseek(m_file, pos, SEEK_SET);
+            for(; pos < end; pos++){
+                int c = stdiocpp::fgetc_unlocked(m_file);
+                if(c == EOF){
+                    break;
+                }
+                if(c == '\0'){
+                    complete = true;
+                    break;
+                }
+            }
+        }
+    }
+    stdiocpp::fseek(m_file, start, SEEK_SET);
+    return complete;
+}
+
+/// Like eventCompleteBefore for format version 2
+bool FileEvents::eventCompleteBeforeV2(long start, off_t end)
+{
+    off_t pos = start;
+    auto getc = [this, &pos, end]() -> int {
+        if(pos >= end){
+            return EOF;
+        }
+        pos++;
+        return stdiocpp::fgetc_unlocked(m_file);
+    };
+    auto skipVarint = [&getc]() -> bool {
+        for(int i=0; i < SHOURNALK_EV2_VARINT_MAX; i++){
+            int c = getc();
+            if(c == EOF){
+                return false;
+            }
+            if((c & 0x80) == 0){
+                return true;
+            }
+        }
+        return false;
+    };
+    auto skipCstring = [&getc]() -> bool {
+        int c;
+        while((c=getc()) != EOF){
+            if(c == '\0'){
+                return true;
+            }
+        }
+        return false;
+    };
+
+    bool complete = false;
+    uint64_t tag;
+    if(freadVarint(m_file, &tag)){
+        // the tag is read twice, that's cheaper than calculating its length
+        stdiocpp::fseek(m_file, start, SEEK_SET);
+        if(skipVarint() && skipVarint() && skipVarint() && skipVarint()){
+            if(tag & SHOURNALK_EV2_HAS_HASH){
+                pos += 8;
+                if(pos <= end){
+                    stdiocpp::fseek(m_file, pos, SEEK_SET);
+                }
+            }
+            if(pos <= end &&
+               (! (tag & SHOURNALK_EV2_NEW_DIR) || skipCstring()) &&
+               skipCstring()){
+                if(! (tag & SHOURNALK_EV2_HAS_CONTENT)){
+                    complete = true;
+                } else if(pos + 8 <= end){
+                    const off_t contentSize = off_t(freadU64OrThrow(m_file));
+                    complete = pos + 8 + contentSize <= end;
+                }
+            }
+        }
+    }
+    stdiocpp::fseek(m_file, start, SEEK_SET);
+    return complete;
+}
+
+void FileEvents::spillToDisk()
+{
+    logDebug << "moving file events to disk after" << m_maxMemSize << "bytes";
+    // kernel-copy has no idea of our buffer - flush it
+    stdiocpp::fflush(m_file);
+    const int memFd = fileno_unlocked(m_file);
+    const off_t size = os::ltell(memFd);
+    FILE* diskFile;
+    if(m_spillDir.isEmpty()){
+        diskFile = stdiocpp::tmpfile();
+    } else {
+        QByteArray path = pathJoinFilename(m_spillDir, QByteArray("file-events.XXXXXX"));
+        const int fd = osutil::mktmp(path);
+        os::remove(path);
+        try {
+            diskFile = stdiocpp::fdopen(fd, "w+");
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+    }
+    try {
+        if(os::sendfile(fileno_unlocked(diskFile), memFd, size_t(size)) != size){
+            throw QExcIo(qtr("Failed to move %1 bytes of file events to disk")
+                         .arg(size));
+        }
+        stdiocpp::fseek(diskFile, 0, SEEK_END);
+    } catch (...) {
+        fclose(diskFile);
+        throw;
+    }
+    fclose(m_file);
+    setFile(diskFile);
+    m_maxMemSize = 0;
+}
+
+void FileEvents::writeV1(int flags, const StrLight &path, const struct stat &st,
+                         HashValue hash, bool storeContent, int storefd)
+{
+    m_eventTmp.flags = flags;
+    m_eventTmp.mtime = st.st_mtime;
+    m_eventTmp.size = st.st_size;
+    m_eventTmp.mode = st.st_mode;
+
+    m_eventTmp.hash = (hash.isNull()) ? 0  : hash.value();
+    m_eventTmp.hash_is_null = hash.isNull();
+
+    m_eventTmp.bytes = (storeContent) ? st.st_size : 0;
+    auto oldOffset = stdiocpp::ftell(m_file);
+    stdiocpp::fwrite_unlocked(&m_eventTmp , sizeof(m_eventTmp), 1, m_file );
+
+    if(storeContent){
+        auto sent = writeFileContent(storefd, m_eventTmp.bytes);
+        if(sent != off_t(m_eventTmp.bytes)){
+            // should happpen very rarely - seek back and correct file size
+            m_eventTmp.bytes = sent;
+            stdiocpp::fseek(m_file, oldOffset, SEEK_SET);
+            stdiocpp::fwrite_unlocked(&m_eventTmp , sizeof(m_eventTmp), 1, m_file );
+            stdiocpp::fseek(m_file, 0, SEEK_END);
+        }
+    }
+    writeFilenameToFile(path, isReadEvent(flags));
+}
+
+/// Write the event in format version 2 (see shournalk_user.h). Other than
+/// the kernel module, we choose the directory slot by the hash of the
+/// directory path.
+void FileEvents::writeV2(int flags, const StrLight &path, const struct stat &st,
+                         HashValue hash, bool storeContent, int storefd)
+{
+    int slashIdx = path.lastIndexOf('/');
+    if(unlikely(slashIdx < 0)){
+        throw QExcProgramming(QString("Invalid path %1").arg(path.c_str()));
+    }
+    if(unlikely(stdiocpp::ftell(m_file) == 0)){
+        stdiocpp::fwrite_unlocked(SHOURNALK_EV2_MAGIC, SHOURNALK_EV2_MAGIC_LEN, 1, m_file);
+    }
+    // files in the root directory have an empty directory path
+    const auto dir = QByteArray::fromRawData(path.constData(), slashIdx);
+    const uint slot = qHash(dir) % SHOURNALK_EV2_DIR_SLOTS;
+    const bool newDir = m_wbuf_dirSlots[slot] != dir;
+
+    uint64_t tag = uint64_t(flags) | (uint64_t(slot) << SHOURNALK_EV2_SLOT_SHIFT);
+    if(! hash.isNull()) tag |= SHOURNALK_EV2_HAS_HASH;
+    if(storeContent) tag |= SHOURNALK_EV2_HAS_CONTENT;
+    if(newDir) tag |= SHOURNALK_EV2_NEW_DIR;
+
+    unsigned char buf[SHOURNALK_EV2_HEAD_MAX];
+    unsigned len = shournalk_ev2_put_varint(buf, tag);
+    len += shournalk_ev2_put_varint(buf + len, shournalk_ev2_zigzag(
+                                        int64_t(st.st_mtime) - m_wbuf_lastMtime));
+    len += shournalk_ev2_put_varint(buf + len, uint64_t(st.st_size));
+    len += shournalk_ev2_put_varint(buf + len, uint64_t(st.st_mode));
+    if(! hash.isNull()){
+        shournalk_ev2_put_u64(buf + len, hash.value());
+        len += 8;
+    }
+    m_wbuf_lastMtime = st.st_mtime;
+    stdiocpp::fwrite_unlocked(buf, len, 1, m_file);
+
+    if(newDir){
+        if(slashIdx > 0){
+            stdiocpp::fwrite_unlocked(path.c_str(), size_t(slashIdx), 1, m_file);
+        }
+        stdiocpp::fwrite_unlocked("", 1, 1, m_file);
+        m_wbuf_dirSlots[slot] = QByteArray(path.constData(), slashIdx);
+    }
+    // including nul
+    stdiocpp::fwrite_unlocked(path.c_str() + slashIdx + 1,
+                              path.size() - size_t(slashIdx), 1, m_file);
+    if(! storeContent){
+        return;
+    }
+    const auto sizeOffset = stdiocpp::ftell(m_file);
+    shournalk_ev2_put_u64(buf, uint64_t(st.st_size));
+    stdiocpp::fwrite_unlocked(buf, 8, 1, m_file);
+    auto sent = writeFileContent(storefd, st.st_size);
+    if(sent != st.st_size){
+        // should happpen very rarely - seek back and correct file size
+        shournalk_ev2_put_u64(buf, uint64_t(sent));
+        stdiocpp::fseek(m_file, sizeOffset, SEEK_SET);
+        stdiocpp::fwrite_unlocked(buf, 8, 1, m_file);
+        stdiocpp::fseek(m_file, 0, SEEK_END);
+    }
+}
+
+/// Copy the content of storefd to our file.
+/// @return the number of copied bytes
+off_t FileEvents::writeFileContent(int storefd, off_t size)
+{
+    assert(os::ltell(storefd) == 0);
+    int targetfd = fileno_unlocked(m_file);
+    // kernel-copy has no idea of our buffer - flush it
+    stdiocpp::fflush(m_file);
+    auto sent = os::sendfile(targetfd, storefd, size_t(size));
+    stdiocpp::fseek(m_file, os::ltell(targetfd), SEEK_SET);
+    if(sent != size){
+        logInfo << qtr("Could only collect %1 of %2 bytes for file %3")
+                   .arg(sent).arg(size)
+                   .arg(osutil::findPathOfFd<QByteArray>(storefd).constData());
+    }
+    return sent;
+}
+
+/// @return false, if it is too early to tell the format version
+/// of a growing file.
+bool FileEvents::detectReadVersion()
+{
+    const long start = stdiocpp::ftell(m_file);
+    if(m_growingFile &&
+       os::fstat(fileno_unlocked(m_file)).st_size - start < SHOURNALK_EV2_MAGIC_LEN){
+        return false;
+    }
+    char magic[SHOURNALK_EV2_MAGIC_LEN];
+    if(stdiocpp::fread_unlocked(magic, sizeof(magic), 1, m_file) == 1 &&
+       memcmp(magic, SHOURNALK_EV2_MAGIC, sizeof(magic)) == 0){
+        m_readVersion = 2;
+    } else {
+        m_readVersion = 1;
+        stdiocpp::fseek(m_file, start, SEEK_SET);
+    }
+    return true;
+}
+
+FileEvent *FileEvents::readV1()
+{
+    if(stdiocpp::fread_unlocked(&m_fileEvent.m_close_event,
+                                sizeof(shournalk_close_event), 1, m_file) != 1){
+        return nullptr;
+    }
+    if(m_fileEvent.fileContentSize() > 0){
+        // remember offset where file content begins, the caller may use this
+        m_fileEvent.m_fileContentStart = stdiocpp::ftell(m_file);
+        stdiocpp::fseek(m_file, m_fileEvent.fileContentSize(), SEEK_CUR);
+    }
+    // without nul
+    const int len = freadCstring(m_file, m_pathTmp) - 1;
+
+    // If last and current directory-path is equal, the producer
+    // may have omitted it after the first time,
+    // for read- and write-events respectively. In this case,
+    // the path does not start with a '/'
+    const bool isWrite = isWriteEvent(m_fileEvent.m_close_event.flags);
+    auto& lastDir = (isWrite) ? m_rbuf_lastWrittenDir : m_rbuf_lastReadDir;
+    auto& lastDirId = (isWrite) ? m_rbuf_lastWrittenDirId : m_rbuf_lastReadDirId;
+    int slashIdx = -1;
+    if(m_pathTmp[0] == '/'){
+        slashIdx = int(static_cast<const char*>(memrchr(m_pathTmp, '/', size_t(len))) -
+                       m_pathTmp);
+        lastDir = (slashIdx == 0) ? QByteArray("/") : QByteArray(m_pathTmp, slashIdx);
+        lastDirId = m_rbuf_nextDirId++;
+    }
+    m_fileEvent.setDirAndFilename(lastDir, lastDirId, m_pathTmp + slashIdx + 1,
+                                  len - slashIdx - 1);
+    return &m_fileEvent;
+}
+
+FileEvent *FileEvents::readV2()
+{
+    auto& ev = m_fileEvent.m_close_event;
+    uint64_t tag;
+    if(! freadVarint(m_file, &tag)){
+        return nullptr;
+    }
+    const uint64_t slot = tag >> SHOURNALK_EV2_SLOT_SHIFT;
+    if(slot >= SHOURNALK_EV2_DIR_SLOTS){
+        throw QExcIo(QString("Invalid directory slot %1 in file %2").arg(slot)
+                     .arg(osutil::findPathOfFd<QByteArray>(fileno(m_file)).constData()));
+    }
+    ev.flags = int(tag & SHOURNALK_EV2_FLAGS_MASK);
+    m_rbuf_lastMtime += shournalk_ev2_unzigzag(freadVarintOrThrow(m_file));
+    ev.mtime = uint64_t(m_rbuf_lastMtime);
+    ev.size = freadVarintOrThrow(m_file);
+    ev.mode = freadVarintOrThrow(m_file);
+    ev.hash_is_null = ! (tag & SHOURNALK_EV2_HAS_HASH);
+    ev.hash = (ev.hash_is_null) ? 0 : freadU64OrThrow(m_file);
+
+    if(tag & SHOURNALK_EV2_NEW_DIR){
+        auto len = freadCstring(m_file, m_pathTmp);
+        m_rbuf_dirSlots[slot] = QByteArray(m_pathTmp, len - 1);
+        m_rbuf_dirSlotIds[slot] = m_rbuf_nextDirId++;
+    }
+    auto filename_len = freadCstring(m_file, m_pathTmp);
+    m_fileEvent.setDirAndFilename(m_rbuf_dirSlots[slot], m_rbuf_dirSlotIds[slot],
+                                  m_pathTmp, filename_len - 1);
+
+    if(tag & SHOURNALK_EV2_HAS_CONTENT){
+        ev.bytes = freadU64OrThrow(m_file);
+        // remember offset where file content begins, the caller may use this
+        m_fileEvent.m_fileContentStart = stdiocpp::ftell(m_file);
+        stdiocpp::fseek(m_file, m_fileEvent.fileContentSize(), SEEK_CUR);
+    } else {
+        ev.bytes = 0;
+    }
+    return &m_fileEvent;
+}
+
+/// Map the remainder of a complete event file into memory. On failure
+/// we keep reading via stdio.
+void FileEvents::mapFile()
+{
+    const long pos = stdiocpp::ftell(m_file);
+    const off_t size = os::fstat(fileno_unlocked(m_file)).st_size;
+    if(size <= pos){
+        return;
+    }
+    void* addr = mmap(nullptr, size_t(size), PROT_READ, MAP_PRIVATE,
+                      fileno_unlocked(m_file), 0);
+    if(addr == MAP_FAILED){
+        logDebug << "failed to map event file, reading it via stdio:"
+                 << strerror(errno);
+        return;
+    }
+    madvise(addr, size_t(size), MADV_SEQUENTIAL);
+    m_map = static_cast<const char*>(addr);
+    m_mapSize = size_t(size);
+    m_mapPos = size_t(pos);
+}
+
+void FileEvents::unmapFile()
+{
+    if(m_map == nullptr){
+        return;
+    }
+    munmap(const_cast<char*>(m_map), m_mapSize);
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_mapPos = 0;
+}
+
+/// @return a pointer after the nul of the c-string at *pos, which is
+/// advanced accordingly.
+static const char* skipMappedCstring(const char* map, size_t mapSize, size_t* pos,
+                                     FILE* file){
+    const void* nul = memchr(map + *pos, '\0', mapSize - *pos);
+    if(nul == nullptr){
+        throw QExcIo(QString("EOF reached without expected null-terminator for file %1")
+                     .arg(osutil::findPathOfFd<QByteArray>(fileno(file)).constData()));
+    }
+    const char* start = map + *pos;
+    *pos = size_t(static_cast<const char*>(nul) - map) + 1;
+    return start;
+}
+
+/// Like readV1, but read from the mapped file.
+FileEvent *FileEvents::readMappedV1()
+{
+    auto& ev = m_fileEvent.m_close_event;
+    if(m_mapSize - m_mapPos < sizeof(shournalk_close_event)){
+        stdiocpp::fseek(m_file, long(m_mapSize), SEEK_SET);
+        return nullptr;
+    }
+    memcpy(&ev, m_map + m_mapPos, sizeof(shournalk_close_event));
+    m_mapPos += sizeof(shournalk_close_event);
+    if(ev.bytes > 0){
+        m_fileEvent.m_fileContentStart = off_t(m_mapPos);
+        if(ev.bytes > m_mapSize - m_mapPos){
+            throw QExcIo(QString("EOF reached within file content for file %1")
+                         .arg(osutil::findPathOfFd<QByteArray>(fileno(m_file)).constData()));
+        }
+        m_mapPos += ev.bytes;
+    }
+    const char* path = skipMappedCstring(m_map, m_mapSize, &m_mapPos, m_file);
+    const int len = int(m_map + m_mapPos - path) - 1;
+
+    const bool isWrite = isWriteEvent(ev.flags);
+    auto& lastDir = (isWrite) ? m_rbuf_lastWrittenDir : m_rbuf_lastReadDir;
+    auto& lastDirId = (isWrite) ? m_rbuf_lastWrittenDirId : m_rbuf_lastReadDirId;
+    int slashIdx = -1;
+    if(path[0] == '/'){
+        slashIdx = int(static_cast<const char*>(memrchr(path, '/', size_t(len))) - path);
+        // the root directory is set by setDirAndFilename
+        lastDir.setRawData(path, uint(slashIdx));
+        lastDirId = m_rbuf_nextDirId++;
+    }
+    m_fileEvent.setDirAndFilename(lastDir, lastDirId, path + slashIdx + 1,
+                                  len - slashIdx - 1);
+    return &m_fileEvent;
+}
+
+/// Like readV2, but read from the mapped file. The directories
+/// of the slots refer to the mapped file as well.
+FileEvent *FileEvents::readMappedV2()
+{
+    auto& ev = m_fileEvent.m_close_event;
+    if(m_mapPos == m_mapSize){
+        stdiocpp::fseek(m_file, long(m_mapSize), SEEK_SET);
+        return nullptr;
+    }
+    const auto* p = reinterpret_cast<const unsigned char*>(m_map + m_mapPos);
+    const auto* end = reinterpret_cast<const unsigned char*>(m_map + m_mapSize);
+    auto throwTruncated = [this]{
+        throw QExcIo(QString("EOF reached within event in file %1")
+                     .arg(osutil::findPathOfFd<QByteArray>(fileno(m_file)).constData()));
+    };
+    auto parseVarint = [&p, end, &throwTruncated]() -> uint64_t {
+        uint64_t val = 0;
+        for(unsigned shift=0; shift < 7*SHOURNALK_EV2_VARINT_MAX; shift += 7){
+            if(p == end){
+                throwTruncated();
+            }
+            const unsigned char c = *p++;
+            val |= uint64_t(c & 0x7f) << shift;
+            if((c & 0x80) == 0){
+                return val;
+            }
+        }
+        throw QExcIo("Invalid varint in event file");
+    };
+    auto parseU64 = [&p, end, &throwTruncated]() -> uint64_t {
+        if(end - p < 8){
+            throwTruncated();
+        }
+        const uint64_t val = shournalk_ev2_get_u64(p);
+        p += 8;
+        return val;
+    };
+
+    const uint64_t tag = parseVarint();
+    const uint64_t slot = tag >> SHOURNALK_EV2_SLOT_SHIFT;
+    if(slot >= SHOURNALK_EV2_DIR_SLOTS){
+        throw QExcIo(QString("Invalid directory slot %1 in file %2").arg(slot)
+                     .arg(osutil::findPathOfFd<QByteArray>(fileno(m_file)).constData()));
+    }
+    ev.flags = int(tag & SHOURNALK_EV2_FLAGS_MASK);
+    m_rbuf_lastMtime += shournalk_ev2_unzigzag(parseVarint());
+    ev.mtime = uint64_t(m_rbuf_lastMtime);
+    ev.size = parseVarint();
+    ev.mode = parseVarint();
+    ev.hash_is_null = ! (tag & SHOURNALK_EV2_HAS_HASH);
+    ev.hash = (ev.hash_is_null) ? 0 : parseU64();
+
+    m_mapPos = size_t(reinterpret_cast<const char*>(p) - m_map);
+    if(tag & SHOURNALK_EV2_NEW_DIR){
+        const char* dir = skipMappedCstring(m_map, m_mapSize, &m_mapPos, m_file);
+        m_rbuf_dirSlots[slot].setRawData(dir, uint(m_map + m_mapPos - dir) - 1);
+        m_rbuf_dirSlotIds[slot] = m_rbuf_nextDirId++;
+    }
+    const char* filename = skipMappedCstring(m_map, m_mapSize, &m_mapPos, m_file);
+    m_fileEvent.setDirAndFilename(m_rbuf_dirSlots[slot], m_rbuf_dirSlotIds[slot],
+                                  filename, int(m_map + m_mapPos - filename) - 1);
+
+    if(tag & SHOURNALK_EV2_HAS_CONTENT){
+        p = reinterpret_cast<const unsigned char*>(m_map + m_mapPos);
+        ev.bytes = parseU64();
+        m_mapPos += 8;
+        if(ev.bytes > m_mapSize - m_mapPos){
+            throwTruncated();
+        }
+        m_fileEvent.m_fileContentStart = off_t(m_mapPos);
+        m_mapPos += ev.bytes;
+    } else {
+        ev.bytes = 0;
+    }
+    return &m_fileEvent;
+}
+
 void FileEvents::writeFilenameToFile(const StrLight &path, bool isREvent)
 {
     auto & lastDir = (isREvent) ? m_wbuf_lastReadDir : m_wbuf_lastWrittenDir;
@@ -19,13 +19,23 @@ public:
     off_t fileContentStart() const;
     const char* path() const;
 
+    uint dirId() const;
+    const QByteArray& dir() const;
+    const QByteArray& filename() const;
+
     FILE *file() const;
 
 private:
     void setPath(const char* path);
+    void setDirAndFilename(const QByteArray& dir, uint dirId,
+                           const char* filename, int filenameLen);
 
     shournalk_close_event m_close_event;
-    QByteArray m_path;
+    mutable QByteArray m_path;
+    mutable bool m_pathIsStale{false};
+    QByteArray m_dir;
+    QByteArray m_filename;
+    uint m_dirId{0};
     off_t m_fileContentStart;
     FILE* m_file;
 
@@ -35,7 +45,10 @@ private:
 
 
 /// Write file-events (in binary format) to a log-file and
-/// read them later on.
+/// read them later on. Both versions of the format written by the
+/// kernel module (see shournalk_user.h) are read, version 2 is
+/// written by default. Complete files are mapped into memory for reading,
+/// so the events refer to the mapping instead of copies.
 class FileEvents
 {
 public:
@@ -44,6 +57,7 @@ public:
 
 public:
     FileEvents();
+    ~FileEvents();
 
     void write(int flags, const StrLight &path,
                const struct stat &st, HashValue hash, int storefd=-1);
@@ -56,6 +70,15 @@ public:
     FILE *file() const;
     void setFile(FILE *file);
 
+    bool growingFile() const;
+    void setGrowingFile(bool growingFile);
+
+    int writeVersion() const;
+    void setWriteVersion(int writeVersion);
+
+    off_t maxMemSize() const;
+    void setMaxMemSize(off_t maxMemSize, const QByteArray& spillDir=QByteArray());
+
     uint rEventCount() const;
     uint rDroppedCount() const;
     uint rStoredFilesCount() const;
@@ -69,17 +92,50 @@ public:
 private:
     Q_DISABLE_COPY(FileEvents)
 
+    void writeV1(int flags, const StrLight& path, const struct stat &st,
+                 HashValue hash, bool storeContent, int storefd);
+    void writeV2(int flags, const StrLight& path, const struct stat &st,
+                 HashValue hash, bool storeContent, int storefd);
+    off_t writeFileContent(int storefd, off_t size);
     void writeFilenameToFile(const StrLight& path, bool isREvent);
+    bool detectReadVersion();
+    FileEvent* readV1();
+    FileEvent* readV2();
+    void mapFile();
+    void unmapFile();
+    FileEvent* readMappedV1();
+    FileEvent* readMappedV2();
+    bool nextEventComplete();
+    bool eventCompleteBefore(long start, off_t end);
+    bool eventCompleteBeforeV2(long start, off_t end);
+    void spillToDisk();
 
     FILE* m_file{};
+    bool m_growingFile{false};
+    off_t m_readEnd{0};
+    int m_readVersion{0}; // 0: not yet known
+    const char* m_map{nullptr};
+    size_t m_mapSize{0};
+    size_t m_mapPos{0};
+    int m_writeVersion{2};
+    off_t m_maxMemSize{0};
+    QByteArray m_spillDir;
     FileEvent m_fileEvent{};
     shournalk_close_event m_eventTmp{};
 
     StrLight m_wbuf_lastReadDir;
     StrLight m_wbuf_lastWrittenDir;
+    QByteArray m_wbuf_dirSlots[SHOURNALK_EV2_DIR_SLOTS];
+    int64_t m_wbuf_lastMtime{0};
 
     QByteArray m_rbuf_lastReadDir;
     QByteArray m_rbuf_lastWrittenDir;
+    uint m_rbuf_lastReadDirId{0};
+    uint m_rbuf_lastWrittenDirId{0};
+    QByteArray m_rbuf_dirSlots[SHOURNALK_EV2_DIR_SLOTS];
+    uint m_rbuf_dirSlotIds[SHOURNALK_EV2_DIR_SLOTS]{};
+    uint m_rbuf_nextDirId{1};
+    int64_t m_rbuf_lastMtime{0};
     char m_pathTmp[PATH_MAX];
     uint m_rEventCount{0};
     uint m_rDroppedCount{0};
@@ -88,6 +144,8 @@ private:
     uint m_wEventCount{0};
     uint m_wDroppedCount{0};
     uint m_wStoredFilesCount{0};
+
+    friend class BenchmarkEventFormat;
 };
 
 
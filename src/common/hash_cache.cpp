@@ -0,0 +1,377 @@
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <QDir>
+#include <QStandardPaths>
+
+#include "hash_cache.h"
+#include "cleanupresource.h"
+#include "excos.h"
+#include "logger.h"
+#include "os.h"
+#include "settings.h"
+
+namespace {
+
+const char HASH_CACHE_MAGIC[8] = {'S', 'H', 'R', 'N', 'H', 'A', 'S', 'H'};
+const uint32_t HASH_CACHE_VERSION = 2;
+const uint32_t HASH_CACHE_MAX_BUCKET_COUNT = 1 << 20;
+
+// Files whose mtime or ctime is younger are not cached: the kernel updates
+// timestamps with a coarse granularity, so a following modification
+// might not be visible in them.
+const int64_t RACY_NSECS = 2 * 1000000000ll;
+
+struct Key {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtimeNs;
+    int64_t ctimeNs;
+    int32_t maxCountOfReads;
+    uint16_t chunkSize; // see fitsKey()
+    uint16_t algorithm;
+
+    bool operator==(const Key& rhs) const {
+        return memcmp(this, &rhs, sizeof (Key)) == 0;
+    }
+
+    bool sameFile(const Key& rhs) const {
+        return dev == rhs.dev && ino == rhs.ino &&
+               chunkSize == rhs.chunkSize && maxCountOfReads == rhs.maxCountOfReads &&
+               algorithm == rhs.algorithm;
+    }
+};
+
+static_assert (sizeof (Key) == 48, "");
+
+inline int64_t toNs(const struct timespec& ts){
+    return int64_t(ts.tv_sec) * 1000000000ll + ts.tv_nsec;
+}
+
+/// Keep an entry at 64 bytes: the chunksize is limited to 40KiB by
+/// the settings, so store it in 16 bits. Hashes of larger ones are not cached.
+inline bool fitsKey(const HashMeta& hashMeta){
+    return hashMeta.chunkSize >= 0 && hashMeta.chunkSize <= UINT16_MAX;
+}
+
+Key mkKey(const struct stat& st, const HashMeta& hashMeta){
+    Key k;
+    memset(&k, 0, sizeof (k));
+    k.dev = uint64_t(st.st_dev);
+    k.ino = uint64_t(st.st_ino);
+    k.size = st.st_size;
+    k.mtimeNs = toNs(st.st_mtim);
+    k.ctimeNs = toNs(st.st_ctim);
+    k.maxCountOfReads = hashMeta.maxCountOfReads;
+    k.chunkSize = uint16_t(hashMeta.chunkSize);
+    k.algorithm = uint16_t(hashMeta.algorithm);
+    return k;
+}
+
+inline uint64_t mix64(uint64_t x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+struct alignas(64) RawHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bucketCount;
+    uint32_t ways;
+    uint32_t entrySize;
+    uint32_t clock;
+};
+
+} // namespace
+
+
+/// Same layout as RawHeader, which is used for reading and writing it.
+struct alignas(64) HashCache::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t bucketCount;
+    uint32_t ways;
+    uint32_t entrySize;
+    std::atomic<uint32_t> clock; // incremented on each use of an entry
+};
+
+/// seq is odd while the entry is written and 0, if it was never used.
+struct HashCache::Entry {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> lastUse;
+    Key key;
+    uint64_t hash;
+};
+
+static_assert (sizeof (std::atomic<uint32_t>) == sizeof (uint32_t), "");
+
+const uint32_t HashCache::CACHE_WAYS;
+const uint32_t HashCache::DEFAULT_BUCKET_COUNT;
+
+
+/// @return the cache shared by all shournal processes of the user or null,
+/// if disabled in the settings or it could not be opened.
+HashCache *HashCache::defaultCache()
+{
+    static HashCache cache;
+    static const bool ok = [] {
+        if(! Settings::instance().hashSettings().persistentCache){
+            return false;
+        }
+        try {
+            cache.open(defaultPath());
+            return true;
+        } catch (const std::exception& ex) {
+            logWarning << qtr("Failed to open the hash cache, continuing without it: %1")
+                          .arg(ex.what());
+            return false;
+        }
+    }();
+    return (ok) ? &cache : nullptr;
+}
+
+std::string HashCache::defaultPath()
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir().mkpath(dir);
+    return (dir + "/hashcache").toUtf8().constData();
+}
+
+HashCache::HashCache() :
+    m_header(nullptr),
+    m_entries(nullptr),
+    m_mapSize(0),
+    m_bucketMask(0)
+{
+    static_assert (sizeof (Header) == sizeof (RawHeader), "");
+    static_assert (offsetof(Header, clock) == offsetof(RawHeader, clock), "");
+    static_assert (sizeof (Entry) == 64, "");
+}
+
+HashCache::~HashCache()
+{
+    close();
+}
+
+/// Open or create the cache file at path. If it exists with a different
+/// bucket count, that one is used. An invalid file (or one written by another
+/// version) is atomically replaced, so processes still using it are
+/// not disturbed.
+/// @param bucketCount: must be a power of two.
+/// @throws ExcOs
+void HashCache::open(const std::string &path, uint32_t bucketCount)
+{
+    assert(! isOpen());
+    assert(bucketCount > 0 && (bucketCount & (bucketCount - 1)) == 0);
+
+    for(int attempt=0; attempt < 3; attempt++){
+        const int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW);
+        if(fd == -1){
+            if(errno != ENOENT){
+                throw os::ExcOs("Failed to open " + path);
+            }
+            createCacheFile(path, bucketCount);
+            continue;
+        }
+        auto closeFd = finally([&fd] { ::close(fd); });
+        if(mapAndValidate(fd, bucketCount)){
+            return;
+        }
+        logDebug << "replacing invalid hash cache" << path.c_str();
+        createCacheFile(path, bucketCount);
+    }
+    throw os::ExcOs("Failed to set up the hash cache at " + path, EINVAL);
+}
+
+void HashCache::close()
+{
+    if(m_header == nullptr){
+        return;
+    }
+    munmap(m_header, m_mapSize);
+    m_header = nullptr;
+    m_entries = nullptr;
+    m_mapSize = 0;
+    m_bucketMask = 0;
+}
+
+bool HashCache::isOpen() const
+{
+    return m_header != nullptr;
+}
+
+/// @return the cached hash or null, if not in cache.
+HashValue HashCache::lookup(const struct stat &st, const HashMeta &hashMeta)
+{
+    assert(isOpen());
+    if(! fitsKey(hashMeta)){
+        return {};
+    }
+    const Key key = mkKey(st, hashMeta);
+    Entry* bucket = bucketOf(st, hashMeta);
+    for(uint32_t i=0; i < CACHE_WAYS; i++){
+        Entry& e = bucket[i];
+        const uint32_t seq = e.seq.load(std::memory_order_acquire);
+        if(seq == 0 || (seq & 1)){
+            continue;
+        }
+        Key k;
+        memcpy(&k, &e.key, sizeof (k));
+        const uint64_t hash = e.hash;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(e.seq.load(std::memory_order_relaxed) != seq || ! (k == key)){
+            continue;
+        }
+        e.lastUse.store(m_header->clock.fetch_add(1, std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+        return HashValue(hash);
+    }
+    return {};
+}
+
+/// Cache the hash of a file with the given stat. Nothing is done, if the
+/// file was modified too recently (see isRacy()), the hash is null or
+/// another process is writing to the same entry.
+void HashCache::insert(const struct stat &st, const HashMeta &hashMeta, const HashValue &hash)
+{
+    assert(isOpen());
+    if(hash.isNull() || isRacy(st) || ! fitsKey(hashMeta)){
+        return;
+    }
+    const Key key = mkKey(st, hashMeta);
+    Entry* bucket = bucketOf(st, hashMeta);
+    const uint32_t now = m_header->clock.fetch_add(1, std::memory_order_relaxed);
+
+    // Prefer an older version of the same file, then an unused entry, else
+    // evict the least recently used one.
+    Entry* sameFile = nullptr;
+    Entry* unused = nullptr;
+    Entry* oldest = nullptr;
+    uint32_t maxAge = 0;
+    for(uint32_t i=0; i < CACHE_WAYS; i++){
+        Entry& e = bucket[i];
+        const uint32_t seq = e.seq.load(std::memory_order_acquire);
+        if(seq == 0){
+            if(unused == nullptr){
+                unused = &e;
+            }
+            continue;
+        }
+        if(! (seq & 1) && e.key.sameFile(key)){
+            sameFile = &e;
+            break;
+        }
+        const uint32_t age = now - e.lastUse.load(std::memory_order_relaxed);
+        if(oldest == nullptr || age > maxAge){
+            oldest = &e;
+            maxAge = age;
+        }
+    }
+    Entry* victim = (sameFile != nullptr) ? sameFile :
+                    (unused != nullptr) ? unused : oldest;
+
+    uint32_t seq = victim->seq.load(std::memory_order_relaxed);
+    if((seq & 1) || ! victim->seq.compare_exchange_strong(seq, seq + 1,
+                                                         std::memory_order_acquire)){
+        return;
+    }
+    // readers must not observe the new content along with the old sequence
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&victim->key, &key, sizeof (key));
+    victim->hash = hash.value();
+    victim->lastUse.store(now, std::memory_order_relaxed);
+    victim->seq.store(seq + 2, std::memory_order_release);
+}
+
+/// @return true, if the file's mtime or ctime is so recent, that a
+/// modification within the same timestamp-tick could go unnoticed.
+bool HashCache::isRacy(const struct stat &st)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const int64_t limit = toNs(now) - RACY_NSECS;
+    return toNs(st.st_mtim) > limit || toNs(st.st_ctim) > limit;
+}
+
+/// @return false, if the file is not a valid cache file.
+bool HashCache::mapAndValidate(int fd, uint32_t bucketCount)
+{
+    const auto st = os::fstat(fd);
+    if(st.st_uid != os::geteuid() || size_t(st.st_size) < sizeof (RawHeader)){
+        return false;
+    }
+    RawHeader h;
+    if(pread(fd, &h, sizeof (h), 0) != ssize_t(sizeof (h))){
+        return false;
+    }
+    bucketCount = h.bucketCount;
+    const size_t mapSize = sizeof (RawHeader) + size_t(bucketCount) * CACHE_WAYS * sizeof (Entry);
+    if(memcmp(h.magic, HASH_CACHE_MAGIC, sizeof (HASH_CACHE_MAGIC)) != 0 ||
+            h.version != HASH_CACHE_VERSION ||
+            h.ways != CACHE_WAYS ||
+            h.entrySize != sizeof (Entry) ||
+            bucketCount == 0 || bucketCount > HASH_CACHE_MAX_BUCKET_COUNT ||
+            (bucketCount & (bucketCount - 1)) != 0 ||
+            size_t(st.st_size) != mapSize){
+        return false;
+    }
+    void* addr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED){
+        throw os::ExcOs("mmap of the hash cache failed");
+    }
+    m_header = static_cast<Header*>(addr);
+    m_entries = reinterpret_cast<Entry*>(static_cast<char*>(addr) + sizeof (Header));
+    m_mapSize = mapSize;
+    m_bucketMask = bucketCount - 1;
+    return true;
+}
+
+/// Create a fresh cache file besides path and rename it to path.
+void HashCache::createCacheFile(const std::string &path, uint32_t bucketCount)
+{
+    std::string tmpPath = path + ".XXXXXX";
+    const int fd = mkostemp(&tmpPath[0], O_CLOEXEC);
+    if(fd == -1){
+        throw os::ExcOs("Failed to create a temporary hash cache besides " + path);
+    }
+    auto closeFd = finally([&fd] { ::close(fd); });
+    auto removeTmp = finally([&tmpPath] { ::unlink(tmpPath.c_str()); });
+
+    RawHeader h;
+    memset(&h, 0, sizeof (h));
+    memcpy(h.magic, HASH_CACHE_MAGIC, sizeof (HASH_CACHE_MAGIC));
+    h.version = HASH_CACHE_VERSION;
+    h.bucketCount = bucketCount;
+    h.ways = CACHE_WAYS;
+    h.entrySize = sizeof (Entry);
+    // the entries are zero (unused), as the file is extended by ftruncate.
+    const off_t fileSize = off_t(sizeof (RawHeader) + size_t(bucketCount) * CACHE_WAYS * sizeof (Entry));
+    if(ftruncate(fd, fileSize) == -1 ||
+       pwrite(fd, &h, sizeof (h), 0) != ssize_t(sizeof (h))){
+        throw os::ExcOs("Failed to write the hash cache " + tmpPath);
+    }
+    os::rename(tmpPath, path);
+    removeTmp.setEnabled(false);
+}
+
+HashCache::Entry *HashCache::bucketOf(const struct stat &st, const HashMeta &hashMeta)
+{
+    const uint64_t h = mix64(uint64_t(st.st_dev) * 0x9e3779b97f4a7c15ull ^ uint64_t(st.st_ino) ^
+                             (uint64_t(hashMeta.algorithm) << 48 |
+                              uint64_t(uint32_t(hashMeta.chunkSize)) << 32 |
+                              uint32_t(hashMeta.maxCountOfReads)) * 0xbf58476d1ce4e5b9ull);
+    return m_entries + (h & m_bucketMask) * CACHE_WAYS;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+
+#include "hashmeta.h"
+#include "nullable_value.h"
+#include "util.h"
+
+
+/// Persistent, memory mapped cache of partial file hashes (see HashControl),
+/// shared by all shournal processes of a user. An entry is keyed by
+/// (dev, inode, size, mtime, ctime) and the hash meta, so as long as a file is
+/// not modified, hashing it again costs only one fstat.
+/// The cache file has a fixed size: entries are organized in buckets of
+/// CACHE_WAYS entries, when a bucket is full, the least recently used
+/// entry is evicted. Concurrent readers and writers (also from different
+/// processes) are synchronized by a sequence counter per entry, so
+/// lookups never block. A writer, which loses the race for an entry, simply
+/// does not cache its hash.
+class HashCache
+{
+public:
+    static const uint32_t CACHE_WAYS = 8;
+    static const uint32_t DEFAULT_BUCKET_COUNT = 1 << 13;
+
+    static HashCache* defaultCache();
+    static std::string defaultPath();
+
+    HashCache();
+    ~HashCache();
+
+    void open(const std::string& path, uint32_t bucketCount=DEFAULT_BUCKET_COUNT);
+    void close();
+    bool isOpen() const;
+
+    HashValue lookup(const struct stat& st, const HashMeta& hashMeta);
+    void insert(const struct stat& st, const HashMeta& hashMeta, const HashValue& hash);
+
+    static bool isRacy(const struct stat& st);
+
+private:
+    Q_DISABLE_COPY(HashCache)
+    DISABLE_MOVE(HashCache)
+
+    struct Header;
+    struct Entry;
+
+    bool mapAndValidate(int fd, uint32_t bucketCount);
+    void createCacheFile(const std::string& path, uint32_t bucketCount);
+    Entry* bucketOf(const struct stat& st, const HashMeta& hashMeta);
+
+    Header* m_header;
+    Entry* m_entries;
+    size_t m_mapSize;
+    uint32_t m_bucketMask;
+};
@@ -1,29 +1,53 @@
 
 #include "hashcontrol.h"
+#include "hash_cache.h"
 
 /// xxhash parts of a file (or the whole file in case of a small one) according to the
-/// specified hashmeta-parameters.
+/// specified hashmeta-parameters. The file is read from offset 0 on, its
+/// offset is not changed.
 /// @return hash-value of null, if 0 bytes were read.
 /// @throws ExcOs, CXXHashError
-HashValue HashControl::genPartlyHash(int fd, qint64 filesize, const HashMeta &hashMeta,
-                                     bool resetOffset)
+HashValue HashControl::genPartlyHash(int fd, qint64 filesize, const HashMeta &hashMeta)
 {
     const off64_t seektstep = filesize / hashMeta.maxCountOfReads;
     auto hashRes = m_hash.digestFile(
                         fd,
                         hashMeta.chunkSize,
                         seektstep ,
-                        hashMeta.maxCountOfReads);
+                        hashMeta.maxCountOfReads,
+                        partial_xxhash_algorithm(hashMeta.algorithm));
     HashValue hashVal;
     if(hashRes.count_of_bytes > 0){
-        if(resetOffset){
-            os::lseek(fd, 0, SEEK_SET);
-        }
         hashVal = hashRes.hash;
     }
     return hashVal;
 }
 
+/// Same as above, but look up the hash in the persistent hash cache first
+/// and store it there after hashing. st must be the fstat of fd.
+/// @throws ExcOs, CXXHashError
+HashValue HashControl::genPartlyHash(int fd, const struct stat &st, const HashMeta &hashMeta)
+{
+    HashCache* cache = (m_cacheIsSet) ? m_cache : HashCache::defaultCache();
+    if(cache == nullptr || st.st_size == 0){
+        return genPartlyHash(fd, st.st_size, hashMeta);
+    }
+    HashValue hashVal = cache->lookup(st, hashMeta);
+    if(! hashVal.isNull()){
+        return hashVal;
+    }
+    hashVal = genPartlyHash(fd, st.st_size, hashMeta);
+    cache->insert(st, hashMeta, hashVal);
+    return hashVal;
+}
+
+/// Use the given cache instead of HashCache::defaultCache(). Pass
+/// null to disable caching.
+void HashControl::setHashCache(HashCache *cache)
+{
+    m_cache = cache;
+    m_cacheIsSet = true;
+}
 
 CXXHash &HashControl::getXXHash()
 {
@@ -5,16 +5,20 @@
 #include "hashmeta.h"
 #include "os.h"
 
+class HashCache;
+
 class HashControl
 {
 public:
 
-    HashValue genPartlyHash(int fd, qint64 filesize, const HashMeta& hashMeta,
-                            bool resetOffset=true);
+    HashValue genPartlyHash(int fd, qint64 filesize, const HashMeta& hashMeta);
+    HashValue genPartlyHash(int fd, const struct stat& st, const HashMeta& hashMeta);
+    void setHashCache(HashCache* cache);
     CXXHash& getXXHash();
 private:
     CXXHash m_hash;
+    HashCache* m_cache{nullptr};
+    bool m_cacheIsSet{false};
 };
 
 
-
@@ -1,9 +1,10 @@
 #include "hashmeta.h"
 
 
-HashMeta::HashMeta(size_type chunks, size_type maxCountOfR)
+HashMeta::HashMeta(size_type chunks, size_type maxCountOfR, Algorithm algo)
     : chunkSize(chunks),
-      maxCountOfReads(maxCountOfR)
+      maxCountOfReads(maxCountOfR),
+      algorithm(algo)
 {}
 
 bool HashMeta::isNull() const
@@ -11,8 +12,15 @@ bool HashMeta::isNull() const
     return chunkSize == 0 && maxCountOfReads == 0;
 }
 
+/// Name of the algorithm as in the config file and json output
+const char *HashMeta::algorithmName() const
+{
+    return (algorithm == XXH3) ? "xxh3" : "xxh64";
+}
+
 bool HashMeta::operator==(const HashMeta &rhs) const
 {
     return chunkSize == rhs.chunkSize &&
-           maxCountOfReads == rhs.maxCountOfReads;
+           maxCountOfReads == rhs.maxCountOfReads &&
+           algorithm == rhs.algorithm;
 }
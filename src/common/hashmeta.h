@@ -9,13 +9,20 @@ struct HashMeta
 {
     typedef int size_type;
 
+    /// Hash function of a hashmeta. The values are stored in the database and
+    /// equal those of partial_xxhash_algorithm, so never change them.
+    /// Hashmetas from before XXH3 was supported are XXH64.
+    enum Algorithm : int { XXH64 = 0, XXH3 = 1 };
+
     HashMeta() = default;
-    HashMeta(size_type chunks, size_type maxCountOfR);
+    HashMeta(size_type chunks, size_type maxCountOfR, Algorithm algo=XXH64);
     size_type chunkSize {};
     size_type maxCountOfReads {};
+    Algorithm algorithm {XXH64};
     qint64 idInDb {db::INVALID_INT_ID} ;
 
     bool isNull() const;
+    const char* algorithmName() const;
 
     bool operator==(const HashMeta& rhs) const;
 };
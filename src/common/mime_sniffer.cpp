@@ -0,0 +1,136 @@
+
+#include <cstring>
+#include <unistd.h>
+
+#include "mime_sniffer.h"
+#include "excos.h"
+#include "os.h"
+#include "qfddummydevice.h"
+
+namespace  {
+
+struct MagicPrefix {
+    const char* prefix;
+    const char* mimetype;
+};
+
+// Only prefixes for which the shared-mime-info magic (as used by
+// QMimeDatabase) yields the same result.
+const MagicPrefix SHEBANG_PREFIXES[] = {
+    {"#!/bin/sh", "application/x-shellscript"},
+    {"#! /bin/sh", "application/x-shellscript"},
+    {"#!/bin/bash", "application/x-shellscript"},
+    {"#! /bin/bash", "application/x-shellscript"},
+    {"#!/usr/bin/env sh", "application/x-shellscript"},
+    {"#!/usr/bin/env bash", "application/x-shellscript"},
+    {"#!/usr/bin/perl", "application/x-perl"},
+    {"#! /usr/bin/perl", "application/x-perl"},
+    {"#!/usr/bin/env perl", "application/x-perl"},
+    {"#!/usr/local/bin/perl", "application/x-perl"},
+};
+
+// Depending on the ELF-header QMimeDatabase reports one of those
+const char* const ELF_MIMETYPES[] = {
+    "application/x-executable",
+    "application/x-sharedlib",
+    "application/x-pie-executable",
+    "application/x-object",
+    "application/x-core",
+};
+
+const size_t SNIFF_SIZE = 64;
+const size_t MAX_CACHE_SIZE = 4096;
+
+bool containsElfMimetype(const MimeSniffer::MimeSet& mimetypes){
+    for(const char* elfType : ELF_MIMETYPES){
+        if(mimetypes.find(QString(elfType)) != mimetypes.end()){
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+
+MimeSniffer::MimeSniffer() = default;
+
+/// @param st: stat of fd, used as cache key
+/// @throws ExcOs
+bool MimeSniffer::mimeTypeMatches(int fd, const struct stat &st,
+                                  const MimeSet &validMimetypes)
+{
+    const CacheKey key{st.st_dev, st.st_ino, st.st_mtim.tv_sec,
+                       st.st_mtim.tv_nsec, st.st_size};
+    auto it = m_cache.find(key);
+    if(it != m_cache.end()){
+        return validMimetypes.find(it->second) != validMimetypes.end();
+    }
+
+    char buf[SNIFF_SIZE];
+    // pread, so we need not to seek back
+    ssize_t len = ::pread(fd, buf, sizeof (buf), 0);
+    if(len == -1){
+        throw os::ExcOs("pread failed");
+    }
+    QString mimetype;
+    switch (sniff(buf, size_t(len), &mimetype)) {
+    case SniffResult::DEFINITE:
+        break;
+    case SniffResult::ELF:
+        if(! containsElfMimetype(validMimetypes)){
+            return false;
+        }
+        mimetype = mimeTypeFromDb(fd);
+        break;
+    case SniffResult::UNKNOWN:
+        mimetype = mimeTypeFromDb(fd);
+        break;
+    }
+
+    if(m_cache.size() >= MAX_CACHE_SIZE){
+        m_cache.clear();
+    }
+    m_cache.emplace(key, mimetype);
+    return validMimetypes.find(mimetype) != validMimetypes.end();
+}
+
+/// Check the beginning of a file for some common magic values.
+/// @param mimetype: set in case of SniffResult::DEFINITE.
+/// @return DEFINITE, if the mimetype is known for sure. ELF if the
+/// file is an ELF binary (of whatever kind). UNKNOWN, if QMimeDatabase
+/// needs to be consulted.
+MimeSniffer::SniffResult MimeSniffer::sniff(const char *data, size_t len, QString *mimetype)
+{
+    if(len == 0){
+        *mimetype = QStringLiteral("application/x-zerosize");
+        return SniffResult::DEFINITE;
+    }
+    if(len >= 4 && memcmp(data, "\x7f" "ELF", 4) == 0){
+        return SniffResult::ELF;
+    }
+    if(len < 2 || data[0] != '#' || data[1] != '!'){
+        return SniffResult::UNKNOWN;
+    }
+    for(const auto& magic : SHEBANG_PREFIXES){
+        const size_t prefixLen = strlen(magic.prefix);
+        if(len >= prefixLen && memcmp(data, magic.prefix, prefixLen) == 0){
+            *mimetype = QString(magic.mimetype);
+            return SniffResult::DEFINITE;
+        }
+    }
+    return SniffResult::UNKNOWN;
+}
+
+void MimeSniffer::clearCache()
+{
+    m_cache.clear();
+}
+
+QString MimeSniffer::mimeTypeFromDb(int fd)
+{
+    QFdDummyDevice f(fd);
+    auto mimetype = m_mimedb.mimeTypeForData(&f).name();
+    os::lseek(fd, 0, SEEK_SET);
+    return mimetype;
+}
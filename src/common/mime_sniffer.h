@@ -0,0 +1,66 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <QMimeDatabase>
+#include <QString>
+
+#include "util.h"
+
+
+/// Find out, whether the mimetype of a file is one of a given set.
+/// QMimeDatabase is rather expensive, so for some common cases (shebangs of
+/// shell-scripts, ELF-binaries, empty files) the first bytes are checked
+/// directly, leaving only ambiguous cases for QMimeDatabase.
+/// Results are cached per (dev, inode, mtime, size).
+class MimeSniffer
+{
+public:
+    typedef std::unordered_set<QString> MimeSet;
+
+    enum class SniffResult { DEFINITE, ELF, UNKNOWN };
+
+    MimeSniffer();
+
+    bool mimeTypeMatches(int fd, const struct stat& st,
+                         const MimeSet& validMimetypes);
+
+    static SniffResult sniff(const char* data, size_t len, QString* mimetype);
+
+    void clearCache();
+
+public:
+    Q_DISABLE_COPY(MimeSniffer)
+    DISABLE_MOVE(MimeSniffer)
+
+private:
+    struct CacheKey {
+        dev_t dev;
+        ino_t ino;
+        time_t mtimeSec;
+        long mtimeNsec;
+        off_t size;
+
+        bool operator==(const CacheKey& rhs) const {
+            return ino == rhs.ino && dev == rhs.dev &&
+                   mtimeSec == rhs.mtimeSec && mtimeNsec == rhs.mtimeNsec &&
+                   size == rhs.size;
+        }
+    };
+
+    struct CacheKeyHash {
+        size_t operator()(const CacheKey& k) const {
+            size_t h = std::hash<ino_t>()(k.ino);
+            h ^= std::hash<dev_t>()(k.dev) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            h ^= std::hash<time_t>()(k.mtimeSec) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            h ^= std::hash<long>()(k.mtimeNsec) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    QString mimeTypeFromDb(int fd);
+
+    QMimeDatabase m_mimedb;
+    std::unordered_map<CacheKey, QString, CacheKeyHash> m_cache;
+};
@@ -323,6 +323,9 @@ bool Settings::loadSections(const QVersionNumber& parsedCfgVersion){
     loadSectIgnoreCmd();
     loadSectMount();
     loadSectHash();
+    loadSectFanotify();
+    loadSectQuery();
+    loadSectDatabase();
     return updateNeeded;
 }
 
@@ -541,14 +544,20 @@ void Settings::loadSectHash()
     const QString sect_hash_enable = "enable";
     const QString sect_hash_chunksize = "chunksize";
     const QString sect_hash_maxCountReads = "max-count-reads";
+    const QString sect_hash_persistentCache = "persistent_cache";
+    const QString sect_hash_algorithm = "algorithm";
 
     sectHash->setComments(qtr(
                           "Note: this section includes advanced settings and should not be "
                           "changed at all in most cases and if so, only with a fresh database. "
                           "%1 or %2 should *not* be changed during the lifetime of the database. "
                           "Changing it is not a well tested feature and in any case causes overhead "
-                          "for hash-based database-queries.").
-                          arg(sect_hash_chunksize, sect_hash_maxCountReads));
+                          "for hash-based database-queries.\n"
+                          "%3: xxh3 or xxh64. Commands observed by the kernel module "
+                          "are always hashed with xxh64. Commands stored with another "
+                          "algorithm remain queryable.").
+                          arg(sect_hash_chunksize, sect_hash_maxCountReads,
+                              sect_hash_algorithm));
 
     m_hashSettings.hashEnable = sectHash->getValue<bool>(sect_hash_enable, true, true);
     // Exclude negative values by using uint
@@ -556,6 +565,19 @@ void Settings::loadSectHash()
                 sectHash->getValue<uint>(sect_hash_chunksize, 256, true));
     m_hashSettings.hashMeta.maxCountOfReads = static_cast<HashMeta::size_type>(
                 sectHash->getValue<uint>(sect_hash_maxCountReads, 3, true));
+    // Keep the hashes of unmodified files in a cache shared by all shournal-processes
+    // of the user, so e.g. frequently read files are not hashed again and again.
+    m_hashSettings.persistentCache = sectHash->getValue<bool>(sect_hash_persistentCache, true);
+    const QString algorithm = sectHash->getValue<QString>(sect_hash_algorithm,
+                                                          "xxh3", true).toLower();
+    if(algorithm == "xxh3"){
+        m_hashSettings.hashMeta.algorithm = HashMeta::XXH3;
+    } else if(algorithm == "xxh64"){
+        m_hashSettings.hashMeta.algorithm = HashMeta::XXH64;
+    } else {
+        throw ExcCfg(qtr("Invalid hash %1 '%2'. Must be xxh3 or xxh64")
+                     .arg(sect_hash_algorithm, algorithm));
+    }
     if(m_hashSettings.hashEnable){
         // TODO: also limit maxCountOfReads -> see kernel module
 
@@ -569,6 +591,95 @@ void Settings::loadSectHash()
     }
 }
 
+void Settings::loadSectFanotify()
+{
+    auto sectFan = m_cfg["Fanotify backend"];
+    const QString sect_fan_persistent = "persistent_session_backend";
+    const QString sect_fan_shm = "shared_memory_channel";
+
+    sectFan->setComments(qtr(
+                         "Only applies to the shell-integration of the fanotify backend!\n"
+                         "%1: if true, a single backend process is launched per "
+                         "shell session, which keeps its mount namespace and "
+                         "fanotify-marks across commands. This greatly reduces the "
+                         "per-command overhead. However, processes which keep "
+                         "running in the background after their command "
+                         "finished are only observed until the next command "
+                         "starts. Further, changes to this config file only take effect "
+                         "in new shell sessions.\n"
+                         "%2: if true (and %1 is true), the shell passes the "
+                         "start and end of each command to the backend via "
+                         "shared memory instead of a socket, which further "
+                         "lowers the per-command overhead.\n"
+                         ).arg(sect_fan_persistent, sect_fan_shm));
+    m_fanotifySettings.persistentSessionBackend =
+            sectFan->getValue<bool>(sect_fan_persistent, false);
+    m_fanotifySettings.sharedMemoryChannel =
+            sectFan->getValue<bool>(sect_fan_shm, false);
+}
+
+void Settings::loadSectQuery()
+{
+    auto sectQuery = m_cfg["Query"];
+    const QString sect_query_cache = "result_cache";
+    const QString sect_query_cacheMax = "result_cache_max_entries";
+
+    sectQuery->setComments(qtr(
+                           "%1: if true, the results of shournal --query are cached "
+                           "in the user's cache directory, so repeating a query "
+                           "returns instantly, as long as no command was added "
+                           "to or deleted from the database in between.\n"
+                           "%2: the maximum number of cached query results.\n"
+                           ).arg(sect_query_cache, sect_query_cacheMax));
+    m_querySettings.resultCache = sectQuery->getValue<bool>(sect_query_cache, false);
+    m_querySettings.resultCacheMaxEntries = static_cast<int>(
+                sectQuery->getValue<uint>(sect_query_cacheMax, 32));
+}
+
+void Settings::loadSectDatabase()
+{
+    auto sectDb = m_cfg["Database"];
+    const QString sect_db_archiveAfter = "archive_after_months";
+    const QString sect_db_incrementalFlush = "incremental_flush_interval";
+    const QString sect_db_eventLogMem = "event_log_memory_limit";
+    const QString sect_db_checkpoint = "checkpoint_interval";
+
+    sectDb->setComments(qtr(
+                        "%1: if greater than zero, commands which started more "
+                        "than that many months ago are moved from the database "
+                        "to the archive database next to it, where each month is "
+                        "kept in separate tables. Queries only read those months "
+                        "of the archive, which they may find results in. "
+                        "Archived commands can not be deleted.\n"
+                        "%2: if greater than zero, the file events of a command "
+                        "observed by the kernel module backend are stored every "
+                        "that many seconds while the command is still running, "
+                        "instead of all at once after it finished. Until then, "
+                        "the end time of the command equals its start time.\n"
+                        "%3: until the file events of a command are stored to "
+                        "the database, they are kept in memory up to that many "
+                        "MiB, beyond that in a temporary file. 0 means, to always "
+                        "use a temporary file.\n"
+                        "%4: if greater than zero and shournal-run observes "
+                        "already running processes (--pid or --cgroup) with "
+                        "the kernel module backend, the kernel module continues "
+                        "with a new event file every that many seconds and the "
+                        "events of the previous one are stored. So observing "
+                        "long running processes like daemons does not fill the "
+                        "disk and the events survive a crash of shournal-run. "
+                        "Takes precedence over %2 for such observations.\n"
+                        ).arg(sect_db_archiveAfter, sect_db_incrementalFlush,
+                              sect_db_eventLogMem, sect_db_checkpoint));
+    m_databaseSettings.archiveAfterMonths = static_cast<int>(
+                sectDb->getValue<uint>(sect_db_archiveAfter, 0));
+    m_databaseSettings.incrementalFlushSecs = static_cast<int>(
+                sectDb->getValue<uint>(sect_db_incrementalFlush, 0));
+    m_databaseSettings.eventLogMaxMemMiB = static_cast<int>(
+                sectDb->getValue<uint>(sect_db_eventLogMem, 64));
+    m_databaseSettings.checkpointSecs = static_cast<int>(
+                sectDb->getValue<uint>(sect_db_checkpoint, 0));
+}
+
 
 Settings::ReadVersionReturn Settings::readVersion(SafeFileUpdate& verUpd8)
 {
@@ -811,6 +922,21 @@ const Settings::HashSettings &Settings::hashSettings() const
     return m_hashSettings;
 }
 
+const Settings::FanotifySettings &Settings::fanotifySettings() const
+{
+    return m_fanotifySettings;
+}
+
+const Settings::QuerySettings &Settings::querySettings() const
+{
+    return m_querySettings;
+}
+
+const Settings::DatabaseSettings &Settings::databaseSettings() const
+{
+    return m_databaseSettings;
+}
+
 
 
 
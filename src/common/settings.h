@@ -26,6 +26,7 @@ public:
     struct HashSettings {
         HashMeta hashMeta;
         bool hashEnable{};
+        bool persistentCache{};
     };
 
     struct WriteFileSettings {
@@ -89,6 +90,39 @@ public:
         DISABLE_MOVE(ScriptFileSettings)
     };
 
+    /// Settings only relevant for the shell integration
+    /// of the fanotify backend.
+    struct FanotifySettings {
+        // keep one backend process per shell session instead of
+        // launching a new one for each command
+        bool persistentSessionBackend {false};
+        // pass command boundaries via a shared memory ring
+        // instead of the socket (requires the above)
+        bool sharedMemoryChannel {false};
+    };
+
+    /// Settings for shournal --query
+    struct QuerySettings {
+        // cache the results of --query until the database changes
+        bool resultCache {false};
+        int resultCacheMaxEntries {32};
+    };
+
+    struct DatabaseSettings {
+        // move commands older than that many months to the
+        // archive database (0: never)
+        int archiveAfterMonths {0};
+        // store the file events of a still running command every
+        // that many seconds (0: only after the command finished)
+        int incrementalFlushSecs {0};
+        // keep the file events of a command in memory until
+        // they grow larger than that (0: always on disk)
+        int eventLogMaxMemMiB {64};
+        // when observing via --pid or --cgroup, store the file
+        // events every that many seconds (0: only at the end)
+        int checkpointSecs {0};
+    };
+
 
 
 public:
@@ -101,6 +135,9 @@ public:
     const WriteFileSettings& writeFileSettings() const;
     const ReadFileSettings& readFileSettings() const;
     const ScriptFileSettings& readEventScriptSettings() const;
+    const FanotifySettings& fanotifySettings() const;
+    const QuerySettings& querySettings() const;
+    const DatabaseSettings& databaseSettings() const;
 
     QString cfgAppDir();
     QString cfgFilepath();
@@ -144,6 +181,9 @@ private:
     void loadSectIgnoreCmd();
     void loadSectMount();
     void loadSectHash();
+    void loadSectFanotify();
+    void loadSectQuery();
+    void loadSectDatabase();
 
     ReadVersionReturn readVersion(SafeFileUpdate &verUpd8);
     bool updateCfgScheme(const QVersionNumber&, ReadVersionReturn&);
@@ -159,6 +199,9 @@ private:
     WriteFileSettings m_wSettings;
     ReadFileSettings m_rSettings;
     ScriptFileSettings m_scriptSettings;
+    FanotifySettings m_fanotifySettings;
+    QuerySettings m_querySettings;
+    DatabaseSettings m_databaseSettings;
     StrLightSet m_mountIgnorePaths;
     bool m_mountIgnoreNoPerm {false};
     bool m_settingsLoaded {false};
@@ -0,0 +1,305 @@
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+#include <unistd.h>
+
+// older glibc-versions do not provide the file sealing constants
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (1024 + 9)
+#define F_GET_SEALS (1024 + 10)
+#define F_SEAL_SEAL   0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW   0x0004
+#endif
+
+#include "shm_ring.h"
+#include "os.h"
+#include "excos.h"
+#include "osutil.h"
+#include "util.h"
+
+using namespace fdcommunication;
+
+namespace  {
+
+const uint32_t SHM_RING_MAGIC = 0x5348524e; // SHRN
+const uint32_t SHM_RING_MIN_CAPACITY = 4096;
+const uint32_t SHM_RING_MAX_CAPACITY = 1 << 26;
+// The consumer may be more privileged than the producer (setuid-backend),
+// so the producer must not be able to truncate the memfd while it is mapped,
+// which would cause a SIGBUS on the consumer's side.
+const int SHM_RING_SEALS = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+struct RecordHeader {
+    int32_t msgId;
+    uint32_t len; // length of custom payload (not padded)
+};
+
+static_assert (sizeof (RecordHeader) == 8, "");
+
+inline uint64_t recordSize(uint32_t payloadLen){
+    // keep the record headers 8-byte aligned
+    return sizeof (RecordHeader) + ((uint64_t(payloadLen) + 7) & ~uint64_t(7));
+}
+
+} // namespace
+
+
+/// Lives at the beginning of the shared memory. Producer and
+/// consumer indeces are kept on separate cachelines. Both only
+/// grow, the position within the ring is index & (capacity - 1).
+struct ShmRing::Header {
+    uint32_t magic;
+    uint32_t capacity;
+    alignas(64) std::atomic<uint64_t> head; // written by the producer
+    alignas(64) std::atomic<uint64_t> tail; // written by the consumer
+    std::atomic<uint32_t> consumerWaiting;
+};
+
+static_assert (sizeof (std::atomic<uint64_t>) == sizeof (uint64_t), "");
+
+
+ShmRing::ShmRing() :
+    m_header(nullptr),
+    m_data(nullptr),
+    m_capacity(0),
+    m_mapSize(0),
+    m_memFd(-1),
+    m_doorbell(EFD_NONBLOCK)
+{}
+
+ShmRing::~ShmRing()
+{
+    teardown();
+}
+
+/// Create a new ring of the given capacity, which must be a power of two.
+/// Pass memFd() and doorbellFd() to the consumer process.
+void ShmRing::create(uint32_t capacity)
+{
+    assert(! isActive());
+    assert(capacity >= SHM_RING_MIN_CAPACITY && capacity <= SHM_RING_MAX_CAPACITY);
+    assert((capacity & (capacity - 1)) == 0);
+
+    // use the raw syscall: older glibc-versions do not provide a wrapper.
+    m_memFd = int(syscall(SYS_memfd_create, "shournal-ring",
+                          MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if(m_memFd == -1){
+        throw os::ExcOs("memfd_create failed");
+    }
+    const size_t mapSize = sizeof (Header) + capacity;
+    if(ftruncate(m_memFd, off_t(mapSize)) == -1){
+        throw os::ExcOs("ftruncate of shared memory ring failed");
+    }
+    if(fcntl(m_memFd, F_ADD_SEALS, SHM_RING_SEALS) == -1){
+        throw os::ExcOs("sealing the shared memory ring failed");
+    }
+    mapRing(mapSize);
+    m_header->magic = SHM_RING_MAGIC;
+    m_header->capacity = capacity;
+    m_header->head.store(0);
+    m_header->tail.store(0);
+    // until the consumer actually read the ring, always ring the bell
+    m_header->consumerWaiting.store(1);
+    m_capacity = capacity;
+}
+
+/// Attach to a ring created by another process. Since the producer may
+/// be a less privileged process, the ring-metadata is verified before use,
+/// including the seals which prevent resizing the ring.
+/// Ownership of memFd and doorbellFd is taken in any case.
+void ShmRing::attach(int memFd, int doorbellFd)
+{
+    assert(! isActive());
+    m_memFd = memFd;
+    m_doorbell.adoptFd(doorbellFd);
+    const int seals = fcntl(memFd, F_GET_SEALS);
+    if(seals == -1 || (seals & SHM_RING_SEALS) != SHM_RING_SEALS){
+        throw ExcFdComm(qtr("Shared memory ring is not sealed against resizing"));
+    }
+    // only fstat after checking the seals, so the size remains valid.
+    auto st = os::fstat(memFd);
+    if(st.st_size < off_t(sizeof (Header) + SHM_RING_MIN_CAPACITY) ||
+       st.st_size > off_t(sizeof (Header) + SHM_RING_MAX_CAPACITY)){
+        throw ExcFdComm(qtr("Shared memory ring has an invalid size of %1 bytes")
+                        .arg(st.st_size));
+    }
+    mapRing(size_t(st.st_size));
+    const uint32_t capacity = m_header->capacity;
+    if(m_header->magic != SHM_RING_MAGIC ||
+       (capacity & (capacity - 1)) != 0 ||
+       sizeof (Header) + capacity != m_mapSize){
+        teardown();
+        throw ExcFdComm(qtr("Shared memory ring is corrupted"));
+    }
+    m_capacity = capacity;
+}
+
+/// To be called in a forked child: the ring is not mapped there
+/// (see mapRing()), so forget it, without unmapping.
+void ShmRing::abandonAfterFork()
+{
+    m_header = nullptr;
+    m_data = nullptr;
+    teardown();
+}
+
+void ShmRing::teardown()
+{
+    if(m_header != nullptr){
+        munmap(m_header, m_mapSize);
+        m_header = nullptr;
+        m_data = nullptr;
+    }
+    closeMemFd();
+}
+
+bool ShmRing::isActive() const
+{
+    return m_header != nullptr;
+}
+
+int ShmRing::memFd() const
+{
+    return m_memFd;
+}
+
+/// The memory remains mapped, so close the memfd once
+/// it was passed to the other process.
+void ShmRing::closeMemFd()
+{
+    if(m_memFd != -1){
+        osutil::closeVerbose(m_memFd);
+        m_memFd = -1;
+    }
+}
+
+/// The consumer shall poll this fd for POLLIN
+int ShmRing::doorbellFd() const
+{
+    return m_doorbell.fd();
+}
+
+/// Duplicate the doorbell to the given fd-number (close-on-exec)
+/// and close the old one.
+void ShmRing::moveDoorbellFd(int newFd)
+{
+    if(newFd == m_doorbell.fd()){
+        return;
+    }
+    os::dup3(m_doorbell.fd(), newFd, O_CLOEXEC);
+    m_doorbell.adoptFd(newFd);
+}
+
+/// Write all messages or none of them.
+/// @return false, if the ring has not enough free space left.
+bool ShmRing::sendMessages(const Messages &messages)
+{
+    assert(isActive());
+    uint64_t total = 0;
+    for(const auto& msg : messages){
+        assert(msg.msgId >= 0);
+        assert(msg.fd == -1);
+        total += recordSize(uint32_t(msg.bytes.size()));
+    }
+    const uint64_t head = m_header->head.load(std::memory_order_relaxed);
+    const uint64_t tail = m_header->tail.load(std::memory_order_acquire);
+    if(total > m_capacity - (head - tail)){
+        return false;
+    }
+    uint64_t pos = head;
+    for(const auto& msg : messages){
+        RecordHeader recHeader{msg.msgId, uint32_t(msg.bytes.size())};
+        writeToRing(pos, &recHeader, sizeof (recHeader));
+        writeToRing(pos + sizeof (recHeader), msg.bytes.constData(), recHeader.len);
+        pos += recordSize(recHeader.len);
+    }
+    // Sequentially consistent store and load, so either we see the consumer
+    // waiting or the consumer sees our new head (see receiveMessages).
+    m_header->head.store(pos);
+    if(m_header->consumerWaiting.load()){
+        m_doorbell.sendMsg(1);
+    }
+    return true;
+}
+
+/// Read all currently available messages (possibly none) without
+/// blocking and announce to wait for the doorbell afterwards.
+void ShmRing::receiveMessages(Messages *messages)
+{
+    assert(isActive());
+    messages->clear();
+    m_header->consumerWaiting.store(0);
+    uint64_t dummy;
+    m_doorbell.tryRecvMsg(&dummy);
+    while(true){
+        drain(messages);
+        m_header->consumerWaiting.store(1);
+        if(m_header->head.load() == m_header->tail.load(std::memory_order_relaxed)){
+            break;
+        }
+        // the producer was faster than us
+        m_header->consumerWaiting.store(0);
+    }
+}
+
+void ShmRing::mapRing(size_t mapSize)
+{
+    void* addr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_memFd, 0);
+    if(addr == MAP_FAILED){
+        throw os::ExcOs("mmap of shared memory ring failed");
+    }
+    // Don't let forked children (e.g. the shell's subshells) write to the ring.
+    // In the child the ring must be abandoned (see abandonAfterFork()).
+    madvise(addr, mapSize, MADV_DONTFORK);
+    m_header = static_cast<Header*>(addr);
+    m_data = static_cast<char*>(addr) + sizeof (Header);
+    m_mapSize = mapSize;
+}
+
+void ShmRing::readFromRing(uint64_t pos, void *dst, size_t len)
+{
+    const size_t offset = size_t(pos & (m_capacity - 1));
+    const size_t first = std::min(len, m_capacity - offset);
+    memcpy(dst, m_data + offset, first);
+    memcpy(static_cast<char*>(dst) + first, m_data, len - first);
+}
+
+void ShmRing::writeToRing(uint64_t pos, const void *src, size_t len)
+{
+    const size_t offset = size_t(pos & (m_capacity - 1));
+    const size_t first = std::min(len, m_capacity - offset);
+    memcpy(m_data + offset, src, first);
+    memcpy(m_data, static_cast<const char*>(src) + first, len - first);
+}
+
+void ShmRing::drain(Messages *messages)
+{
+    uint64_t tail = m_header->tail.load(std::memory_order_relaxed);
+    const uint64_t head = m_header->head.load(std::memory_order_acquire);
+    if(head - tail > m_capacity){
+        throw ExcFdComm(qtr("Shared memory ring is corrupted (invalid head)"));
+    }
+    while(tail != head){
+        RecordHeader recHeader;
+        if(head - tail < sizeof (recHeader)){
+            throw ExcFdComm(qtr("Shared memory ring is corrupted (truncated record)"));
+        }
+        readFromRing(tail, &recHeader, sizeof (recHeader));
+        const uint64_t recSize = recordSize(recHeader.len);
+        if(recSize > head - tail || recHeader.msgId < 0){
+            throw ExcFdComm(qtr("Shared memory ring is corrupted (invalid record)"));
+        }
+        QByteArray payload(int(recHeader.len), Qt::Uninitialized);
+        readFromRing(tail + sizeof (recHeader), payload.data(), recHeader.len);
+        messages->push_back(Message(recHeader.msgId, payload));
+        tail += recSize;
+    }
+    m_header->tail.store(tail, std::memory_order_release);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "cefd.h"
+#include "fdcommunication.h"
+
+
+namespace fdcommunication {
+
+/// Lock-free single-producer/single-consumer ring buffer of messages,
+/// residing in shared memory (memfd). It allows the shell integration to
+/// pass the command boundaries to a persistent backend without
+/// a socket roundtrip.
+/// The consumer is woken up by an eventfd-doorbell (see doorbellFd()) which
+/// is only rung, if the consumer announced to wait for it.
+/// Messages must not contain file descriptors. In case the ring is full, the
+/// producer shall fall back to the socket, the consumer shall thus always
+/// drain the ring before reading from the socket, to preserve the order.
+class ShmRing
+{
+public:
+    typedef SocketCommunication::Message Message;
+    typedef SocketCommunication::Messages Messages;
+
+    ShmRing();
+    ~ShmRing();
+
+    void create(uint32_t capacity);
+    void attach(int memFd, int doorbellFd);
+    void teardown();
+    void abandonAfterFork();
+
+    bool isActive() const;
+    int memFd() const;
+    void closeMemFd();
+    int doorbellFd() const;
+    void moveDoorbellFd(int newFd);
+
+    bool sendMessages(const Messages& messages);
+    void receiveMessages(Messages* messages);
+
+private:
+    Q_DISABLE_COPY(ShmRing)
+    DISABLE_MOVE(ShmRing)
+
+    struct Header;
+
+    void mapRing(size_t mapSize);
+    void readFromRing(uint64_t pos, void* dst, size_t len);
+    void writeToRing(uint64_t pos, const void* src, size_t len);
+    void drain(Messages* messages);
+
+    Header* m_header;
+    char* m_data;
+    uint32_t m_capacity;
+    size_t m_mapSize;
+    int m_memFd;
+    CEfd m_doorbell;
+};
+
+} // namespace fdcommunication
@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
 
 #include "stdiocpp.h"
 #include "util.h"
@@ -48,6 +50,26 @@ FILE *stdiocpp::tmpfile(int o_flags __attribute__ ((unused)))
     }
 }
 
+/// Create an anonymous file residing in memory (memfd). If
+/// memfd_create is not supported (kernel < 3.17), fall back to tmpfile().
+FILE *stdiocpp::memfile(const char *name)
+{
+    // use the raw syscall: older glibc-versions do not provide a wrapper.
+    int fd = int(syscall(SYS_memfd_create, name, MFD_CLOEXEC));
+    if(fd == -1){
+        if(errno == ENOSYS){
+            return stdiocpp::tmpfile();
+        }
+        throw QExcStdio(QString("memfd_create failed for %1: ").arg(name), nullptr, true);
+    }
+    try {
+        return stdiocpp::fdopen(fd, "w+");
+    } catch (const QExcStdio&) {
+        close(fd);
+        throw ;
+    }
+}
+
 FILE *stdiocpp::fopen(const char *pathname, const char *mode)
 {
     FILE* f = ::fopen(pathname, mode);
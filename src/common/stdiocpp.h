@@ -15,6 +15,7 @@ public:
 };
 
 FILE* tmpfile(int o_flags=0);
+FILE* memfile(const char* name);
 FILE *fopen(const char *pathname, const char *mode);
 FILE *fdopen(int fd, const char *mode);
 void fclose(FILE *stream);
@@ -0,0 +1,257 @@
+
+#include <cerrno>
+#include <unistd.h>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonValue>
+
+#include "json_stream_writer.h"
+#include "exccommon.h"
+
+namespace {
+
+inline char hexdig(uint u){
+    return char((u < 0xa) ? '0' + u : 'a' + u - 0xa);
+}
+
+// Largest integer a double (which QJsonValue uses for all numbers)
+// represents exactly.
+const qint64 MAX_EXACT_DOUBLE_INT = qint64(1) << 53;
+
+/// Depending on the Qt version, QJsonDocument writes integral numbers
+/// either plain or in exponent notation, if that is shorter (1e+15).
+bool qtWritesPlainIntegers(){
+    static const bool plain =
+            QJsonDocument(QJsonArray{QJsonValue(1e15)}).toJson(QJsonDocument::Compact) ==
+            "[1000000000000000]";
+    return plain;
+}
+
+/// Format the number exactly as QJsonDocument does
+QByteArray qtJsonNumber(const QJsonValue& val){
+    QByteArray arr = QJsonDocument(QJsonArray{val}).toJson(QJsonDocument::Compact);
+    // strip []
+    return arr.mid(1, arr.size() - 2);
+}
+
+} // namespace
+
+
+/// @param fd: the file descriptor to flush the buffer to. If -1, the buffer
+/// is never flushed automatically but may be obtained by buffer().
+/// @param flushThreshold: flushIfNeeded() writes the buffer, once it is larger.
+JsonStreamWriter::JsonStreamWriter(int fd, int flushThreshold) :
+    m_fd(fd),
+    m_flushThreshold(flushThreshold)
+{
+    m_buf.reserve(flushThreshold + 4096);
+}
+
+void JsonStreamWriter::beginObject()
+{
+    prepareValue();
+    m_buf.append('{');
+    m_isFirstElement.push_back(true);
+}
+
+void JsonStreamWriter::endObject()
+{
+    m_buf.append('}');
+    m_isFirstElement.pop_back();
+}
+
+void JsonStreamWriter::beginArray()
+{
+    prepareValue();
+    m_buf.append('[');
+    m_isFirstElement.push_back(true);
+}
+
+void JsonStreamWriter::endArray()
+{
+    m_buf.append(']');
+    m_isFirstElement.pop_back();
+}
+
+/// @param k: the key, which must be plain ASCII not requiring any escapes.
+void JsonStreamWriter::key(const char *k)
+{
+    prepareValue();
+    m_buf.append('"');
+    m_buf.append(k);
+    m_buf.append("\":", 2);
+    m_afterKey = true;
+}
+
+void JsonStreamWriter::writeString(const QString &str)
+{
+    prepareValue();
+    m_buf.append('"');
+    appendEscaped(str);
+    m_buf.append('"');
+}
+
+void JsonStreamWriter::writeInt(qint64 val)
+{
+    prepareValue();
+    if(val <= MAX_EXACT_DOUBLE_INT && val >= -MAX_EXACT_DOUBLE_INT &&
+            qtWritesPlainIntegers()){
+        m_buf.append(QByteArray::number(val));
+    } else {
+        m_buf.append(qtJsonNumber(QJsonValue(val)));
+    }
+}
+
+void JsonStreamWriter::writeBool(bool val)
+{
+    prepareValue();
+    m_buf.append((val) ? "true" : "false");
+}
+
+void JsonStreamWriter::writeNull()
+{
+    prepareValue();
+    m_buf.append("null", 4);
+}
+
+/// Write the variant the same way as QJsonValue::fromVariant would convert it,
+/// for the types used in shournal.
+void JsonStreamWriter::writeVariant(const QVariant &var)
+{
+    switch (var.userType()) {
+    case QMetaType::Bool: writeBool(var.toBool()); return;
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong: writeInt(var.toLongLong()); return;
+    case QMetaType::ULongLong:
+    case QMetaType::Float:
+    case QMetaType::Double:
+        prepareValue();
+        m_buf.append(qtJsonNumber(QJsonValue::fromVariant(var)));
+        return;
+    case QMetaType::QString: writeString(var.toString()); return;
+    default: break;
+    }
+    const QString str = var.toString();
+    if(str.isEmpty()){
+        writeNull();
+    } else {
+        writeString(str);
+    }
+}
+
+void JsonStreamWriter::writeRaw(const char *str)
+{
+    m_buf.append(str);
+}
+
+void JsonStreamWriter::writeRaw(const QByteArray &data)
+{
+    m_buf.append(data);
+}
+
+void JsonStreamWriter::flushIfNeeded()
+{
+    if(m_buf.size() >= m_flushThreshold){
+        flush();
+    }
+}
+
+/// Write the buffer to the file descriptor passed in the constructor
+/// @throws QExcIo
+void JsonStreamWriter::flush()
+{
+    if(m_fd == -1){
+        return;
+    }
+    const char* data = m_buf.constData();
+    size_t remaining = size_t(m_buf.size());
+    while(remaining > 0){
+        const ssize_t ret = ::write(m_fd, data, remaining);
+        if(ret == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            throw QExcIo("Failed to write json output");
+        }
+        data += ret;
+        remaining -= size_t(ret);
+    }
+    m_buf.resize(0);
+}
+
+const QByteArray &JsonStreamWriter::buffer() const
+{
+    return m_buf;
+}
+
+void JsonStreamWriter::clearBuffer()
+{
+    m_buf.resize(0);
+}
+
+void JsonStreamWriter::prepareValue()
+{
+    if(m_afterKey){
+        m_afterKey = false;
+        return;
+    }
+    if(m_isFirstElement.empty()){
+        return;
+    }
+    if(m_isFirstElement.back()){
+        m_isFirstElement.back() = false;
+    } else {
+        m_buf.append(',');
+    }
+}
+
+/// Escape and convert to UTF-8 like Qt's json writer does: control characters,
+/// quotes and backslashes are escaped, invalid UTF-16 (lone surrogates) is
+/// written as \\uXXXX.
+void JsonStreamWriter::appendEscaped(const QString &str)
+{
+    const ushort* src = reinterpret_cast<const ushort*>(str.constData());
+    const ushort* const end = src + str.size();
+    while(src != end){
+        const ushort u = *src++;
+        if(u < 0x80){
+            if(u >= 0x20 && u != 0x22 && u != 0x5c){
+                m_buf.append(char(u));
+                continue;
+            }
+            m_buf.append('\\');
+            switch (u) {
+            case 0x22: m_buf.append('"'); break;
+            case 0x5c: m_buf.append('\\'); break;
+            case 0x8: m_buf.append('b'); break;
+            case 0xc: m_buf.append('f'); break;
+            case 0xa: m_buf.append('n'); break;
+            case 0xd: m_buf.append('r'); break;
+            case 0x9: m_buf.append('t'); break;
+            default: {
+                const char esc[] = {'u', '0', '0', hexdig(u >> 4), hexdig(u & 0xf)};
+                m_buf.append(esc, sizeof (esc));
+            }
+            }
+        } else if(u < 0x800){
+            m_buf.append(char(0xc0 | (u >> 6)));
+            m_buf.append(char(0x80 | (u & 0x3f)));
+        } else if(! QChar::isSurrogate(u)){
+            m_buf.append(char(0xe0 | (u >> 12)));
+            m_buf.append(char(0x80 | ((u >> 6) & 0x3f)));
+            m_buf.append(char(0x80 | (u & 0x3f)));
+        } else if(QChar::isHighSurrogate(u) && src != end && QChar::isLowSurrogate(*src)){
+            const uint ucs4 = QChar::surrogateToUcs4(u, *src++);
+            m_buf.append(char(0xf0 | (ucs4 >> 18)));
+            m_buf.append(char(0x80 | ((ucs4 >> 12) & 0x3f)));
+            m_buf.append(char(0x80 | ((ucs4 >> 6) & 0x3f)));
+            m_buf.append(char(0x80 | (ucs4 & 0x3f)));
+        } else {
+            const char esc[] = {'\\', 'u', hexdig((u >> 12) & 0xf), hexdig((u >> 8) & 0xf),
+                                hexdig((u >> 4) & 0xf), hexdig(u & 0xf)};
+            m_buf.append(esc, sizeof (esc));
+        }
+    }
+}
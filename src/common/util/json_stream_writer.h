@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+
+/// Write compact JSON as UTF-8 into a reusable buffer, which is flushed to
+/// a file descriptor, once it grows beyond a threshold. Other than
+/// QJsonDocument, no intermediate objects are built, however, the output
+/// is byte-identical to QJsonDocument::toJson(QJsonDocument::Compact),
+/// as long as the keys of each object are written in ascending order
+/// (QJsonObject sorts its keys).
+/// Commas are inserted automatically. Usage:
+///     w.beginObject();
+///     w.key("a"); w.writeInt(1);
+///     w.key("b"); w.writeString("foo");
+///     w.endObject();
+class JsonStreamWriter
+{
+public:
+    explicit JsonStreamWriter(int fd=-1, int flushThreshold=1 << 16);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    void key(const char* k);
+
+    void writeString(const QString& str);
+    void writeInt(qint64 val);
+    void writeBool(bool val);
+    void writeNull();
+    void writeVariant(const QVariant& var);
+
+    void writeRaw(const char* str);
+    void writeRaw(const QByteArray& data);
+
+    void flushIfNeeded();
+    void flush();
+
+    const QByteArray& buffer() const;
+    void clearBuffer();
+
+public:
+    Q_DISABLE_COPY(JsonStreamWriter)
+
+private:
+    void prepareValue();
+    void appendEscaped(const QString& str);
+
+    int m_fd;
+    int m_flushThreshold;
+    QByteArray m_buf;
+    // one entry per open object/array: true, if no element was written yet
+    std::vector<bool> m_isFirstElement;
+    bool m_afterKey{false};
+};
@@ -31,40 +31,74 @@
 
 #include "user_kernerl.h"
 
-static ssize_t __do_read(xxh_common_file_t file, void *buf, size_t nbytes){
+/// read nbytes at *pos and advance *pos by the number of read bytes.
+/// In userspace use pread, so no lseek is required for sparse
+/// reads and the file offset is left untouched.
+static ssize_t __do_read(xxh_common_file_t file, void *buf, size_t nbytes,
+                         loff_t* pos){
 #ifdef __KERNEL__
-    return kutil_kernel_read_cachefriendly(file, buf, nbytes, &file->f_pos);
+    return kutil_kernel_read_cachefriendly(file, buf, nbytes, pos);
 #else
-    ssize_t ret = read(file, buf, nbytes);
+    ssize_t ret = pread(file, buf, nbytes, *pos);
     if(unlikely(ret < 0)){
         return -errno;
     }
+    *pos += ret;
     return ret;
 #endif
 }
 
 
-static loff_t __do_seek(xxh_common_file_t file, loff_t offset){
 #ifdef __KERNEL__
-    file->f_pos += offset;
-    return 0;
-    // return vfs_llseek(file, offset, whence);
+#define __hash_reset(part_hash) \
+    xxh64_reset((part_hash)->xxh_state, 0)
+#define __hash_update(part_hash, buf, len) \
+    xxh64_update((part_hash)->xxh_state, buf, len)
+#define __hash_digest(part_hash) \
+    xxh64_digest((part_hash)->xxh_state)
+#define __hash_buffer(part_hash, buf, len) \
+    xxh64(buf, len, 0)
 #else
-    loff_t ret = lseek(file, offset, SEEK_CUR);
-    if(unlikely(ret < 0)){
-        return -errno;
+static void __hash_reset(struct partial_xxhash* part_hash){
+    if(part_hash->algorithm == PARTIAL_XXHASH_XXH3){
+        XXH3_64bits_reset(part_hash->xxh3_state);
+    } else {
+        xxh64_reset(part_hash->xxh_state, 0);
     }
-    return ret;   
-#endif
 }
 
+static long __hash_update(struct partial_xxhash* part_hash,
+                          const void* buf, size_t len){
+    if(part_hash->algorithm == PARTIAL_XXHASH_XXH3){
+        return XXH3_64bits_update(part_hash->xxh3_state, buf, len);
+    }
+    return xxh64_update(part_hash->xxh_state, buf, len);
+}
+
+static uint64_t __hash_digest(struct partial_xxhash* part_hash){
+    if(part_hash->algorithm == PARTIAL_XXHASH_XXH3){
+        return XXH3_64bits_digest(part_hash->xxh3_state);
+    }
+    return xxh64_digest(part_hash->xxh_state);
+}
+
+static uint64_t __hash_buffer(struct partial_xxhash* part_hash,
+                              const void* buf, size_t len){
+    if(part_hash->algorithm == PARTIAL_XXHASH_XXH3){
+        return XXH3_64bits(buf, len);
+    }
+    return xxh64(buf, len, 0);
+}
+#endif
+
+
 /// read bufsize bytes from file and directly hash them
 static ssize_t __read_and_hash(xxh_common_file_t file,
-                                       void* buf, size_t bufsize,
-                                       XXH_COMMON_STATE* xxh_state){
-    ssize_t readBytes = __do_read(file, buf, bufsize);
+                               struct partial_xxhash* part_hash,
+                               size_t bufsize, loff_t* pos){
+    ssize_t readBytes = __do_read(file, part_hash->buf, bufsize, pos);
     if(likely(readBytes > 0)){
-        long xxh_ret = xxh64_update(xxh_state, buf, readBytes);
+        long xxh_ret = __hash_update(part_hash, part_hash->buf, readBytes);
         // we always provide a valid buffer, so no
         // need to check for errors in production.
         kuassert(xxh_ret == 0);
@@ -79,19 +113,18 @@ static ssize_t __read_and_hash(xxh_common_file_t file,
 /// than the chunksize.
 /// @return The number of read/hashed bytes or a neg. error.
 static ssize_t __read_chunk(xxh_common_file_t file,
-                                   struct partial_xxhash* part_hash){
+                                   struct partial_xxhash* part_hash,
+                                   loff_t* pos){
     ssize_t readBytes;
 
     if(part_hash->chunksize <= part_hash->bufsize){
-        readBytes = __read_and_hash(file, part_hash->buf, part_hash->chunksize,
-                                    part_hash->xxh_state);
+        readBytes = __read_and_hash(file, part_hash, part_hash->chunksize, pos);
     } else {        
         // read and digest immediatly, as our buffer is small
         size_t missing_bytes = part_hash->chunksize;
         size_t readsize = part_hash->bufsize;
         while(true){
-            ssize_t bytes = __read_and_hash(file, part_hash->buf, readsize,
-                                            part_hash->xxh_state);
+            ssize_t bytes = __read_and_hash(file, part_hash, readsize, pos);
             if(unlikely(bytes < 0)) return bytes;
 
             missing_bytes -= bytes;
@@ -114,10 +147,39 @@ static ssize_t __read_chunk(xxh_common_file_t file,
 
 
 
+/// All chunks fit into the buffer: read them one after another into it
+/// and hash them at once, which avoids the overhead of the
+/// xxhash-state. The result is the same as for the streaming variant.
+static long __digest_buffered(xxh_common_file_t file,
+                              struct partial_xxhash* part_hash,
+                              loff_t* pos, loff_t net_seek,
+                              struct partial_xxhash_result* result){
+    char* buf_pos = part_hash->buf;
+    int countOfReads;
+    for(countOfReads=0; countOfReads < part_hash->max_count_of_reads ; ++countOfReads) {
+        ssize_t readBytes = __do_read(file, buf_pos, part_hash->chunksize, pos);
+        if(unlikely(readBytes < 0)) return -readBytes;
+        buf_pos += readBytes;
+        if(readBytes < part_hash->chunksize) {
+            break; // EOF
+        }
+        if(net_seek > 0){
+            *pos += net_seek;
+        }
+    }
+    result->count_of_bytes = buf_pos - part_hash->buf;
+    result->hash = (result->count_of_bytes == 0) ? 0 :
+                       __hash_buffer(part_hash, part_hash->buf,
+                                     result->count_of_bytes);
+    return 0;
+}
+
+
 /// XXHASH-digest a whole file or parts of it at regular intervals.
-/// @param file the fildescriptor of the file. Note that in general you would want
-///           to make sure, that the offset is at 0. Note that the offset
-///           may be changed during the call.
+/// @param file the fildescriptor of the file. In userspace, reading starts
+///             at offset 0 and the file offset is not changed. In the kernel
+///             reading starts at the file position which is changed
+///             during the call.
 /// @param chunksize size of the chunks to read at once.
 /// @param seekstep Read chunks from the file every seekstep bytes. The read chunk
 ///                 does not count into this, so if you actually want to skip bytes,
@@ -125,6 +187,8 @@ static ssize_t __read_chunk(xxh_common_file_t file,
 ///                 performed at all.
 /// @param maxCountOfReads stop reading and digest after that count of 'read'-
 ///                        operations.
+/// @param algorithm (userspace only) XXH64 or XXH3. The kernel always
+///                  uses XXH64.
 /// @param result write hash and count of read bytes in here
 /// @return 0 on success, else a positive error
 long partial_xxh_digest_file(xxh_common_file_t file,
@@ -132,36 +196,45 @@ long partial_xxh_digest_file(xxh_common_file_t file,
                 struct partial_xxhash_result* result
                 )
 {
-    long err;
     int countOfReads;
     loff_t net_seek;
+#ifdef __KERNEL__
+    loff_t* pos = &file->f_pos;
+#else
+    loff_t file_pos = 0;
+    loff_t* pos = &file_pos;
+#endif
     result->count_of_bytes = 0;
 
     kuassert(part_hash->max_count_of_reads > 0);
     kuassert(part_hash->chunksize > 0);
     kuassert(part_hash->bufsize > 0);
 
-    xxh64_reset(part_hash->xxh_state, 0);
     net_seek = part_hash->seekstep - part_hash->chunksize;
 
+    if(part_hash->chunksize <= part_hash->bufsize &&
+        (size_t)part_hash->max_count_of_reads <=
+                part_hash->bufsize / part_hash->chunksize){
+        return __digest_buffered(file, part_hash, pos, net_seek, result);
+    }
+
+    __hash_reset(part_hash);
     for(countOfReads=0; countOfReads < part_hash->max_count_of_reads ; ++countOfReads) {
         // maybe_todo: preload next chunk with filemap.c:page_cache_read?
-        ssize_t readBytes = __read_chunk(file, part_hash);
+        ssize_t readBytes = __read_chunk(file, part_hash, pos);
         if(unlikely(readBytes < 0)) return -readBytes;
         result->count_of_bytes += readBytes;
         if(readBytes < part_hash->chunksize) {
             break; // EOF
         }
-
-        if( net_seek > 0  &&
-                unlikely((err = __do_seek(file, net_seek)) < 0) ) {
-            return -err;
+        if(net_seek > 0){
+            *pos += net_seek;
         }
     }
     if(result->count_of_bytes == 0){
         result->hash = 0;
     } else {
-        result->hash = xxh64_digest(part_hash->xxh_state);
+        result->hash = __hash_digest(part_hash);
     }
     return 0;
 }
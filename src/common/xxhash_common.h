@@ -30,11 +30,22 @@ typedef int xxh_common_file_t;
 extern "C" {
 #endif
 
+/// The hash function used by partial_xxh_digest_file. The values
+/// are stored in the database (hashmeta), so never change them.
+enum partial_xxhash_algorithm {
+    PARTIAL_XXHASH_XXH64 = 0,
+    PARTIAL_XXHASH_XXH3 = 1, /* userspace only */
+};
+
 struct partial_xxhash {
     unsigned chunksize; /* read and hash that many bytes per chunk */
     int max_count_of_reads; /* do not read more than that many chunks */
     loff_t seekstep; /* determined by file size and max_count_of_reads */
     XXH_COMMON_STATE* xxh_state;
+#ifndef __KERNEL__
+    int algorithm; /* enum partial_xxhash_algorithm */
+    XXH3_state_t* xxh3_state; /* used instead of xxh_state for XXH3 */
+#endif
     char* buf;
     size_t bufsize;
 };
@@ -3,6 +3,7 @@
 #include <climits>
 #include <cstdlib>
 #include <cassert>
+#include <cstring>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -21,37 +22,50 @@
 using shell_request_handler::ShellRequest;
 using shell_request_handler::checkForTriggerAndHandle;
 
-/// @return absolute version of the passed path or an empty string in case
-/// of an error.
-static std::string mkAbsPath(const char* path){
+static const char TRIGGER_RESPONSE_PATH[] = "_///shournal_trigger_response///_";
+
+/// Resolve the passed path against the cached working directory
+/// (see ShellGlobals::cwdCache) without allocating memory.
+/// @param buf: buffer of size PATH_MAX, which receives the joined path
+/// @return absolute version of the passed path (either path itself or buf)
+/// or nullptr in case of an error.
+static const char* mkAbsPath(const char* path, char* buf){
     if(path[0] == '/'){
         return path;
     }
-    std::string buf(PATH_MAX, '\0');
-
-    char* rawBuf = strDataAccess(buf);
-    if(getcwd(rawBuf, buf.size()) == nullptr){
-        logWarning << qtr("Failed to resolve relative path %1. "
-                       "The working-directory could not be determined (%2). "
-                       "File events will not be registered.")
-                   .arg(path, translation::strerror_l());
-        return {};
-    }
-    if(rawBuf[0] != '/'){
-        // see also man 3 getcwd
-        logWarning << qtr("Failed to resolve relative path %1. "
-                       "The working-directory does not begin with '/' but %2. "
-                       "File events will not be registered.")
-                   .arg(path, rawBuf);
-        return {};
+    auto& g_shell = ShellGlobals::instance();
+    if(g_shell.cwdCacheLen == 0){
+        if(getcwd(g_shell.cwdCache, sizeof(g_shell.cwdCache)) == nullptr){
+            logWarning << qtr("Failed to resolve relative path %1. "
+                           "The working-directory could not be determined (%2). "
+                           "File events will not be registered.")
+                       .arg(path, translation::strerror_l());
+            return nullptr;
+        }
+        if(g_shell.cwdCache[0] != '/'){
+            // see also man 3 getcwd
+            logWarning << qtr("Failed to resolve relative path %1. "
+                           "The working-directory does not begin with '/' but %2. "
+                           "File events will not be registered.")
+                       .arg(path, g_shell.cwdCache);
+            return nullptr;
+        }
+        g_shell.cwdCacheLen = strlen(g_shell.cwdCache);
     }
 
-    // resize to actual length
-    buf.resize(strlen(rawBuf));
-    if(buf.size() != 1){
-        buf += '/';
+    size_t cwdLen = g_shell.cwdCacheLen;
+    const size_t pathLen = strlen(path);
+    // cwd + '/' + path + '\0'
+    if(cwdLen + 1 + pathLen + 1 > PATH_MAX){
+        logWarning << qtr("Failed to resolve relative path %1: path too long. "
+                          "File events will not be registered.").arg(path);
+        return nullptr;
+    }
+    memcpy(buf, g_shell.cwdCache, cwdLen);
+    if(cwdLen != 1){
+        buf[cwdLen++] = '/';
     }
-    buf += path;
+    memcpy(buf + cwdLen, path, pathLen + 1);
     return buf;
 }
 
@@ -76,6 +90,15 @@ int event_open::handleOpen(const char *pathname, int flags, mode_t mode, bool la
     }
 
     auto& g_shell = ShellGlobals::instance();
+
+    // Fast path: outside of a command, only the trigger response path is of
+    // interest. Checking its first char allows for skipping the atomic flag
+    // and the strcmp for nearly all paths, e.g. while sourcing large rc-files.
+    const bool maybeTrigger = pathname[0] == '_';
+    if(! maybeTrigger && g_shell.watchState != E_WatchState::WITHIN_CMD){
+        return g_shell.orig_open(pathname, flags, mode);
+    }
+
     if(g_shell.ignoreEvents.test_and_set()){
         return g_shell.orig_open(pathname, flags, mode);
     }
@@ -86,7 +109,7 @@ int event_open::handleOpen(const char *pathname, int flags, mode_t mode, bool la
     // So check for the pathname before handling the request in
     // checkForTriggerAndHandle (this is for cases where the trigger variable is set
     // and other redirections occurr in between).
-    if(strcmp(pathname, "_///shournal_trigger_response///_") == 0){
+    if(maybeTrigger && strcmp(pathname, TRIGGER_RESPONSE_PATH) == 0){
         bool shellRequestSuccess = false;
         auto shellRequest = checkForTriggerAndHandle(&shellRequestSuccess);
         switch (shellRequest) {
@@ -100,22 +123,23 @@ int event_open::handleOpen(const char *pathname, int flags, mode_t mode, bool la
         shell_earlydbg("ignoring pathname %s (not WITHIN_CMD)", pathname);
         return g_shell.orig_open(pathname, flags, mode);
     }
-    const auto absPath = mkAbsPath(pathname);
+    char absPathBuf[PATH_MAX];
+    const char* absPath = mkAbsPath(pathname, absPathBuf);
+    if(absPath == nullptr){
+        return g_shell.orig_open(pathname, flags, mode);
+    }
 
     // pass the resolved abs. path relative to shournal's root directory fd,
     // by omitting the initial '/'.
     // Users may further pass malformed file-paths such as //foo, so find the first
     // non-slash char.
-    const char* actualPath = nullptr;
-    for(size_t i=0; i < absPath.size(); i++){
-        if(absPath[i] != '/'){
-            actualPath = &absPath[i];
-            break;
-        }
+    const char* actualPath = absPath;
+    while(*actualPath == '/'){
+        ++actualPath;
     }
 
-    if(actualPath == nullptr || absPath.c_str() + absPath.size() - actualPath < 1){
-        // Get here on mkAbsPath-error or because user attempted to open "/" or ""
+    if(*actualPath == '\0'){
+        // Get here because user attempted to open "/" or ""
         // The shortest possible absolute FILEpath under linux is two chars long.
         // We may get here, if bash-user calls e.g.
         // while read line; do echo $line ; done < "/"
@@ -126,4 +150,3 @@ int event_open::handleOpen(const char *pathname, int flags, mode_t mode, bool la
     logDebug << "about to open" << actualPath - 1;
     return openat(g_shell.shournalRootDirFd, actualPath, flags, mode);
 }
-
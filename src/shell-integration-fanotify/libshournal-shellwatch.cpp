@@ -35,6 +35,8 @@ static void initSymIfNeeded(){
             g_shell.orig_open = reinterpret_cast<open_func_t>(os::dlsym(RTLD_NEXT, "open"));
             // globals.orig_fopen = reinterpret_cast<fopen_func_t>(os::dlsym(RTLD_NEXT, "fopen"));
             g_shell.orig_strcpy = reinterpret_cast<strcpy_func_t>(os::dlsym(RTLD_NEXT, "strcpy"));
+            g_shell.orig_chdir = reinterpret_cast<chdir_func_t>(os::dlsym(RTLD_NEXT, "chdir"));
+            g_shell.orig_fchdir = reinterpret_cast<fchdir_func_t>(os::dlsym(RTLD_NEXT, "fchdir"));
 
             return;
         } catch(const std::exception& ex){
@@ -96,6 +98,24 @@ int open64(const char *pathname, int flags, mode_t mode) {
     return ShellGlobals::instance().orig_open(pathname, flags, mode);
 }
 
+// chdir and fchdir are only observed to invalidate the cached
+// working directory used in event_open.
+LIBSHOURNAL_SHELLWATCH_EXPORT
+int chdir(const char *path){
+    initSymIfNeeded();
+    auto& g_shell = ShellGlobals::instance();
+    g_shell.cwdCacheLen = 0;
+    return g_shell.orig_chdir(path);
+}
+
+LIBSHOURNAL_SHELLWATCH_EXPORT
+int fchdir(int fd){
+    initSymIfNeeded();
+    auto& g_shell = ShellGlobals::instance();
+    g_shell.cwdCacheLen = 0;
+    return g_shell.orig_fchdir(fd);
+}
+
 // There seems to be no point in observing fopen - browsing the source-code
 // of bash, zsh, kash, csh, .. all relevant user file activity is handled via
 // the 'open' library-call. If one day it would be observed anyway: the shell's
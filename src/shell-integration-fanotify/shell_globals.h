@@ -1,10 +1,12 @@
 #pragma once
 
+#include <climits>
 #include <csignal>
 #include <sched.h>
 #include <atomic>
 #include <QByteArray>
 #include <QDateTime>
+#include <memory>
 #include <mutex>
 
 #include "attached_shell.h"
@@ -12,6 +14,7 @@
 #include "logger.h"
 #include "os.h"
 #include "sessioninfo.h"
+#include "shm_ring.h"
 #include "util.h"
 
 
@@ -22,6 +25,8 @@ typedef int (*execve_func_t)(const char *filename, char *const argv[],
 
 typedef int (*open_func_t)(const char *pathname, int flags, mode_t mode);
 typedef char * (*strcpy_func_t)(char *, const char*);
+typedef int (*chdir_func_t)(const char *path);
+typedef int (*fchdir_func_t)(int fd);
 
 extern const char* ENV_VARNAME_SHELL_VERBOSITY;
 
@@ -41,6 +46,8 @@ public:
     execve_func_t orig_execve {};
     open_func_t orig_open {};
     strcpy_func_t orig_strcpy {};
+    chdir_func_t orig_chdir {};
+    fchdir_func_t orig_fchdir {};
 
     std::atomic_flag ignoreEvents{};
 
@@ -59,9 +66,19 @@ public:
 
     SessionInfo sessionInfo;
     int shournalRootDirFd {-1};
+    // if true, the backend behind shournalSocket observes all
+    // commands of this session (see Settings::FanotifySettings)
+    bool persistentBackend {false};
+    // optional shared memory channel to the persistent backend
+    std::unique_ptr<fdcommunication::ShmRing> shmRing;
 
     pid_t shellParentPid {0};
 
+    // The shell's working directory, so relative paths can be resolved
+    // without a getcwd-call on each open. Invalidated (len=0) on chdir/fchdir.
+    char cwdCache[PATH_MAX] {};
+    size_t cwdCacheLen {0};
+
 public:
     ~ShellGlobals() = default;
     Q_DISABLE_COPY(ShellGlobals)
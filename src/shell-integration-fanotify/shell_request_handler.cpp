@@ -1,5 +1,7 @@
 
 #include <sys/socket.h>
+#include <poll.h>
+#include <pthread.h>
 #include <cassert>
 #include <cstdlib>
 #include <QCoreApplication>
@@ -34,6 +36,7 @@
 using socket_message::E_SocketMsg;
 using socket_message::socketMsgToStr;
 using fdcommunication::SocketCommunication;
+using fdcommunication::ShmRing;
 using osutil::closeVerbose;
 using shell_request_handler::ShellRequest;
 
@@ -166,6 +169,62 @@ static void verboseCloseShournalSocket(){
 
     }
     g_shell.shournalSocket.setSockFd(-1);
+    g_shell.persistentBackend = false;
+    g_shell.shmRing.reset();
+}
+
+/// Send to the persistent backend, preferably via the shared memory ring.
+/// If the ring is full, fall back to the socket: the backend drains the
+/// ring before reading from the socket, so the order is preserved.
+static void sendToPersistentBackend(const SocketCommunication::Messages& messages){
+    auto& g_shell = ShellGlobals::instance();
+    if(g_shell.shmRing != nullptr && g_shell.shmRing->sendMessages(messages)){
+        return;
+    }
+    g_shell.shournalSocket.sendMessages(messages);
+}
+
+/// Writing to the shared memory ring succeeds even if the backend is gone,
+/// so check whether it closed its end of the socket.
+static bool persistentBackendIsAlive(){
+    struct pollfd pfd{};
+    pfd.fd = ShellGlobals::instance().shournalSocket.sockFd();
+    pfd.events = POLLRDHUP;
+    return poll(&pfd, 1, 0) != 1;
+}
+
+/// The ring is not mapped in forked children (subshells), which
+/// thus send via the socket.
+static void abandonShmRingInChild(){
+    auto& g_shell = ShellGlobals::instance();
+    if(g_shell.shmRing != nullptr){
+        g_shell.shmRing->abandonAfterFork();
+        g_shell.shmRing.reset();
+    }
+}
+
+/// @return the shared memory ring for the persistent backend or nullptr,
+/// if it could not be created (e.g. old kernel without memfd).
+static std::unique_ptr<ShmRing> createShmRingVerbose(){
+    const uint32_t SHM_RING_CAPACITY = 1 << 16;
+    static bool atforkRegistered = false;
+    if(! atforkRegistered){
+        if(pthread_atfork(nullptr, nullptr, abandonShmRingInChild) != 0){
+            logInfo << qtr("Failed to register the fork-handler, "
+                           "using the socket instead of the shared memory channel");
+            return nullptr;
+        }
+        atforkRegistered = true;
+    }
+    std::unique_ptr<ShmRing> ring(new ShmRing);
+    try {
+        ring->create(SHM_RING_CAPACITY);
+    } catch (const std::exception& ex) {
+        logInfo << qtr("Failed to setup the shared memory channel, "
+                       "using the socket instead: %1").arg(ex.what());
+        return nullptr;
+    }
+    return ring;
 }
 
 static void verboseCloseRootDirFd(){
@@ -242,8 +301,10 @@ static bool handleCleanupCmd(){
 
     auto finalActions = finally([&g_shell] {
         g_shell.watchState = E_WatchState::INTERMEDIATE;
-        verboseCloseShournalSocket();
-        verboseCloseRootDirFd();
+        if(! g_shell.persistentBackend){
+            verboseCloseShournalSocket();
+            verboseCloseRootDirFd();
+        }
     });
 
     QByteArray lastCommand = getenv("_SHOURNAL_LAST_COMMAND");
@@ -269,12 +330,58 @@ static bool handleCleanupCmd(){
     SocketCommunication::Messages messages;
     messages.push_back({int(E_SocketMsg::COMMAND), lastCommand});
     messages.push_back({int(E_SocketMsg::RETURN_VALUE), qBytesFromVar(returnVal)});
-    g_shell.shournalSocket.sendMessages(messages);
+    if(g_shell.persistentBackend){
+        messages.push_back({int(E_SocketMsg::CMD_FINISHED)});
+    }
+    try {
+        if(g_shell.persistentBackend){
+            sendToPersistentBackend(messages);
+        } else {
+            g_shell.shournalSocket.sendMessages(messages);
+        }
+    } catch (const fdcommunication::ExcFdComm& ex) {
+        if(! g_shell.persistentBackend){
+            throw;
+        }
+        // The backend is gone, launch a new one for the next command.
+        logWarning << qtr("Failed to send the command to the persistent "
+                          "%1-process: %2").arg(app::SHOURNAL_RUN_FANOTIFY, ex.descrip());
+        verboseCloseShournalSocket();
+        verboseCloseRootDirFd();
+        return false;
+    }
 
     return true;
 }
 
 
+/// Start observing the next command using the already running backend
+/// of this session: it discards events which occurred in between and
+/// receives our current working directory.
+static bool prepareCmdWithPersistentBackend(){
+    auto& g_shell = ShellGlobals::instance();
+    try {
+        if(g_shell.shmRing != nullptr && ! persistentBackendIsAlive()){
+            throw fdcommunication::ExcFdComm(qtr("the socket was closed"));
+        }
+        SocketCommunication::Messages messages;
+        messages.push_back({int(E_SocketMsg::CLEAR_EVENTS)});
+        messages.push_back({int(E_SocketMsg::WORKING_DIRECTORY),
+                            os::readlink<QByteArray>("/proc/self/cwd")});
+        sendToPersistentBackend(messages);
+    } catch (const std::exception& ex) {
+        logInfo << qtr("The persistent %1-process is not available (%2), "
+                       "launching a new one...").arg(app::SHOURNAL_RUN_FANOTIFY, ex.what());
+        verboseCloseShournalSocket();
+        verboseCloseRootDirFd();
+        return false;
+    }
+    g_shell.watchState = E_WatchState::WITHIN_CMD;
+    shell_logger::flushBufferdMessages();
+    return true;
+}
+
+
 static bool handleEnableRequest(){
     if(! initializeAttachedShellIfNeeded()){
         return false;
@@ -351,9 +458,15 @@ bool shell_request_handler::handlePrepareCmd(){
         return false;
     }
 
+    if(g_shell.persistentBackend && prepareCmdWithPersistentBackend()){
+        return true;
+    }
+
     if(! loadSettings()){
         return false;
     }
+    const auto& fanSettings = Settings::instance().fanotifySettings();
+    const bool persistent = fanSettings.persistentSessionBackend;
 
     g_shell.shournalSocket.setSockFd(-1);
 
@@ -384,6 +497,19 @@ bool shell_request_handler::handlePrepareCmd(){
             args.push_back("--tmpdir");
             args.push_back(tmpdir);
         }
+        std::unique_ptr<ShmRing> shmRing;
+        if(persistent){
+            args.push_back("--persistent");
+            if(fanSettings.sharedMemoryChannel){
+                shmRing = createShmRingVerbose();
+            }
+        }
+        if(shmRing != nullptr){
+            args.push_back("--shm-ring-fd");
+            args.push_back(std::to_string(shmRing->memFd()));
+            args.push_back("--shm-doorbell-fd");
+            args.push_back(std::to_string(shmRing->doorbellFd()));
+        }
         g_shell.lastMountNamespacePid = -1;
         subprocess::Subprocess subproc;
         subproc.setInNewSid(true); // Survive parent shell exit
@@ -405,6 +531,10 @@ bool shell_request_handler::handlePrepareCmd(){
             }
         }
 
+        if(shmRing != nullptr){
+            forwardFs.insert(shmRing->memFd());
+            forwardFs.insert(shmRing->doorbellFd());
+        }
         subproc.setForwardFdsOnExec(forwardFs);
         subproc.call(args);
         logDebug << "launched" << BACKEND_FILENAME
@@ -470,6 +600,17 @@ bool shell_request_handler::handlePrepareCmd(){
         }
         g_shell.shournalSocket.setSockFd(g_shell.shournalSocketNb);
         g_shell.shournalSockFdDescripFlags = os::getFdDescriptorFlags(g_shell.shournalSocketNb);
+        g_shell.persistentBackend = persistent;
+        if(shmRing != nullptr){
+            // The backend mapped the ring. Like the socket, move the doorbell out of the
+            // way of the user's file descriptors.
+            shmRing->closeMemFd();
+            int doorbellFd = verbose_findHighestFreeFd(g_shell.shournalRootDirFd - 1);
+            if(doorbellFd != -1){
+                shmRing->moveDoorbellFd(doorbellFd);
+                g_shell.shmRing = std::move(shmRing);
+            }
+        }
 
         g_shell.watchState = E_WatchState::WITHIN_CMD;
         shell_logger::flushBufferdMessages();
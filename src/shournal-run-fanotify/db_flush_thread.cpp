@@ -0,0 +1,106 @@
+
+#include <cassert>
+#include <sys/resource.h>
+
+#include "db_flush_thread.h"
+
+#include "db_archive.h"
+#include "db_controller.h"
+#include "logger.h"
+#include "os.h"
+#include "stdiocpp.h"
+#include "storedfiles.h"
+#include "translation.h"
+
+const int PRIO_DATABASE_FLUSH = 10;
+
+
+DbFlushThread::~DbFlushThread()
+{
+    try {
+        finish();
+    } catch (const std::exception& e) {
+        logCritical << __func__ << e.what();
+    }
+}
+
+void DbFlushThread::start()
+{
+    assert(! m_thread.joinable());
+    m_finish = false;
+    m_thread = std::thread(&DbFlushThread::run, this);
+}
+
+/// Enqueue the finished command. We take over ownership of
+/// the file-events (and their FILE).
+void DbFlushThread::push(const CommandInfo &cmd, std::unique_ptr<FileEvents> fileEvents)
+{
+    assert(m_thread.joinable());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back({cmd, std::move(fileEvents)});
+    }
+    m_cond.notify_one();
+}
+
+/// Flush all pending commands and wait for the thread to exit.
+void DbFlushThread::finish()
+{
+    if(! m_thread.joinable()){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finish = true;
+    }
+    m_cond.notify_one();
+    m_thread.join();
+}
+
+bool DbFlushThread::isRunning() const
+{
+    return m_thread.joinable();
+}
+
+void DbFlushThread::run()
+{
+    // On Linux the nice value applies per thread, so we do not
+    // disturb the event processing.
+    os::setpriority(PRIO_PROCESS, 0, PRIO_DATABASE_FLUSH);
+    while(true){
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_finish || ! m_jobs.empty(); });
+            if(m_jobs.empty()){
+                // m_finish is set
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        flush(job);
+    }
+}
+
+void DbFlushThread::flush(DbFlushThread::Job &job)
+{
+    FILE* eventFile = job.fileEvents->file();
+    try {
+        if(job.cmd.text.isEmpty()){
+            logDebug << "command-text is empty, "
+                        "not pushing to database...";
+        } else {
+            job.cmd.idInDb = db_controller::addCommand(job.cmd);
+            StoredFiles::mkpath();
+            stdiocpp::fseek(eventFile, 0, SEEK_SET);
+            db_controller::addFileEvents(job.cmd, *job.fileEvents);
+            db_archive::archiveIfDue();
+        }
+    } catch (std::exception& e) {
+        // May happen, e.g. if we run out of disk space...
+        logCritical << qtr("Failed to store (some) file-events to disk: %1").arg(e.what());
+    }
+    fclose(eventFile);
+}
+
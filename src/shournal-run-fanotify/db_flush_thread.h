@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "commandinfo.h"
+#include "fileevents.h"
+#include "util.h"
+
+/// Store finished commands along with their file-events to the database
+/// within a background thread, so the fanotify event processing does not
+/// stall while sqlite is busy. Used by the persistent shell session backend,
+/// which observes one command after another. Note that the database must
+/// *only* be accessed from within this thread, once it was started.
+class DbFlushThread
+{
+public:
+    DbFlushThread() = default;
+    ~DbFlushThread();
+
+    void start();
+    void push(const CommandInfo& cmd, std::unique_ptr<FileEvents> fileEvents);
+    void finish();
+
+    bool isRunning() const;
+
+public:
+    Q_DISABLE_COPY(DbFlushThread)
+    DISABLE_MOVE(DbFlushThread)
+
+private:
+    struct Job {
+        CommandInfo cmd;
+        std::unique_ptr<FileEvents> fileEvents;
+    };
+
+    void run();
+    void flush(Job& job);
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Job> m_jobs;
+    bool m_finish {false};
+};
+
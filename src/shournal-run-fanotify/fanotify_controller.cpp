@@ -391,6 +391,25 @@ void FanotifyController::unregisterAllReadPaths()
 
 }
 
+/// Undo unregisterAllReadPaths(). This is only necessary, if we
+/// observe several commands in a row (persistent shell session backend):
+/// each command may collect its own read (script-) files.
+void FanotifyController::reregisterReadPathsIfNeeded()
+{
+    if(! m_ReadEventsUnregistered){
+        return;
+    }
+    logDebug << "re-registering read paths...";
+    for(const auto& p : m_readMountPaths){
+        if (fanotify_mark(m_fanFd, FAN_MARK_ADD | FAN_MARK_MOUNT,
+                          FAN_CLOSE_NOWRITE, AT_FDCWD,
+                          p.c_str()) == -1) {
+            logInfo << "fanotify_mark: failed to re-add read-path " << p
+                    <<": " << translation::strerror_l();
+        }
+    }
+    m_ReadEventsUnregistered = false;
+}
 
 void FanotifyController::ignoreOwnPath(const QByteArray& p){
     if (fanotify_mark(m_fanFd,
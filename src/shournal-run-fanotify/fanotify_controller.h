@@ -17,6 +17,7 @@ public:
     void setupPaths();
 
     bool handleEvents();
+    void reregisterReadPathsIfNeeded();
 
     int fanFd() const;
 
@@ -30,6 +30,7 @@
 #include "excos.h"
 #include "db_globals.h"
 #include "db_connection.h"
+#include "db_archive.h"
 #include "db_controller.h"
 #include "commandinfo.h"
 #include "translation.h"
@@ -254,6 +255,16 @@ void FileWatcher::run()
         int rootDirFd = os::open("/", O_RDONLY | O_DIRECTORY);
         auto closeRootDir = finally([&rootDirFd] { closeVerbose(rootDirFd);} );
         SocketMessages sockMesgs;
+        if(m_shmRingMemFd != -1){
+            m_shmRing.reset(new fdcommunication::ShmRing);
+            m_shmRing->attach(m_shmRingMemFd, m_shmRingDoorbellFd);
+            // the mapping remains valid
+            m_shmRing->closeMemFd();
+        }
+        if(m_persistent && m_storeToDatabase){
+            // Start before raising our capabilities for event processing
+            m_dbFlushThread.start();
+        }
         m_sockCom.sendMsg({int(E_SocketMsg::SETUP_DONE),
                            qBytesFromVar(msenterChildRet.pid), rootDirFd});
 
@@ -282,6 +293,17 @@ void FileWatcher::run()
         break;
     }
 
+    if(m_persistent){
+        // All finished commands were already passed to the flush
+        // thread. Only get here with a non-empty command text, if
+        // the shell did not send CMD_FINISHED for the last one.
+        if(! cmdInfo.text.isEmpty()){
+            handleCmdFinished(cmdInfo);
+        }
+        m_dbFlushThread.finish();
+        cpp_exit(ret);
+    }
+
     QStringList missingFields;
     if(cmdInfo.text.isEmpty()){
         // An empty command text should only occur, if the observed shell-session
@@ -364,6 +386,23 @@ void FileWatcher::setTmpDir(const QByteArray &tmpDir)
     m_tmpDir = tmpDir;
 }
 
+/// If true, keep observing after the shell reported the end of a command
+/// (CMD_FINISHED) until the socket is closed. Only applies to
+/// the shell integration (socket-fd).
+void FileWatcher::setPersistent(bool persistent)
+{
+    m_persistent = persistent;
+}
+
+
+/// Additionally receive messages via the shared memory ring created
+/// by the shell integration (see ShmRing). Only applies to the persistent mode.
+void FileWatcher::setShmRingFds(int memFd, int doorbellFd)
+{
+    m_shmRingMemFd = memFd;
+    m_shmRingDoorbellFd = doorbellFd;
+}
+
 
 void FileWatcher::setCommandFilename(char *commandFilename)
 {
@@ -372,10 +411,31 @@ void FileWatcher::setCommandFilename(char *commandFilename)
 
 
 ///  @return E_SocketMsg::EMPTY, if processing shall be stopped
-E_SocketMsg FileWatcher::processSocketEvent( CommandInfo& cmdInfo ){
+E_SocketMsg FileWatcher::processSocketEvent( CommandInfo& cmdInfo,
+                                             FanotifyController_ptr& fanotifyCtrl){
     m_sockCom.receiveMessages(&m_sockMessages);
+    return processMessages(m_sockMessages, cmdInfo, fanotifyCtrl);
+}
+
+/// Process all messages the shell integration wrote to the
+/// shared memory ring so far.
+///  @return E_SocketMsg::EMPTY, if processing shall be stopped
+E_SocketMsg FileWatcher::processShmRingEvent(CommandInfo &cmdInfo,
+                                             FanotifyController_ptr &fanotifyCtrl)
+{
+    m_shmRing->receiveMessages(&m_shmRingMessages);
+    if(m_shmRingMessages.isEmpty()){
+        return E_SocketMsg::ENUM_END;
+    }
+    return processMessages(m_shmRingMessages, cmdInfo, fanotifyCtrl);
+}
+
+///  @return E_SocketMsg::EMPTY, if processing shall be stopped
+E_SocketMsg FileWatcher::processMessages(const SocketMessages& messages,
+                                         CommandInfo& cmdInfo,
+                                         FanotifyController_ptr& fanotifyCtrl){
     E_SocketMsg returnMsg = E_SocketMsg::ENUM_END;
-    for(auto & msg : m_sockMessages){
+    for(auto & msg : messages){
         if(msg.bytes.size() > RECEIVE_BUF_SIZE - 1024*10){
             logWarning << "unusual large message received";
         }
@@ -413,6 +473,15 @@ E_SocketMsg FileWatcher::processSocketEvent( CommandInfo& cmdInfo ){
             // maybe_todo: also clear fanotify overflow events
             // (which occurred very unlikely in this case)
             cmdInfo.startTime = QDateTime::currentDateTime();
+            if(m_persistent){
+                fanotifyCtrl->reregisterReadPathsIfNeeded();
+            }
+            break;
+        case E_SocketMsg::WORKING_DIRECTORY:
+            cmdInfo.workingDirectory = QString::fromLocal8Bit(msg.bytes);
+            break;
+        case E_SocketMsg::CMD_FINISHED:
+            handleCmdFinished(cmdInfo);
             break;
         default: {
             // application bug?
@@ -426,6 +495,25 @@ E_SocketMsg FileWatcher::processSocketEvent( CommandInfo& cmdInfo ){
     return returnMsg;
 }
 
+/// Persistent session backend: the shell reported the end of a command.
+/// Pass it along with its events to the database flush thread and
+/// prepare for the next command.
+void FileWatcher::handleCmdFinished(CommandInfo &cmdInfo)
+{
+    cmdInfo.endTime = QDateTime::currentDateTime();
+    auto fileEvents = m_fEventHandler->takeFileEvents();
+    if(m_dbFlushThread.isRunning()){
+        m_dbFlushThread.push(cmdInfo, std::move(fileEvents));
+    } else {
+        fclose(fileEvents->file());
+    }
+    cmdInfo.idInDb = db::INVALID_INT_ID;
+    cmdInfo.text = "";
+    cmdInfo.returnVal = CommandInfo::INVALID_RETURN_VAL;
+    cmdInfo.startTime = QDateTime::currentDateTime();
+    cmdInfo.endTime = QDateTime();
+}
+
 void FileWatcher::flushToDisk(CommandInfo& cmdInfo){
     assert(os::getegid() == os::getgid());
     assert(os::geteuid() == os::getuid());
@@ -437,6 +525,7 @@ void FileWatcher::flushToDisk(CommandInfo& cmdInfo){
         StoredFiles::mkpath();
         stdiocpp::fseek(m_fEventHandler->fileEvents().file(), 0, SEEK_SET);
         db_controller::addFileEvents(cmdInfo, m_fEventHandler->fileEvents());
+        db_archive::archiveIfDue();
     } catch (std::exception& e) {
         // May happen, e.g. if we run out of disk space...
         logCritical << qtr("Failed to store (some) file-events to disk: %1").arg(e.what());
@@ -482,8 +571,8 @@ E_SocketMsg FileWatcher::fan_pollUntilStopped(CommandInfo& cmdInfo,
     }
 
     int poll_num;
-    const nfds_t nfds = 2;
-    struct pollfd fds[nfds];
+    const nfds_t nfds = (m_shmRing != nullptr) ? 3 : 2;
+    struct pollfd fds[3];
 
     fds[0].fd = m_sockCom.sockFd();
     fds[0].events = POLLIN;
@@ -491,6 +580,11 @@ E_SocketMsg FileWatcher::fan_pollUntilStopped(CommandInfo& cmdInfo,
     // Fanotify input
     fds[1].fd = fanotifyCtrl->fanFd();
     fds[1].events = POLLIN;
+
+    // doorbell of the shared memory ring (if any)
+    fds[2].fd = (m_shmRing != nullptr) ? m_shmRing->doorbellFd() : -1;
+    fds[2].events = POLLIN;
+    fds[2].revents = 0;
     while (true) {
         // cleanly cpp_exit poll:
         // poll for two file descriptors: the fanotify descriptor and
@@ -514,8 +608,16 @@ E_SocketMsg FileWatcher::fan_pollUntilStopped(CommandInfo& cmdInfo,
             logDebug << "new fanotify events...";
             fanotifyCtrl->handleEvents();
         }
+        // Messages which did not fit into the ring are sent via socket, so
+        // always drain the ring before reading from the socket.
+        if ((fds[2].revents & POLLIN) ||
+                (m_shmRing != nullptr && (fds[0].revents & POLLIN))) {
+            if(processShmRingEvent(cmdInfo, fanotifyCtrl) == E_SocketMsg::EMPTY){
+                return E_SocketMsg::EMPTY;
+            }
+        }
         if (fds[0].revents & POLLIN) {
-            if(processSocketEvent(cmdInfo) == E_SocketMsg::EMPTY){
+            if(processSocketEvent(cmdInfo, fanotifyCtrl) == E_SocketMsg::EMPTY){
                 return E_SocketMsg::EMPTY;
             }
         }
@@ -5,6 +5,8 @@
 #include "fanotify_controller.h"
 #include "socket_message.h"
 #include "fdcommunication.h"
+#include "shm_ring.h"
+#include "db_flush_thread.h"
 
 class FanotifyController;
 struct CommandInfo;
@@ -33,6 +35,8 @@ public:
     void setStoreToDatabase(bool storeToDatabase);
     void setPrintSummary(bool printSummary);
     void setTmpDir(const QByteArray &tmpDir);
+    void setPersistent(bool persistent);
+    void setShmRingFds(int memFd, int doorbellFd);
 
 private:
     struct MsenterChildReturnValue {
@@ -60,12 +64,25 @@ private:
     bool m_printSummary{};
     fdcommunication::SocketCommunication::Messages m_sockMessages;
     bool m_storeToDatabase;
+    bool m_persistent {false};
+    DbFlushThread m_dbFlushThread;
+    int m_shmRingMemFd {-1};
+    int m_shmRingDoorbellFd {-1};
+    std::unique_ptr<fdcommunication::ShmRing> m_shmRing;
+    fdcommunication::SocketCommunication::Messages m_shmRingMessages;
 
     std::shared_ptr<FileEventHandler> createFileEventHandler();
     MsenterChildReturnValue setupMsenterTargetChildProcess();
     socket_message::E_SocketMsg fan_pollUntilStopped(CommandInfo& cmdInfo,
                                  FanotifyController_ptr& fanotifyCtrl);
-    socket_message::E_SocketMsg processSocketEvent( CommandInfo& cmdInfo );
+    socket_message::E_SocketMsg processSocketEvent( CommandInfo& cmdInfo,
+                                                    FanotifyController_ptr& fanotifyCtrl);
+    socket_message::E_SocketMsg processShmRingEvent( CommandInfo& cmdInfo,
+                                                     FanotifyController_ptr& fanotifyCtrl);
+    socket_message::E_SocketMsg processMessages(
+            const fdcommunication::SocketCommunication::Messages& messages,
+            CommandInfo& cmdInfo, FanotifyController_ptr& fanotifyCtrl);
+    void handleCmdFinished(CommandInfo& cmdInfo);
     void flushToDisk(CommandInfo& cmdInfo);
 
 
@@ -63,6 +63,8 @@ void callFilewatcherSafe(FileWatcher& fwatcher){
         logCritical << qtr("Sorry, need to close: ") << ex.what();
     } catch(const ExcMountCtrl & ex){
         logCritical << qtr("mount failed: ") << ex.descrip();
+    } catch(const fdcommunication::ExcFdComm & ex){
+        logCritical << qtr("Communication with the shell failed: ") << ex.descrip();
     }
     if(fwatcher.sockFd() != -1){
         SocketCommunication fdCom;
@@ -184,6 +186,31 @@ int shournal_run_main(int argc, char *argv[])
     argVerbosity.setAllowedOptions(app::VERBOSITIES);
     parser.addArg(&argVerbosity);
 
+    QOptArg argPersistent("", "persistent", qtr("Must be passed along with '%1'. "
+                                                "Keep observing after a command "
+                                                "finished, until the socket is closed.")
+                                            .arg(argSocketFd.name()), false);
+    argPersistent.setInternalOnly(true);
+    argPersistent.addRequiredArg(&argSocketFd);
+    parser.addArg(&argPersistent);
+
+    QOptArg argShmRingFd("", "shm-ring-fd", qtr("Must be passed along with '%1'. "
+                                                "memfd of a shared memory ring, "
+                                                "the shell-integration passes "
+                                                "command-boundaries with.")
+                                            .arg(argPersistent.name()));
+    argShmRingFd.setInternalOnly(true);
+    argShmRingFd.addRequiredArg(&argPersistent);
+    parser.addArg(&argShmRingFd);
+
+    QOptArg argShmDoorbellFd("", "shm-doorbell-fd", qtr("eventfd signaling new "
+                                                        "messages in the shared memory "
+                                                        "ring."));
+    argShmDoorbellFd.setInternalOnly(true);
+    argShmDoorbellFd.addRequiredArg(&argShmRingFd);
+    argShmRingFd.addRequiredArg(&argShmDoorbellFd);
+    parser.addArg(&argShmDoorbellFd);
+
     QOptArg argShellSessionUUID("", "shell-session-uuid", qtr("uuid as base64-encoded string"));
     argShellSessionUUID.setInternalOnly(true);
     parser.addArg(&argShellSessionUUID);
@@ -323,6 +350,14 @@ int shournal_run_main(int argc, char *argv[])
             int socketFd = argSocketFd.getValue<int>(-1);
             os::setFdDescriptorFlags(socketFd, FD_CLOEXEC);
             fwatcher.setSockFd(socketFd);
+            fwatcher.setPersistent(argPersistent.wasParsed());
+            if(argShmRingFd.wasParsed()){
+                int memFd = argShmRingFd.getValue<int>(-1);
+                int doorbellFd = argShmDoorbellFd.getValue<int>(-1);
+                os::setFdDescriptorFlags(memFd, FD_CLOEXEC);
+                os::setFdDescriptorFlags(doorbellFd, FD_CLOEXEC);
+                fwatcher.setShmRingFds(memFd, doorbellFd);
+            }
             callFilewatcherSafe(fwatcher); // [[noreturn]]
         }
 
@@ -15,6 +15,7 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <functional>
 
 
 #include "app.h"
@@ -22,6 +23,7 @@
 #include "cpp_exit.h"
 #include "conversions.h"
 #include "commandinfo.h"
+#include "db_archive.h"
 #include "db_controller.h"
 #include "cleanupresource.h"
 #include "fdentries.h"
@@ -90,10 +92,281 @@ static void handleFifoEvent(shared_ptr<FifoCom>& fifoCom,
 
 }
 
+static void lowerPriorityForDbFlush(){
+    try {
+        // Do not disturb other processes while we flush events to database
+        os::setpriority(PRIO_PROCESS, 0, PRIO_DATABASE_FLUSH);
+    } catch (const os::ExcOs&) {
+        // This may happen regularly, e.g. if priority was already lowered.
+        logDebug << "Failed to set priority before database flush";
+    }
+}
+
+
+namespace {
+
+/// The kernel module only provides xxh64, so commands observed by it
+/// are always hashed with it, regardless of the configured algorithm.
+CommandInfo cmdInfoFromLocalEnv(){
+    CommandInfo cmdInfo = CommandInfo::fromLocalEnv();
+    cmdInfo.hashMeta.algorithm = HashMeta::XXH64;
+    return cmdInfo;
+}
+
+/// The kernel module appends to the event file through the file description
+/// we handed over, so read it through a separate one. The event file is
+/// unlinked, so reopen it via procfs. Writable, to punch holes into it.
+FILE* reopenEventFile(FILE* eventFile){
+    const int fd = os::open("/proc/self/fd/" +
+                            QByteArray::number(fileno_unlocked(eventFile)),
+                            O_RDWR);
+    try {
+        return stdiocpp::fdopen(fd, "r");
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+}
+
+/// Until the command finished, it is stored with an end time
+/// equal to its start time.
+void addProvisionalCommand(CommandInfo* cmdInfo){
+    CommandInfo provisionalCmd = *cmdInfo;
+    provisionalCmd.endTime = provisionalCmd.startTime;
+    cmdInfo->idInDb = db_controller::addCommand(provisionalCmd);
+}
+
+/// Store the file events of a still running command to the database
+/// every now and then, so they can be queried early and the event file
+/// does not grow without bounds during long observations.
+class IncrementalFlush {
+public:
+    IncrementalFlush(FILE* eventFile, CommandInfo* cmdInfo) :
+        m_cmdInfo(cmdInfo),
+        m_file(reopenEventFile(eventFile))
+    {
+        m_fileEvents.setFile(m_file);
+        m_fileEvents.setGrowingFile(true);
+        try {
+            addProvisionalCommand(m_cmdInfo);
+        } catch (...) {
+            fclose(m_file);
+            throw;
+        }
+    }
+
+    ~IncrementalFlush(){
+        fclose(m_file);
+    }
+
+    /// Store all completely written events. Afterwards free the disk space
+    /// of the stored ones, the kernel module only appends to the file.
+    void flush(){
+        db_controller::addFileEvents(*m_cmdInfo, m_fileEvents);
+        const off_t consumed = stdiocpp::ftell(m_file) & ~off_t(PAGE_SIZE - 1);
+        if(consumed > m_punchedBytes &&
+           fallocate(fileno_unlocked(m_file), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                     m_punchedBytes, consumed - m_punchedBytes) == 0){
+            m_punchedBytes = consumed;
+        }
+    }
+
+    FileEvents& fileEvents() {
+        return m_fileEvents;
+    }
+
+private:
+    Q_DISABLE_COPY(IncrementalFlush)
+    DISABLE_MOVE(IncrementalFlush)
+
+    CommandInfo* m_cmdInfo;
+    FILE* m_file{};
+    FileEvents m_fileEvents;
+    off_t m_punchedBytes{0};
+};
+
+/// Store the file events of a long observation (e.g. of a daemon) in
+/// segments: the kernel module continues with a new event file and the
+/// events of the previous one are stored. In contrast to IncrementalFlush,
+/// a stored segment is closed, so neither disk nor memory usage grow and
+/// stored events survive a crash.
+class Checkpoints {
+public:
+    Checkpoints(ShournalK_ptr shournalk, CommandInfo* cmdInfo) :
+        m_shournalk(std::move(shournalk)),
+        m_cmdInfo(cmdInfo)
+    {
+        addProvisionalCommand(m_cmdInfo);
+    }
+
+    void checkpoint(){
+        if(! m_swapSupported){
+            return;
+        }
+        FILE* segment;
+        try {
+            segment = m_shournalk->swapTarget();
+        } catch (const ExcShournalk& ex) {
+            // e.g. an older kernel module
+            logWarning << qtr("Disabling checkpoints, storing file events after "
+                              "the observation finished: %1").arg(ex.what());
+            m_swapSupported = false;
+            return;
+        }
+        auto closeSegment = finally([&segment] {
+            fclose(segment);
+        });
+        m_segmentBytes += os::fstat(fileno_unlocked(segment)).st_size;
+        storeEvents(segment);
+    }
+
+    /// Store the events of the current segment, after the kernel
+    /// module has written all of them.
+    void storeRemaining(){
+        storeEvents(m_shournalk->tmpFileTarget());
+    }
+
+    /// @return the total size of all closed segments
+    off_t segmentBytes() const {
+        return m_segmentBytes;
+    }
+
+private:
+    Q_DISABLE_COPY(Checkpoints)
+    DISABLE_MOVE(Checkpoints)
+
+    void storeEvents(FILE* file){
+        stdiocpp::fseek(file, 0, SEEK_SET);
+        FileEvents fileEvents;
+        fileEvents.setFile(file);
+        db_controller::addFileEvents(*m_cmdInfo, fileEvents);
+    }
+
+    ShournalK_ptr m_shournalk;
+    CommandInfo* m_cmdInfo;
+    bool m_swapSupported{true};
+    off_t m_segmentBytes{0};
+};
+
+/// The event file of the kernel module resides in memory (memfd). Once it
+/// grows larger than maxMemSize, move its completely written events to an
+/// unnamed file on disk every now and then and free their memory. The kernel
+/// module keeps appending to the event file, the remaining events are moved
+/// to disk in finish().
+class EventSpill {
+public:
+    EventSpill(FILE* eventFile, off_t maxMemSize) :
+        m_eventFile(eventFile),
+        m_file(reopenEventFile(eventFile)),
+        m_maxMemSize(maxMemSize)
+    {
+        // only used to find the end of the last complete event
+        m_fileEvents.setFile(m_file);
+        m_fileEvents.setGrowingFile(true);
+    }
+
+    ~EventSpill(){
+        fclose(m_file);
+        if(m_diskFile != nullptr){
+            fclose(m_diskFile);
+        }
+    }
+
+    void spillIfDue(){
+        if(m_diskFile == nullptr){
+            if(os::fstat(fileno_unlocked(m_file)).st_size <= m_maxMemSize){
+                return;
+            }
+            logDebug << "moving file events to disk after" << m_maxMemSize << "bytes";
+            m_diskFile = stdiocpp::tmpfile(O_NOATIME);
+        }
+        while(m_fileEvents.read() != nullptr){}
+        const off_t completeEnd = stdiocpp::ftell(m_file);
+        copyToDisk(completeEnd);
+
+        const off_t punchEnd = completeEnd & ~off_t(PAGE_SIZE - 1);
+        if(punchEnd > m_punchedBytes &&
+           fallocate(fileno_unlocked(m_file), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                     m_punchedBytes, punchEnd - m_punchedBytes) == 0){
+            m_punchedBytes = punchEnd;
+        }
+    }
+
+    /// Must be called after the kernel module has written all events.
+    /// @return the file containing all events, positioned at its start.
+    FILE* finish(){
+        if(m_diskFile == nullptr){
+            stdiocpp::fseek(m_eventFile, 0, SEEK_SET);
+            return m_eventFile;
+        }
+        copyToDisk(os::fstat(fileno_unlocked(m_file)).st_size);
+        stdiocpp::fseek(m_diskFile, 0, SEEK_SET);
+        return m_diskFile;
+    }
+
+private:
+    Q_DISABLE_COPY(EventSpill)
+    DISABLE_MOVE(EventSpill)
+
+    /// Append the not yet copied bytes of the event file up to end
+    void copyToDisk(off_t end){
+        if(end <= m_copiedBytes){
+            return;
+        }
+        const size_t count = size_t(end - m_copiedBytes);
+        if(os::sendfile(fileno_unlocked(m_diskFile), fileno_unlocked(m_file),
+                        count, m_copiedBytes) != off_t(count)){
+            throw QExcIo(qtr("Failed to move %1 bytes of file events to disk")
+                         .arg(count));
+        }
+        m_copiedBytes = end;
+    }
+
+    FILE* m_eventFile;
+    FILE* m_file;
+    FILE* m_diskFile{};
+    FileEvents m_fileEvents;
+    off_t m_maxMemSize;
+    off_t m_copiedBytes{0};
+    off_t m_punchedBytes{0};
+};
+
+} // namespace
+
+
+/// @return the populated-state from a cgroup's cgroup.events file
+static bool cgroupIsPopulated(int eventsFd){
+    char buf[256];
+    os::lseek(eventsFd, 0, SEEK_SET);
+    const ssize_t len = os::read(eventsFd, buf, sizeof(buf) - 1);
+    buf[len] = '\0';
+    const char* populated = strstr(buf, "populated ");
+    return populated != nullptr && populated[strlen("populated ")] == '1';
+}
+
+/// Wait for a cgroup to become empty. If it is empty at first, wait until
+/// a process entered and all processes left.
+/// @return true, if the cgroup is (still) populated or was never populated.
+static bool cgroupKeepObserving(int eventsFd, bool* wasPopulated){
+    if(cgroupIsPopulated(eventsFd)){
+        *wasPopulated = true;
+        return true;
+    }
+    return ! *wasPopulated;
+}
+
+
+/// @param onTimeout: if set, called every timeoutMs, until the
+/// kernel module reports the end of the observation.
+/// @param cgroupFd: if set, the observed cgroup is unmarked, once
+/// it becomes empty.
 static int do_polling(ShournalK_ptr& shournalk,
                       struct shournalk_run_result* run_result,
                       const QByteArray& fifopath,
-                      CommandInfo* cmdInfo){
+                      CommandInfo* cmdInfo,
+                      const std::function<void()>& onTimeout=nullptr,
+                      int timeoutMs=-1,
+                      int cgroupFd=-1){
     int fifo = -1;
     auto finallyCloseFifo = finally([&fifo] {
         if(fifo != -1) close(fifo);
@@ -128,8 +401,28 @@ static int do_polling(ShournalK_ptr& shournalk,
         fifoCom = make_shared<FifoCom>(fifo);
     }
 
+    int cgroupEvents = -1;
+    auto finallyCloseCgroupEvents = finally([&cgroupEvents] {
+        if(cgroupEvents != -1) close(cgroupEvents);
+    });
+    bool cgroupWasPopulated = false;
+    int cgroupEventsIdx = -1;
+    if(cgroupFd != -1){
+        // A change of cgroup.events is signaled by POLLPRI
+        cgroupEvents = os::openat(cgroupFd, std::string("cgroup.events"), O_RDONLY);
+        cgroupKeepObserving(cgroupEvents, &cgroupWasPopulated);
+        pollfd fd;
+        fd.fd = cgroupEvents;
+        fd.events = POLLPRI;
+        cgroupEventsIdx = fds.size();
+        fds.push_back(fd);
+    }
+
+    if(! onTimeout){
+        timeoutMs = -1;
+    }
     while (1) {
-        int poll_num = poll(fds.data(), nfds_t(fds.size()), -1);
+        int poll_num = poll(fds.data(), nfds_t(fds.size()), timeoutMs);
         if (poll_num == -1) {
             if (errno == EINTR){     // Interrupted by a signal
                 continue;            // Restart poll()
@@ -137,9 +430,10 @@ static int do_polling(ShournalK_ptr& shournalk,
             logCritical << "Error during poll: " << translation::strerror_l();
             return errno;
         }
-
-        // 0 only on timeout, which is infinite
-        assert(poll_num != 0);
+        if(poll_num == 0){
+            onTimeout();
+            continue;
+        }
 
         if (fds[0].revents & POLLIN) {
             auto read_count = os::read(shournalk->kgrp()->pipe_readend, run_result,
@@ -154,7 +448,18 @@ static int do_polling(ShournalK_ptr& shournalk,
         }
         assert(fds.size() > 1);
 
-        if(fds[1].revents & POLLIN){
+        if(cgroupEventsIdx != -1 && fds[cgroupEventsIdx].revents & (POLLPRI | POLLERR)){
+            if(! cgroupKeepObserving(cgroupEvents, &cgroupWasPopulated)){
+                logDebug << "observed cgroup became empty";
+                try {
+                    shournalk->removeCgroup(cgroupFd);
+                } catch (const ExcShournalk& ex) {
+                    logWarning << ex.what();
+                }
+                // negative fds are ignored by poll
+                fds[cgroupEventsIdx].fd = -1;
+            }
+        } else if(fifoCom && fds[1].revents & POLLIN){
             handleFifoEvent(fifoCom, cmdInfo, shournalk);
         } else {
             // can never happen, because we opened the
@@ -227,11 +532,16 @@ void Filewatcher_shournalk::setPrintSummary(bool printSummary)
     m_printSummary = printSummary;
 }
 
+void Filewatcher_shournalk::setCgroupPath(const QByteArray &cgroupPath)
+{
+    m_cgroupPath = cgroupPath;
+}
+
 
 CommandInfo Filewatcher_shournalk::runExec(ShournalK_ptr &shournalk,
                                            CEfd& toplvlEfd)
 {
-    CommandInfo cmdInfo =  CommandInfo::fromLocalEnv();
+    CommandInfo cmdInfo = cmdInfoFromLocalEnv();
     cmdInfo.sessionInfo.uuid = m_shellSessionUUID;
 
     if(m_commandFilename != nullptr){
@@ -286,7 +596,7 @@ CommandInfo Filewatcher_shournalk::runMarkPid(ShournalK_ptr &shournalk, CEfd &to
 {
     assert(! m_cmdString.isEmpty());
 
-    CommandInfo cmdInfo =  CommandInfo::fromLocalEnv();
+    CommandInfo cmdInfo = cmdInfoFromLocalEnv();
     cmdInfo.sessionInfo.uuid = m_shellSessionUUID;
     // Start-time will likely be overwritten later
     cmdInfo.text = m_cmdString;
@@ -304,6 +614,29 @@ CommandInfo Filewatcher_shournalk::runMarkPid(ShournalK_ptr &shournalk, CEfd &to
 }
 
 
+/// Observe all processes within a cgroup (v2) instead of a process tree,
+/// until the cgroup becomes empty.
+CommandInfo Filewatcher_shournalk::runMarkCgroup(ShournalK_ptr &shournalk, CEfd &toplvlEfd)
+{
+    CommandInfo cmdInfo = cmdInfoFromLocalEnv();
+    cmdInfo.sessionInfo.uuid = m_shellSessionUUID;
+    cmdInfo.text = "cgroup " + QString(m_cgroupPath);
+    cmdInfo.startTime = QDateTime::currentDateTime();
+
+    try {
+        m_cgroupFd = os::open(m_cgroupPath, O_RDONLY | O_DIRECTORY);
+        shournalk->doMarkCgroup(m_cgroupFd);
+        toplvlEfd.sendMsg(CEfd::MSG_OK);
+    } catch (const std::exception& ex) {
+        logWarning << qtr("Failed to observe cgroup %1: %2")
+                      .arg(QString(m_cgroupPath), ex.what());
+        toplvlEfd.sendMsg(CEfd::MSG_FAIL);
+        cpp_exit(1);
+    }
+    return cmdInfo;
+}
+
+
 void Filewatcher_shournalk::run()
 {
     auto shournalk = make_shared<ShournalkControl>();
@@ -325,6 +658,8 @@ void Filewatcher_shournalk::run()
 
     if(m_commandArgc != 0){
         cmdInfo = runExec(shournalk, toplvlEfd);
+    } else if(! m_cgroupPath.isEmpty()){
+        cmdInfo = runMarkCgroup(shournalk, toplvlEfd);
     } else {
         cmdInfo = runMarkPid(shournalk, toplvlEfd);
         os::mkfifo(m_fifoname, 0600);
@@ -339,9 +674,81 @@ void Filewatcher_shournalk::run()
     // at locations which are usually never unmounted.
     os::chdir("/");
 
+    const auto& dbCfg = Settings::instance().databaseSettings();
+    std::unique_ptr<Checkpoints> checkpoints;
+    if(m_storeToDatabase && m_commandArgc == 0 && dbCfg.checkpointSecs > 0){
+        lowerPriorityForDbFlush();
+        try {
+            checkpoints.reset(new Checkpoints(shournalk, &cmdInfo));
+        } catch (std::exception& e) {
+            logWarning << qtr("Failed to prepare checkpoints, storing file events "
+                              "after the observation finished: %1").arg(e.what());
+            cmdInfo.idInDb = db::INVALID_INT_ID;
+        }
+    }
+    auto storeCheckpoint = [&checkpoints]{
+        try {
+            checkpoints->checkpoint();
+        } catch (std::exception& e) {
+            logCritical << qtr("Failed to store (some) file-events to disk: %1")
+                           .arg(e.what());
+        }
+    };
+
+    std::unique_ptr<IncrementalFlush> incFlush;
+    const int flushSecs = dbCfg.incrementalFlushSecs;
+    if(m_storeToDatabase && ! checkpoints && flushSecs > 0){
+        lowerPriorityForDbFlush();
+        try {
+            incFlush.reset(new IncrementalFlush(shournalk->tmpFileTarget(), &cmdInfo));
+        } catch (std::exception& e) {
+            logWarning << qtr("Failed to prepare storing file events while the "
+                              "command is running, storing them after it "
+                              "finished: %1").arg(e.what());
+            cmdInfo.idInDb = db::INVALID_INT_ID;
+        }
+    }
+    auto flushIncrementally = [&incFlush]{
+        try {
+            incFlush->flush();
+        } catch (std::exception& e) {
+            logCritical << qtr("Failed to store (some) file-events to disk: %1")
+                           .arg(e.what());
+        }
+    };
+
+    // Storing incrementally already frees the memory of stored events,
+    // checkpoints keep each event file small.
+    std::unique_ptr<EventSpill> spill;
+    if(! incFlush && ! checkpoints && shournalk->targetMaxMemSize() > 0){
+        spill.reset(new EventSpill(shournalk->tmpFileTarget(),
+                                   shournalk->targetMaxMemSize()));
+    }
+    auto spillIfDue = [&spill]{
+        try {
+            spill->spillIfDue();
+        } catch (std::exception& e) {
+            logWarning << qtr("Failed to move file events to disk: %1").arg(e.what());
+        }
+    };
+
+    std::function<void()> onTimeout;
+    int timeoutMs = -1;
+    if(checkpoints){
+        onTimeout = storeCheckpoint;
+        timeoutMs = dbCfg.checkpointSecs * 1000;
+    } else if(incFlush){
+        onTimeout = flushIncrementally;
+        timeoutMs = flushSecs * 1000;
+    } else if(spill){
+        onTimeout = spillIfDue;
+        timeoutMs = 1000;
+    }
+
     struct shournalk_run_result krun_result;
     auto poll_result = do_polling(shournalk, &krun_result,
-                                  m_fifoname, &cmdInfo);
+                                  m_fifoname, &cmdInfo,
+                                  onTimeout, timeoutMs, m_cgroupFd);
     cmdInfo.endTime = QDateTime::currentDateTime();
     if(cmdInfo.returnVal == CommandInfo::INVALID_RETURN_VAL &&
             krun_result.selected_exitcode != SHOURNALK_INVALID_EXIT_CODE){
@@ -393,29 +800,45 @@ void Filewatcher_shournalk::run()
                     krun_result.w_event_count, krun_result.r_event_count,
                     krun_result.lost_event_count,
                     krun_result.stored_event_count,
-                    os::fstat(fileno(shournalk->tmpFileTarget())).st_size);
+                    os::fstat(fileno(shournalk->tmpFileTarget())).st_size +
+                    ((checkpoints) ? checkpoints->segmentBytes() : 0));
     }
 
-    if(m_storeToDatabase){
-        // os::lseek(fileno_unlocked(tmpFileTarget), 0, SEEK_SET);
-        stdiocpp::fseek(shournalk->tmpFileTarget(), 0, SEEK_SET);
-        FileEvents fileEvents;
-        fileEvents.setFile(shournalk->tmpFileTarget());
+    if(incFlush || checkpoints){
+        // The kernel module has written all events, store the remaining
+        // ones and complete the provisional command.
         try {
-            // Do not disturb other processes while we flush events to database
-            os::setpriority(PRIO_PROCESS, 0, PRIO_DATABASE_FLUSH);
-        } catch (const os::ExcOs&) {
-            // This may happen regularly, e.g. if priority was already lowered.
-            logDebug << "Failed to set priority before database flush";
+            if(checkpoints){
+                checkpoints->storeRemaining();
+            } else {
+                db_controller::addFileEvents(cmdInfo, incFlush->fileEvents());
+            }
+            db_controller::updateCommand(cmdInfo);
+            db_archive::archiveIfDue();
+        } catch (std::exception& e) {
+            logCritical << qtr("Failed to store (some) file-events to disk: %1").arg(e.what());
         }
+    } else if(m_storeToDatabase){
+        FileEvents fileEvents;
+        lowerPriorityForDbFlush();
         try {
+            if(spill){
+                fileEvents.setFile(spill->finish());
+            } else {
+                stdiocpp::fseek(shournalk->tmpFileTarget(), 0, SEEK_SET);
+                fileEvents.setFile(shournalk->tmpFileTarget());
+            }
             cmdInfo.idInDb = db_controller::addCommand(cmdInfo);
             db_controller::addFileEvents(cmdInfo, fileEvents);
+            db_archive::archiveIfDue();
         } catch (std::exception& e) {
             // May happen, e.g. if we run out of disk space...
             logCritical << qtr("Failed to store (some) file-events to disk: %1").arg(e.what());
         }
     }
+    checkpoints.reset();
+    incFlush.reset();
+    spill.reset();
     shournalk.reset();
 
     cpp_exit(cmdInfo.returnVal);
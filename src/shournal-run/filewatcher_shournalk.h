@@ -32,6 +32,7 @@ public:
     void setCmdString(const QString &cmdString);
     void setFifoname(const QByteArray &fifoname);
     void setPrintSummary(bool printSummary);
+    void setCgroupPath(const QByteArray &cgroupPath);
 
     [[noreturn]]
     void run();
@@ -40,6 +41,7 @@ public:
 private:
     CommandInfo runExec(ShournalK_ptr& shournalk, CEfd &toplvlEfd);
     CommandInfo runMarkPid(ShournalK_ptr& shournalk, CEfd &toplvlEfd);
+    CommandInfo runMarkCgroup(ShournalK_ptr& shournalk, CEfd &toplvlEfd);
 
 
     int m_commandArgc{};
@@ -52,6 +54,8 @@ private:
     QByteArray m_shellSessionUUID;
     QString m_cmdString;
     QByteArray m_fifoname;
+    QByteArray m_cgroupPath;
+    int m_cgroupFd{-1};
 
 
 
@@ -1,6 +1,7 @@
 #include "mark_helper.h"
 
 #include <sys/user.h>
+#include <cstring>
 #include <QHash>
 #include <QVersionNumber>
 
@@ -48,6 +49,67 @@ static shounalk_settings buildKSettings(){
     return ksettings;
 }
 
+/// @param sep: appended to each string
+static std::string joinStrs(const StrLightSet& strs, char sep){
+    std::string joined;
+    for(const auto& str : strs){
+        joined.append(str.c_str(), str.size());
+        joined += sep;
+    }
+    return joined;
+}
+
+/// Serialize the paths and extensions of our settings into a mark
+/// program (see shournalk_user.h), so the kernel receives them at once.
+static std::string compileMarkProgram(){
+    auto & s = Settings::instance();
+    shournalk_mark_prog_header header{};
+    header.version = SHOURNALK_MARK_PROG_VERSION;
+    std::string prog(sizeof (header), '\0');
+
+    auto appendSection = [&prog, &header](int action, const std::string& strs){
+        if(strs.empty()){
+            return;
+        }
+        shournalk_mark_prog_section section{};
+        section.action = action;
+        section.len = uint32_t(strs.size());
+        prog.append(reinterpret_cast<const char*>(&section), sizeof (section));
+        prog += strs;
+        header.n_sections++;
+    };
+
+    appendSection(SHOURNALK_MARK_W_INCL,
+                  joinStrs(s.writeFileSettings().includePaths->allPaths(), '\0'));
+    appendSection(SHOURNALK_MARK_W_EXCL,
+                  joinStrs(s.writeFileSettings().excludePaths->allPaths(), '\0'));
+    appendSection(SHOURNALK_MARK_ALL_EXCL, joinStrs(s.getMountIgnorePaths(), '\0'));
+
+    if(s.readFileSettings().enable){
+        appendSection(SHOURNALK_MARK_R_INCL,
+                      joinStrs(s.readFileSettings().includePaths->allPaths(), '\0'));
+        appendSection(SHOURNALK_MARK_R_EXCL,
+                      joinStrs(s.readFileSettings().excludePaths->allPaths(), '\0'));
+    }
+    if(s.readEventScriptSettings().enable){
+        const auto & scriptSets = s.readEventScriptSettings();
+        appendSection(SHOURNALK_MARK_SCRIPT_INCL,
+                      joinStrs(scriptSets.includePaths->allPaths(), '\0'));
+        appendSection(SHOURNALK_MARK_SCRIPT_EXCL,
+                      joinStrs(scriptSets.excludePaths->allPaths(), '\0'));
+        if(! scriptSets.includeExtensions.empty()){
+            appendSection(SHOURNALK_MARK_SCRIPT_EXTS,
+                          joinStrs(scriptSets.includeExtensions, '/') + '\0');
+        }
+    }
+    if(prog.size() > size_t(SHOURNALK_MARK_PROG_MAX_SIZE)){
+        throw ExcShournalk(qtr("too many include- or exclude-paths configured"));
+    }
+    header.size = uint32_t(prog.size());
+    memcpy(&prog[0], &header, sizeof (header));
+    return prog;
+}
+
 
 
 ShournalkControl::ShournalkControl()
@@ -82,13 +144,14 @@ ShournalkControl::ShournalkControl()
         }
     }
 
-    m_tmpFileTarget = stdiocpp::tmpfile(O_NOATIME); // tmpfile auto deletes..
-    if(m_tmpFileTarget == nullptr){
-        throw ExcShournalk(qtr("Failed to open temporary event target-file: %1")
-                           .arg(translation::strerror_l(errno)));
-    }
+    // Keep the events in memory, until they become too large
+    // (see EventSpill in filewatcher_shournalk.cpp).
+    m_targetMaxMemSize = off_t(
+                Settings::instance().databaseSettings().eventLogMaxMemMiB) * 1024 * 1024;
+    m_tmpFileTarget = openTargetFile();
     int fd = fileno_unlocked(m_tmpFileTarget);
     shournalk_set_target_fd(m_kgrp, fd);
+    m_markProgramSupported = shournalk_mark_program_supported();
 }
 
 ShournalkControl::~ShournalkControl()
@@ -106,11 +169,22 @@ void ShournalkControl::doMark(pid_t pid, bool collectExitcode)
         shournalk_set_settings(m_kgrp, &ksettings);
 
         int ret;
-        int flags = SHOURNALK_MARK_ADD;
+        // older kernel modules ignore the format flag, FileEvents
+        // reads both versions.
+        int flags = SHOURNALK_MARK_ADD | SHOURNALK_MARK_EVENTS_V2;
         if(collectExitcode){
             flags |= SHOURNALK_MARK_COLLECT_EXITCODE;
         }
 
+        if(m_markProgramSupported){
+            if((ret = shournalk_mark_pid_program(m_kgrp, flags, pid,
+                                                 markProgram().data())) != 0){
+                throw ExcShournalk(translation::strerror_l(ret));
+            }
+            return;
+        }
+
+        // older kernel module: one write per path
         if((ret = shournalk_filter_pid(m_kgrp, flags, pid)) != 0){
             throw ExcShournalk(translation::strerror_l(ret));
         }
@@ -156,6 +230,57 @@ void ShournalkControl::doMark(pid_t pid, bool collectExitcode)
     }
 }
 
+/// Observe all processes within the cgroup (v2) directory opened as
+/// cgroupFd, until removeCgroup is called.
+/// @throws ExcShournalk
+void ShournalkControl::doMarkCgroup(int cgroupFd)
+{
+    if(! m_markProgramSupported){
+        throw ExcShournalk(qtr("The kernel module is too old to observe cgroups"));
+    }
+    auto ksettings = buildKSettings();
+    shournalk_set_settings(m_kgrp, &ksettings);
+    int ret;
+    if((ret = shournalk_mark_cgroup_program(m_kgrp,
+                                            SHOURNALK_MARK_ADD | SHOURNALK_MARK_EVENTS_V2,
+                                            cgroupFd,
+                                            markProgram().data())) != 0){
+        throw ExcShournalk(qtr("Failed to mark cgroup for observation - %1")
+                           .arg(translation::strerror_l(ret)));
+    }
+}
+
+void ShournalkControl::removeCgroup(int cgroupFd)
+{
+    int ret;
+    if((ret = shournalk_mark_cgroup_program(m_kgrp, SHOURNALK_MARK_REMOVE,
+                                            cgroupFd, nullptr)) != 0){
+        throw ExcShournalk(
+                    qtr("Failed to unmark cgroup for observation: %1")
+                    .arg(translation::strerror_l(ret)));
+    }
+}
+
+/// Let the kernel module write all pending events and continue writing
+/// to a new target file, e.g. to store the events of a long observation
+/// in segments. Also allowed after preparePollOnce().
+/// @return the previous target file, which is complete. The caller
+/// becomes responsible for closing it.
+/// @throws ExcShournalk
+FILE *ShournalkControl::swapTarget()
+{
+    FILE* newTarget = openTargetFile();
+    int ret;
+    if((ret = shournalk_swap_target_fd(m_kgrp, fileno_unlocked(newTarget))) != 0){
+        fclose(newTarget);
+        throw ExcShournalk(qtr("Failed to swap the event target-file: %1")
+                           .arg(translation::strerror_l(ret)));
+    }
+    FILE* oldTarget = m_tmpFileTarget;
+    m_tmpFileTarget = newTarget;
+    return oldTarget;
+}
+
 void ShournalkControl::preparePollOnce()
 {
     if(shournalk_prepare_poll_ONCE(m_kgrp)){
@@ -174,11 +299,42 @@ void ShournalkControl::removePid(pid_t pid)
 }
 
 
+FILE *ShournalkControl::openTargetFile()
+{
+    FILE* f;
+    try {
+        f = (m_targetMaxMemSize > 0)
+                ? stdiocpp::memfile("shournalk-events")
+                : stdiocpp::tmpfile(O_NOATIME); // tmpfile auto deletes..
+    } catch (const std::exception& ex) {
+        throw ExcShournalk(qtr("Failed to open temporary event target-file: %1")
+                           .arg(ex.what()));
+    }
+    return f;
+}
+
+/// The settings are loaded once per process, so the program is
+/// compiled on first use only.
+const std::string &ShournalkControl::markProgram()
+{
+    if(m_markProgram.empty()){
+        m_markProgram = compileMarkProgram();
+    }
+    return m_markProgram;
+}
+
 FILE *ShournalkControl::tmpFileTarget() const
 {
     return m_tmpFileTarget;
 }
 
+/// @return the size in bytes, up to which the target file should reside in
+/// memory, or 0, if it is located on disk.
+off_t ShournalkControl::targetMaxMemSize() const
+{
+    return m_targetMaxMemSize;
+}
+
 shournalk_group *ShournalkControl::kgrp() const
 {
     return m_kgrp;
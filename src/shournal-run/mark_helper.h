@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdio.h>
+#include <string>
 
 #include "exccommon.h"
 #include "settings.h"
@@ -25,14 +26,25 @@ public:
 
     void removePid(pid_t pid);
 
+    void doMarkCgroup(int cgroupFd);
+    void removeCgroup(int cgroupFd);
+
+    FILE* swapTarget();
+
     FILE *tmpFileTarget() const;
+    off_t targetMaxMemSize() const;
     shournalk_group *kgrp() const;
 
 private:
     Q_DISABLE_COPY(ShournalkControl)
     struct shournalk_group* m_kgrp;
     FILE* m_tmpFileTarget;
+    off_t m_targetMaxMemSize;
+    bool m_markProgramSupported;
+    std::string m_markProgram; // compiled on first mark
 
+    FILE* openTargetFile();
+    const std::string& markProgram();
     void markPaths(const Settings::StrLightSet& paths, int path_tpye);
     void markExtensions(const Settings::StrLightSet& extensions, int ext_type);
     void doMarkExtensions(const StrLight &extensions, int ext_type);
@@ -118,6 +118,12 @@ static int shournal_run_main(int argc, char *argv[])
                          qtr("Mark the process with given pid for observation."));
     parser.addArg(&argPid);
 
+    QOptArg argCgroup("", "cgroup",
+                      qtr("Observe all processes within the given cgroup (v2) "
+                          "directory, until it becomes empty. Write access to "
+                          "the directory is required."));
+    parser.addArg(&argCgroup);
+
 
     QOptArg argPrintFifopath("", "print-fifopath-for-pid",
                          qtr("Print the fifo path for a given pid "
@@ -262,6 +268,12 @@ static int shournal_run_main(int argc, char *argv[])
             QIErr() << qtr("%1 and %2 are mutually exclusive").arg(argExec.name(), argPid.name());
             cpp_exit(1);
         }
+        if(argCgroup.wasParsed() &&
+                (argExec.wasParsed() || argPid.wasParsed())) {
+            QIErr() << qtr("%1 is mutually exclusive with %2 and %3")
+                       .arg(argCgroup.name(), argExec.name(), argPid.name());
+            cpp_exit(1);
+        }
 
         if(argVersion.wasParsed()){
             QOut() << app::SHOURNAL_RUN << qtr(" version ") << app::version().toString() << "\n";
@@ -317,6 +329,10 @@ static int shournal_run_main(int argc, char *argv[])
             fwatcher.setCmdString(argCmdString.getValue<QString>());
             fwatcher.run();
         }
+        if(argCgroup.wasParsed()){
+            fwatcher.setCgroupPath(argCgroup.getValue<QByteArray>());
+            fwatcher.run();
+        }
 
         if(parser.rest().len != 0){
             QIErr() << qtr("Invalid parameters passed: %1.\n"
@@ -26,6 +26,8 @@
 #define SHOURNALK_DOCKER_MARK_PATH SHOURNALK_CTRL_DOCKER_PATH "/mark"
 
 #define SHOURNALK_VERSION_PATH SHOURNALK_CTRL_PATH  "/version"
+#define SHOURNALK_MARK_PROG_VERSION_PATH SHOURNALK_CTRL_PATH  "/mark_program_version"
+#define SHOURNALK_DOCKER_MARK_PROG_VERSION_PATH SHOURNALK_CTRL_DOCKER_PATH  "/mark_program_version"
 
 static bool __file_exists(const char* filename){
     struct stat buffer;
@@ -80,6 +82,25 @@ const char* shournalk_versionpath(void){
     return SHOURNALK_VERSION_PATH;
 }
 
+/// @return true, if the loaded kernel module accepts mark programs
+/// of our version (see shournalk_mark_pid_program).
+bool shournalk_mark_program_supported(void){
+    char buf[32];
+    ssize_t ret;
+    int fd = open(SHOURNALK_MARK_PROG_VERSION_PATH, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        fd = open(SHOURNALK_DOCKER_MARK_PROG_VERSION_PATH, O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            return false;
+    }
+    ret = read(fd, buf, sizeof (buf) - 1);
+    close(fd);
+    if(ret <= 0)
+        return false;
+    buf[ret] = '\0';
+    return atoi(buf) == SHOURNALK_MARK_PROG_VERSION;
+}
+
 
 
 /// @param flags: for creating the pipe, e.g. O_NONBLOCK
@@ -160,6 +181,44 @@ int shournalk_commit(struct shournalk_group* grp){
     return __shournalk_filter_common(grp, SHOURNALK_MARK_COMMIT, 0);
 }
 
+/// Mark the pid, add all paths and extensions of the given mark
+/// program (see shournalk_user.h) and commit, using a single write.
+/// Make sure to set target_fd and settings beforehand.
+int shournalk_mark_pid_program(struct shournalk_group* grp, unsigned int flags,
+                               pid_t pid, const void* program){
+    grp->__mark_struct.pid = pid;
+    grp->__mark_struct.data = program;
+    return __shournalk_filter_common(grp, flags, SHOURNALK_MARK_PID_PROGRAM);
+}
+
+
+/// Mark all processes within the cgroup (v2) directory opened as cgroup_fd,
+/// using a mark program (see shournalk_user.h). With flags
+/// SHOURNALK_MARK_REMOVE the cgroup is unmarked and program is ignored.
+/// Make sure to set target_fd and settings beforehand.
+int shournalk_mark_cgroup_program(struct shournalk_group* grp, unsigned int flags,
+                                  int cgroup_fd, const void* program){
+    grp->__mark_struct.pid = (uint64_t)cgroup_fd;
+    grp->__mark_struct.data = program;
+    return __shournalk_filter_common(grp, flags, SHOURNALK_MARK_CGROUP);
+}
+
+
+/// Let the target, which currently writes to the set target_fd, write
+/// all pending events and continue with new_target_fd, which becomes
+/// the set target_fd. Afterwards the old target file is complete.
+/// May also be called after shournalk_prepare_poll_ONCE.
+int shournalk_swap_target_fd(struct shournalk_group* grp, int new_target_fd){
+    int ret;
+    grp->__mark_struct.pid = (uint64_t)new_target_fd;
+    if((ret = __shournalk_filter_common(grp, SHOURNALK_MARK_ADD,
+                                        SHOURNALK_SWAP_TARGET)) != 0){
+        return ret;
+    }
+    grp->__mark_struct.target_fd = new_target_fd;
+    return 0;
+}
+
 
 /// cĺose the pipe write end to avoid deadlock in poll.
 /// warning - may only be called once per shournalk-group.
@@ -26,6 +26,7 @@ struct shournalk_version {
 
 bool shournalk_module_is_loaded(void);
 const char* shournalk_versionpath(void);
+bool shournalk_mark_program_supported(void);
 
 
 struct shournalk_group* shournalk_init(unsigned int flags);
@@ -41,6 +42,12 @@ int shournalk_filter_pid(struct shournalk_group* grp, unsigned int flags, pid_t
 int shournalk_filter_string(struct shournalk_group* grp, unsigned int flags,
                            int str_tpye, const char* str);
 int shournalk_commit(struct shournalk_group* grp);
+int shournalk_mark_pid_program(struct shournalk_group* grp, unsigned int flags,
+                               pid_t pid, const void* program);
+int shournalk_mark_cgroup_program(struct shournalk_group* grp, unsigned int flags,
+                                  int cgroup_fd, const void* program);
+
+int shournalk_swap_target_fd(struct shournalk_group* grp, int new_target_fd);
 
 int shournalk_prepare_poll_ONCE(struct shournalk_group* grp);
 
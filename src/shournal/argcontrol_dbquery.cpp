@@ -1,4 +1,6 @@
 #include <QDebug>
+#include <QDirIterator>
+#include <QFileInfo>
 #include <cassert>
 #include <unistd.h>
 
@@ -11,6 +13,7 @@
 #include "database/query_columns.h"
 #include "database/file_query_helper.h"
 #include "database/db_conversions.h"
+#include "database/query_result_cache.h"
 #include "app.h"
 #include "logger.h"
 #include "qoutstream.h"
@@ -23,18 +26,59 @@
 #include "osutil.h"
 #include "translation.h"
 #include "conversions.h"
+#include "settings.h"
 
 using translation::TrSnippets;
 
 using db_controller::QueryColumns;
 
+/// @return the query result cache, if enabled in the settings
+static std::unique_ptr<QueryResultCache> mkResultCacheIfEnabled(){
+    const auto& querySettings = Settings::instance().querySettings();
+    if(! querySettings.resultCache){
+        return std::unique_ptr<QueryResultCache>();
+    }
+    return std::unique_ptr<QueryResultCache>(
+                new QueryResultCache(QueryResultCache::defaultDir(),
+                                     querySettings.resultCacheMaxEntries));
+}
 
 [[noreturn]]
 static void
 queryCmdPrintAndExit(std::unique_ptr<CommandPrinter>& cmdPrinter,
                           SqlQuery& sqlQ,
                           bool reverseResultIter ){
-    auto results = db_controller::queryForCmd(sqlQ, reverseResultIter);
+    auto resultCache = mkResultCacheIfEnabled();
+    auto results = db_controller::queryForCmd(sqlQ, reverseResultIter, resultCache.get());
+    cmdPrinter->printCommandInfosEvtlRestore(results);
+    cpp_exit(0);
+}
+
+[[noreturn]]
+static void
+queryLineagePrintAndExit(std::unique_ptr<CommandPrinter>& cmdPrinter,
+                         const QOptArg& argLineage,
+                         const QOptArg& argMaxDepth,
+                         QOptArg& argYoungerThan,
+                         int defaultMaxDepth,
+                         const SqlQuery& filterQuery,
+                         bool reverseResultIter){
+    const int maxDepth = argMaxDepth.getValue<int>(defaultMaxDepth);
+    if(maxDepth < 0){
+        QIErr() << qtr("argument %1: the depth must not be negative")
+                   .arg(argMaxDepth.name());
+        cpp_exit(1);
+    }
+    QDateTime minStartTime;
+    if(argYoungerThan.wasParsed()){
+        minStartTime = argYoungerThan.getVariantRelativeDateTimes().first().toDateTime();
+    }
+    const auto wFileQuery = file_query_helper::buildFileQuerySmart(
+                argLineage.getValue<QString>(), false);
+    auto resultCache = mkResultCacheIfEnabled();
+    auto results = db_controller::queryLineage(wFileQuery, maxDepth, minStartTime,
+                                               filterQuery, reverseResultIter,
+                                               resultCache.get());
     cmdPrinter->printCommandInfosEvtlRestore(results);
     cpp_exit(0);
 }
@@ -91,6 +135,52 @@ static void addFileQuery(SqlQuery &query, const QOptArg& argFile,
     query.addWithAnd(fQuery);
 }
 
+/// @param listOrDir: a directory to be searched recursively or a file
+/// containing one path per line (- for stdin).
+static QStringList collectWFilesFrom(const QString& listOrDir){
+    QStringList filenames;
+    if(QFileInfo(listOrDir).isDir()){
+        QDirIterator it(listOrDir, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot,
+                        QDirIterator::Subdirectories);
+        while(it.hasNext()){
+            filenames.push_back(it.next());
+        }
+        return filenames;
+    }
+    QFile f;
+    bool success;
+    if(listOrDir == "-"){
+        success = f.open(stdin, QFile::OpenModeFlag::ReadOnly);
+    } else {
+        f.setFileName(listOrDir);
+        success = f.open(QFile::OpenModeFlag::ReadOnly);
+    }
+    if(! success){
+        QIErr() << qtr("Failed to open %1: %2").arg(listOrDir, f.errorString());
+        cpp_exit(1);
+    }
+    while(! f.atEnd()){
+        const QString line = QString::fromUtf8(f.readLine()).trimmed();
+        if(! line.isEmpty()){
+            filenames.push_back(line);
+        }
+    }
+    return filenames;
+}
+
+static void addWFilesBatchQuery(SqlQuery &query, const QOptArg& argWFilesFrom){
+    const auto filenames = collectWFilesFrom(argWFilesFrom.getValue<QString>());
+    if(filenames.isEmpty()){
+        QIErr() << qtr("argument %1: no files given.").arg(argWFilesFrom.name());
+        cpp_exit(1);
+    }
+    int foundCount;
+    query.addWithAnd(file_query_helper::buildWFilesBatchQuery(filenames, &foundCount));
+    if(foundCount < filenames.size()){
+        QIErr() << qtr("%1 of %2 files were not found in the database.")
+                   .arg(filenames.size() - foundCount).arg(filenames.size());
+    }
+}
 
 
 void argcontol_dbquery::addBytesizeSqlArgToQueryIfParsed(SqlQuery &query, QOptSqlArg &arg,
@@ -115,6 +205,7 @@ void argcontol_dbquery::parse(int argc, char *argv[])
         "-like will allow for using sql wildcards (e.g. '%').\n"
         "Examples:\n"
         "%1 --query --wfile /tmp/foo123 - use existing file to find out, how it was created.\n"
+        "%1 --query --lineage ./a.out - find all commands which (transitively) led to a.out.\n"
         "%1 --query --wsize -gt 10KiB - print all commands which have written to files whose "
                                     "size is greater than 10KiB.\n"
         "%1 --query --wpath -like /home/user% - print all commands, which have written to files "
@@ -144,6 +235,14 @@ void argcontol_dbquery::parse(int argc, char *argv[])
     argTakeFromWFile.setAllowedOptions(TAKE_FROM_FILE_OPTIONS);
     parser.addArg(&argTakeFromWFile);
 
+    QOptArg argWFilesFrom("", "wfiles-from",
+                          qtr("Like %1, but for many files at once: pass a directory "
+                              "(all files below it are used) or a file "
+                              "containing one path per line (- for stdin). "
+                              "The query is always performed on the basis "
+                              "of hash(es), mtime and size.").arg(argWFile.name()));
+    parser.addArg(&argWFilesFrom);
+
     const QString wFilePreamble = qtr("Query for files written to ");
     QOptSqlArg argWName("wn", "wname", wFilePreamble + qtr("by filename."),
                         QOptSqlArg::cmpOpsText());
@@ -232,6 +331,32 @@ void argcontol_dbquery::parse(int argc, char *argv[])
                              );
     parser.addArg(&argRestoreRfileId);
 
+    // ------------ lineage
+    QOptArg argLineage("", "lineage",
+                       qtr("Pass an existing file(-path) to find out, how it came to be: "
+                           "like %1, the command(s) which wrote the file are searched. "
+                           "Additionally, commands which previously wrote a file that "
+                           "was read by a found command are searched, "
+                           "recursively. Other query-parameters further "
+                           "filter the found commands.").arg(argWFile.name()));
+    parser.addArg(&argLineage);
+
+    const int DEFAULT_lineageMaxDepth = 32;
+    QOptArg argLineageMaxDepth("", "lineage-max-depth",
+                               qtr("The max. number of recursions for %1 "
+                                   "(default is %2).")
+                               .arg(argLineage.name()).arg(DEFAULT_lineageMaxDepth));
+    argLineageMaxDepth.addRequiredArg(&argLineage);
+    parser.addArg(&argLineageMaxDepth);
+
+    QOptArg argLineageYoungerThan("", "lineage-younger-than",
+                                  qtr("Only follow commands for %1 which were executed "
+                                      "within the given number of years, months, "
+                                      "days, etc. (e.g. 2d).").arg(argLineage.name()));
+    argLineageYoungerThan.setIsRelativeDateTime(true, true);
+    argLineageYoungerThan.addRequiredArg(&argLineage);
+    parser.addArg(&argLineageYoungerThan);
+
     // ------------ cmd
 
     QOptSqlArg argCmdText("cmdtxt", "command-text", qtr("Query for commands with matching command-string."),
@@ -413,6 +538,9 @@ void argcontol_dbquery::parse(int argc, char *argv[])
     if(argRFile.wasParsed()){
         addFileQuery(query, argRFile, argTakeFromRFile, true);
     }
+    if(argWFilesFrom.wasParsed()){
+        addWFilesBatchQuery(query, argWFilesFrom);
+    }
 
     if(argFileStat.wasParsed()){
         cmdPrinter->setReportFileStatus(true);
@@ -444,6 +572,12 @@ void argcontol_dbquery::parse(int argc, char *argv[])
         cpp_exit(1);
     }
 
+    if(argLineage.wasParsed()){
+        queryLineagePrintAndExit(cmdPrinter, argLineage, argLineageMaxDepth,
+                                 argLineageYoungerThan, DEFAULT_lineageMaxDepth,
+                                 query, reverseResultIter);
+    }
+
     if(query.isEmpty()){
         QIErr() << qtr("No target fields given (empty query).");
         cpp_exit(1);
@@ -1,56 +1,47 @@
 #include "cmd_stats.h"
 
-#include "cleanupresource.h"
+#include "db_connection.h"
+#include "logger.h"
+#include "util.h"
+
+namespace {
+
+// Max. number of commands inserted into the temporary table
+// with a single statement (sqlite allows at least 999 bind-values).
+const size_t PENDING_CMDS_BATCH_SIZE = 256;
+
+} // namespace
 
 /// Do not collect more than that many entries of each category
 CmdStats::CmdStats() :
     m_maxCountOfStats(5)
+{}
+
+CmdStats::~CmdStats()
 {
-    m_cmdsWithMostFileModsQueue.setMaxSize(m_maxCountOfStats);
+    if(! m_cmdTableCreated){
+        return;
+    }
+    try {
+        db_connection::mkQuery()->exec("drop table if exists temp.cmdStatsCmd");
+    } catch (const std::exception& ex) {
+        logWarning << ex.what();
+    }
 }
 
 void CmdStats::setMaxCountOfStats(const int &val)
 {
     m_maxCountOfStats = val;
-    m_cmdsWithMostFileModsQueue.setMaxSize(val);
 }
 
+/// Only the id of cmd is remembered along with its (zero based) index -
+/// all other information is queried from the database in eval().
 void CmdStats::collectCmd(const CommandInfo &cmd)
 {
-    auto incrementIdxLater = finally([this] { ++m_currentCmdIdx; });
-
-    if(! cmd.fileWriteInfos.isEmpty()){
-        MostFileModsEntry mostFileMods;
-        mostFileMods.idx = m_currentCmdIdx;
-        mostFileMods.idInDb = cmd.idInDb;
-        mostFileMods.cmdTxt = cmd.text;
-        mostFileMods.countOfFileMods = cmd.fileWriteInfos.size();
-        m_cmdsWithMostFileModsQueue.push(mostFileMods);
-    }
-
-    if(! cmd.sessionInfo.uuid.isNull()){
-        auto & el = m_sessionMostCmdsMap[cmd.sessionInfo.uuid];
-        if(el.idx == -1){
-            // remember the first cmd in this session
-            el.idx = m_currentCmdIdx;
-            el.idInDb = cmd.idInDb;
-        }
-        el.cmdUuid = cmd.sessionInfo.uuid;
-        ++el.cmdCount;
-    }
-
-    {
-        auto & cwdCmdCountEntry = m_cwdCmdCountMap[cmd.workingDirectory];
-        ++cwdCmdCountEntry.cmdCount;
-    }
-
-    for(const auto& info : cmd.fileReadInfos){
-        auto & dirIoEntry = m_dirIoCountMap[info.path];
-        ++dirIoEntry.readCount;
-    }
-    for(const auto& info : cmd.fileWriteInfos){
-        auto & dirIoEntry = m_dirIoCountMap[info.path];
-        ++dirIoEntry.writeCount;
+    m_pendingCmds.emplace_back(m_currentCmdIdx, cmd.idInDb);
+    ++m_currentCmdIdx;
+    if(m_pendingCmds.size() >= PENDING_CMDS_BATCH_SIZE){
+        flushPendingCmds();
     }
 }
 
@@ -59,40 +50,91 @@ void CmdStats::collectCmd(const CommandInfo &cmd)
 /// afterwards not needed data.
 void CmdStats::eval()
 {
-    m_cmdsWithMostFileMods = m_cmdsWithMostFileModsQueue.popAll<MostFileModsEntrys>(true);
-
-    limited_priority_queue<SessionMostCmdsEntry,
-                           SessionMostCmds,
-                           cmpSessionMostCmdEntry> sessionMostCmdsPq;
-    sessionMostCmdsPq.setMaxSize(m_maxCountOfStats);
-    for(const auto & el : m_sessionMostCmdsMap){
-        sessionMostCmdsPq.push(el);
+    flushPendingCmds();
+    if(! m_cmdTableCreated){
+        return;
+    }
+    auto query = db_connection::mkQuery();
+
+    // Count the written files in a correlated subquery, so the
+    // index on writtenFile.cmdId is used.
+    query->prepare("select s.idx,s.cmdId,cmd.txt,s.countOfFileMods from "
+                   "(select idx,cmdId,"
+                   "(select count(*) from writtenFile where writtenFile.cmdId=c.cmdId) "
+                   "as countOfFileMods from temp.cmdStatsCmd as c) as s "
+                   "join cmd on cmd.id=s.cmdId "
+                   "where s.countOfFileMods > 0 "
+                   "order by s.countOfFileMods desc, s.idx limit ?");
+    query->addBindValue(m_maxCountOfStats);
+    query->exec();
+    while(query->next()){
+        MostFileModsEntry e;
+        e.idx = qVariantTo_throw<int>(query->value(0));
+        e.idInDb = qVariantTo_throw<qint64>(query->value(1));
+        e.cmdTxt = query->value(2).toString();
+        e.countOfFileMods = qVariantTo_throw<int>(query->value(3));
+        m_cmdsWithMostFileMods.push_back(e);
     }
 
-    m_sessionMostCmds = sessionMostCmdsPq.popAll<SessionMostCmds>(true);
-    m_sessionMostCmdsMap.clear();
-
-
-    limited_priority_queue<CwdCmdCount, CwdCmdCounts, cmpCwdCmdCount> cwdCmdCountQueue;
-    cwdCmdCountQueue.setMaxSize(m_maxCountOfStats);
-    for(auto it=m_cwdCmdCountMap.begin(); it != m_cwdCmdCountMap.end(); ++it){
-        // was not yet assigned because here it has to be assigned only once per
-        // working dir
-        it.value().workingDir = it.key();
-        cwdCmdCountQueue.push(it.value());
+    // sqlite: with min(), the bare column c.cmdId is taken from the
+    // row holding the minimum, which is the first cmd of the session.
+    query->prepare("select min(c.idx),c.cmdId,cmd.sessionId,count(*) as cmdCount "
+                   "from temp.cmdStatsCmd as c "
+                   "join cmd on cmd.id=c.cmdId "
+                   "where cmd.sessionId is not null "
+                   "group by cmd.sessionId "
+                   "order by cmdCount desc, min(c.idx) limit ?");
+    query->addBindValue(m_maxCountOfStats);
+    query->exec();
+    while(query->next()){
+        SessionMostCmdsEntry e;
+        e.idx = qVariantTo_throw<int>(query->value(0));
+        e.idInDb = qVariantTo_throw<qint64>(query->value(1));
+        e.cmdUuid = query->value(2).toByteArray();
+        e.cmdCount = qVariantTo_throw<int>(query->value(3));
+        m_sessionMostCmds.push_back(e);
     }
-    m_cwdCmdCounts = cwdCmdCountQueue.popAll<CwdCmdCounts>(true);
-    m_cwdCmdCountMap.clear();
 
+    query->prepare("select cmd.workingDirectory,count(*) as cmdCount "
+                   "from temp.cmdStatsCmd as c "
+                   "join cmd on cmd.id=c.cmdId "
+                   "group by cmd.workingDirectory "
+                   "order by cmdCount desc limit ?");
+    query->addBindValue(m_maxCountOfStats);
+    query->exec();
+    while(query->next()){
+        CwdCmdCount e;
+        e.workingDir = query->value(0).toString();
+        e.cmdCount = qVariantTo_throw<int>(query->value(1));
+        m_cwdCmdCounts.push_back(e);
+    }
 
-    limited_priority_queue<DirIoCount, DirIoCounts, cmpDirIoCount> dirIoCountQueue;
-    dirIoCountQueue.setMaxSize(m_maxCountOfStats);
-    for(auto it=m_dirIoCountMap.begin(); it != m_dirIoCountMap.end(); ++it){
-        it.value().dir = it.key();
-        dirIoCountQueue.push(it.value());
+    query->prepare("select pathtable.path,io.readCount,io.writeCount from "
+                   "(select pathId,sum(r) as readCount,sum(w) as writeCount from "
+                   "(select readFile.pathId as pathId,1 as r,0 as w "
+                   "from temp.cmdStatsCmd as c "
+                   "join readFileCmd on readFileCmd.cmdId=c.cmdId "
+                   "join readFile on readFile.id=readFileCmd.readFileId "
+                   "union all "
+                   "select writtenFile.pathId,0,1 "
+                   "from temp.cmdStatsCmd as c "
+                   "join writtenFile on writtenFile.cmdId=c.cmdId) "
+                   "group by pathId "
+                   "order by readCount+writeCount desc limit ?) as io "
+                   "join pathtable on pathtable.id=io.pathId "
+                   "order by io.readCount+io.writeCount desc");
+    query->addBindValue(m_maxCountOfStats);
+    query->exec();
+    while(query->next()){
+        DirIoCount e;
+        e.dir = query->value(0).toString();
+        e.readCount = qVariantTo_throw<qint64>(query->value(1));
+        e.writeCount = qVariantTo_throw<qint64>(query->value(2));
+        m_dirIoCounts.push_back(e);
     }
-    m_dirIoCounts = dirIoCountQueue.popAll<DirIoCounts>(true);
-    m_dirIoCountMap.clear();
+
+    query->exec("drop table if exists temp.cmdStatsCmd");
+    m_cmdTableCreated = false;
 }
 
 const CmdStats::MostFileModsEntrys &CmdStats::cmdsWithMostFileMods() const
@@ -114,3 +156,37 @@ const CmdStats::DirIoCounts &CmdStats::dirIoCounts() const
 {
     return m_dirIoCounts;
 }
+
+void CmdStats::createCmdTable()
+{
+    auto query = db_connection::mkQuery();
+    query->exec("drop table if exists temp.cmdStatsCmd");
+    query->exec("create temp table cmdStatsCmd "
+                "(idx INTEGER PRIMARY KEY, cmdId INTEGER)");
+    m_cmdTableCreated = true;
+}
+
+/// Insert the pending commands into the temporary table. Note that this
+/// happens while the command-query is still active, which is fine, as
+/// only the temp-database is written.
+void CmdStats::flushPendingCmds()
+{
+    if(m_pendingCmds.empty()){
+        return;
+    }
+    if(! m_cmdTableCreated){
+        createCmdTable();
+    }
+    QString queryStr = "insert into temp.cmdStatsCmd (idx,cmdId) values ";
+    for(size_t i=0; i < m_pendingCmds.size(); i++){
+        queryStr += (i == 0) ? "(?,?)" : ",(?,?)";
+    }
+    auto query = db_connection::mkQuery();
+    query->prepare(queryStr);
+    for(const auto& p : m_pendingCmds){
+        query->addBindValue(p.first);
+        query->addBindValue(p.second);
+    }
+    query->exec();
+    m_pendingCmds.clear();
+}
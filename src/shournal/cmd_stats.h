@@ -1,11 +1,17 @@
 #pragma once
 
+#include <vector>
 #include <QVector>
-#include <QHash>
 
 #include "commandinfo.h"
-#include "limited_priority_queue.h"
 
+/// Statistics about the commands passed to collectCmd(), e.g. the
+/// commands which modified the most files.
+/// The aggregation is performed within the database: only the ids of the
+/// collected commands are stored (in a temporary table), the top-N
+/// entries of each category are computed in eval() via GROUP BY/LIMIT.
+/// This way memory consumption does not depend on the number of
+/// commands or files.
 class CmdStats
 {
 public:
@@ -47,6 +53,7 @@ public:
 public:
 
     CmdStats();
+    ~CmdStats();
 
     void setMaxCountOfStats(const int &val);
 
@@ -63,45 +70,17 @@ public:
     const DirIoCounts& dirIoCounts() const;
 
 private:
-    struct cmpFileModEntry {
-        bool operator()(const MostFileModsEntry & e1, const MostFileModsEntry & e2) {
-            return e1.countOfFileMods > e2.countOfFileMods;
-        }
-    };
+    void createCmdTable();
+    void flushPendingCmds();
 
-    struct cmpSessionMostCmdEntry {
-        bool operator()(const SessionMostCmdsEntry & e1, const SessionMostCmdsEntry & e2) {
-            return e1.cmdCount > e2.cmdCount;
-        }
-    };
+    std::vector<std::pair<int, qint64> > m_pendingCmds; // idx, idInDb
+    bool m_cmdTableCreated{false};
 
-    struct cmpCwdCmdCount {
-        bool operator()(const CwdCmdCount & e1, const CwdCmdCount & e2) {
-            return e1.cmdCount > e2.cmdCount;
-        }
-    };
-
-    struct cmpDirIoCount {
-        bool operator()(const DirIoCount & e1, const DirIoCount & e2) {
-            return e1.readCount + e1.writeCount > e2.readCount + e2.writeCount;
-        }
-    };
-    limited_priority_queue<MostFileModsEntry,
-                           MostFileModsEntrys,
-                           cmpFileModEntry> m_cmdsWithMostFileModsQueue;
     MostFileModsEntrys m_cmdsWithMostFileMods;
-
-    QHash<QByteArray, SessionMostCmdsEntry> m_sessionMostCmdsMap;
     SessionMostCmds m_sessionMostCmds;
-
-    QHash<QString, CwdCmdCount> m_cwdCmdCountMap;
     CwdCmdCounts m_cwdCmdCounts;
-
-    QHash<QString, DirIoCount> m_dirIoCountMap;
     DirIoCounts m_dirIoCounts;
 
-
     int m_maxCountOfStats;
     int m_currentCmdIdx{0};
 };
-
@@ -8,6 +8,7 @@
 #include <QStandardPaths>
 
 #include "command_printer.h"
+#include "command_query_iterator.h"
 #include "qformattedstream.h"
 #include "util.h"
 #include "qfilethrow.h"
@@ -45,6 +46,29 @@ void CommandPrinter::createRestoreTopleveDirIfNeeded()
     }
 }
 
+/// @return the next command or nullptr, if there are no more.
+/// If the file status shall be reported, several commands are read
+/// ahead, so the status of their files is evaluated in parallel, while
+/// the current command is printed.
+CommandInfo* CommandPrinter::nextCommand(CommandQueryIterator &cmdIter)
+{
+    if(! m_reportFileStatus){
+        return (cmdIter.next()) ? &cmdIter.value() : nullptr;
+    }
+    const size_t READ_AHEAD_COUNT = 32;
+    while(m_readAheadCmds.size() < READ_AHEAD_COUNT && cmdIter.next()){
+        m_readAheadCmds.push_back(cmdIter.value());
+        m_fileStatusCache.prefetch(m_readAheadCmds.back(), m_maxCountWfiles,
+                                   m_maxCountRfiles);
+    }
+    if(m_readAheadCmds.empty()){
+        return nullptr;
+    }
+    m_currentCmd = std::move(m_readAheadCmds.front());
+    m_readAheadCmds.pop_front();
+    return &m_currentCmd;
+}
+
 void CommandPrinter::restoreReadFile_safe(const FileReadInfo &readInfo, const QString &cmdIdStr)
 {
     QFileThrow f(m_storedFiles.mkPathStringToStoredReadFile(readInfo));
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <deque>
 #include <memory>
 
 #include "storedfiles.h"
 #include "conversions.h"
 #include "qfilethrow.h"
 #include "cmd_stats.h"
+#include "commandinfo.h"
+#include "file_status_cache.h"
 
 
 class CommandQueryIterator;
@@ -38,6 +41,8 @@ protected:
 
     void createRestoreTopleveDirIfNeeded();
 
+    CommandInfo* nextCommand(CommandQueryIterator& cmdIter);
+
     void restoreReadFile_safe(const FileReadInfo& readInfo,
                          const QString &cmdIdStr);
     void restoreReadFile_safe(const FileReadInfo& readInfo,
@@ -55,6 +60,11 @@ protected:
     CmdStats m_cmdStats;
     int m_minCountOfStats;
     bool m_reportFileStatus{false};
+    FileStatusCache m_fileStatusCache;
+
+private:
+    std::deque<CommandInfo> m_readAheadCmds;
+    CommandInfo m_currentCmd;
 };
 
 
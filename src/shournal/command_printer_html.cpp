@@ -18,6 +18,14 @@
 
 using qresource_helper::data_safe;
 
+namespace {
+
+// The data of that many commands (read and written files) is compressed
+// and stored in one chunk, which the report only parses on demand.
+const int CMD_DATA_CHUNK_SIZE = 256;
+
+} // namespace
+
 
 void CommandPrinterHtml::printCommandInfosEvtlRestore(std::unique_ptr<CommandQueryIterator> &cmdIter)
 {
@@ -67,6 +75,7 @@ void CommandPrinterHtml::printCommandInfosEvtlRestore(std::unique_ptr<CommandQue
             this->processSingleCommand(outstream, cmdIter->value(), finalCommandEndDate,
                                        tmpCmdDataFile);
         }
+        flushCmdDataChunk(tmpCmdDataFile);
 
         outstream << "]";
 
@@ -81,6 +90,7 @@ void CommandPrinterHtml::printCommandInfosEvtlRestore(std::unique_ptr<CommandQue
 
         outstream << "const CMD_FINAL_ENDDATE_STR = '"
                   << finalCommandEndDate.toString(Conversions::dateIsoFormatWithMilliseconds()) << "';\n";
+        outstream << "const CMD_DATA_CHUNK_SIZE = " << CMD_DATA_CHUNK_SIZE << ";\n";
         outstream << "</script>\n";
     });
 
@@ -98,7 +108,9 @@ void CommandPrinterHtml::printCommandInfosEvtlRestore(std::unique_ptr<CommandQue
         outstream << "</script>\n";
 
 
-        // write the cmd-data of the tempfile to html
+        // write the compressed cmd-data chunks of the tempfile to html.
+        // They are not parsed by the browser on load, but by main.js
+        // on demand.
         if(! tmpCmdDataFile.seek(0)){
             throw QExcIo("Failed to seek to 0 in cmdData tmpfile: " +  tmpCmdDataFile.errorString());
         }
@@ -108,8 +120,8 @@ void CommandPrinterHtml::printCommandInfosEvtlRestore(std::unique_ptr<CommandQue
         while(! (line = tmpCmdDataFile.readLine()).isEmpty()){
             // pop \n
             line.resize(line.size() - 1);
-            outstream << "<script id=\"commandDataJSON" << linecounter
-                      << R"(" type="application/json">)";
+            outstream << "<script id=\"commandDataChunk" << linecounter
+                      << R"(" type="application/octet-stream">)";
             outstream << line;
 
             outstream << "</script>\n";
@@ -124,11 +136,11 @@ void CommandPrinterHtml::printCommandInfosEvtlRestore(std::unique_ptr<CommandQue
         m_cmdStats.eval();
         writeStatistics(outstream);
 
+        outstream << "\n</script>\n";
+
         // finally write read files:
         writeReadFileContentsToHtml(outstream, readFileIdSet);
 
-        outstream << "\n</script>\n";
-
 
     });
 
@@ -173,6 +185,12 @@ void CommandPrinterHtml::writeCmdStartup(const CommandInfo &cmd, QTextStream &ou
     cmdJsonStartup.sessionInfo = true;
     cmdJsonStartup.text = true;
     cmd.write(jsonCmdStartup, m_writeDatesWithMillisec, cmdJsonStartup);
+    // since we may restrict the number of read/written files (to not generate
+    // huge html-files), store the real number in any case. It is part
+    // of the startup data, so the timeline and stats do not need the
+    // (lazily loaded) file events.
+    jsonCmdStartup["fileReadEvents_length"] = cmd.fileReadInfos.length();
+    jsonCmdStartup["fileWriteEvents_length"] = cmd.fileWriteInfos.length();
 
     outstream << QJsonDocument(jsonCmdStartup).toJson(QJsonDocument::Compact);
 }
@@ -192,12 +210,30 @@ void CommandPrinterHtml::writeCmdData(const CommandInfo &cmd,
     QJsonObject jsonCmdData;
     cmd.write(jsonCmdData, m_writeDatesWithMillisec, cmdJsonData);
 
-    // since we may restrict the number of read/written files (to not generate
-    // huge html-files), store the real number in any case:
-    jsonCmdData["fileReadEvents_length"] = cmd.fileReadInfos.length();
-    jsonCmdData["fileWriteEvents_length"] = cmd.fileWriteInfos.length();
+    m_cmdDataChunk.append((m_cmdDataChunkCount == 0) ? '[' : ',');
+    m_cmdDataChunk.append(QJsonDocument(jsonCmdData).toJson(QJsonDocument::Compact));
+    ++m_cmdDataChunkCount;
+    if(m_cmdDataChunkCount >= CMD_DATA_CHUNK_SIZE){
+        flushCmdDataChunk(tmpCmdDataFile);
+    }
+}
 
-    if(tmpCmdDataFile.write(QJsonDocument(jsonCmdData).toJson(QJsonDocument::Compact)) == -1){
+/// Write the collected cmd-data as json array, zlib-compressed and base64
+/// encoded as a single line to tmpCmdDataFile.
+void CommandPrinterHtml::flushCmdDataChunk(QTemporaryFile &tmpCmdDataFile)
+{
+    if(m_cmdDataChunkCount == 0){
+        return;
+    }
+    m_cmdDataChunk.append(']');
+    // qCompress prepends the uncompressed size (4 bytes) to the zlib-stream,
+    // which the browser's DecompressionStream does not expect.
+    const QByteArray compressed = qCompress(m_cmdDataChunk);
+    m_cmdDataChunk.clear();
+    m_cmdDataChunkCount = 0;
+
+    if(tmpCmdDataFile.write(QByteArray::fromRawData(compressed.constData() + 4,
+                                                    compressed.size() - 4).toBase64()) == -1){
         throw QExcIo("Failed to write cmdData to tmpfile: " +  tmpCmdDataFile.errorString());
     }
     tmpCmdDataFile.write("\n");
@@ -221,28 +257,22 @@ void CommandPrinterHtml::addScriptsToReadFilesSet(const FileReadInfos &infos,
     }
 }
 
+/// Uniquely store each read (text) file base64 encoded in its own script tag,
+/// which is looked up by main.js, once the file shall be displayed.
 void CommandPrinterHtml::writeReadFileContentsToHtml(QTextStream &outstream,
                                                      FileReadInfoSet_t &readFileIdSet)
 {
-    // uniquely store each script in the html file
-    outstream << "const readFileContentMap = new Map([\n";
-    auto autoCloseNewMap = finally([&outstream] {  outstream << "]);\n"; });
-
     for(const auto& id_ : readFileIdSet) {
-        // javascript Maps can take 2d arrays in the constructor.
-        // Each array entry has the format [key, value].
-        outstream << "[" << id_ << ",";
-        auto autoCloseBracket = finally([&outstream] { outstream << "],\n"; });
         QFileThrow f(m_storedFiles.mkPathStringToStoredReadFile(id_));
         try {
             f.open(QFile::OpenModeFlag::ReadOnly);
             auto mtype = m_mimedb.mimeTypeForData(&f);
             if(! mtype.inherits("text/plain")){
-                outstream << "null"; // don't use 'undefined' here!
                 continue;
             }
-            outstream << "\"";
-            auto autoSetQuote = finally([&outstream] { outstream << "\""; });
+            outstream << "<script id=\"readFileContent" << id_
+                      << R"(" type="application/octet-stream">)";
+            auto autoCloseTag = finally([&outstream] { outstream << "</script>\n"; });
             writeFileToStream(f, outstream);
 
         } catch (const QExcIo& e) {
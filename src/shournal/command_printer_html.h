@@ -28,6 +28,7 @@ protected:
     void writeCmdStartup(const CommandInfo& cmd, QTextStream& outstream);
     void writeCmdData(const CommandInfo& cmd,
                       QTemporaryFile& tmpCmdDataFile);
+    void flushCmdDataChunk(QTemporaryFile& tmpCmdDataFile);
 
     void addScriptsToReadFilesSet(const FileReadInfos& infos, FileReadInfoSet_t& set);
     void writeReadFileContentsToHtml(QTextStream& outstream, FileReadInfoSet_t& readFileIdSet);
@@ -36,6 +37,8 @@ protected:
 
     QMimeDatabase m_mimedb;
     bool m_writeDatesWithMillisec{true};
+    QByteArray m_cmdDataChunk;
+    int m_cmdDataChunkCount{0};
 
 };
 
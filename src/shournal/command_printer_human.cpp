@@ -45,15 +45,16 @@ void CommandPrinterHuman::printCommandInfosEvtlRestore(std::unique_ptr<CommandQu
     }
 
     const QString currentHostname = QHostInfo::localHostName();
-    while(cmdIter->next()){
-        m_cmdStats.collectCmd(cmdIter->value());
+    CommandInfo* pCmd;
+    while((pCmd = nextCommand(*cmdIter)) != nullptr){
+        m_cmdStats.collectCmd(*pCmd);
         s.setLineStart(m_indentlvl0);
         // for indentlvl0 line-word-wrapping makes almost no
         // sense and hinders copy-pasting  of long terminal commands.
         auto oldMaxLineWidth = s.maxLineWidth();
         s.setMaxLineWidth(std::numeric_limits<int>::max());
 
-        auto & cmd = cmdIter->value();
+        auto & cmd = *pCmd;
         s << qtr("cmd-id %1").arg(cmd.idInDb);
         if(cmd.returnVal != CommandInfo::INVALID_RETURN_VAL){
             s << qtr("$?=%1").arg(QString::number(cmd.returnVal));
@@ -139,7 +140,7 @@ void
 CommandPrinterHuman::printReadFileEventEvtlRestore
 (const CommandInfo &cmd, QFormattedStream& s,
  const FileReadInfo& f, const QString &cmdIdStr){
-    auto fStatus = (reportFileStatus()) ? " "+f.currentStatus(cmd) : "";
+    auto fStatus = (reportFileStatus()) ? " "+m_fileStatusCache.status(f, cmd.hashMeta) : "";
     s.setLineStart(m_indentlvl2);
     s << pathJoinFilename(f.path, f.name)
       << "(" + m_userStrConv.bytesToHuman(f.size) + ")"
@@ -220,7 +221,7 @@ void CommandPrinterHuman::printWriteInfos
             }
             break;
         }
-        auto fStatus = (reportFileStatus()) ? " "+f.currentStatus(cmd) : "";
+        auto fStatus = (reportFileStatus()) ? " "+m_fileStatusCache.status(f, cmd.hashMeta) : "";
         s << pathJoinFilename(f.path, f.name)
           << "(" + m_userStrConv.bytesToHuman(f.size) + ")"
           << qtr("Hash:") << ((f.hash.isNull()) ? "-" : QString::number(f.hash.value())) +
@@ -4,6 +4,7 @@
 
 #include "command_printer_json.h"
 #include "command_query_iterator.h"
+#include "json_stream_writer.h"
 #include "logger.h"
 #include "util.h"
 
@@ -14,29 +15,37 @@ void CommandPrinterJson::printCommandInfosEvtlRestore(std::unique_ptr<CommandQue
         m_outputFile.open(QFile::OpenModeFlag::WriteOnly);
     }
 
-    QTextStream outstream(&m_outputFile);
+    // Commands are streamed directly to the output file descriptor.
+    // For large commands (many file events), this is a lot faster than
+    // building a QJsonDocument per command.
+    m_outputFile.flush();
+    JsonStreamWriter w(m_outputFile.handle());
     {
         QJsonObject header;
         header["pathToReadFiles"] = StoredFiles::getReadFilesDir();
         QJsonDocument doc(header);
-        outstream << "HEADER:" << doc.toJson(QJsonDocument::Compact) << "\n";
+        w.writeRaw("HEADER:");
+        w.writeRaw(doc.toJson(QJsonDocument::Compact));
+        w.writeRaw("\n");
     }
 
     CmdJsonWriteCfg jsonCfg(true);
     jsonCfg.fileStatus = this->reportFileStatus();
-    while(cmdIter->next()){
-        QJsonObject cmdObject;
-        cmdIter->value().write(cmdObject, false, jsonCfg);
-        QJsonDocument doc(cmdObject);
-        outstream << "COMMAND:" << doc.toJson(QJsonDocument::Compact) << "\n";
+    jsonCfg.fileStatusCache = &m_fileStatusCache;
+    CommandInfo* pCmd;
+    while((pCmd = nextCommand(*cmdIter)) != nullptr){
+        w.writeRaw("COMMAND:");
+        pCmd->write(w, false, jsonCfg);
+        w.writeRaw("\n");
+        w.flushIfNeeded();
 
         if(! m_restoreReadFiles){
             continue;
         }
-        for(const auto& readInfo : cmdIter->value().fileReadInfos){
+        for(const auto& readInfo : pCmd->fileReadInfos){
             if(readInfo.isStoredToDisk){
                 createRestoreTopleveDirIfNeeded();
-                restoreReadFile_safe(readInfo, QString::number(cmdIter->value().idInDb));
+                restoreReadFile_safe(readInfo, QString::number(pCmd->idInDb));
             }
         }
     }
@@ -47,6 +56,9 @@ void CommandPrinterJson::printCommandInfosEvtlRestore(std::unique_ptr<CommandQue
                     (m_countOfRestoredFiles == 0) ? QVariant() : m_restoreDir.absolutePath() );
         footer["countOfRestoredFiles"] = m_countOfRestoredFiles;
         QJsonDocument doc(footer);
-        outstream << "FOOTER:" << doc.toJson(QJsonDocument::Compact) << "\n";
+        w.writeRaw("FOOTER:");
+        w.writeRaw(doc.toJson(QJsonDocument::Compact));
+        w.writeRaw("\n");
     }
+    w.flush();
 }
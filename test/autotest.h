@@ -99,6 +99,10 @@ inline int run(int argc, char *argv[])
     parser.addArg(&argIntegrationTest);
 
 
+    QOptArg argBenchmark("", "benchmark",
+                         "Run benchmarks, instead of normal tests", false);
+    parser.addArg(&argBenchmark);
+
     QOptArg argShell("", "shell", "The shell used for the intgeration tests, including"
                                   " arguments, separated by whitespace");
     argShell.addRequiredArg(&argIntegrationTest);
@@ -157,8 +161,13 @@ inline int run(int argc, char *argv[])
             if(! test->objectName().startsWith("IntegrationTest")){
                 continue;
             }
+        } else if(argBenchmark.wasParsed()){
+            if(! test->objectName().startsWith("Benchmark")){
+                continue;
+            }
         } else{
-            if(test->objectName().startsWith("IntegrationTest")){
+            if(test->objectName().startsWith("IntegrationTest") ||
+               test->objectName().startsWith("Benchmark")){
                 continue;
             }
 
@@ -0,0 +1,403 @@
+
+#include <QTest>
+#include <QDebug>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QStandardPaths>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <thread>
+
+#include "autotest.h"
+#include "helper_for_test.h"
+#include "app.h"
+#include "os.h"
+#include "qfilethrow.h"
+
+
+/// End-to-end overhead of observing typical workloads with
+/// shournal-run-fanotify and shournal-run (kernel module backend),
+/// compared to running them unobserved. The installed backends are
+/// looked up in PATH (shournal-run-fanotify requires its capabilities),
+/// unavailable backends and workloads whose tools are missing are skipped.
+/// Each backend uses a fresh database and a configuration without event
+/// limit, which observes reads and writes below the benchmark's temporary
+/// directory, so the workloads are fully observed (see writeBackendCfg).
+/// Every workload is run RUNS times per backend, the run with the median
+/// wall time is reported. Per workload and backend the results contain
+/// - wall_ms and overhead_pct relative to the unobserved run
+/// - backend_cpu_ms: the cpu time in excess of the unobserved run
+///   plus that of the consumer threads of shournalk
+/// - lost_events, write_events and read_events from --print-summary
+/// - db_ingest_ms: the time from the end of the workload until the
+///   backend exited, which is dominated by storing the events
+/// The results are written as JSON to the file given in the environment
+/// variable SHOURNAL_BENCH_JSON (default: shournal-bench.json in the
+/// working directory).
+/// Run with
+///     runTests --benchmark
+/// or within the test build directory
+///     make bench
+class BenchmarkBackendOverhead : public QObject {
+    Q_OBJECT
+
+    static const int RUNS = 3;
+
+    struct RunResult {
+        qint64 wallNs {0};
+        qint64 cpuNs {0};
+        qint64 kthreadCpuNs {0};
+        qint64 postCmdNs {0};
+        qint64 lostEvents {-1};
+        qint64 wEvents {-1};
+        qint64 rEvents {-1};
+    };
+
+    struct Backend {
+        QString name;
+        QString exe; // empty: unobserved
+    };
+
+    std::shared_ptr<QTemporaryDir> m_tmpDir;
+    QVector<Backend> m_backends;
+    QJsonArray m_results;
+    QJsonObject m_settings;
+
+    static qint64 timevalToNs(const timeval& tv){
+        return qint64(tv.tv_sec) * 1000000000 + qint64(tv.tv_usec) * 1000;
+    }
+
+    static bool haveExecutables(const QStringList& exes){
+        for(const auto& exe : exes){
+            if(QStandardPaths::findExecutable(exe).isEmpty()){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Run argv within workDir with stdout to /dev/null and stderr to errPath.
+    /// @return the exit status and the rusage of the process (including its
+    /// waited-for descendants) in ru.
+    static int runProcess(const QStringList& argv, const QString& workDir,
+                          const QString& errPath, rusage* ru){
+        std::vector<QByteArray> args;
+        for(const auto& a : argv){
+            args.push_back(a.toLocal8Bit());
+        }
+        std::vector<char*> cargs;
+        for(auto& a : args){
+            cargs.push_back(a.data());
+        }
+        cargs.push_back(nullptr);
+        const QByteArray dir = workDir.toLocal8Bit();
+        const QByteArray err = errPath.toLocal8Bit();
+
+        const pid_t pid = os::fork();
+        if(pid == 0){
+            int devnull = open("/dev/null", O_WRONLY);
+            int errFd = open(err.constData(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if(devnull == -1 || errFd == -1 || chdir(dir.constData()) == -1 ||
+               dup2(devnull, STDOUT_FILENO) == -1 || dup2(errFd, STDERR_FILENO) == -1){
+                _exit(127);
+            }
+            execvp(cargs[0], cargs.data());
+            _exit(127);
+        }
+        int status;
+        while(wait4(pid, &status, 0, ru) == -1){
+            if(errno != EINTR){
+                throw os::ExcOs("wait4 failed");
+            }
+        }
+        return (WIFEXITED(status)) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+
+    /// @return the cpu time of the consumer threads of shournalk
+    static qint64 shournalkKthreadCpuNs(){
+        const qint64 ticksPerSec = sysconf(_SC_CLK_TCK);
+        qint64 ticks = 0;
+        for(const auto& pid : QDir("/proc").entryList(QDir::Dirs | QDir::NoDotAndDotDot)){
+            QFile comm("/proc/" + pid + "/comm");
+            if(! comm.open(QFile::ReadOnly) ||
+                    ! comm.readAll().startsWith("shournalk_co")){
+                continue;
+            }
+            QFile stat("/proc/" + pid + "/stat");
+            if(! stat.open(QFile::ReadOnly)){
+                continue;
+            }
+            // fields after the command name, which is enclosed in parentheses
+            const QByteArray statStr = stat.readAll();
+            const auto fields = statStr.mid(statStr.lastIndexOf(')') + 2).split(' ');
+            if(fields.size() > 12){
+                // utime and stime
+                ticks += fields[11].toLongLong() + fields[12].toLongLong();
+            }
+        }
+        return ticks * 1000000000 / ticksPerSec;
+    }
+
+    static qint64 parseSummaryValue(const QString& summary, const QString& key){
+        QRegularExpression re(key + ": (\\d+)");
+        auto match = re.match(summary);
+        return (match.hasMatch()) ? match.captured(1).toLongLong() : -1;
+    }
+
+    /// The defaults would limit the number of write events and only
+    /// observe read events below $HOME, so write a config to the backend's
+    /// cfg-dir, which lifts the limits and includes the benchmark's
+    /// directory for read and write events. The settings are recorded
+    /// in the results.
+    void writeBackendCfg(const QString& cfgDir){
+        const QString includePath = m_tmpDir->path();
+        QString cfg;
+        for(const char* sect : {"File write-events", "File read-events"}){
+            cfg += QString("[%1]\n"
+                           "include_paths = '''\n"
+                           "%2\n"
+                           "'''\n"
+                           "max_event_count = 0\n\n").arg(sect, includePath);
+        }
+        QDir().mkpath(cfgDir);
+        testhelper::writeStringToFile(cfgDir + "/config.ini", cfg);
+        // the config scheme version, so the config is taken as is
+        testhelper::writeStringToFile(cfgDir + "/.config-version", "3.2");
+
+        m_settings["write_include_paths"] = QJsonArray{includePath};
+        m_settings["read_include_paths"] = QJsonArray{includePath};
+        m_settings["write_max_event_count"] = 0;
+        m_settings["read_max_event_count"] = 0;
+    }
+
+    RunResult runOnce(const Backend& backend, const QString& workDir,
+                      const QString& prepare, const QString& command){
+        const QString stampPath = m_tmpDir->path() + "/stamp";
+        const QString errPath = m_tmpDir->path() + "/stderr";
+        rusage ru{};
+        if(runProcess({"sh", "-c", prepare}, workDir, errPath, &ru) != 0){
+            throw QExcIo("failed to prepare workload: " + prepare);
+        }
+        QFile::remove(stampPath);
+
+        QStringList argv;
+        if(! backend.exe.isEmpty()){
+            const QString backendDir = m_tmpDir->path() + "/" + backend.name;
+            argv << backend.exe << "--cfg-dir" << backendDir + "/cfg"
+                 << "--data-dir" << backendDir + "/data"
+                 << "--print-summary" << "-e";
+        }
+        // the workload's end is the mtime of the stamp file
+        argv << "sh" << "-c" << command + "\n: > '" + stampPath + "'";
+
+        RunResult res;
+        const bool isShournalk = backend.exe.endsWith("shournal-run");
+        const qint64 kthreadCpuStart = (isShournalk) ? shournalkKthreadCpuNs() : 0;
+        QElapsedTimer timer;
+        timer.start();
+        const int ret = runProcess(argv, workDir, errPath, &ru);
+        res.wallNs = timer.nsecsElapsed();
+        const qint64 endNs = QDateTime::currentMSecsSinceEpoch() * 1000000;
+        if(ret != 0){
+            throw QExcIo(QString("%1 failed with %2 for workload: %3")
+                         .arg(argv.first()).arg(ret).arg(command));
+        }
+        if(isShournalk){
+            res.kthreadCpuNs = shournalkKthreadCpuNs() - kthreadCpuStart;
+        }
+        res.cpuNs = timevalToNs(ru.ru_utime) + timevalToNs(ru.ru_stime);
+        const auto st = os::stat(stampPath.toLocal8Bit());
+        res.postCmdNs = std::max(endNs - (qint64(st.st_mtim.tv_sec) * 1000000000 +
+                                          st.st_mtim.tv_nsec), qint64(0));
+
+        if(! backend.exe.isEmpty()){
+            QFileThrow errFile(errPath);
+            errFile.open(QFile::ReadOnly);
+            const QString summary = errFile.readAll();
+            res.lostEvents = parseSummaryValue(summary, "number of lost events");
+            res.wEvents = parseSummaryValue(summary, "number of write-events");
+            res.rEvents = parseSummaryValue(summary, "number of read-events");
+        }
+        return res;
+    }
+
+    RunResult runMedian(const Backend& backend, const QString& workDir,
+                        const QString& prepare, const QString& command){
+        QVector<RunResult> runs;
+        for(int i=0; i < RUNS; i++){
+            runs.push_back(runOnce(backend, workDir, prepare, command));
+        }
+        std::sort(runs.begin(), runs.end(), [](const RunResult& r1, const RunResult& r2){
+            return r1.wallNs < r2.wallNs;
+        });
+        return runs[RUNS / 2];
+    }
+
+    void mkSourceTree(const QString& dir, int fileCount, int fileSize){
+        for(int i=0; i < fileCount; i++){
+            const QString subdir = dir + "/d" + QString::number(i / 100);
+            QDir().mkpath(subdir);
+            testhelper::writeStuffToFile(subdir + "/f" + QString::number(i), fileSize);
+        }
+    }
+
+    void mkCppProject(const QString& dir, int fileCount){
+        QDir().mkpath(dir);
+        QString makefile = "SRCS := $(wildcard *.cpp)\n"
+                           "all: $(SRCS:.cpp=.o)\n"
+                           "%.o: %.cpp\n"
+                           "\t$(CXX) -O1 -c $< -o $@\n";
+        testhelper::writeStringToFile(dir + "/Makefile", makefile);
+        for(int i=0; i < fileCount; i++){
+            testhelper::writeStringToFile(
+                        dir + QString("/unit%1.cpp").arg(i),
+                        QString("#include <map>\n#include <string>\n#include <vector>\n"
+                                "std::map<std::string, std::vector<int>> f%1(int n){\n"
+                                "    std::map<std::string, std::vector<int>> m;\n"
+                                "    for(int i=0; i < n; i++) m[std::to_string(i)].push_back(i);\n"
+                                "    return m;\n}\n").arg(i));
+        }
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+        m_tmpDir = testhelper::mkAutoDelTmpDir();
+        m_backends.push_back({"none", ""});
+
+        const QString fanExe = QStandardPaths::findExecutable("shournal-run-fanotify");
+        if(fanExe.isEmpty()){
+            qWarning() << "shournal-run-fanotify not found in PATH - skipping it";
+        } else {
+            m_backends.push_back({"fanotify", fanExe});
+        }
+        const QString kExe = QStandardPaths::findExecutable("shournal-run");
+        rusage ru{};
+        if(kExe.isEmpty() ||
+           runProcess({kExe, "--shournalk-is-loaded"}, m_tmpDir->path(),
+                      "/dev/null", &ru) != 0){
+            qWarning() << "shournal-run not found in PATH or shournalk not loaded"
+                          " - skipping it";
+        } else {
+            m_backends.push_back({"shournalk", kExe});
+        }
+        for(const auto& backend : m_backends){
+            if(! backend.exe.isEmpty()){
+                writeBackendCfg(m_tmpDir->path() + "/" + backend.name + "/cfg");
+            }
+        }
+    }
+
+    void cleanupTestCase(){
+        QJsonObject root;
+        utsname uts{};
+        uname(&uts);
+        root["shournal_version"] = app::version().toString();
+        root["kernel"] = QString(uts.release);
+        root["date"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+        root["runs"] = RUNS;
+        root["backend_settings"] = m_settings;
+        root["results"] = m_results;
+
+        QString outPath = QString::fromLocal8Bit(qgetenv("SHOURNAL_BENCH_JSON"));
+        if(outPath.isEmpty()){
+            outPath = "shournal-bench.json";
+        }
+        QFileThrow out(outPath);
+        out.open(QFile::WriteOnly | QFile::Truncate);
+        out.write(QJsonDocument(root).toJson());
+        qInfo() << "benchmark results written to" << QFileInfo(out).absoluteFilePath();
+    }
+
+    void benchWorkload_data(){
+        QTest::addColumn<QStringList>("tools");
+        QTest::addColumn<QString>("prepare");
+        QTest::addColumn<QString>("command");
+
+        const QString nproc = QString::number(std::max(1u, std::thread::hardware_concurrency()));
+        QTest::newRow("untar") << QStringList{"tar"}
+                               << "rm -rf out && mkdir out"
+                               << "tar -xf ../tree.tar -C out";
+        QTest::newRow("cxx-build") << QStringList{"make", "c++"}
+                                   << "rm -f *.o"
+                                   << "make -s -j" + nproc + " CXX=c++";
+        QTest::newRow("git-checkout") << QStringList{"git"}
+                                      << "git checkout -q a"
+                                      << "git checkout -q b";
+        QTest::newRow("fork-loop") << QStringList{}
+                                   << ":"
+                                   << "i=0; while [ $i -lt 5000 ]; do /bin/true; "
+                                      "i=$((i+1)); done";
+        QTest::newRow("large-write") << QStringList{"dd"}
+                                     << "rm -f big"
+                                     << "dd if=/dev/zero of=big bs=1M count=512 2>/dev/null";
+    }
+
+    void benchWorkload(){
+        QFETCH(QStringList, tools);
+        QFETCH(QString, prepare);
+        QFETCH(QString, command);
+        if(! haveExecutables(tools)){
+            QSKIP("required tools not found");
+        }
+        const QString tag = QTest::currentDataTag();
+        const QString workDir = m_tmpDir->path() + "/" + tag;
+        QDir().mkpath(workDir);
+        rusage ru{};
+        if(tag == "untar"){
+            mkSourceTree(m_tmpDir->path() + "/tree", 20000, 4096);
+            QCOMPARE(runProcess({"tar", "-cf", "tree.tar", "tree"}, m_tmpDir->path(),
+                                "/dev/null", &ru), 0);
+        } else if(tag == "cxx-build"){
+            mkCppProject(workDir, 64);
+        } else if(tag == "git-checkout"){
+            mkSourceTree(workDir + "/tree", 5000, 1024);
+            const QString git = "git -c user.name=bench -c user.email=bench@localhost ";
+            const QString script =
+                    "git init -q . && git checkout -q -b a && git add -A && " +
+                    git + "commit -q -m a && git checkout -q -b b && "
+                    "for f in tree/*/*; do echo b >> $f; done && " +
+                    git + "commit -q -a -m b";
+            QCOMPARE(runProcess({"sh", "-c", script}, workDir, "/dev/null", &ru), 0);
+        }
+
+        RunResult unobserved;
+        for(const auto& backend : m_backends){
+            const RunResult res = runMedian(backend, workDir, prepare, command);
+            if(backend.exe.isEmpty()){
+                unobserved = res;
+            }
+            QJsonObject obj;
+            obj["workload"] = tag;
+            obj["backend"] = backend.name;
+            obj["wall_ms"] = res.wallNs / 1e6;
+            obj["overhead_pct"] = (res.wallNs - unobserved.wallNs) * 100.0 /
+                                  std::max(unobserved.wallNs, qint64(1));
+            obj["backend_cpu_ms"] = (res.cpuNs - unobserved.cpuNs + res.kthreadCpuNs) / 1e6;
+            obj["db_ingest_ms"] = res.postCmdNs / 1e6;
+            obj["lost_events"] = res.lostEvents;
+            obj["write_events"] = res.wEvents;
+            obj["read_events"] = res.rEvents;
+            m_results.append(obj);
+            qInfo() << tag << backend.name << ":" << res.wallNs / 1e6 << "ms,"
+                    << obj["overhead_pct"].toDouble() << "% overhead";
+        }
+    }
+};
+
+
+DECLARE_TEST(BenchmarkBackendOverhead)
+
+#include "benchmark_backend_overhead.moc"
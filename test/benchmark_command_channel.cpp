@@ -0,0 +1,137 @@
+
+#include <QTest>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <thread>
+
+#include "autotest.h"
+#include "cleanupresource.h"
+#include "fdcommunication.h"
+#include "shm_ring.h"
+#include "socket_message.h"
+#include "os.h"
+#include "util.h"
+
+using fdcommunication::SocketCommunication;
+using fdcommunication::ShmRing;
+using socket_message::E_SocketMsg;
+
+
+/// Per-command control overhead between the shell integration and a
+/// persistent backend: pass the boundaries of 10k back-to-back trivial
+/// commands (as the shell does in the prepare- and cleanup-request) via
+/// socket or shared memory ring, while the receiver processes them in
+/// another thread.
+/// Run with
+///     runTests --benchmark
+class BenchmarkCommandChannel : public QObject {
+    Q_OBJECT
+
+    static const int COMMAND_COUNT = 10000;
+
+    static SocketCommunication::Messages prepareMessages(){
+        return { {int(E_SocketMsg::CLEAR_EVENTS)},
+                 {int(E_SocketMsg::WORKING_DIRECTORY), "/home/user/some/project"} };
+    }
+
+    static SocketCommunication::Messages cleanupMessages(){
+        return { {int(E_SocketMsg::COMMAND), "true"},
+                 {int(E_SocketMsg::RETURN_VALUE), qBytesFromVar(qint32(0))},
+                 {int(E_SocketMsg::CMD_FINISHED)} };
+    }
+
+    static int countFinished(const SocketCommunication::Messages& messages){
+        int count = 0;
+        for(const auto& m : messages){
+            if(m.msgId == int(E_SocketMsg::CMD_FINISHED)){
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    static void runSocket(){
+        auto sockets = os::socketpair(PF_UNIX, SOCK_STREAM);
+        auto closeSocks = finally([&sockets] {
+            close(sockets[0]);
+            close(sockets[1]);
+        });
+        SocketCommunication sender;
+        sender.setSockFd(sockets[0]);
+
+        std::thread receiver([&sockets]{
+            SocketCommunication sockCom;
+            sockCom.setReceiveBufferSize(1024*1024);
+            sockCom.setSockFd(sockets[1]);
+            SocketCommunication::Messages messages;
+            int finished = 0;
+            while(finished < COMMAND_COUNT){
+                sockCom.receiveMessages(&messages);
+                finished += countFinished(messages);
+            }
+        });
+        const auto prepare = prepareMessages();
+        const auto cleanup = cleanupMessages();
+        for(int i=0; i < COMMAND_COUNT; i++){
+            sender.sendMessages(prepare);
+            sender.sendMessages(cleanup);
+        }
+        receiver.join();
+    }
+
+    static void runShmRing(){
+        ShmRing sender;
+        sender.create(1 << 16);
+        ShmRing consumer;
+        consumer.attach(os::dup(sender.memFd()), os::dup(sender.doorbellFd()));
+
+        std::thread receiver([&consumer]{
+            SocketCommunication::Messages messages;
+            struct pollfd pfd{};
+            pfd.fd = consumer.doorbellFd();
+            pfd.events = POLLIN;
+            int finished = 0;
+            while(finished < COMMAND_COUNT){
+                poll(&pfd, 1, -1);
+                consumer.receiveMessages(&messages);
+                finished += countFinished(messages);
+            }
+        });
+        const auto prepare = prepareMessages();
+        const auto cleanup = cleanupMessages();
+        for(int i=0; i < COMMAND_COUNT; i++){
+            // the shell falls back to the socket in this case
+            while(! sender.sendMessages(prepare)) std::this_thread::yield();
+            while(! sender.sendMessages(cleanup)) std::this_thread::yield();
+        }
+        receiver.join();
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+    }
+
+    void bench10kCommands_data(){
+        QTest::addColumn<bool>("useShmRing");
+        QTest::newRow("socket") << false;
+        QTest::newRow("shm ring") << true;
+    }
+
+    void bench10kCommands(){
+        QFETCH(bool, useShmRing);
+        QBENCHMARK {
+            if(useShmRing){
+                runShmRing();
+            } else {
+                runSocket();
+            }
+        }
+    }
+};
+
+
+DECLARE_TEST(BenchmarkCommandChannel)
+
+#include "benchmark_command_channel.moc"
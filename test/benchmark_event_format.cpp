@@ -0,0 +1,203 @@
+
+#include <QTest>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <vector>
+
+#include "autotest.h"
+#include "cleanupresource.h"
+#include "fileevents.h"
+#include "stdiocpp.h"
+#include "util.h"
+
+
+/// Size and parse throughput of the event file formats (see
+/// shournalk_user.h): 1M file events of a simulated build, which reads
+/// headers from a few system directories and reads and writes sources
+/// and objects within a project tree, are written with FileEvents in
+/// format version 1 and 2 to an in-memory file and read back. Reported
+/// are the bytes per event and the events (and MiB) parsed per second.
+/// benchIngest compares reading the events the way the database layer
+/// does: formerly via stdio, converting and splitting each path(), now
+/// from the mapping, converting only the filename and new directories.
+/// Run with
+///     runTests --benchmark
+class BenchmarkEventFormat : public QObject {
+    Q_OBJECT
+
+    static const int EVENT_COUNT = 1000000;
+    static const int PROJECT_DIR_COUNT = 200;
+
+    struct Ev {
+        int flags;
+        StrLight path;
+        struct stat st;
+        HashValue hash;
+    };
+
+    static std::vector<Ev> mkEvents(){
+        const QVector<QByteArray> sysDirs {
+            "/usr/include", "/usr/include/c++/9", "/usr/include/x86_64-linux-gnu/bits",
+            "/usr/lib/gcc/x86_64-linux-gnu/9/include",
+        };
+        std::vector<Ev> evs;
+        evs.reserve(EVENT_COUNT);
+        const time_t buildStart = 1600000000;
+        for(int i=0; i < EVENT_COUNT; i++){
+            Ev e{};
+            QByteArray path;
+            const int dirIdx = (i / 8) % PROJECT_DIR_COUNT;
+            switch (i % 8) {
+            case 0: case 1: case 2: case 3:
+                e.flags = O_RDONLY;
+                path = sysDirs[i % sysDirs.size()] + "/header_" +
+                        QByteArray::number(i % 97) + ".h";
+                e.st.st_mtime = buildStart - 86400 * 100 - i % 1000;
+                break;
+            case 4: case 5:
+                e.flags = O_RDONLY;
+                path = "/home/user/project/src/module_" + QByteArray::number(dirIdx) +
+                        "/file_" + QByteArray::number(i % 31) + ".cpp";
+                e.st.st_mtime = buildStart - 3600 - i % 100;
+                break;
+            default:
+                e.flags = O_WRONLY;
+                path = "/home/user/project/build/module_" + QByteArray::number(dirIdx) +
+                        "/file_" + QByteArray::number(i % 31) + ".o";
+                e.st.st_mtime = buildStart + i / 1000;
+                break;
+            }
+            e.path = StrLight(path.constData(), size_t(path.size()));
+            e.st.st_size = 1000 + i % 50000;
+            e.st.st_mode = S_IFREG | 0644;
+            e.hash = HashValue(0x9e3779b97f4a7c15ull * uint64_t(i + 1));
+            evs.push_back(e);
+        }
+        return evs;
+    }
+
+    /// @return the file the events were written to
+    static FILE* writeEvents(const std::vector<Ev>& evs, int version){
+        FILE* file = stdiocpp::memfile("benchmark-file-events");
+        FileEvents writer;
+        writer.setFile(file);
+        writer.setWriteVersion(version);
+        for(const auto& e : evs){
+            writer.write(e.flags, e.path, e.st, e.hash);
+        }
+        stdiocpp::fflush(file);
+        return file;
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+    }
+
+    void benchFormat_data(){
+        QTest::addColumn<int>("version");
+        QTest::newRow("v1") << 1;
+        QTest::newRow("v2") << 2;
+    }
+
+    void benchFormat(){
+        QFETCH(int, version);
+        const auto evs = mkEvents();
+        FILE* file = stdiocpp::memfile("benchmark-file-events");
+        auto closeFile = finally([&file] { fclose(file); });
+
+        FileEvents writer;
+        writer.setFile(file);
+        writer.setWriteVersion(version);
+        QElapsedTimer timer;
+        timer.start();
+        for(const auto& e : evs){
+            writer.write(e.flags, e.path, e.st, e.hash);
+        }
+        stdiocpp::fflush(file);
+        const qint64 writeNs = timer.nsecsElapsed();
+        const long fileSize = stdiocpp::ftell(file);
+
+        FileEvents reader;
+        reader.setFile(file);
+        int count = 0;
+        timer.start();
+        QBENCHMARK_ONCE {
+            stdiocpp::fseek(file, 0, SEEK_SET);
+            while(reader.read() != nullptr){
+                count++;
+            }
+        }
+        const double readSecs = std::max(timer.nsecsElapsed(), qint64(1)) / 1e9;
+        QCOMPARE(count, EVENT_COUNT);
+
+        qInfo() << QTest::currentDataTag() << ":"
+                << double(fileSize) / EVENT_COUNT << "bytes/event,"
+                << writeNs / EVENT_COUNT << "ns/event written,"
+                << qint64(EVENT_COUNT / readSecs) << "events/s and"
+                << fileSize / readSecs / (1024 * 1024) << "MiB/s parsed";
+    }
+
+    void benchIngest_data(){
+        benchFormat_data();
+    }
+
+    void benchIngest(){
+        QFETCH(int, version);
+        FILE* file = writeEvents(mkEvents(), version);
+        auto closeFile = finally([&file] { fclose(file); });
+
+        // the former reader: stdio and a path per event
+        FileEvents stdioEvents;
+        stdiocpp::fseek(file, 0, SEEK_SET);
+        stdioEvents.setFile(file);
+        QVERIFY(stdioEvents.detectReadVersion());
+        int stdioCount = 0;
+        qint64 stdioChars = 0;
+        QElapsedTimer timer;
+        timer.start();
+        FileEvent* e;
+        while((e = (version == 2) ? stdioEvents.readV2() : stdioEvents.readV1()) != nullptr){
+            const auto dirFname = splitAbsPath(QString(e->path()));
+            stdioChars += dirFname.first.size() + dirFname.second.size();
+            stdioCount++;
+        }
+        const double stdioSecs = std::max(timer.nsecsElapsed(), qint64(1)) / 1e9;
+
+        FileEvents mappedEvents;
+        stdiocpp::fseek(file, 0, SEEK_SET);
+        mappedEvents.setFile(file);
+        int mappedCount = 0;
+        qint64 mappedChars = 0;
+        QHash<uint, QString> dirs;
+        timer.start();
+        QBENCHMARK_ONCE {
+            while((e = mappedEvents.read()) != nullptr){
+                auto it = dirs.find(e->dirId());
+                if(it == dirs.end()){
+                    it = dirs.insert(e->dirId(), QString::fromUtf8(e->dir()));
+                }
+                mappedChars += it.value().size() + QString::fromUtf8(e->filename()).size();
+                mappedCount++;
+            }
+        }
+        const double mappedSecs = std::max(timer.nsecsElapsed(), qint64(1)) / 1e9;
+        QCOMPARE(stdioCount, EVENT_COUNT);
+        QCOMPARE(mappedCount, EVENT_COUNT);
+        QCOMPARE(mappedChars, stdioChars);
+
+        qInfo() << QTest::currentDataTag() << ": stdio"
+                << qint64(EVENT_COUNT / stdioSecs) << "events/s, mapped"
+                << qint64(EVENT_COUNT / mappedSecs) << "events/s";
+    }
+};
+
+
+DECLARE_TEST(BenchmarkEventFormat)
+
+#include "benchmark_event_format.moc"
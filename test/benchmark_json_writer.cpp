@@ -0,0 +1,118 @@
+
+#include <QTest>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <fcntl.h>
+#include <algorithm>
+
+#include "autotest.h"
+#include "cleanupresource.h"
+#include "json_stream_writer.h"
+#include "os.h"
+#include "database/commandinfo.h"
+
+
+/// Throughput of the json output of shournal --query (CommandPrinterJson):
+/// 100 commands with 10k file events each (1M in total) are written to
+/// /dev/null, either via QJsonDocument and QTextStream (the former
+/// implementation) or via JsonStreamWriter. The commands are generated in
+/// memory, so database access is not part of the measurement.
+/// Run with
+///     runTests --benchmark
+class BenchmarkJsonWriter : public QObject {
+    Q_OBJECT
+
+    static const int COMMAND_COUNT = 100;
+    static const int FILES_PER_COMMAND = 10000;
+
+    static CommandInfo mkCmd(int cmdIdx){
+        CommandInfo cmd;
+        cmd.idInDb = cmdIdx;
+        cmd.text = "make -j8 all";
+        cmd.returnVal = 0;
+        cmd.username = "user";
+        cmd.hostname = "host";
+        cmd.hashMeta = HashMeta(4096, 20);
+        cmd.sessionInfo.uuid = QByteArray("0123456789abcdef");
+        cmd.startTime = QDateTime::currentDateTime();
+        cmd.endTime = cmd.startTime.addSecs(30);
+        cmd.workingDirectory = "/home/user/project";
+        for(int i=0; i < FILES_PER_COMMAND; i++){
+            FileWriteInfo w;
+            w.idInDb = qint64(cmdIdx) * FILES_PER_COMMAND + i;
+            w.path = "/home/user/project/build/obj";
+            w.name = "file_" + QString::number(i) + ".o";
+            w.size = 10000 + i;
+            w.mtime = cmd.startTime;
+            w.hash = HashValue(1234567890123456789ull + uint64_t(i));
+            cmd.fileWriteInfos.push_back(w);
+        }
+        return cmd;
+    }
+
+    static qint64 writeQJson(const QVector<CommandInfo>& cmds, QFile& out){
+        QTextStream outstream(&out);
+        CmdJsonWriteCfg jsonCfg(true);
+        qint64 bytes = 0;
+        for(const auto& cmd : cmds){
+            QJsonObject cmdObject;
+            cmd.write(cmdObject, false, jsonCfg);
+            QByteArray json = QJsonDocument(cmdObject).toJson(QJsonDocument::Compact);
+            bytes += json.size() + 9;
+            outstream << "COMMAND:" << json << "\n";
+        }
+        return bytes;
+    }
+
+    static qint64 writeStreaming(const QVector<CommandInfo>& cmds, int fd){
+        JsonStreamWriter w(fd);
+        CmdJsonWriteCfg jsonCfg(true);
+        qint64 bytes = 0;
+        for(const auto& cmd : cmds){
+            w.writeRaw("COMMAND:");
+            cmd.write(w, false, jsonCfg);
+            w.writeRaw("\n");
+            bytes += w.buffer().size();
+            w.flush();
+        }
+        return bytes;
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+    }
+
+    void bench1MFileEvents_data(){
+        QTest::addColumn<bool>("streaming");
+        QTest::newRow("QJsonDocument") << false;
+        QTest::newRow("JsonStreamWriter") << true;
+    }
+
+    void bench1MFileEvents(){
+        QFETCH(bool, streaming);
+        QVector<CommandInfo> cmds;
+        for(int i=0; i < COMMAND_COUNT; i++){
+            cmds.push_back(mkCmd(i));
+        }
+        const int fd = os::open("/dev/null", O_WRONLY);
+        auto closeFd = finally([&fd] { close(fd); });
+        QFile out;
+        QVERIFY(out.open(fd, QFile::WriteOnly));
+
+        qint64 bytes = 0;
+        QElapsedTimer timer;
+        timer.start();
+        QBENCHMARK_ONCE {
+            bytes = (streaming) ? writeStreaming(cmds, fd) : writeQJson(cmds, out);
+        }
+        const double secs = std::max(timer.nsecsElapsed(), qint64(1)) / 1e9;
+        qInfo() << QTest::currentDataTag() << ":" << bytes / (1024.0 * 1024.0) / secs << "MB/s";
+    }
+};
+
+
+DECLARE_TEST(BenchmarkJsonWriter)
+
+#include "benchmark_json_writer.moc"
@@ -0,0 +1,165 @@
+
+#include <QTest>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "autotest.h"
+#include "helper_for_test.h"
+#include "cleanupresource.h"
+#include "hashcontrol.h"
+#include "os.h"
+
+
+/// Partial hashing (HashControl::genPartlyHash) of a corpus of files between
+/// 1 KiB and 1 GiB with the default hash settings, compared to the former
+/// implementation, which read the chunks with read+lseek and always used
+/// the xxhash-state, and to hashing with XXH3 instead of XXH64. Files larger than 1 MiB are created sparse. As the
+/// files are hashed again and again, they reside in the page cache, so the
+/// syscall- and hashing-overhead is measured, not the disk.
+/// Run with
+///     runTests --benchmark
+class BenchmarkPartialHash : public QObject {
+    Q_OBJECT
+
+    static const int HASHES_PER_FILE = 20000;
+    static const int SMALL_FILE_COUNT = 10000;
+
+    const HashMeta m_hashMeta{256, 3};
+    const HashMeta m_hashMetaXXH3{256, 3, HashMeta::XXH3};
+
+    static uint64_t legacyDigest(int fd, qint64 filesize, const HashMeta& hashMeta,
+                                 XXH64_state_t* state, char* buf){
+        const off64_t seekstep = filesize / hashMeta.maxCountOfReads;
+        XXH64_reset(state, 0);
+        for(int i=0; i < hashMeta.maxCountOfReads; i++){
+            const ssize_t readBytes = os::read(fd, buf, size_t(hashMeta.chunkSize));
+            XXH64_update(state, buf, size_t(readBytes));
+            if(readBytes < hashMeta.chunkSize){
+                break;
+            }
+            if(seekstep > hashMeta.chunkSize){
+                os::lseek(fd, seekstep - hashMeta.chunkSize, SEEK_CUR);
+            }
+        }
+        const uint64_t hash = XXH64_digest(state);
+        os::lseek(fd, 0, SEEK_SET);
+        return hash;
+    }
+
+    static void mkFile(const QString& fpath, qint64 size){
+        if(size <= 1024 * 1024){
+            testhelper::writeStuffToFile(fpath, int(size));
+            return;
+        }
+        testhelper::writeStuffToFile(fpath, 1024 * 1024);
+        if(truncate(fpath.toUtf8().constData(), size) == -1){
+            throw os::ExcOs("truncate failed");
+        }
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+    }
+
+    void benchFileSizes_data(){
+        QTest::addColumn<qint64>("size");
+        QTest::newRow("1KiB") << qint64(1024);
+        QTest::newRow("64KiB") << qint64(64) * 1024;
+        QTest::newRow("1MiB") << qint64(1024) * 1024;
+        QTest::newRow("64MiB") << qint64(64) * 1024 * 1024;
+        QTest::newRow("1GiB") << qint64(1024) * 1024 * 1024;
+    }
+
+    void benchFileSizes(){
+        QFETCH(qint64, size);
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        const QString fpath = tmpDir->path() + "/file";
+        mkFile(fpath, size);
+        const int fd = os::open(fpath.toUtf8().constData(), O_RDONLY);
+        auto closeFd = finally([&fd] { close(fd); });
+
+        XXH64_state_t* state = XXH64_createState();
+        auto freeState = finally([&state] { XXH64_freeState(state); });
+        std::vector<char> buf(size_t(m_hashMeta.chunkSize));
+        HashControl hashCtrl;
+        hashCtrl.setHashCache(nullptr);
+        QCOMPARE(hashCtrl.genPartlyHash(fd, size, m_hashMeta).value(),
+                 legacyDigest(fd, size, m_hashMeta, state, buf.data()));
+
+        QElapsedTimer timer;
+        timer.start();
+        for(int i=0; i < HASHES_PER_FILE; i++){
+            legacyDigest(fd, size, m_hashMeta, state, buf.data());
+        }
+        const qint64 legacyNs = timer.nsecsElapsed();
+
+        timer.start();
+        QBENCHMARK_ONCE {
+            for(int i=0; i < HASHES_PER_FILE; i++){
+                hashCtrl.genPartlyHash(fd, size, m_hashMeta);
+            }
+        }
+        const qint64 currentNs = timer.nsecsElapsed();
+
+        timer.start();
+        for(int i=0; i < HASHES_PER_FILE; i++){
+            hashCtrl.genPartlyHash(fd, size, m_hashMetaXXH3);
+        }
+        const qint64 xxh3Ns = timer.nsecsElapsed();
+        qInfo() << QTest::currentDataTag() << ": read+lseek"
+                << legacyNs / HASHES_PER_FILE << "ns/file, pread"
+                << currentNs / HASHES_PER_FILE << "ns/file, pread+xxh3"
+                << xxh3Ns / HASHES_PER_FILE << "ns/file";
+    }
+
+    /// Open and hash many small files from several threads, each
+    /// with its own HashControl.
+    void benchManySmallFiles(){
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        std::vector<std::string> paths;
+        for(int i=0; i < SMALL_FILE_COUNT; i++){
+            const QString fpath = tmpDir->path() + "/f" + QString::number(i);
+            testhelper::writeStuffToFile(fpath, 1024 + i % 1024);
+            paths.push_back(fpath.toStdString());
+        }
+        const unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+        std::atomic<size_t> nextIdx(0);
+        auto worker = [&] {
+            HashControl hashCtrl;
+            hashCtrl.setHashCache(nullptr);
+            size_t idx;
+            while((idx = nextIdx.fetch_add(1)) < paths.size()){
+                const int fd = os::open(paths[idx], O_RDONLY);
+                hashCtrl.genPartlyHash(fd, os::fstat(fd).st_size, m_hashMeta);
+                close(fd);
+            }
+        };
+        QElapsedTimer timer;
+        timer.start();
+        QBENCHMARK_ONCE {
+            std::vector<std::thread> threads;
+            for(unsigned i=0; i < threadCount; i++){
+                threads.emplace_back(worker);
+            }
+            for(auto& t : threads){
+                t.join();
+            }
+        }
+        const double secs = std::max(timer.nsecsElapsed(), qint64(1)) / 1e9;
+        qInfo() << SMALL_FILE_COUNT << "files with" << threadCount << "threads:"
+                << SMALL_FILE_COUNT / secs << "files/s";
+    }
+};
+
+
+DECLARE_TEST(BenchmarkPartialHash)
+
+#include "benchmark_partial_hash.moc"
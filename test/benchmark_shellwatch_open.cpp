@@ -0,0 +1,88 @@
+
+#include <QTest>
+#include <QDebug>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "autotest.h"
+
+
+/// Measure the per-open overhead of libshournal-shellwatch.so
+/// outside of a command (the state most opens of an
+/// interactive shell happen in, e.g. while sourcing rc-files)
+/// compared to plain libc.
+/// Run with
+///     runTests --benchmark
+class BenchmarkShellwatchOpen : public QObject {
+    Q_OBJECT
+
+    typedef int (*open_func_t)(const char *pathname, int flags, mode_t mode);
+
+    void* m_libHandle {};
+    open_func_t m_preloadOpen {};
+
+    static const int OPENS_PER_ITERATION = 1000;
+
+    static void openCloseLoop(open_func_t openFunc, const char* path){
+        for(int i=0; i < OPENS_PER_ITERATION; i++){
+            int fd = openFunc(path, O_RDONLY, 0);
+            if(fd != -1){
+                close(fd);
+            }
+        }
+    }
+
+    static int libcOpen(const char *pathname, int flags, mode_t mode){
+        return ::open(pathname, flags, mode);
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+#ifdef SHOURNALTEST_LIBSHELLWATCH
+        // RTLD_LOCAL: do not interpose the symbols of this process, we
+        // call the hook explicitly.
+        m_libHandle = dlopen(SHOURNALTEST_LIBSHELLWATCH, RTLD_NOW | RTLD_LOCAL);
+        if(m_libHandle == nullptr){
+            qWarning() << "failed to load" << SHOURNALTEST_LIBSHELLWATCH << dlerror();
+            return;
+        }
+        m_preloadOpen = reinterpret_cast<open_func_t>(dlsym(m_libHandle, "open"));
+#endif
+    }
+
+    void cleanupTestCase(){
+        if(m_libHandle != nullptr){
+            dlclose(m_libHandle);
+        }
+    }
+
+    void benchOpen_data(){
+        QTest::addColumn<bool>("preload");
+        QTest::addColumn<QByteArray>("path");
+
+        QTest::newRow("libc absolute") << false << QByteArray("/dev/null");
+        QTest::newRow("shellwatch absolute") << true << QByteArray("/dev/null");
+        QTest::newRow("libc relative") << false << QByteArray("../../dev/null");
+        QTest::newRow("shellwatch relative") << true << QByteArray("../../dev/null");
+    }
+
+    void benchOpen(){
+        QFETCH(bool, preload);
+        QFETCH(QByteArray, path);
+        if(preload && m_preloadOpen == nullptr){
+            QSKIP("libshournal-shellwatch not available");
+        }
+        open_func_t openFunc = (preload) ? m_preloadOpen : &libcOpen;
+        QBENCHMARK {
+            openCloseLoop(openFunc, path.constData());
+        }
+    }
+};
+
+
+DECLARE_TEST(BenchmarkShellwatchOpen)
+
+#include "benchmark_shellwatch_open.moc"
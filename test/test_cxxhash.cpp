@@ -13,21 +13,28 @@ class CXXHashTest : public QObject {
 
     bool test_hash(int fd, const std::string& str, int chunksize,
                    int seekstep, int maxCountOfReads, int bufsize,
-                   CXXHash& h, std::string expected=""){
+                   CXXHash& h, std::string expected="",
+                   partial_xxhash_algorithm algorithm=PARTIAL_XXHASH_XXH64){
         ftruncate(fd, 0);
         lseek(fd, 0, SEEK_SET);
         os::write(fd, str);
         lseek(fd, 0, SEEK_SET);
 
         h.resizeBuf(bufsize);
-        struct partial_xxhash_result res = h.digestFile(fd, chunksize, seekstep, maxCountOfReads);
+        struct partial_xxhash_result res = h.digestFile(fd, chunksize, seekstep,
+                                                          maxCountOfReads, algorithm);
 
         if(expected.empty()){
             // delete all underscores (jumped over during partial hash)
             expected = str;
             expected.erase(std::remove(expected.begin(), expected.end(), '_'), expected.end());
         }
-        return res.hash == XXH64(expected.c_str(), expected.size(), 0 );
+        const uint64_t expectedHash = (algorithm == PARTIAL_XXHASH_XXH3) ?
+                    XXH3_64bits(expected.c_str(), expected.size()) :
+                    XXH64(expected.c_str(), expected.size(), 0 );
+        // the file offset is not changed
+        return res.hash == expectedHash &&
+                lseek(fd, 0, SEEK_CUR) == 0;
     }
 
 
@@ -44,21 +51,24 @@ private slots:
         CXXHash h;
         const int ignoreMaxReads = std::numeric_limits<int>::max();
 
+       for(auto algo : {PARTIAL_XXHASH_XXH64, PARTIAL_XXHASH_XXH3}){
        // result should be independent from buffer size
        for(int bufSize=1; bufSize < 128; bufSize++){
-           QVERIFY(test_hash(fd, "aa__bb__cc__dd", 2, 4, ignoreMaxReads, bufSize, h));
+           QVERIFY(test_hash(fd, "aa__bb__cc__dd", 2, 4, ignoreMaxReads, bufSize, h, "", algo));
            // change maxCountOfReads
-           QVERIFY(test_hash(fd, "aa__bb__cc__dd", 2, 4, 2, bufSize, h, "aabb"));
+           QVERIFY(test_hash(fd, "aa__bb__cc__dd", 2, 4, 2, bufSize, h, "aabb", algo));
            // effectively digest everything
            QVERIFY(test_hash(fd, "aa__bb__cc__dd", 2, 2, ignoreMaxReads, bufSize, h,
-                             "aa__bb__cc__dd"));
+                             "aa__bb__cc__dd", algo));
            // corner case: seekstep == chunksize + 1
            QVERIFY(test_hash(fd, "aa__bb__cc__dd", 2, 3, ignoreMaxReads, bufSize, h,
-                             "aa_b__c_dd"));
+                             "aa_b__c_dd", algo));
            // uneven character length should also work
-           QVERIFY(test_hash(fd, "aa__bb__cc__d", 2, 4, ignoreMaxReads, bufSize, h));
+           QVERIFY(test_hash(fd, "aa__bb__cc__d", 2, 4, ignoreMaxReads, bufSize, h, "", algo));
            // larger chunks
-           QVERIFY(test_hash(fd, "aaaa__bbbb__cccc__dddd", 4, 6, ignoreMaxReads, bufSize, h));
+           QVERIFY(test_hash(fd, "aaaa__bbbb__cccc__dddd", 4, 6, ignoreMaxReads, bufSize, h,
+                             "", algo));
+       }
        }
     }
 
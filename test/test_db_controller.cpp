@@ -1,6 +1,8 @@
 
 #include <QTest>
 #include <QTemporaryFile>
+#include <QFileInfo>
+#include <QDir>
 #include <cassert>
 #include <fcntl.h>
 
@@ -16,11 +18,15 @@
 #include "database/db_connection.h"
 #include "database/query_columns.h"
 #include "database/db_conversions.h"
+#include "database/file_query_helper.h"
 #include "database/storedfiles.h"
 #include "cleanupresource.h"
 #include "settings.h"
 #include "qfilethrow.h"
 #include "stdiocpp.h"
+#include "hashcontrol.h"
+#include "database/query_result_cache.h"
+#include "database/db_archive.h"
 
 
 
@@ -125,6 +131,45 @@ void db_addFileEventsWrapper(const CommandInfo &cmd, FileEvents &fileEvents){
     db_controller::addFileEvents(cmd, fileEvents);
 }
 
+struct LineageFile {
+    int flags;
+    const char* path;
+    off_t size;
+    uint64_t hash;
+};
+
+/// Add a command at the given day (of Jan 2019, unless another month
+/// is given) which read and wrote the given files.
+qint64 addLineageCmd(int day, const QVector<LineageFile>& files, int month=1){
+    FILE* tmpFile = stdiocpp::tmpfile();
+    auto closeTmpFile = finally([&tmpFile] {
+        fclose(tmpFile);
+    });
+    FileEvents fileEvents;
+    fileEvents.setFile(tmpFile);
+    for(const auto& f : files){
+        struct stat st{};
+        st.st_mtime = Qt::datetimeFromDate(QDate(2019,1,1)).toTime_t();
+        st.st_size = f.size;
+        fileEvents.write(f.flags, f.path, st, HashValue(f.hash));
+    }
+    CommandInfo cmd = generateCmdInfo();
+    cmd.startTime = Qt::datetimeFromDate(QDate(2019, month, day));
+    cmd.endTime = cmd.startTime;
+    cmd.idInDb = db_controller::addCommand(cmd);
+    db_addFileEventsWrapper(cmd, fileEvents);
+    return cmd.idInDb;
+}
+
+QVector<qint64> cmdIdsOf(std::unique_ptr<CommandQueryIterator> it){
+    QVector<qint64> ids;
+    while(it->next()){
+        ids.push_back(it->value().idInDb);
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
 class DbCtrlTest : public QObject {
     Q_OBJECT
 
@@ -467,6 +512,584 @@ private slots:
         QCOMPARE(countStoredFiles(), 0);
     }
 
+    void tLineage(){
+        auto closeDb = finally([] {
+            db_connection::close();
+        });
+        // a -> b -> c, u is unrelated, d reads c but comes after it
+        const qint64 a = addLineageCmd(1, {{O_WRONLY, "/tmp/a", 10, 100}});
+        const qint64 b = addLineageCmd(2, {{O_RDONLY, "/tmp/a", 10, 100},
+                                           {O_WRONLY, "/tmp/b", 20, 200}});
+        addLineageCmd(2, {{O_WRONLY, "/tmp/u", 30, 300}});
+        const qint64 c = addLineageCmd(3, {{O_RDONLY, "/tmp/b", 20, 200},
+                                           {O_RDONLY, "/tmp/u", 30, 999},
+                                           {O_WRONLY, "/tmp/c", 40, 400}});
+        addLineageCmd(4, {{O_RDONLY, "/tmp/c", 40, 400}});
+        // a producer may not start after its consumer
+        addLineageCmd(5, {{O_WRONLY, "/tmp/b2", 20, 200}});
+
+        QueryColumns & queryCols = QueryColumns::instance();
+        SqlQuery wQuery;
+        wQuery.addWithAnd(queryCols.wFile_size, 40);
+        wQuery.addWithAnd(queryCols.wFile_hash,
+                          db_conversions::fromHashValue(HashValue(400)));
+
+        QCOMPARE(cmdIdsOf(db_controller::queryLineage(wQuery, 32)),
+                 QVector<qint64>({a, b, c}));
+        QCOMPARE(cmdIdsOf(db_controller::queryLineage(wQuery, 1)),
+                 QVector<qint64>({b, c}));
+        QCOMPARE(cmdIdsOf(db_controller::queryLineage(wQuery, 0)),
+                 QVector<qint64>({c}));
+        QCOMPARE(cmdIdsOf(db_controller::queryLineage(
+                              wQuery, 32, Qt::datetimeFromDate(QDate(2019,1,2)))),
+                 QVector<qint64>({b, c}));
+
+        SqlQuery filter;
+        filter.addWithAnd(queryCols.cmd_id, a, E_CompareOperator::NE);
+        QCOMPARE(cmdIdsOf(db_controller::queryLineage(wQuery, 32, QDateTime(), filter)),
+                 QVector<qint64>({b, c}));
+    }
+
+    void tWFilesBatch(){
+        auto closeDb = finally([] {
+            db_connection::close();
+        });
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        const QString pathFound = tmpDir->path() + "/found";
+        const QString pathEmpty = tmpDir->path() + "/empty";
+        const QString pathNotFound = tmpDir->path() + "/notfound";
+        testhelper::writeStringToFile(pathFound, "some content");
+        testhelper::writeStringToFile(pathEmpty, "");
+        testhelper::writeStringToFile(pathNotFound, "some other content");
+
+        FILE* tmpFile = stdiocpp::tmpfile();
+        auto closeTmpFile = finally([&tmpFile] {
+            fclose(tmpFile);
+        });
+        FileEvents fileEvents;
+        fileEvents.setFile(tmpFile);
+        CommandInfo cmd = generateCmdInfo();
+        HashControl hashCtrl;
+        for(const auto& p : {pathFound, pathEmpty}){
+            QFileThrow f(p);
+            f.open(QFile::ReadOnly);
+            const auto st = os::fstat(f.handle());
+            fileEvents.write(O_WRONLY, toStrLight(p), st,
+                             hashCtrl.genPartlyHash(f.handle(), st.st_size, cmd.hashMeta));
+        }
+        cmd.idInDb = db_controller::addCommand(cmd);
+        db_addFileEventsWrapper(cmd, fileEvents);
+        // another command with same sizes but different content
+        addLineageCmd(3, {{O_WRONLY, "/tmp/found", off_t(QFileInfo(pathFound).size()), 1}});
+
+        int foundCount;
+        auto q = file_query_helper::buildWFilesBatchQuery(
+                    {pathFound, pathEmpty, pathNotFound, tmpDir->path() + "/nonexistent"},
+                    &foundCount);
+        QCOMPARE(foundCount, 2);
+        QCOMPARE(cmdIdsOf(queryForCmd(q)), QVector<qint64>({cmd.idInDb}));
+
+        q = file_query_helper::buildWFilesBatchQuery({pathNotFound}, &foundCount);
+        QCOMPARE(foundCount, 0);
+        QVERIFY(cmdIdsOf(queryForCmd(q)).isEmpty());
+
+        // Commands stored with hashing disabled have no hash (NULL in
+        // older databases), so they are found by size, like in
+        // buildFileQuerySmart.
+        const QString pathUnhashed = tmpDir->path() + "/unhashed";
+        testhelper::writeStringToFile(pathUnhashed, "unhashed content");
+        FILE* unhashedFile = stdiocpp::tmpfile();
+        auto closeUnhashedFile = finally([&unhashedFile] {
+            fclose(unhashedFile);
+        });
+        FileEvents unhashedEvents;
+        unhashedEvents.setFile(unhashedFile);
+        unhashedEvents.write(O_WRONLY, toStrLight(pathUnhashed),
+                             os::stat(pathUnhashed.toUtf8().constData()), HashValue());
+        CommandInfo unhashedCmd = generateCmdInfo();
+        unhashedCmd.hashMeta = HashMeta();
+        unhashedCmd.idInDb = db_controller::addCommand(unhashedCmd);
+        db_addFileEventsWrapper(unhashedCmd, unhashedEvents);
+        auto query = db_connection::mkQuery();
+        query->prepare("update writtenFile set hash=null where cmdId=?");
+        query->addBindValue(unhashedCmd.idInDb);
+        query->exec();
+        q = file_query_helper::buildWFilesBatchQuery({pathUnhashed, pathNotFound}, &foundCount);
+        QCOMPARE(foundCount, 1);
+        QCOMPARE(cmdIdsOf(queryForCmd(q)), QVector<qint64>({unhashedCmd.idInDb}));
+
+        // The query text is the same for all batches, so it must not be
+        // served from the result cache.
+        QueryResultCache resultCache(tmpDir->path() + "/queryresults", 2);
+        q = file_query_helper::buildWFilesBatchQuery({pathFound}, &foundCount);
+        QVERIFY(! q.cacheable());
+        QCOMPARE(cmdIdsOf(queryForCmd(q, false, &resultCache)), QVector<qint64>({cmd.idInDb}));
+        q = file_query_helper::buildWFilesBatchQuery({pathNotFound}, &foundCount);
+        QVERIFY(cmdIdsOf(queryForCmd(q, false, &resultCache)).isEmpty());
+    }
+
+    void tHashAlgorithms(){
+        auto closeDb = finally([] {
+            db_connection::close();
+        });
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        // Same size and hash parameters, only the algorithm differs, so each
+        // file must only be found for the command which hashed it the same way.
+        const QString path64 = tmpDir->path() + "/xxh64";
+        const QString path3 = tmpDir->path() + "/xxh3";
+        testhelper::writeStringToFile(path64, "content A");
+        testhelper::writeStringToFile(path3, "content B");
+
+        HashControl hashCtrl;
+        auto addCmd = [&hashCtrl](const QString& path, HashMeta::Algorithm algo){
+            FILE* tmpFile = stdiocpp::tmpfile();
+            auto closeTmpFile = finally([&tmpFile] {
+                fclose(tmpFile);
+            });
+            FileEvents fileEvents;
+            fileEvents.setFile(tmpFile);
+            CommandInfo cmd = generateCmdInfo();
+            cmd.hashMeta.algorithm = algo;
+            QFileThrow f(path);
+            f.open(QFile::ReadOnly);
+            const auto st = os::fstat(f.handle());
+            fileEvents.write(O_WRONLY, toStrLight(path), st,
+                             hashCtrl.genPartlyHash(f.handle(), st.st_size, cmd.hashMeta));
+            cmd.idInDb = db_controller::addCommand(cmd);
+            db_addFileEventsWrapper(cmd, fileEvents);
+            return cmd.idInDb;
+        };
+        const qint64 cmd64 = addCmd(path64, HashMeta::XXH64);
+        const qint64 cmd3 = addCmd(path3, HashMeta::XXH3);
+
+        const auto hashMetas = db_controller::queryHashmetas();
+        QCOMPARE(int(hashMetas.size()), 2);
+        QVERIFY(hashMetas[0].idInDb != hashMetas[1].idInDb);
+        QVERIFY(hashMetas[0].algorithm != hashMetas[1].algorithm);
+
+        int foundCount;
+        auto q = file_query_helper::buildWFilesBatchQuery({path64}, &foundCount);
+        QCOMPARE(cmdIdsOf(queryForCmd(q)), QVector<qint64>({cmd64}));
+        q = file_query_helper::buildWFilesBatchQuery({path3}, &foundCount);
+        QCOMPARE(cmdIdsOf(queryForCmd(q)), QVector<qint64>({cmd3}));
+
+        QueryColumns & queryCols = QueryColumns::instance();
+        SqlQuery cmdQuery;
+        cmdQuery.addWithAnd(queryCols.cmd_id, cmd3);
+        auto it = queryForCmd(cmdQuery);
+        QVERIFY(it->next());
+        QVERIFY(it->value().hashMeta.algorithm == HashMeta::XXH3);
+    }
+
+    void tQueryResultCache(){
+        auto closeDb = finally([] {
+            db_connection::close();
+        });
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        QueryResultCache resultCache(tmpDir->path() + "/queryresults", 2);
+
+        const qint64 a = addLineageCmd(1, {{O_WRONLY, "/tmp/a", 10, 1}});
+        const qint64 gen = db_controller::queryGeneration();
+        SqlQuery q;
+        q.addWithAnd(QueryColumns::instance().cmd_id, 0, E_CompareOperator::GT);
+        QCOMPARE(cmdIdsOf(queryForCmd(q, false, &resultCache)), QVector<qint64>({a}));
+
+        // cached results are served until the db changes
+        auto it = queryForCmd(q, false, &resultCache);
+        QVERIFY(it->next());
+        QCOMPARE(it->value().fileWriteInfos.size(), 1);
+        QVERIFY(! it->next());
+        QCOMPARE(db_controller::queryGeneration(), gen);
+
+        // Modify the db behind db_controller's back, like older shournal
+        // versions do: the triggers increment the generation nevertheless.
+        auto query = db_connection::mkQuery();
+        query->exec("update cmd set txt='changed'");
+        QVERIFY(db_controller::queryGeneration() > gen);
+        it = queryForCmd(q, false, &resultCache);
+        QVERIFY(it->next());
+        QCOMPARE(it->value().text, QString("changed"));
+        const qint64 genChanged = db_controller::queryGeneration();
+        query->exec("delete from writtenFile");
+        QVERIFY(db_controller::queryGeneration() > genChanged);
+        it = queryForCmd(q, false, &resultCache);
+        QVERIFY(it->next());
+        QVERIFY(it->value().fileWriteInfos.isEmpty());
+
+        // adding or deleting commands invalidates the cache
+        const qint64 b = addLineageCmd(2, {{O_RDONLY, "/tmp/a", 10, 1}});
+        QCOMPARE(cmdIdsOf(queryForCmd(q, false, &resultCache)), QVector<qint64>({a, b}));
+        QCOMPARE(deleteCommandInDb(a), 1);
+        QCOMPARE(cmdIdsOf(queryForCmd(q, false, &resultCache)), QVector<qint64>({b}));
+        QCOMPARE(cmdIdsOf(queryForCmd(q, true, &resultCache)), QVector<qint64>({b}));
+
+        // at most maxEntries results are kept
+        q.addWithAnd(QueryColumns::instance().cmd_id, 1000, E_CompareOperator::LT);
+        QCOMPARE(cmdIdsOf(queryForCmd(q, false, &resultCache)), QVector<qint64>({b}));
+        QCOMPARE(QDir(tmpDir->path() + "/queryresults").entryList(QDir::Files).size(), 2);
+    }
+
+    /// File events of a running command are stored in several batches,
+    /// while its event file is still growing.
+    void tGrowingFileEvents(){
+        auto closeDb = finally([] {
+            db_connection::close();
+        });
+        FILE* srcFile = stdiocpp::tmpfile();
+        FILE* growingFile = stdiocpp::tmpfile();
+        auto closeTmpFiles = finally([&srcFile, &growingFile] {
+            fclose(srcFile);
+            fclose(growingFile);
+        });
+        FileEvents srcEvents;
+        srcEvents.setFile(srcFile);
+        // the offsets below are those of version 1
+        srcEvents.setWriteVersion(1);
+        struct stat st{};
+        st.st_size = 10;
+        srcEvents.write(O_WRONLY, "/tmp/a", st, HashValue(1));
+        stdiocpp::fflush(srcFile);
+        const long firstEventEnd = stdiocpp::ftell(srcFile);
+        // same directory -> only the filename is written
+        srcEvents.write(O_WRONLY, "/tmp/b", st, HashValue(2));
+        stdiocpp::fflush(srcFile);
+        const long srcSize = stdiocpp::ftell(srcFile);
+        QByteArray content(int(srcSize), '\0');
+        stdiocpp::fseek(srcFile, 0, SEEK_SET);
+        QCOMPARE(stdiocpp::fread_unlocked(content.data(), size_t(srcSize), 1, srcFile),
+                 size_t(1));
+
+        const int appendFd = os::open("/proc/self/fd/" +
+                                      QByteArray::number(fileno(growingFile)), O_WRONLY);
+        auto closeAppendFd = finally([&appendFd] { close(appendFd); });
+        auto append = [&appendFd, &content](long offset, size_t len){
+            QCOMPARE(write(appendFd, content.constData() + offset, len), ssize_t(len));
+        };
+        FileEvents fileEvents;
+        fileEvents.setFile(growingFile);
+        fileEvents.setGrowingFile(true);
+        CommandInfo cmd = generateCmdInfo();
+        cmd.idInDb = db_controller::addCommand(cmd);
+        SqlQuery q;
+        q.addWithAnd(QueryColumns::instance().cmd_id, cmd.idInDb, E_CompareOperator::EQ);
+        auto countWFiles = [&q]{
+            auto it = queryForCmd(q);
+            return (it->next()) ? it->value().fileWriteInfos.size() : -1;
+        };
+
+        // first event and the header of the second one
+        append(0, size_t(firstEventEnd) + sizeof(shournalk_close_event));
+        db_controller::addFileEvents(cmd, fileEvents);
+        QCOMPARE(countWFiles(), 1);
+        QCOMPARE(stdiocpp::ftell(growingFile), firstEventEnd);
+
+        // the second event without the nul of its filename
+        append(firstEventEnd + long(sizeof(shournalk_close_event)),
+               size_t(srcSize - firstEventEnd) - sizeof(shournalk_close_event) - 1);
+        db_controller::addFileEvents(cmd, fileEvents);
+        QCOMPARE(countWFiles(), 1);
+
+        append(srcSize - 1, 1);
+        db_controller::addFileEvents(cmd, fileEvents);
+        QCOMPARE(countWFiles(), 2);
+        QCOMPARE(stdiocpp::ftell(growingFile), srcSize);
+    }
+
+    /// Events in format version 2 are read back unchanged, also
+    /// while the file is still growing.
+    void tFileEventsV2(){
+        FILE* srcFile = stdiocpp::tmpfile();
+        FILE* growingFile = stdiocpp::tmpfile();
+        FILE* contentFile = stdiocpp::tmpfile();
+        auto closeTmpFiles = finally([&srcFile, &growingFile, &contentFile] {
+            fclose(srcFile);
+            fclose(growingFile);
+            fclose(contentFile);
+        });
+        const QByteArray content("#!/bin/sh\necho hi\n");
+        stdiocpp::fwrite_unlocked(content.constData(), size_t(content.size()), 1, contentFile);
+        stdiocpp::fflush(contentFile);
+
+        struct Ev {
+            int flags;
+            QByteArray path;
+            time_t mtime;
+            HashValue hash;
+            bool storeContent;
+        };
+        const QVector<Ev> evs {
+            {O_WRONLY, "/tmp/a", 1000, HashValue(1), false},
+            {O_WRONLY, "/tmp/b", 1005, HashValue(), false},
+            {O_RDONLY, "/tmp/script.sh", 900, HashValue(3), true},
+            {O_RDWR, "/rootfile", 2000, HashValue(4), false},
+            {O_RDONLY, "/home/user/dir/c", 0, HashValue(5), false},
+            {O_WRONLY, "/tmp/d", 1000, HashValue(6), false},
+        };
+        FileEvents srcEvents;
+        srcEvents.setFile(srcFile);
+        QCOMPARE(srcEvents.writeVersion(), 2);
+        for(const auto& e : evs){
+            struct stat st{};
+            st.st_mtime = e.mtime;
+            st.st_mode = S_IFREG | 0644;
+            st.st_size = (e.storeContent) ? content.size() : 10;
+            os::lseek(fileno(contentFile), 0, SEEK_SET);
+            srcEvents.write(e.flags, e.path.constData(), st, e.hash,
+                            (e.storeContent) ? fileno(contentFile) : -1);
+        }
+        stdiocpp::fflush(srcFile);
+        const long srcSize = stdiocpp::ftell(srcFile);
+        QByteArray src(int(srcSize), '\0');
+        stdiocpp::fseek(srcFile, 0, SEEK_SET);
+        QCOMPARE(stdiocpp::fread_unlocked(src.data(), size_t(srcSize), 1, srcFile),
+                 size_t(1));
+        QVERIFY(src.startsWith(SHOURNALK_EV2_MAGIC));
+
+        auto compareEvent = [&evs, &content](FileEvent* e, int idx){
+            const Ev& expected = evs[idx];
+            QCOMPARE(e->flags(), expected.flags);
+            QCOMPARE(QByteArray(e->path()), expected.path);
+            QCOMPARE(e->mtime(), uint64_t(expected.mtime));
+            QCOMPARE(e->mode(), uint64_t(S_IFREG | 0644));
+            QCOMPARE(e->hash(), expected.hash);
+            if(! expected.storeContent){
+                QCOMPARE(e->fileContentSize(), off_t(0));
+                return;
+            }
+            QCOMPARE(e->fileContentSize(), off_t(content.size()));
+            const long pos = stdiocpp::ftell(e->file());
+            QByteArray stored(content.size(), '\0');
+            stdiocpp::fseek(e->file(), e->fileContentStart(), SEEK_SET);
+            QCOMPARE(stdiocpp::fread_unlocked(stored.data(), size_t(stored.size()),
+                                              1, e->file()), size_t(1));
+            stdiocpp::fseek(e->file(), pos, SEEK_SET);
+            QCOMPARE(stored, content);
+        };
+
+        stdiocpp::fseek(srcFile, 0, SEEK_SET);
+        FileEvents readEvents;
+        readEvents.setFile(srcFile);
+        FileEvent* e;
+        int count = 0;
+        while((e = readEvents.read()) != nullptr){
+            QVERIFY(count < evs.size());
+            compareEvent(e, count);
+            count++;
+        }
+        QCOMPARE(count, evs.size());
+
+        // append byte by byte: no event must be read before it is complete
+        const int appendFd = os::open("/proc/self/fd/" +
+                                      QByteArray::number(fileno(growingFile)), O_WRONLY);
+        auto closeAppendFd = finally([&appendFd] { close(appendFd); });
+        FileEvents growingEvents;
+        growingEvents.setFile(growingFile);
+        growingEvents.setGrowingFile(true);
+        count = 0;
+        for(int i=0; i < src.size(); i++){
+            QCOMPARE(write(appendFd, src.constData() + i, 1), ssize_t(1));
+            while((e = growingEvents.read()) != nullptr){
+                QVERIFY(count < evs.size());
+                compareEvent(e, count);
+                count++;
+            }
+        }
+        QCOMPARE(count, evs.size());
+        QCOMPARE(stdiocpp::ftell(growingFile), srcSize);
+    }
+
+    /// Complete event files are read from a mapping, growing ones via
+    /// stdio, both must yield the same events.
+    void tMappedFileEvents_data(){
+        QTest::addColumn<int>("version");
+        QTest::newRow("v1") << 1;
+        QTest::newRow("v2") << 2;
+    }
+
+    void tMappedFileEvents(){
+        QFETCH(int, version);
+        FILE* file = stdiocpp::tmpfile();
+        auto closeFile = finally([&file] { fclose(file); });
+        FileEvents writeEvents;
+        writeEvents.setFile(file);
+        writeEvents.setWriteVersion(version);
+        const QVector<QPair<int, QByteArray>> evs {
+            {O_WRONLY, "/tmp/a"}, {O_RDONLY, "/usr/include/b.h"}, {O_WRONLY, "/tmp/c"},
+            {O_RDONLY, "/d"}, {O_RDONLY, "/usr/include/e.h"}, {O_WRONLY, "/home/f"},
+        };
+        for(const auto& e : evs){
+            struct stat st{};
+            st.st_size = 10;
+            writeEvents.write(e.first, e.second.constData(), st, HashValue(1));
+        }
+
+        struct ReadEvent {
+            QByteArray path;
+            QByteArray dir;
+            QByteArray filename;
+            uint dirId;
+        };
+        auto readAll = [&file](bool growing){
+            stdiocpp::fseek(file, 0, SEEK_SET);
+            FileEvents readEvents;
+            readEvents.setFile(file);
+            readEvents.setGrowingFile(growing);
+            QVector<ReadEvent> res;
+            FileEvent* e;
+            while((e = readEvents.read()) != nullptr){
+                // deep copies, the views are only valid until the next read
+                res.push_back({QByteArray(e->path()),
+                               QByteArray(e->dir().constData(), e->dir().size()),
+                               QByteArray(e->filename().constData(), e->filename().size()),
+                               e->dirId()});
+            }
+            return res;
+        };
+        const auto mapped = readAll(false);
+        const auto viaStdio = readAll(true);
+        QCOMPARE(mapped.size(), evs.size());
+        QCOMPARE(viaStdio.size(), evs.size());
+        for(int i=0; i < evs.size(); i++){
+            QCOMPARE(mapped[i].path, evs[i].second);
+            QCOMPARE(viaStdio[i].path, evs[i].second);
+            const auto dirFname = splitAbsPath(evs[i].second);
+            QCOMPARE(mapped[i].dir, dirFname.first);
+            QCOMPARE(mapped[i].filename, dirFname.second);
+            QCOMPARE(viaStdio[i].dir, dirFname.first);
+            QCOMPARE(viaStdio[i].filename, dirFname.second);
+            QCOMPARE(mapped[i].dirId, viaStdio[i].dirId);
+            for(int j=0; j < i; j++){
+                if(mapped[j].dirId == mapped[i].dirId){
+                    QCOMPARE(mapped[j].dir, mapped[i].dir);
+                }
+            }
+        }
+        // the file position is at the end after mapped reading as well
+        stdiocpp::fseek(file, 0, SEEK_SET);
+        FileEvents readEvents;
+        readEvents.setFile(file);
+        while(readEvents.read() != nullptr){}
+        QCOMPARE(stdiocpp::ftell(file), os::fstat(fileno(file)).st_size);
+    }
+
+    void tSpillFileEvents(){
+        FileEvents fileEvents;
+        FILE* memFile = stdiocpp::memfile("test-file-events");
+        fileEvents.setFile(memFile);
+        auto closeFile = finally([&fileEvents] {
+            fclose(fileEvents.file());
+        });
+        struct stat st{};
+        st.st_size = 10;
+        fileEvents.write(O_WRONLY, "/tmp/a", st, HashValue(1));
+        const off_t firstEventEnd = stdiocpp::ftell(memFile);
+        fileEvents.setMaxMemSize(firstEventEnd + 1);
+
+        // same directory -> only the filename is written
+        fileEvents.write(O_WRONLY, "/tmp/b", st, HashValue(2));
+        QVERIFY(fileEvents.file() != memFile);
+        QCOMPARE(fileEvents.maxMemSize(), off_t(0));
+        fileEvents.write(O_WRONLY, "/tmp/c", st, HashValue(3));
+
+        stdiocpp::fseek(fileEvents.file(), 0, SEEK_SET);
+        QStringList paths;
+        FileEvent* e;
+        while((e = fileEvents.read()) != nullptr){
+            paths.push_back(e->path());
+        }
+        QCOMPARE(paths, QStringList({"/tmp/a", "/tmp/b", "/tmp/c"}));
+    }
+
+    void tArchive(){
+        auto closeDb = finally([] {
+            db_connection::close();
+        });
+        // a (Jan) -> b (Feb) -> c (Mar)
+        const qint64 a = addLineageCmd(1, {{O_WRONLY, "/tmp/a", 10, 100}}, 1);
+        const qint64 b = addLineageCmd(1, {{O_RDONLY, "/tmp/a", 10, 100},
+                                           {O_WRONLY, "/tmp/b", 20, 200}}, 2);
+        const qint64 c = addLineageCmd(1, {{O_RDONLY, "/tmp/b", 20, 200},
+                                           {O_WRONLY, "/tmp/c", 30, 300}}, 3);
+        QCOMPARE(db_archive::archiveMonthsBefore(QDate(2019, 3, 1)), 2);
+        QCOMPARE(db_archive::archiveMonthsBefore(QDate(2019, 3, 1)), 0);
+        QCOMPARE(db_archive::queryArchivedMonths(), QStringList({"2019-01", "2019-02"}));
+        QCOMPARE(db_archive::queryArchivedMonths(
+                     Qt::datetimeFromDate(QDate(2019, 2, 5))), QStringList({"2019-02"}));
+
+        // only the database itself is queried without archive
+        auto query = db_connection::mkQuery();
+        query->exec("select id from cmd");
+        query->next(true);
+        QCOMPARE(qVariantTo_throw<qint64>(query->value(0)), c);
+        QVERIFY(! query->next());
+
+        QueryColumns & queryCols = QueryColumns::instance();
+        SqlQuery q;
+        q.addWithAnd(queryCols.wFile_size, 0, E_CompareOperator::GT);
+        QCOMPARE(cmdIdsOf(queryForCmd(q)), QVector<qint64>({a, b, c}));
+        auto it = queryForCmd(q);
+        QVERIFY(it->next());
+        QCOMPARE(it->value().fileWriteInfos.size(), 1);
+        QCOMPARE(it->value().fileWriteInfos.first().path, QString("/tmp"));
+        it.reset();
+
+        q.addWithAnd(queryCols.cmd_starttime, Qt::datetimeFromDate(QDate(2019, 2, 1)),
+                     E_CompareOperator::GE);
+        QCOMPARE(cmdIdsOf(queryForCmd(q)), QVector<qint64>({b, c}));
+
+        SqlQuery wQuery;
+        wQuery.addWithAnd(queryCols.wFile_size, 30);
+        QCOMPARE(cmdIdsOf(db_controller::queryLineage(wQuery, 32)),
+                 QVector<qint64>({a, b, c}));
+
+        // The newest commands (e.g. --history) only require the newest
+        // archived months, if any.
+        auto countArchiveViews = [&query]{
+            query->exec("select count(*) from temp.sqlite_master where type='view'");
+            query->next(true);
+            return qVariantTo_throw<int>(query->value(0));
+        };
+        SqlQuery histQuery;
+        histQuery.addWithAnd(queryCols.cmd_id, 0, E_CompareOperator::GT);
+        histQuery.setAscending(false);
+        histQuery.setLimit(1);
+        it = queryForCmd(histQuery);
+        QCOMPARE(countArchiveViews(), 0);
+        QVERIFY(it->next());
+        QCOMPARE(it->value().idInDb, c);
+        QVERIFY(! it->next());
+        it.reset();
+        histQuery.setLimit(2);
+        it = queryForCmd(histQuery);
+        QCOMPARE(countArchiveViews(), 3); // only the newest month
+        it.reset();
+        QCOMPARE(cmdIdsOf(queryForCmd(histQuery)), QVector<qint64>({b, c}));
+        histQuery.setLimit(10);
+        QCOMPARE(cmdIdsOf(queryForCmd(histQuery)), QVector<qint64>({a, b, c}));
+
+        // Cached results keep the archive attached, so the commands can
+        // be further queried by the caller.
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        QueryResultCache resultCache(tmpDir->path() + "/queryresults", 2);
+        QCOMPARE(cmdIdsOf(queryForCmd(q, false, &resultCache)), QVector<qint64>({b, c}));
+        it = queryForCmd(q, false, &resultCache);
+        QCOMPARE(countArchiveViews(), 3);
+        query->exec("select count(*) from cmd");
+        query->next(true);
+        QCOMPARE(qVariantTo_throw<int>(query->value(0)), 2);
+        it.reset();
+        QCOMPARE(countArchiveViews(), 0);
+
+        // Archived rows are neither deleted along with other commands,
+        // nor are their ids reused.
+        QCOMPARE(deleteCommandInDb(c), 1);
+        const qint64 d = addLineageCmd(1, {{O_RDONLY, "/tmp/a", 10, 100}}, 4);
+        QVERIFY(d > b);
+        SqlQuery rQuery;
+        rQuery.addWithAnd(queryCols.rFile_size, 10);
+        QCOMPARE(cmdIdsOf(queryForCmd(rQuery)), QVector<qint64>({b, d}));
+    }
+
     void tSchemeUpdates(){
         const QString & dbDir = db_connection::getDatabaseDir();
         os::rmdir(dbDir.toUtf8());
@@ -497,6 +1120,8 @@ private slots:
         auto cmd = queryForCmd(q);
         QCOMPARE(cmd->computeSize(), 1);
         QVERIFY(cmd->next());
+        // hashmetas from before v3.6 were hashed with XXH64
+        QVERIFY(cmd->value().hashMeta == HashMeta(4096, 20, HashMeta::XXH64));
         QCOMPARE(cmd->value().fileWriteInfos.size(),2);
         auto fw = __fInfoById(cmd->value().fileWriteInfos, 1);
         QVERIFY(fw);
@@ -0,0 +1,91 @@
+
+#include <QTest>
+
+#include "autotest.h"
+#include "helper_for_test.h"
+#include "util.h"
+#include "os.h"
+#include "hashcontrol.h"
+#include "qfilethrow.h"
+#include "database/commandinfo.h"
+#include "database/file_status_cache.h"
+
+
+class FileStatusCacheTest : public QObject {
+    Q_OBJECT
+
+    static FileWriteInfo mkWriteInfo(const QString& fpath, const HashMeta& hashMeta){
+        QFileThrow f(fpath);
+        f.open(QFile::ReadOnly);
+        const auto st = os::fstat(f.handle());
+        FileWriteInfo info;
+        auto pathFname = splitAbsPath(fpath);
+        info.path = pathFname.first;
+        info.name = pathFname.second;
+        info.size = st.st_size;
+        info.mtime = QDateTime::fromTime_t(static_cast<uint>(st.st_mtime));
+        info.hash = HashControl().genPartlyHash(f.handle(), st.st_size, hashMeta);
+        return info;
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+    }
+
+    void tStatus() {
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        const HashMeta hashMeta(256, 5);
+        const QString fpath = tmpDir->path() + "/file";
+        testhelper::writeStringToFile(fpath, "some content");
+        const auto upToDate = mkWriteInfo(fpath, hashMeta);
+
+        auto sizeDiffers = upToDate;
+        sizeDiffers.size += 1;
+
+        auto hashDiffers = upToDate;
+        hashDiffers.hash = HashValue(upToDate.hash.value() + 1);
+
+        auto notExist = upToDate;
+        notExist.name = "does_not_exist";
+
+        FileStatusCache cache(2);
+        // hashDiffers is prefetched first, so the same file is hashed for it.
+        for(const auto* f : {&hashDiffers, &sizeDiffers, &upToDate, &notExist}){
+            cache.prefetch(*f, hashMeta);
+        }
+        QCOMPARE(cache.status(upToDate, hashMeta), QString("U"));
+        QCOMPARE(cache.status(sizeDiffers, hashMeta), QString("M"));
+        QCOMPARE(cache.status(hashDiffers, hashMeta), QString("M"));
+        QCOMPARE(cache.status(notExist, hashMeta), QString("N"));
+
+        // results equal the uncached ones
+        CommandInfo cmd;
+        cmd.hashMeta = hashMeta;
+        for(const auto* f : {&hashDiffers, &sizeDiffers, &upToDate, &notExist}){
+            QCOMPARE(cache.status(*f, hashMeta), f->currentStatus(cmd));
+        }
+    }
+
+    void tLateHash() {
+        // The first file info for a path has a different size, so hashing
+        // is performed later, on status().
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        const HashMeta hashMeta(256, 5);
+        const QString fpath = tmpDir->path() + "/file";
+        testhelper::writeStringToFile(fpath, "some content");
+        const auto upToDate = mkWriteInfo(fpath, hashMeta);
+        auto sizeDiffers = upToDate;
+        sizeDiffers.size += 1;
+
+        FileStatusCache cache(1);
+        cache.prefetch(sizeDiffers, hashMeta);
+        QCOMPARE(cache.status(sizeDiffers, hashMeta), QString("M"));
+        QCOMPARE(cache.status(upToDate, hashMeta), QString("U"));
+    }
+};
+
+
+DECLARE_TEST(FileStatusCacheTest)
+
+#include "test_file_status_cache.moc"
@@ -5,6 +5,8 @@
 
 #include <QTest>
 #include <QTemporaryFile>
+#include <QTemporaryDir>
+#include <QDir>
 
 
 
@@ -106,6 +108,70 @@ private slots:
 
     }
 
+    void tWriteDirVerdicts(){
+        // The per-directory verdicts must not change what gets recorded.
+        QTemporaryDir tmpDir;
+        QVERIFY(tmpDir.isValid());
+        const QString base = tmpDir.path();
+        QDir d(base);
+        QVERIFY(d.mkpath("incl/sub"));
+        QVERIFY(d.mkpath("incl/excl/reincl"));
+        QVERIFY(d.mkpath("incl/.hidden"));
+        QVERIFY(d.mkpath("incl/.hidden2"));
+        QVERIFY(d.mkpath("notincl/incl"));
+
+        auto & wCfg = Settings::instance().m_wSettings;
+        const auto oldIncl = wCfg.includePaths;
+        const auto oldExcl = wCfg.excludePaths;
+        const auto oldInclHidden = wCfg.includePathsHidden;
+        auto restoreCfg = finally([&] {
+            wCfg.includePaths = oldIncl;
+            wCfg.excludePaths = oldExcl;
+            wCfg.includePathsHidden = oldInclHidden;
+        });
+        wCfg.includePaths = std::make_shared<PathTree>();
+        wCfg.excludePaths = std::make_shared<PathTree>();
+        wCfg.includePathsHidden = std::make_shared<PathTree>();
+        wCfg.excludeHidden = true;
+        wCfg.includePaths->insert(toStrLight(base + "/incl"));
+        wCfg.includePaths->insert(toStrLight(base + "/incl/excl/reincl"));
+        wCfg.includePaths->insert(toStrLight(base + "/notincl/incl"));
+        wCfg.excludePaths->insert(toStrLight(base + "/incl/excl"));
+        wCfg.excludePaths->insert(toStrLight(base + "/incl/sub/excl_file"));
+        wCfg.includePathsHidden->insert(toStrLight(base + "/incl/.hidden2"));
+
+        const QList<QPair<QString, bool> > files {
+            {"incl/a", true},
+            {"incl/sub/b", true},
+            {"incl/sub/.b", false},
+            {"incl/sub/excl_file", false},
+            {"incl/sub/c", true},
+            {"incl/excl/d", false},
+            // excludes are applied first, so nested includes are ignored
+            {"incl/excl/reincl/e", false},
+            {"incl/.hidden/f", false},
+            {"incl/.hidden2/g", true},
+            {"incl/.hidden2/.g", true},
+            {"notincl/h", false},
+            {"notincl/incl/i", true},
+            {"notincl/incl/.j", false},
+        };
+        FileEventHandler fEventHandler;
+        // twice, so the second round is served from the cache
+        for(int round=0; round < 2; round++){
+            for(const auto& f : files){
+                const QString path = base + '/' + f.first;
+                testhelper::writeStringToFile(path, "foo");
+                int fd = os::open(path.toUtf8(), O_WRONLY);
+                auto closeFd = finally([&fd] { close(fd); });
+                const auto countBefore = fEventHandler.fileEvents().wEventCount();
+                fEventHandler.handleCloseWrite(fd);
+                QCOMPARE(fEventHandler.fileEvents().wEventCount() > countBefore,
+                         f.second);
+            }
+        }
+    }
+
     void tRead(){
         // TODO: implement a test...
 
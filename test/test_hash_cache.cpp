@@ -0,0 +1,144 @@
+
+#include <QTest>
+#include <cstring>
+
+#include "autotest.h"
+#include "helper_for_test.h"
+#include "hash_cache.h"
+#include "hashcontrol.h"
+#include "os.h"
+#include "qfilethrow.h"
+
+
+class HashCacheTest : public QObject {
+    Q_OBJECT
+
+    /// Files modified within the last seconds are not cached, so
+    /// fake old timestamps.
+    static struct stat mkOldStat(ino_t ino){
+        struct stat st;
+        memset(&st, 0, sizeof (st));
+        st.st_dev = 1;
+        st.st_ino = ino;
+        st.st_size = 1000;
+        st.st_mtim.tv_sec = 1000000;
+        st.st_ctim.tv_sec = 1000000;
+        return st;
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+    }
+
+    void tLookupInsert() {
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        const HashMeta hashMeta(256, 5);
+        HashCache cache;
+        cache.open((tmpDir->path() + "/hashcache").toStdString());
+
+        auto st = mkOldStat(42);
+        QVERIFY(cache.lookup(st, hashMeta).isNull());
+        cache.insert(st, hashMeta, HashValue(123));
+        QCOMPARE(cache.lookup(st, hashMeta), HashValue(123));
+
+        // any change of the key is a miss
+        QVERIFY(cache.lookup(st, HashMeta(256, 6)).isNull());
+        auto modified = st;
+        modified.st_ctim.tv_nsec += 1;
+        QVERIFY(cache.lookup(modified, hashMeta).isNull());
+        modified = st;
+        modified.st_size += 1;
+        QVERIFY(cache.lookup(modified, hashMeta).isNull());
+
+        // a new version of the same file replaces the old one
+        modified.st_mtim.tv_sec += 1;
+        cache.insert(modified, hashMeta, HashValue(456));
+        QCOMPARE(cache.lookup(modified, hashMeta), HashValue(456));
+        QVERIFY(cache.lookup(st, hashMeta).isNull());
+
+        // recently modified files are not cached
+        auto recent = mkOldStat(43);
+        clock_gettime(CLOCK_REALTIME, &recent.st_ctim);
+        QVERIFY(HashCache::isRacy(recent));
+        cache.insert(recent, hashMeta, HashValue(789));
+        QVERIFY(cache.lookup(recent, hashMeta).isNull());
+    }
+
+    void tEviction() {
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        const HashMeta hashMeta(256, 5);
+        HashCache cache;
+        // a single bucket
+        cache.open((tmpDir->path() + "/hashcache").toStdString(), 1);
+
+        for(ino_t ino=0; ino < HashCache::CACHE_WAYS; ino++){
+            cache.insert(mkOldStat(ino), hashMeta, HashValue(ino + 100));
+        }
+        // make the first one recently used, so the second one is evicted
+        QCOMPARE(cache.lookup(mkOldStat(0), hashMeta), HashValue(100));
+        cache.insert(mkOldStat(HashCache::CACHE_WAYS), hashMeta, HashValue(1));
+
+        QCOMPARE(cache.lookup(mkOldStat(0), hashMeta), HashValue(100));
+        QVERIFY(cache.lookup(mkOldStat(1), hashMeta).isNull());
+        QCOMPARE(cache.lookup(mkOldStat(2), hashMeta), HashValue(102));
+        QCOMPARE(cache.lookup(mkOldStat(HashCache::CACHE_WAYS), hashMeta), HashValue(1));
+    }
+
+    void tPersistence() {
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        const std::string path = (tmpDir->path() + "/hashcache").toStdString();
+        const HashMeta hashMeta(256, 5);
+        const auto st = mkOldStat(42);
+        {
+            HashCache cache;
+            cache.open(path, 16);
+            cache.insert(st, hashMeta, HashValue(123));
+        }
+        {
+            // the bucket count of the existing file is used
+            HashCache cache;
+            cache.open(path);
+            QCOMPARE(cache.lookup(st, hashMeta), HashValue(123));
+        }
+        // an invalid file is replaced
+        testhelper::writeStringToFile(QString::fromStdString(path), "garbage");
+        HashCache cache;
+        cache.open(path);
+        QVERIFY(cache.lookup(st, hashMeta).isNull());
+    }
+
+    void tHashControl() {
+        auto tmpDir = testhelper::mkAutoDelTmpDir();
+        const HashMeta hashMeta(16, 3);
+        HashCache cache;
+        cache.open((tmpDir->path() + "/hashcache").toStdString());
+        HashControl hashCtrl;
+        hashCtrl.setHashCache(&cache);
+
+        const QString fpath = tmpDir->path() + "/file";
+        testhelper::writeStringToFile(fpath, "some content of the file");
+        QFileThrow f(fpath);
+        f.open(QFile::ReadOnly);
+        auto st = os::fstat(f.handle());
+        st.st_mtim.tv_sec -= 100;
+        st.st_ctim.tv_sec -= 100;
+        const auto hash = hashCtrl.genPartlyHash(f.handle(), st, hashMeta);
+        QVERIFY(! hash.isNull());
+        QCOMPARE(hash, HashControl().genPartlyHash(f.handle(), st.st_size, hashMeta));
+        QCOMPARE(cache.lookup(st, hashMeta), hash);
+        QCOMPARE(os::ltell(f.handle()), off_t(0));
+
+        // For an unchanged stat the file is not read again
+        f.close();
+        testhelper::writeStringToFile(fpath, "other content of the file");
+        f.open(QFile::ReadOnly);
+        QCOMPARE(hashCtrl.genPartlyHash(f.handle(), st, hashMeta), hash);
+        QVERIFY(hashCtrl.genPartlyHash(f.handle(), os::fstat(f.handle()), hashMeta) != hash);
+    }
+};
+
+
+DECLARE_TEST(HashCacheTest)
+
+#include "test_hash_cache.moc"
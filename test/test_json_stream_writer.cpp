@@ -0,0 +1,110 @@
+
+#include <QTest>
+#include <QJsonDocument>
+#include <QJsonArray>
+
+#include "autotest.h"
+#include "json_stream_writer.h"
+#include "database/commandinfo.h"
+
+
+class JsonStreamWriterTest : public QObject {
+    Q_OBJECT
+
+    static QByteArray qtJson(const CommandInfo& cmd, bool withMilliseconds,
+                             const CmdJsonWriteCfg& cfg){
+        QJsonObject o;
+        cmd.write(o, withMilliseconds, cfg);
+        return QJsonDocument(o).toJson(QJsonDocument::Compact);
+    }
+
+    static QByteArray streamJson(const CommandInfo& cmd, bool withMilliseconds,
+                                 const CmdJsonWriteCfg& cfg){
+        JsonStreamWriter w;
+        cmd.write(w, withMilliseconds, cfg);
+        return w.buffer();
+    }
+
+    static CommandInfo mkCmd(){
+        CommandInfo cmd;
+        cmd.idInDb = 123456789012;
+        cmd.text = QString("echo \"quoted\" \\ back\tslash\nnewline \x01 ") +
+                   QString::fromUtf8("ümläut € \xF0\x9F\x98\x80") +
+                   QChar(0xD800) + "lone surrogate";
+        cmd.returnVal = -3;
+        cmd.username = "user";
+        cmd.hostname = "host";
+        cmd.hashMeta = HashMeta(4096, 20);
+        cmd.sessionInfo.uuid = QByteArray("0123456789abcdef");
+        cmd.startTime = QDateTime::currentDateTime();
+        cmd.endTime = cmd.startTime.addMSecs(1234);
+        cmd.workingDirectory = "/home/user/dir with space";
+
+        FileWriteInfo w;
+        w.idInDb = 1;
+        w.path = "/tmp";
+        w.name = "written";
+        w.size = 1000000;
+        w.mtime = cmd.startTime;
+        w.hash = HashValue(18446744073709551615ull);
+        cmd.fileWriteInfos.push_back(w);
+        w.idInDb = 2;
+        w.size = 0;
+        w.hash = HashValue();
+        cmd.fileWriteInfos.push_back(w);
+
+        FileReadInfo r;
+        r.idInDb = 3;
+        r.path = "/usr/bin";
+        r.name = "read";
+        r.size = 9007199254740993; // > 2^53
+        r.mtime = QDateTime();
+        r.hash = HashValue(42);
+        r.isStoredToDisk = true;
+        cmd.fileReadInfos.push_back(r);
+        return cmd;
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+    }
+
+    void tIdenticalToQJson() {
+        auto cmd = mkCmd();
+        for(bool withMillis : {false, true}){
+            CmdJsonWriteCfg all(true);
+            QCOMPARE(streamJson(cmd, withMillis, all), qtJson(cmd, withMillis, all));
+
+            CmdJsonWriteCfg some(false);
+            some.idInDb = true;
+            some.sessionInfo = true;
+            some.fileWriteInfos = true;
+            some.maxCountWFiles = 1;
+            QCOMPARE(streamJson(cmd, withMillis, some), qtJson(cmd, withMillis, some));
+        }
+
+        // null/empty values
+        CommandInfo emptyCmd;
+        emptyCmd.text = QString();
+        CmdJsonWriteCfg all(true);
+        QCOMPARE(streamJson(emptyCmd, false, all), qtJson(emptyCmd, false, all));
+    }
+
+    void tNumbers() {
+        for(qint64 val : {qint64(0), qint64(-1), qint64(1000000), qint64(1) << 53,
+                          (qint64(1) << 53) + 1, std::numeric_limits<qint64>::max()}){
+            JsonStreamWriter w;
+            w.beginArray();
+            w.writeInt(val);
+            w.endArray();
+            QCOMPARE(w.buffer(), QJsonDocument(QJsonArray{QJsonValue(val)})
+                     .toJson(QJsonDocument::Compact));
+        }
+    }
+};
+
+
+DECLARE_TEST(JsonStreamWriterTest)
+
+#include "test_json_stream_writer.moc"
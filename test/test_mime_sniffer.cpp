@@ -0,0 +1,93 @@
+
+#include <QTest>
+#include <QTemporaryFile>
+#include <QMimeDatabase>
+
+#include "autotest.h"
+#include "mime_sniffer.h"
+#include "os.h"
+
+using SniffResult = MimeSniffer::SniffResult;
+
+
+class MimeSnifferTest : public QObject {
+    Q_OBJECT
+
+    static QString sniffStr(const QByteArray& data, SniffResult expectedResult){
+        QString mimetype;
+        auto res = MimeSniffer::sniff(data.constData(), size_t(data.size()), &mimetype);
+        if(res != expectedResult){
+            return "unexpected sniff result";
+        }
+        return mimetype;
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+    }
+
+    void testSniffMatchesMimeDb() {
+        // Whenever the sniffer is sure about the mimetype, it must agree
+        // with QMimeDatabase.
+        QMimeDatabase db;
+        const QList<QByteArray> samples {
+            "",
+            "#!/bin/sh\necho foo\n",
+            "#! /bin/sh\necho foo\n",
+            "#!/bin/bash\necho foo\n",
+            "#! /bin/bash -e\necho foo\n",
+            "#!/usr/bin/env bash\necho foo\n",
+            "#!/usr/bin/env sh\necho foo\n",
+            "#!/usr/bin/perl\nprint 'foo';\n",
+            "#!/usr/bin/env perl\nprint 'foo';\n",
+        };
+        for(const auto& s : samples){
+            QString mimetype;
+            auto res = MimeSniffer::sniff(s.constData(), size_t(s.size()), &mimetype);
+            QCOMPARE(int(res), int(SniffResult::DEFINITE));
+            QCOMPARE(mimetype, db.mimeTypeForData(s).name());
+        }
+    }
+
+    void testSniffAmbiguous() {
+        QCOMPARE(sniffStr("#!/usr/bin/python3\nprint(1)\n", SniffResult::UNKNOWN), QString());
+        QCOMPARE(sniffStr("echo foo\n", SniffResult::UNKNOWN), QString());
+        QCOMPARE(sniffStr("#", SniffResult::UNKNOWN), QString());
+        QCOMPARE(sniffStr(QByteArray("\x7f" "ELF\x02\x01\x01", 7), SniffResult::ELF), QString());
+    }
+
+    void testMimeTypeMatches() {
+        QTemporaryFile f;
+        QVERIFY(f.open());
+        f.write("#!/bin/bash\necho foo\n");
+        f.flush();
+        f.seek(0);
+        const int fd = f.handle();
+
+        const MimeSniffer::MimeSet shellscript{"application/x-shellscript"};
+        const MimeSniffer::MimeSet textPlain{"text/plain"};
+        MimeSniffer sniffer;
+        auto st = os::fstat(fd);
+        QVERIFY(sniffer.mimeTypeMatches(fd, st, shellscript));
+        QVERIFY(! sniffer.mimeTypeMatches(fd, st, textPlain));
+        // the file offset must not change
+        QCOMPARE(os::ltell(fd), off_t(0));
+
+        // a changed file is not served from the cache
+        f.resize(0);
+        f.write("just some text, more text\n");
+        f.flush();
+        f.seek(0);
+        st = os::fstat(fd);
+        // (the size differs, in case the mtime-granularity is coarse)
+        QVERIFY(! sniffer.mimeTypeMatches(fd, st, shellscript));
+        QVERIFY(sniffer.mimeTypeMatches(fd, st, textPlain));
+        QCOMPARE(os::ltell(fd), off_t(0));
+    }
+};
+
+
+DECLARE_TEST(MimeSnifferTest)
+
+#include "test_mime_sniffer.moc"
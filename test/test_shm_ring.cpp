@@ -0,0 +1,124 @@
+
+#include <QTest>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/memfd.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "autotest.h"
+#include "shm_ring.h"
+#include "os.h"
+#include "osutil.h"
+
+using fdcommunication::ShmRing;
+using Message = ShmRing::Message;
+using Messages = ShmRing::Messages;
+
+
+class ShmRingTest : public QObject {
+    Q_OBJECT
+
+    static bool doorbellRung(const ShmRing& ring){
+        struct pollfd pfd{};
+        pfd.fd = ring.doorbellFd();
+        pfd.events = POLLIN;
+        return poll(&pfd, 1, 0) == 1;
+    }
+
+private slots:
+    void initTestCase(){
+        logger::setup(__FILE__);
+    }
+
+    void tNormal() {
+        ShmRing producer;
+        producer.create(4096);
+        ShmRing consumer;
+        consumer.attach(os::dup(producer.memFd()), os::dup(producer.doorbellFd()));
+        producer.closeMemFd();
+
+        Messages received;
+        consumer.receiveMessages(&received);
+        QVERIFY(received.isEmpty());
+        QVERIFY(! doorbellRung(consumer));
+
+        Message msg1{1, "echo hi some_text_with_umläüts"};
+        Message msg2{2, ""};
+        Message msg3{3, "abcdefg"};
+        QVERIFY(producer.sendMessages({msg1, msg2}));
+        QVERIFY(producer.sendMessages({msg3}));
+        QVERIFY(doorbellRung(consumer));
+
+        consumer.receiveMessages(&received);
+        QCOMPARE(received.size(), 3);
+        QCOMPARE(received[0], msg1);
+        QCOMPARE(received[1], msg2);
+        QCOMPARE(received[2], msg3);
+        // the doorbell is reset on receive
+        QVERIFY(! doorbellRung(consumer));
+    }
+
+    void tWrapAroundAndFull() {
+        ShmRing producer;
+        producer.create(4096);
+        ShmRing consumer;
+        consumer.attach(os::dup(producer.memFd()), os::dup(producer.doorbellFd()));
+
+        // odd sizes, so the records wrap around at different offsets
+        Messages received;
+        for(int i=0; i < 1000; i++){
+            Message msg{i % 7, QByteArray(i % 333, char('a' + i % 26))};
+            QVERIFY(producer.sendMessages({msg, msg}));
+            consumer.receiveMessages(&received);
+            QCOMPARE(received.size(), 2);
+            QCOMPARE(received[0], msg);
+            QCOMPARE(received[1], msg);
+        }
+
+        // all or nothing
+        const Message big{1, QByteArray(3000, 'x')};
+        QVERIFY(producer.sendMessages({big}));
+        QVERIFY(! producer.sendMessages({big}));
+        QVERIFY(! producer.sendMessages({Message{2, "small"}, big}));
+        consumer.receiveMessages(&received);
+        QCOMPARE(received.size(), 1);
+        QCOMPARE(received[0], big);
+        QVERIFY(producer.sendMessages({big}));
+    }
+
+    void tAttachInvalid() {
+        int fd = osutil::unnamed_tmp();
+        os::write(fd, QByteArray(8192, 'x'));
+        ShmRing consumer;
+        QVERIFY_EXCEPTION_THROWN(consumer.attach(fd, eventfd(0, EFD_CLOEXEC)),
+                                 fdcommunication::ExcFdComm);
+        QVERIFY(! consumer.isActive());
+    }
+
+    void tSealed() {
+        ShmRing producer;
+        producer.create(4096);
+        // the producer can't truncate the ring mapped by the consumer
+        QCOMPARE(ftruncate(producer.memFd(), 0), -1);
+        QCOMPARE(ftruncate(producer.memFd(), 1 << 20), -1);
+
+        // the same content in an unsealed memfd is rejected
+        const auto st = os::fstat(producer.memFd());
+        QByteArray content(int(st.st_size), '\0');
+        QCOMPARE(pread(producer.memFd(), content.data(), size_t(content.size()), 0),
+                 ssize_t(content.size()));
+        const int unsealedFd = int(syscall(SYS_memfd_create, "test-ring", MFD_CLOEXEC));
+        QVERIFY(unsealedFd != -1);
+        os::write(unsealedFd, content);
+        ShmRing consumer;
+        QVERIFY_EXCEPTION_THROWN(consumer.attach(unsealedFd, os::dup(producer.doorbellFd())),
+                                 fdcommunication::ExcFdComm);
+        QVERIFY(! consumer.isActive());
+    }
+};
+
+
+DECLARE_TEST(ShmRingTest)
+
+#include "test_shm_ring.moc"